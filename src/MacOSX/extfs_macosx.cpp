@@ -551,6 +551,22 @@ ssize_t extfs_write(int fd, void *buffer, size_t length)
 }
 
 
+/*
+ *  Read/write "length" bytes at file offset "offset" without changing
+ *  the file position, returns number of bytes transferred (or -1 on error)
+ */
+
+ssize_t extfs_pread(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pread(fd, buffer, length, offset);
+}
+
+ssize_t extfs_pwrite(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pwrite(fd, buffer, length, offset);
+}
+
+
 /*
  *  Remove file/directory (and associated helper files),
  *  returns false on error (and sets errno)
@@ -39,6 +39,7 @@
 #include <string>
 using std::string;
 
+#include "clock.h"
 #include "cpu_emulation.h"
 #include "macos_util_macosx.h"
 #include "main.h"
@@ -218,6 +219,7 @@ int main(int argc, char **argv)
 	ROMBaseHost = NULL;
 	srand(time(NULL));
 	tzset();
+	ClockInit();
 
 	// Print some info
 	printf(GetString(STR_ABOUT_TEXT1), VERSION_MAJOR, VERSION_MINOR);
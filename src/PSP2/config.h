@@ -0,0 +1,50 @@
+/*
+ *  config.h - Configuration for the slirp library on PSP2
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The PSP2 port has no configure script, this replaces the autoconf
+ *  generated config.h included by the slirp sources.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/* Headers */
+#define HAVE_STDINT_H 1
+#define HAVE_STDLIB_H 1
+#define HAVE_STRING_H 1
+#define HAVE_UNISTD_H 1
+#define HAVE_SYS_SELECT_H 1
+#define HAVE_SYS_IOCTL_H 1
+
+/* Functions */
+#define HAVE_INET_ATON 1
+#define HAVE_STRDUP 1
+#define HAVE_STRERROR 1
+
+/* No AF_UNIX sockets, no fork() */
+#define NO_UNIX_SOCKETS 1
+
+/* Type sizes */
+#define SIZEOF_SHORT 2
+#define SIZEOF_INT 4
+#define SIZEOF_VOID_P 4
+
+#endif
@@ -31,6 +31,10 @@
 #include <pspnet_apctl.h>
 */
 #include <psp2/types.h>
+#include <psp2/kernel/threadmgr.h>
+#include <psp2/sysmodule.h>
+#include <psp2/net/net.h>
+#include <psp2/net/netctl.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +48,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <map>
 
 #include "cpu_emulation.h"
 #include "main.h"
@@ -52,7 +57,12 @@
 #include "macos_util.h"
 #include "ether.h"
 #include "ether_defs.h"
+#include "ether_slirp.h"
+#include "ether_capture.h"
 
+#ifndef NO_STD_NAMESPACE
+using std::map;
+#endif
 
 #define DEBUG 0
 #include "debug.h"
@@ -60,13 +70,113 @@
 #define MONITOR 0
 
 
+// Size of memory pool for SceNet
+const int NET_MEMORY_SIZE = 1024 * 1024;
+
+// Maximum time the slirp thread waits for socket activity (usec)
+const int SLIRP_POLL_USEC = 10000;
+
+// Maximum time the UDP reception thread waits for packets or an interrupt acknowledge (usec)
+const int UDP_POLL_USEC = 100000;
+
 // Global variables
-static int read_thread;						// Packet reception thread
-static bool ether_thread_active = true;		// Flag for quitting the reception thread
+static SceUID read_thread = -1;				// Packet reception thread
+static volatile bool ether_thread_active = true;	// Flag for quitting the reception thread
+static SceUID int_ack = -1;					// Interrupt acknowledge semaphore
 
 static int fd = -1;							// UDP socket fd
 static bool udp_tunnel = false;
 
+static void *net_memory = NULL;				// SceNet memory pool, non-NULL if network initialized
+static SceUID slirp_thread = -1;			// slirp worker thread
+static volatile bool slirp_thread_active = false;	// Flag for quitting the slirp thread
+
+// Attached network protocols, maps protocol type to MacOS handler address
+static map<uint16, uint32> net_protocols;
+
+
+/*
+ *  Load network modules, get address of DNS server or local address
+ */
+
+static bool init_net(int info_code, char *addr)
+{
+	if (sceSysmoduleLoadModule(SCE_SYSMODULE_NET) < 0)
+		return false;
+
+	SceNetInitParam param;
+	net_memory = malloc(NET_MEMORY_SIZE);
+	param.memory = net_memory;
+	param.size = NET_MEMORY_SIZE;
+	param.flags = 0;
+	if (net_memory == NULL || sceNetInit(&param) < 0 || sceNetCtlInit() < 0)
+		goto net_error;
+
+	SceNetCtlInfo info;
+	if (sceNetCtlInetGetInfo(info_code, &info) < 0)
+		goto net_error;
+	strncpy(addr, info_code == SCE_NETCTL_INFO_GET_PRIMARY_DNS ? info.primary_dns : info.ip_address, 15);
+	addr[15] = 0;
+	D(bug("%s %s\n", info_code == SCE_NETCTL_INFO_GET_PRIMARY_DNS ? "DNS server" : "Local address", addr));
+	return true;
+
+net_error:
+	sceNetTerm();
+	free(net_memory);
+	net_memory = NULL;
+	sceSysmoduleUnloadModule(SCE_SYSMODULE_NET);
+	return false;
+}
+
+static void exit_net(void)
+{
+	if (net_memory) {
+		sceNetCtlTerm();
+		sceNetTerm();
+		free(net_memory);
+		net_memory = NULL;
+		sceSysmoduleUnloadModule(SCE_SYSMODULE_NET);
+	}
+}
+
+// Network setup for UDP tunnelling, called by EtherInit() before the socket is opened
+bool ether_init_net(char *local_ip)
+{
+	if (!init_net(SCE_NETCTL_INFO_GET_IP_ADDRESS, local_ip)) {
+		WarningAlert(GetString(STR_NO_ACCESS_POINT_ERR));
+		return false;
+	}
+	return true;
+}
+
+void ether_exit_net(void)
+{
+	exit_net();
+}
+
+
+/*
+ *  slirp worker thread
+ */
+
+static int slirp_receive_proc(SceSize args, void *argp)
+{
+	while (slirp_thread_active) {
+		ether_slirp_poll(SLIRP_POLL_USEC);
+
+		// Trigger Ethernet interrupt for received packets. The flag is
+		// cleared before EtherInterrupt() runs, so packets which arrive
+		// meanwhile raise it again.
+		if (ether_slirp_pending() && !(InterruptFlags & INTFLAG_ETHER)) {
+			D(bug(" packet received, triggering Ethernet interrupt\n"));
+			SetInterruptFlag(INTFLAG_ETHER);
+			TriggerInterrupt();
+		}
+	}
+	sceKernelExitDeleteThread(0);
+	return 0;
+}
+
 
 /*
  *  Initialization
@@ -74,8 +184,38 @@ static bool udp_tunnel = false;
 
 bool ether_init(void)
 {
-	// Do nothing as PSP only does udptunnel
-	return false;
+	// Only user mode networking through slirp is supported
+	const char *name = PrefsFindString("ether");
+	if (name == NULL || strcmp(name, "slirp") != 0)
+		return false;
+
+	char dns_addr[16];
+	if (!init_net(SCE_NETCTL_INFO_GET_PRIMARY_DNS, dns_addr)) {
+		WarningAlert(GetString(STR_NO_ACCESS_POINT_ERR));
+		return false;
+	}
+	if (!ether_slirp_init(dns_addr)) {
+		WarningAlert(GetString(STR_SLIRP_NO_DNS_FOUND_WARN));
+		exit_net();
+		return false;
+	}
+	memcpy(ether_addr, ether_slirp_addr, 6);
+	D(bug("Ethernet address %02x %02x %02x %02x %02x %02x\n", ether_addr[0], ether_addr[1], ether_addr[2], ether_addr[3], ether_addr[4], ether_addr[5]));
+
+	// Start slirp thread
+	slirp_thread_active = true;
+	slirp_thread = sceKernelCreateThread("slirp", slirp_receive_proc, 0x10000100, 0x10000, 0, 0, NULL);
+	if (slirp_thread < 0 || sceKernelStartThread(slirp_thread, 0, NULL) < 0) {
+		WarningAlert(GetString(STR_NO_NET_THREAD_ERR));
+		slirp_thread_active = false;
+		if (slirp_thread >= 0)
+			sceKernelDeleteThread(slirp_thread);
+		slirp_thread = -1;
+		ether_slirp_exit();
+		exit_net();
+		return false;
+	}
+	return true;
 }
 
 
@@ -85,7 +225,13 @@ bool ether_init(void)
 
 void ether_exit(void)
 {
-	// Do nothing as PSP only does udptunnel
+	if (slirp_thread >= 0) {
+		slirp_thread_active = false;
+		sceKernelWaitThreadEnd(slirp_thread, NULL, NULL);
+		slirp_thread = -1;
+		ether_slirp_exit();
+	}
+	exit_net();
 }
 
 
@@ -95,7 +241,7 @@ void ether_exit(void)
 
 void ether_reset(void)
 {
-	// Do nothing as PSP only does udptunnel
+	net_protocols.clear();
 }
 
 
@@ -105,7 +251,7 @@ void ether_reset(void)
 
 int16 ether_add_multicast(uint32 pb)
 {
-	// Do nothing as PSP only does udptunnel
+	// slirp passes all packets addressed to the Mac
 	return noErr;
 }
 
@@ -116,7 +262,6 @@ int16 ether_add_multicast(uint32 pb)
 
 int16 ether_del_multicast(uint32 pb)
 {
-	// Do nothing as PSP only does udptunnel
 	return noErr;
 }
 
@@ -127,7 +272,9 @@ int16 ether_del_multicast(uint32 pb)
 
 int16 ether_attach_ph(uint16 type, uint32 handler)
 {
-	// Do nothing as PSP only does udptunnel
+	if (net_protocols.find(type) != net_protocols.end())
+		return lapProtErr;
+	net_protocols[type] = handler;
 	return noErr;
 }
 
@@ -138,7 +285,8 @@ int16 ether_attach_ph(uint16 type, uint32 handler)
 
 int16 ether_detach_ph(uint16 type)
 {
-	// Do nothing as PSP only does udptunnel
+	if (net_protocols.erase(type) == 0)
+		return lapProtErr;
 	return noErr;
 }
 
@@ -149,7 +297,23 @@ int16 ether_detach_ph(uint16 type)
 
 int16 ether_write(uint32 wds)
 {
-	// Do nothing as PSP only does udptunnel
+	// Copy packet to buffer
+	uint8 packet[1516];
+	int len = ether_wds_to_buffer(wds, packet);
+
+#if MONITOR
+	bug("Sending Ethernet packet:\n");
+	for (int i=0; i<len; i++) {
+		bug("%02x ", packet[i]);
+	}
+	bug("\n");
+#endif
+
+	// Hand it to the slirp thread
+	if (!ether_slirp_write(packet, len)) {
+		D(bug("WARNING: Couldn't transmit packet\n"));
+		return excessCollsns;
+	}
 	return noErr;
 }
 
@@ -160,23 +324,25 @@ int16 ether_write(uint32 wds)
 
 static int receive_proc_udp(SceSize args, void *argp)
 {
-	/*while (ether_thread_active)
-	{
+	while (ether_thread_active) {
 		fd_set readfds;
 		FD_ZERO(&readfds);
 		FD_SET(fd, &readfds);
 		struct timeval timeout;
-		timeout.tv_sec = 1;
-		timeout.tv_usec = 0;
-		select(fd+1, &readfds, NULL, NULL, &timeout);
-		if (FD_ISSET(fd, &readfds))
-		{
+		timeout.tv_sec = 0;
+		timeout.tv_usec = UDP_POLL_USEC;
+		if (select(fd+1, &readfds, NULL, NULL, &timeout) > 0 && FD_ISSET(fd, &readfds)) {
 			D(bug(" packet received, triggering Ethernet interrupt\n"));
 			SetInterruptFlag(INTFLAG_ETHER);
 			TriggerInterrupt();
+
+			// Wait until EtherInterrupt() has emptied the socket, otherwise
+			// select() reports the same packets again
+			SceUInt wait_usec = UDP_POLL_USEC;
+			sceKernelWaitSema(int_ack, 1, &wait_usec);
 		}
 	}
-	sceKernelExitDeleteThread(0);*/
+	sceKernelExitDeleteThread(0);
 	return 0;
 }
 
@@ -187,16 +353,27 @@ static int receive_proc_udp(SceSize args, void *argp)
 
 bool ether_start_udp_thread(int socket_fd)
 {
-	/*fd = socket_fd;
+	fd = socket_fd;
 	udp_tunnel = true;
 	ether_thread_active = true;
-	read_thread = sceKernelCreateThread("UDP Receiver", receive_proc_udp, 0x14, 0x1800, PSP_THREAD_ATTR_USER, NULL);
-	if(read_thread < 0)
-        return false;
-	sceKernelStartThread(read_thread, 0, NULL);
-	//read_thread = spawn_thread(receive_proc_udp, "UDP Receiver", B_URGENT_DISPLAY_PRIORITY, NULL);
-	//resume_thread(read_thread);
-	return true;*/
+	int_ack = sceKernelCreateSema("Ether IRQ Ack", 0, 0, 1, NULL);
+	if (int_ack < 0)
+		goto thread_error;
+	read_thread = sceKernelCreateThread("UDP Receiver", receive_proc_udp, 0x10000100, 0x10000, 0, 0, NULL);
+	if (read_thread < 0 || sceKernelStartThread(read_thread, 0, NULL) < 0)
+		goto thread_error;
+	return true;
+
+thread_error:
+	WarningAlert(GetString(STR_NO_NET_THREAD_ERR));
+	if (read_thread >= 0)
+		sceKernelDeleteThread(read_thread);
+	read_thread = -1;
+	if (int_ack >= 0)
+		sceKernelDeleteSema(int_ack);
+	int_ack = -1;
+	udp_tunnel = false;
+	fd = -1;
 	return false;
 }
 
@@ -207,10 +384,115 @@ bool ether_start_udp_thread(int socket_fd)
 
 void ether_stop_udp_thread(void)
 {
-	/*ether_thread_active = false;
-	//status_t result;
-	//wait_for_thread(read_thread, &result);
-	sceKernelDelayThread(1*1000*1000);*/
+	if (read_thread >= 0) {
+		ether_thread_active = false;
+		sceKernelSignalSema(int_ack, 1);
+		sceKernelWaitThreadEnd(read_thread, NULL, NULL);
+		read_thread = -1;
+	}
+	if (int_ack >= 0) {
+		sceKernelDeleteSema(int_ack);
+		int_ack = -1;
+	}
+	udp_tunnel = false;
+	fd = -1;
+}
+
+
+/*
+ *  Packet capture writer thread
+ */
+
+static SceUID capture_thread = -1;
+static SceUID capture_sem = -1;
+static volatile bool capture_thread_cancel;
+
+static int capture_proc(SceSize args, void *argp)
+{
+	while (!capture_thread_cancel) {
+		// Look at the capture ring at least every 100ms
+		SceUInt timeout = 100000;
+		sceKernelWaitSema(capture_sem, 1, &timeout);
+		if (capture_thread_cancel)
+			break;
+		EtherCaptureService();
+	}
+	sceKernelExitDeleteThread(0);
+	return 0;
+}
+
+bool ether_capture_thread_start(void)
+{
+	capture_thread_cancel = false;
+	capture_sem = sceKernelCreateSema("Capture", 0, 0, 1, NULL);
+	if (capture_sem < 0)
+		return false;
+	capture_thread = sceKernelCreateThread("capture_thread", capture_proc, 0x10000100, 0x4000, 0, 0, NULL);
+	if (capture_thread < 0 || sceKernelStartThread(capture_thread, 0, NULL) < 0) {
+		if (capture_thread >= 0)
+			sceKernelDeleteThread(capture_thread);
+		capture_thread = -1;
+		sceKernelDeleteSema(capture_sem);
+		capture_sem = -1;
+		return false;
+	}
+	return true;
+}
+
+void ether_capture_thread_stop(void)
+{
+	if (capture_thread >= 0) {
+		capture_thread_cancel = true;
+		sceKernelSignalSema(capture_sem, 1);
+		sceKernelWaitThreadEnd(capture_thread, NULL, NULL);
+		capture_thread = -1;
+	}
+	if (capture_sem >= 0) {
+		sceKernelDeleteSema(capture_sem);
+		capture_sem = -1;
+	}
+}
+
+void ether_capture_wakeup(void)
+{
+	sceKernelSignalSema(capture_sem, 1);
+}
+
+
+/*
+ *  Dispatch packet to protocol handler
+ */
+
+static void ether_dispatch_packet(uint32 p, uint32 length)
+{
+	EtherCapture(Mac2HostAddr(p), length);
+
+	// Get packet type
+	uint16 type = ReadMacInt16(p + 12);
+
+	// Look for protocol
+	uint16 search_type = (type <= 1500 ? 0 : type);
+	if (net_protocols.find(search_type) == net_protocols.end())
+		return;
+	uint32 handler = net_protocols[search_type];
+
+	// No default handler
+	if (handler == 0)
+		return;
+
+	// Copy header to RHA
+	Mac2Mac_memcpy(ether_data + ed_RHA, p, 14);
+	D(bug(" header %08x%04x %08x%04x %04x\n", ReadMacInt32(ether_data + ed_RHA), ReadMacInt16(ether_data + ed_RHA + 4), ReadMacInt32(ether_data + ed_RHA + 6), ReadMacInt16(ether_data + ed_RHA + 10), ReadMacInt16(ether_data + ed_RHA + 12)));
+
+	// Call protocol handler
+	M68kRegisters r;
+	r.d[0] = type;									// Packet type
+	r.d[1] = length - 14;							// Remaining packet length (without header, for ReadPacket)
+	r.a[0] = p + 14;								// Pointer to packet (Mac address, for ReadPacket)
+	r.a[3] = ether_data + ed_RHA + 14;				// Pointer behind header in RHA
+	r.a[4] = ether_data + ed_ReadPacket;			// Pointer to ReadPacket/ReadRest routines
+	D(bug(" calling protocol handler %08x, type %08x, length %08x, data %08x, rha %08x, read_packet %08x\n", handler, r.d[0], r.d[1], r.a[0], r.a[3], r.a[4]));
+	Execute68k(handler, &r);
 }
 
 
@@ -220,30 +502,34 @@ void ether_stop_udp_thread(void)
 
 void EtherInterrupt(void)
 {
-	/*D(bug("EtherIRQ\n"));
+	D(bug("EtherIRQ\n"));
 	EthernetPacket ether_packet;
 	uint32 packet = ether_packet.addr();
 
-	if (udp_tunnel)
-	{
-		ssize_t length;
-
-		// Read packets from socket and hand to ether_udp_read() for processing
-		while (true)
-		{
-			struct sockaddr_in from;
-			socklen_t from_len = sizeof(from);
-            sceKernelDelayThread(10);
-			length = recvfrom(fd, Mac2HostAddr(packet), 1514, 0, (struct sockaddr *)&from, &from_len);
-			if (length < 14)
-				break;
-			ether_udp_read(packet, length, &from);
+	if (udp_tunnel) {
+		// Read packets from socket in batches and pass them to ether_udp_read(),
+		// then let the reception thread wait for more
+		ether_udp_receive(packet);
+		sceKernelSignalSema(int_ack, 1);
+		D(bug(" EtherIRQ done\n"));
+		return;
+	}
+
+	// Dispatch packets received by slirp
+	int length;
+	while ((length = ether_slirp_read(Mac2HostAddr(packet), 1514)) > 0) {
+		if (length < 14)
+			continue;
+
+#if MONITOR
+		bug("Receiving Ethernet packet:\n");
+		for (int i=0; i<length; i++) {
+			bug("%02x ", ReadMacInt8(packet + i));
 		}
+		bug("\n");
+#endif
 
+		ether_dispatch_packet(packet, length);
 	}
-	else
-	{
-		// Do nothing as PSP only does udptunnel
-	}
-	D(bug(" EtherIRQ done\n"));*/
+	D(bug(" EtherIRQ done\n"));
 }
@@ -28,7 +28,10 @@
 #include <errno.h>
 #include <utime.h>
 
+#include <psp2/kernel/threadmgr.h>
+
 #include "sysdeps.h"
+#include "main.h"
 #include "extfs.h"
 #include "extfs_defs.h"
 
@@ -220,6 +223,48 @@ static const ext2type e2t_translation[] = {
 	{NULL, 0, 0}	// End marker
 };
 
+// Hash table of e2t_translation[] indices (+1, 0 = empty slot), by extension
+const int E2T_HASH_SIZE = 128;	// Power of 2, more than twice the number of extensions
+static uint8 e2t_hash[E2T_HASH_SIZE];
+static bool e2t_hash_valid = false;
+
+static uint32 hash_ext(const char *ext)
+{
+	uint32 h = 2166136261u;
+	while (*ext)
+		h = (h ^ (uint8)*ext++) * 16777619u;
+	return h;
+}
+
+static void init_e2t_hash(void)
+{
+	for (int i=0; e2t_translation[i].ext; i++) {
+		uint32 slot = hash_ext(e2t_translation[i].ext) & (E2T_HASH_SIZE - 1);
+		while (e2t_hash[slot])
+			slot = (slot + 1) & (E2T_HASH_SIZE - 1);
+		e2t_hash[slot] = i + 1;
+	}
+	e2t_hash_valid = true;
+}
+
+// Find translation for file name extension of path, NULL if none
+static const ext2type *find_e2t(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+	if (ext == NULL || strchr(ext, '/'))
+		return NULL;
+	if (!e2t_hash_valid)
+		init_e2t_hash();
+	uint32 slot = hash_ext(ext) & (E2T_HASH_SIZE - 1);
+	while (e2t_hash[slot]) {
+		const ext2type *e = e2t_translation + e2t_hash[slot] - 1;
+		if (!strcmp(ext, e->ext))
+			return e;
+		slot = (slot + 1) & (E2T_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
 void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 {
 	// Set default finder info
@@ -242,16 +287,10 @@ void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 
 	// No Finder info file, translate file name extension to MacOS type/creator
 	if (!is_dir) {
-		int path_len = strlen(path);
-		for (int i=0; e2t_translation[i].ext; i++) {
-			int ext_len = strlen(e2t_translation[i].ext);
-			if (path_len < ext_len)
-				continue;
-			if (!strcmp(path + path_len - ext_len, e2t_translation[i].ext)) {
-				WriteMacInt32(finfo + fdType, e2t_translation[i].type);
-				WriteMacInt32(finfo + fdCreator, e2t_translation[i].creator);
-				break;
-			}
+		const ext2type *e = find_e2t(path);
+		if (e) {
+			WriteMacInt32(finfo + fdType, e->type);
+			WriteMacInt32(finfo + fdCreator, e->creator);
 		}
 	}
 }
@@ -285,17 +324,13 @@ void set_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 
 uint32 get_rfork_size(const char *path)
 {
-	// Open resource file
-	int fd = open_rsrc(path, O_RDONLY);
-	if (fd < 0)
+	// Stat resource file instead of opening it
+	char helper_path[MAX_PATH_LENGTH];
+	make_helper_path(path, helper_path, ".rsrc/");
+	struct stat st;
+	if (stat(helper_path, &st) < 0 || !S_ISREG(st.st_mode))
 		return 0;
-
-	// Get size
-	off_t size = lseek(fd, 0, SEEK_END);
-
-	// Close file and return size
-	close(fd);
-	return size < 0 ? 0 : size;
+	return st.st_size;
 }
 
 int open_rfork(const char *path, int flag)
@@ -331,6 +366,22 @@ ssize_t extfs_write(int fd, void *buffer, size_t length)
 }
 
 
+/*
+ *  Read/write "length" bytes at file offset "offset" without changing
+ *  the file position, returns number of bytes transferred (or -1 on error)
+ */
+
+ssize_t extfs_pread(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pread(fd, buffer, length, offset);
+}
+
+ssize_t extfs_pwrite(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pwrite(fd, buffer, length, offset);
+}
+
+
 /*
  *  Remove file/directory (and associated helper files),
  *  returns false on error (and sets errno)
@@ -387,6 +438,119 @@ bool extfs_rename(const char *old_path, const char *new_path)
 }
 
 
+#if EXTFS_WATCH
+/*
+ *  Host change watcher: the watched directories are polled for changed
+ *  modification times once per second
+ */
+
+const int MAX_WATCHED_DIRS = 16;
+
+struct watched_dir {
+	uint32 dir_id;			// CNID of directory (0 = unused)
+	time_t mtime;			// Last seen modification time
+	char path[MAX_PATH_LENGTH];
+};
+
+static watched_dir watched_dirs[MAX_WATCHED_DIRS];
+static B2_mutex *watch_lock;
+static SceUID watch_thread = -1;
+static volatile bool watch_thread_cancel;
+
+static void poll_watched_dirs(void)
+{
+	uint32 changed[MAX_WATCHED_DIRS];
+	int num_changed = 0;
+	B2_lock_mutex(watch_lock);
+	for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+		watched_dir *w = watched_dirs + i;
+		if (w->dir_id == 0)
+			continue;
+		struct stat st;
+		time_t mtime = stat(w->path, &st) < 0 ? 0 : st.st_mtime;
+		if (mtime != w->mtime) {
+			w->mtime = mtime;
+			changed[num_changed++] = w->dir_id;
+		}
+	}
+	B2_unlock_mutex(watch_lock);
+	for (int i=0; i<num_changed; i++)
+		ExtFSHostChanged(changed[i], NULL);
+}
+
+static int watch_func(SceSize args, void *argp)
+{
+	while (!watch_thread_cancel) {
+		poll_watched_dirs();
+		for (int i=0; i<10 && !watch_thread_cancel; i++)
+			sceKernelDelayThread(100*1000);
+	}
+	sceKernelExitDeleteThread(0);
+	return 0;
+}
+
+bool extfs_watch_init(void)
+{
+	memset(watched_dirs, 0, sizeof(watched_dirs));
+	watch_lock = B2_create_mutex();
+	watch_thread_cancel = false;
+	watch_thread = sceKernelCreateThread("extfs_watch_thread", watch_func, 0x10000100, 0x4000, 0, 0, NULL);
+	if (watch_thread < 0) {
+		extfs_watch_exit();
+		return false;
+	}
+	sceKernelStartThread(watch_thread, 0, 0);
+	return true;
+}
+
+void extfs_watch_exit(void)
+{
+	if (watch_lock == NULL)
+		return;
+	if (watch_thread >= 0) {
+		watch_thread_cancel = true;
+		sceKernelWaitThreadEnd(watch_thread, NULL, NULL);
+		watch_thread = -1;
+	}
+	B2_delete_mutex(watch_lock);
+	watch_lock = NULL;
+}
+
+bool extfs_watch_dir(uint32 dir_id, const char *path)
+{
+	B2_lock_mutex(watch_lock);
+	watched_dir *w = NULL;
+	for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+		if (watched_dirs[i].dir_id == 0) {
+			w = watched_dirs + i;
+			break;
+		}
+	}
+	if (w) {
+		struct stat st;
+		w->mtime = stat(path, &st) < 0 ? 0 : st.st_mtime;
+		strncpy(w->path, path, MAX_PATH_LENGTH - 1);
+		w->path[MAX_PATH_LENGTH - 1] = 0;
+		w->dir_id = dir_id;
+	}
+	B2_unlock_mutex(watch_lock);
+	return w != NULL;
+}
+
+void extfs_unwatch_dir(uint32 dir_id)
+{
+	B2_lock_mutex(watch_lock);
+	for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+		if (watched_dirs[i].dir_id == dir_id) {
+			watched_dirs[i].dir_id = 0;
+			break;
+		}
+	}
+	B2_unlock_mutex(watch_lock);
+}
+#endif
+
+
 // Convert from the host OS filename encoding to MacRoman
 const char *host_encoding_to_macroman(const char *filename)
 {
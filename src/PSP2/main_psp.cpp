@@ -49,6 +49,7 @@ using std::string;
 #include "rom_patches.h"
 #include "xpram.h"
 #include "timer.h"
+#include "clock.h"
 #include "video.h"
 #include "emul_op.h"
 #include "prefs.h"
@@ -90,6 +91,7 @@ static uint8 last_xpram[XPRAM_SIZE];				// Buffer for monitoring XPRAM changes
 
 static bool tick_thread_active = false;				// Flag: 60Hz thread installed
 static volatile bool tick_thread_cancel = false;	// Flag: Cancel 60Hz thread
+static ClockTicker tick_ticker;						// 60Hz deadlines and jitter statistics
 //static int tick_thread;								// 60Hz thread
 
 #if USE_SCRATCHMEM_SUBTERFUGE
@@ -153,6 +155,9 @@ int main(int argc, char **argv)
 	sceCommonDialogSetConfigParam(&(SceCommonDialogConfigParam){});
 
 	char str[256];
+
+	// Start monotonic clock
+	ClockInit();
 
     psvDebugScreenInit();
     psvDebugScreenSetBgColor(0xFF000000);
@@ -313,23 +318,31 @@ int main(int argc, char **argv)
 		QuitEmulator();
 	}
 
+#if USE_VIRTUAL_TIME
+	// Derive all time from the executed instruction count?
+	if (PrefsFindBool("vtime"))
+		clock_virtual_start(PrefsFindInt32("vtimeips"), one_tick);
+#endif
+
 	// Initialize everything
 	if (!InitAll())
 		QuitEmulator();
 	D(bug("Initialization complete\n"));
 
 #ifndef USE_CPU_EMUL_SERVICES
-	// start 60Hz thread
-	int thid = sceKernelCreateThread("tick_thread", tick_func, 0x10000100, 0x1800, 0, 0, NULL);
+	// start 60Hz thread (in virtual time mode, the CPU loop generates the ticks)
+	if (!ClockVirtual) {
+		int thid = sceKernelCreateThread("tick_thread", tick_func, 0x10000100, 0x1800, 0, 0, NULL);
 
-	if(thid < 0) {
-		sprintf(str, Get_String(STR_TICK_THREAD_ERR));
-		ErrorAlert(str);
-		QuitEmulator();
+		if(thid < 0) {
+			sprintf(str, Get_String(STR_TICK_THREAD_ERR));
+			ErrorAlert(str);
+			QuitEmulator();
+		}
+		sceKernelStartThread(thid, 0, 0);
+		tick_thread_active = true;
+		D(bug("60Hz thread started\n"));
 	}
-	sceKernelStartThread(thid, 0, 0);
-	tick_thread_active = true;
-	D(bug("60Hz thread started\n"));
 
 #endif
 	// Start 68k and jump to ROM boot routine
@@ -365,6 +378,7 @@ void QuitEmulator(void)
 	if (tick_thread_active) {
 		tick_thread_cancel = true;
 		sceKernelDelayThread(100*1000);
+		clock_ticker_report(tick_ticker, "60Hz thread");
 	}
 #endif
 
@@ -415,7 +429,9 @@ void FlushCodeCache(void *start, uint32 size)
  */
 
 struct B2_mutex {
-	int dummy;
+	B2_mutex() { m = sceKernelCreateMutex("B2 Mutex", 0, 0, NULL); }
+	~B2_mutex() { sceKernelDeleteMutex(m); }
+	SceUID m;
 };
 
 B2_mutex *B2_create_mutex(void)
@@ -425,10 +441,12 @@ B2_mutex *B2_create_mutex(void)
 
 void B2_lock_mutex(B2_mutex *mutex)
 {
+	sceKernelLockMutex(mutex->m, 1, NULL);
 }
 
 void B2_unlock_mutex(B2_mutex *mutex)
 {
+	sceKernelUnlockMutex(mutex->m, 1);
 }
 
 void B2_delete_mutex(B2_mutex *mutex)
@@ -446,14 +464,12 @@ uint32 InterruptFlags = 0;
 #if EMULATED_68K
 void SetInterruptFlag(uint32 flag)
 {
-	// PSP uses cooperative multitasking, so no need to worry
-	InterruptFlags |= flag;
+	__sync_fetch_and_or(&InterruptFlags, flag);
 }
 
 void ClearInterruptFlag(uint32 flag)
 {
-	// PSP uses cooperative multitasking, so no need to worry
-	InterruptFlags &= ~flag;
+	__sync_fetch_and_and(&InterruptFlags, ~flag);
 }
 #endif
 
@@ -518,16 +534,11 @@ static int tick_func(SceSize args, void *argp)
     }
     else
     {
-        uint64 next = GetTicks_usec();
+        clock_ticker_init(tick_ticker, 16625);
         while (!tick_thread_cancel)
         {
             one_tick();
-            next += 16625;
-            int64 delay = next - GetTicks_usec();
-            if (delay > 0)
-                Delay_usec(delay);
-            else if (delay < -16625)
-                next = GetTicks_usec();
+            clock_ticker_wait(tick_ticker);
         }
     }
 
@@ -36,6 +36,7 @@ extern char *RequestString (char *initialStr);
 #include "prefs_editor.h"
 #include "user_strings.h"
 #include "user_strings_psp.h"
+#include "cow_image.h"
 
 #define Get_String(x) const_cast<char*>(GetString(x))
 
@@ -159,6 +160,22 @@ void psp_create_hardfile(void *arg)
 
     gui_Print_Left(textbuf, 0xFFCCCCCC);
 
+    if (PrefsFindBool("sparsehfv"))
+    {
+        // Sparse image, blocks are only allocated when written to
+        sceIoRemove(filename);
+        if (!cow_image_create_sparse(filename, (loff_t)filesize * 1024*1024, COW_DEFAULT_BLOCK_SIZE))
+        {
+            sceKernelDelayThread(4*1000*1000);
+            gui_Print_Left("Could not create hardfile!", 0xFFED4337);
+            sceKernelDelayThread(4*1000*1000);
+            return;
+        }
+        gui_Print_Left("Hardfile successfully created.", 0xFFCCCCCC);
+        sceKernelDelayThread(4*1000*1000);
+        return;
+    }
+
     int fd = sceIoOpen(filename, SCE_O_CREAT | SCE_O_TRUNC | SCE_O_WRONLY, 0777);
 
 	if (fd <= 0)
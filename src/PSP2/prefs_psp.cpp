@@ -38,10 +38,13 @@ prefs_desc platform_prefs_items[] = {
     {"pspdar", TYPE_INT32, false,          "PSP display aspect ratio"},
     {"psposcan", TYPE_BOOLEAN, false,      "PSP video overscan enable"},
     {"relaxed60hz", TYPE_BOOLEAN, false,   "Use relaxed timing for 60 Hz IRQ"},
+    {"vtime", TYPE_BOOLEAN, false,         "Derive all time from executed instructions"},
+    {"vtimeips", TYPE_INT32, false,        "Emulated instructions per second in virtual time mode"},
     {"reartouch", TYPE_BOOLEAN, false,     "Enable rear touch panel"},
     {"indirecttouch", TYPE_BOOLEAN, false, "Use indirect front touch"},
     {"pointerspeed", TYPE_INT32, false,    "Mouse pointer speed"},
     {"analogdeadzone", TYPE_INT32, false,  "Analog joystick deadzone"},
+    {"sparsehfv", TYPE_BOOLEAN, false,     "Create new hardfiles as sparse images"},
 	{NULL, TYPE_END, false, NULL} // End of list
 };
 
@@ -95,4 +98,7 @@ void SavePrefs(void)
 void AddPlatformPrefsDefaults(void)
 {
 	PrefsReplaceString("extfs", "ms0:");
+	PrefsAddBool("vtime", false);
+	PrefsAddInt32("vtimeips", 10000000);
+	PrefsAddBool("sparsehfv", false);
 }
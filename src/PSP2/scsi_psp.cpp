@@ -18,19 +18,143 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+/*
+ *  There is no SCSI hardware on the Vita, so the "scsi0".."scsi6" prefs
+ *  items name hardfile images (".hfv") which are presented as direct-access
+ *  disks. The commands needed by SCSI disk drivers and formatters are
+ *  emulated here.
+ *
+ *  Data of READ and WRITE commands is transferred with one Sys_read()/
+ *  Sys_write() per entry of the scatter/gather table built by scsi.cpp,
+ *  directly to and from Mac memory, so no intermediate buffer is needed
+ *  however large the transfer is. Going through the Sys_*() layer also
+ *  keeps overlay and compressed images, the block cache and suspend/resume
+ *  working for SCSI targets.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
 #include "sysdeps.h"
+#include "main.h"
+#include "prefs.h"
+#include "sys.h"
 #include "scsi.h"
 
 #define DEBUG 0
 #include "debug.h"
 
 
+// SCSI commands
+enum {
+	CMD_TEST_UNIT_READY = 0x00,
+	CMD_REZERO_UNIT = 0x01,
+	CMD_REQUEST_SENSE = 0x03,
+	CMD_FORMAT_UNIT = 0x04,
+	CMD_READ_6 = 0x08,
+	CMD_WRITE_6 = 0x0a,
+	CMD_SEEK_6 = 0x0b,
+	CMD_INQUIRY = 0x12,
+	CMD_MODE_SELECT_6 = 0x15,
+	CMD_RESERVE = 0x16,
+	CMD_RELEASE = 0x17,
+	CMD_MODE_SENSE_6 = 0x1a,
+	CMD_START_STOP_UNIT = 0x1b,
+	CMD_SEND_DIAGNOSTIC = 0x1d,
+	CMD_PREVENT_ALLOW_REMOVAL = 0x1e,
+	CMD_READ_CAPACITY = 0x25,
+	CMD_READ_10 = 0x28,
+	CMD_WRITE_10 = 0x2a,
+	CMD_SEEK_10 = 0x2b,
+	CMD_VERIFY_10 = 0x2f,
+	CMD_SYNCHRONIZE_CACHE = 0x35,
+	CMD_MODE_SELECT_10 = 0x55,
+	CMD_MODE_SENSE_10 = 0x5a
+};
+
+// Status bytes
+enum {
+	STATUS_GOOD = 0x00,
+	STATUS_CHECK_CONDITION = 0x02
+};
+
+// Sense keys and additional sense codes
+enum {
+	SENSE_NONE = 0x00,
+	SENSE_NOT_READY = 0x02,
+	SENSE_MEDIUM_ERROR = 0x03,
+	SENSE_ILLEGAL_REQUEST = 0x05,
+	SENSE_DATA_PROTECT = 0x07
+};
+
+enum {
+	ASC_NONE = 0x00,
+	ASC_READ_ERROR = 0x11,
+	ASC_INVALID_COMMAND = 0x20,
+	ASC_LBA_OUT_OF_RANGE = 0x21,
+	ASC_INVALID_FIELD_IN_CDB = 0x24,
+	ASC_WRITE_PROTECTED = 0x27,
+	ASC_WRITE_ERROR = 0x0c
+};
+
+const uint32 BLOCK_SIZE = 512;
+
+// Geometry reported in mode pages, the Mac doesn't care about it
+const int NUM_HEADS = 16;
+const int SECTORS_PER_TRACK = 63;
+
+// Emulated target
+struct scsi_target {
+	void *fh;				// Image file handle (NULL = no target)
+	uint32 num_blocks;		// Number of 512 byte blocks
+	bool read_only;
+	uint8 sense_key;		// Sense data for next REQUEST SENSE
+	uint8 asc;
+	uint32 info;			// Information field (failing block)
+};
+
+static scsi_target targets[8];
+static scsi_target *target;		// Selected target
+
+static uint8 the_cmd[12];		// Active SCSI command
+static int the_cmd_len;
+
+
 /*
  *  Initialization
  */
 
 void SCSIInit(void)
 {
+	for (int id=0; id<8; id++) {
+		scsi_target *t = targets + id;
+		t->fh = NULL;
+		t->sense_key = SENSE_NONE;
+		t->asc = ASC_NONE;
+		t->info = 0;
+
+		char prefs_name[16];
+		sprintf(prefs_name, "scsi%d", id);
+		const char *str = PrefsFindString(prefs_name);
+		if (str == NULL || str[0] == 0)
+			continue;
+
+		// A leading '*' opens the image read-only, like for "disk"
+		bool read_only = false;
+		if (str[0] == '*') {
+			read_only = true;
+			str++;
+		}
+		t->fh = Sys_open(str, read_only);
+		if (t->fh == NULL)
+			continue;
+		t->read_only = SysIsReadOnly(t->fh);
+		loff_t size = SysGetFileSize(t->fh);
+		t->num_blocks = size / BLOCK_SIZE;
+		D(bug("SCSI ID %d: %s, %u blocks%s\n", id, str, t->num_blocks, t->read_only ? ", read-only" : ""));
+	}
+	target = NULL;
+
 	// Reset SCSI bus
 	SCSIReset();
 }
@@ -42,6 +166,12 @@ void SCSIInit(void)
 
 void SCSIExit(void)
 {
+	for (int id=0; id<8; id++) {
+		if (targets[id].fh) {
+			Sys_close(targets[id].fh);
+			targets[id].fh = NULL;
+		}
+	}
 }
 
 
@@ -51,6 +181,7 @@ void SCSIExit(void)
 
 void scsi_set_cmd(int cmd_length, uint8 *cmd)
 {
+	memcpy(the_cmd, cmd, the_cmd_len = cmd_length);
 }
 
 
@@ -60,7 +191,7 @@ void scsi_set_cmd(int cmd_length, uint8 *cmd)
 
 bool scsi_is_target_present(int id)
 {
-	return false;
+	return targets[id].fh != NULL;
 }
 
 
@@ -70,7 +201,218 @@ bool scsi_is_target_present(int id)
 
 bool scsi_set_target(int id, int lun)
 {
-	return false;
+	// Images only have LUN 0
+	if (targets[id].fh == NULL || lun != 0)
+		return false;
+	target = targets + id;
+	return true;
+}
+
+
+/*
+ *  Record sense data and return CHECK CONDITION status
+ */
+
+static uint16 check_condition(uint8 sense_key, uint8 asc, uint32 info = 0)
+{
+	D(bug(" check condition, sense key %d, ASC %02x\n", sense_key, asc));
+	target->sense_key = sense_key;
+	target->asc = asc;
+	target->info = info;
+	return STATUS_CHECK_CONDITION;
+}
+
+
+/*
+ *  Copy command reply into S/G table, returns number of bytes copied
+ */
+
+static size_t scatter_reply(const uint8 *data, size_t length, int sg_size, uint8 **sg_ptr, uint32 *sg_len)
+{
+	size_t done = 0;
+	for (int i=0; i<sg_size && done<length; i++) {
+		size_t n = sg_len[i];
+		if (n > length - done)
+			n = length - done;
+		memcpy(sg_ptr[i], data + done, n);
+		done += n;
+	}
+	return done;
+}
+
+
+/*
+ *  Transfer blocks between image and S/G table, one Sys_read()/Sys_write()
+ *  per (already merged) S/G entry; returns number of bytes transferred
+ */
+
+static size_t transfer_blocks(bool write, loff_t offset, size_t length, int sg_size, uint8 **sg_ptr, uint32 *sg_len)
+{
+	size_t done = 0;
+	for (int i=0; i<sg_size && done<length; i++) {
+		size_t n = sg_len[i];
+		if (n > length - done)
+			n = length - done;
+		size_t actual = write ? Sys_write(target->fh, sg_ptr[i], offset + done, n) : Sys_read(target->fh, sg_ptr[i], offset + done, n);
+		done += actual;
+		if (actual != n)
+			break;
+	}
+	return done;
+}
+
+
+/*
+ *  READ/WRITE/VERIFY commands
+ */
+
+static uint16 read_write(bool write, uint32 block, uint32 count, size_t data_length, int sg_size, uint8 **sg_ptr, uint32 *sg_len)
+{
+	D(bug(" %s block %u, count %u\n", write ? "write" : "read", block, count));
+	if (block > target->num_blocks || count > target->num_blocks - block)
+		return check_condition(SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE, block);
+	if (write && target->read_only)
+		return check_condition(SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+
+	// Only as much as the S/G table holds is transferred
+	size_t length = (size_t)count * BLOCK_SIZE;
+	if (length > data_length)
+		length = data_length;
+	size_t actual = transfer_blocks(write, (loff_t)block * BLOCK_SIZE, length, sg_size, sg_ptr, sg_len);
+	if (actual != length) {
+		uint32 failed = block + actual / BLOCK_SIZE;
+		return check_condition(SENSE_MEDIUM_ERROR, write ? ASC_WRITE_ERROR : ASC_READ_ERROR, failed);
+	}
+	return STATUS_GOOD;
+}
+
+
+/*
+ *  Build INQUIRY data
+ */
+
+static size_t inquiry_data(uint8 *data)
+{
+	memset(data, 0, 36);
+	data[0] = 0x00;				// Direct-access device
+	data[2] = 0x02;				// SCSI-2
+	data[3] = 0x02;				// Response data format
+	data[4] = 36 - 5;			// Additional length
+	memcpy(data + 8, "BASILISK", 8);
+	memcpy(data + 16, "VIRTUAL DISK    ", 16);
+	memcpy(data + 32, "1.0 ", 4);
+	return 36;
+}
+
+
+/*
+ *  Append mode page to buffer, returns length of page
+ */
+
+static size_t mode_page(uint8 *p, int page)
+{
+	uint32 cylinders = target->num_blocks / (NUM_HEADS * SECTORS_PER_TRACK);
+	switch (page) {
+		case 0x01:		// Read-write error recovery
+			memset(p, 0, 8);
+			p[0] = 0x01;
+			p[1] = 6;
+			return 8;
+
+		case 0x03:		// Format device
+			memset(p, 0, 24);
+			p[0] = 0x03;
+			p[1] = 22;
+			p[10] = SECTORS_PER_TRACK >> 8;
+			p[11] = SECTORS_PER_TRACK & 0xff;
+			p[12] = BLOCK_SIZE >> 8;
+			p[13] = BLOCK_SIZE & 0xff;
+			p[20] = 0x80;			// Soft-sectored
+			return 24;
+
+		case 0x04:		// Rigid disk geometry
+			memset(p, 0, 24);
+			p[0] = 0x04;
+			p[1] = 22;
+			p[2] = cylinders >> 16;
+			p[3] = cylinders >> 8;
+			p[4] = cylinders;
+			p[5] = NUM_HEADS;
+			p[20] = 0x1c;			// 7200 rpm
+			p[21] = 0x20;
+			return 24;
+
+		case 0x08:		// Caching
+			memset(p, 0, 12);
+			p[0] = 0x08;
+			p[1] = 10;
+			return 12;
+
+		default:
+			return 0;
+	}
+}
+
+
+/*
+ *  Build MODE SENSE(6/10) data, returns 0 for unsupported pages
+ */
+
+static size_t mode_sense_data(uint8 *data, bool ten)
+{
+	bool dbd = the_cmd[1] & 0x08;
+	int page = the_cmd[2] & 0x3f;
+	int pc = the_cmd[2] >> 6;
+	size_t header = ten ? 8 : 4;
+
+	uint8 *p = data + header;
+	if (!dbd) {
+		// Block descriptor
+		memset(p, 0, 8);
+		uint32 blocks = target->num_blocks > 0xffffff ? 0xffffff : target->num_blocks;
+		p[1] = blocks >> 16;
+		p[2] = blocks >> 8;
+		p[3] = blocks;
+		p[5] = BLOCK_SIZE >> 16;
+		p[6] = BLOCK_SIZE >> 8;
+		p[7] = BLOCK_SIZE & 0xff;
+		p += 8;
+	}
+
+	if (page == 0x3f) {
+		static const int pages[] = {0x01, 0x03, 0x04, 0x08};
+		for (int i=0; i<4; i++)
+			p += mode_page(p, pages[i]);
+	} else {
+		size_t n = mode_page(p, page);
+		if (n == 0 && page != 0)
+			return 0;
+		p += n;
+	}
+
+	// Changeable values: nothing can be changed
+	if (pc == 1) {
+		uint8 *q = data + header + (dbd ? 0 : 8);
+		while (q < p) {
+			memset(q + 2, 0, q[1]);
+			q += q[1] + 2;
+		}
+	}
+
+	size_t length = p - data;
+	if (ten) {
+		memset(data, 0, 8);
+		data[0] = (length - 2) >> 8;
+		data[1] = length - 2;
+		data[3] = target->read_only ? 0x80 : 0x00;	// Write-protect flag
+		data[7] = dbd ? 0 : 8;
+	} else {
+		data[0] = length - 1;
+		data[1] = 0;
+		data[2] = target->read_only ? 0x80 : 0x00;
+		data[3] = dbd ? 0 : 8;
+	}
+	return length;
 }
 
 
@@ -81,6 +423,130 @@ bool scsi_set_target(int id, int lun)
 
 bool scsi_send_cmd(size_t data_length, bool reading, int sg_size, uint8 **sg_ptr, uint32 *sg_len, uint16 *stat, uint32 timeout)
 {
-	return false;
-}
+	if (target == NULL)
+		return false;
+
+	D(bug("scsi_send_cmd %02x, %d bytes %s\n", the_cmd[0], data_length, reading ? "in" : "out"));
+	uint8 reply[256];
+	size_t reply_length = 0;		// Length of reply data, limited by allocation length
+	uint32 alloc_length = 0;
+	uint16 status = STATUS_GOOD;
+
+	// Any command but REQUEST SENSE clears the sense data
+	uint8 cmd = the_cmd[0];
+	if (cmd != CMD_REQUEST_SENSE) {
+		target->sense_key = SENSE_NONE;
+		target->asc = ASC_NONE;
+		target->info = 0;
+	}
+
+	switch (cmd) {
+		case CMD_TEST_UNIT_READY:
+		case CMD_REZERO_UNIT:
+		case CMD_SEEK_6:
+		case CMD_SEEK_10:
+		case CMD_RESERVE:
+		case CMD_RELEASE:
+		case CMD_START_STOP_UNIT:
+		case CMD_SEND_DIAGNOSTIC:
+		case CMD_PREVENT_ALLOW_REMOVAL:
+		case CMD_MODE_SELECT_6:
+		case CMD_MODE_SELECT_10:
+		case CMD_VERIFY_10:
+			break;
 
+		case CMD_SYNCHRONIZE_CACHE:
+			Sys_flush(target->fh);
+			break;
+
+		case CMD_FORMAT_UNIT:
+			// Images don't need low-level formatting
+			if (target->read_only)
+				status = check_condition(SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+			break;
+
+		case CMD_REQUEST_SENSE:
+			memset(reply, 0, 18);
+			reply[0] = 0x70;				// Current error, fixed format
+			if (target->info) {
+				reply[0] |= 0x80;			// Information field valid
+				reply[3] = target->info >> 24;
+				reply[4] = target->info >> 16;
+				reply[5] = target->info >> 8;
+				reply[6] = target->info;
+			}
+			reply[2] = target->sense_key;
+			reply[7] = 10;					// Additional sense length
+			reply[12] = target->asc;
+			reply_length = 18;
+			alloc_length = the_cmd[4];
+			target->sense_key = SENSE_NONE;
+			target->asc = ASC_NONE;
+			target->info = 0;
+			break;
+
+		case CMD_INQUIRY:
+			if (the_cmd[1] & 0x01)			// No vital product data pages
+				status = check_condition(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+			else {
+				reply_length = inquiry_data(reply);
+				alloc_length = the_cmd[4];
+			}
+			break;
+
+		case CMD_MODE_SENSE_6:
+		case CMD_MODE_SENSE_10:
+			reply_length = mode_sense_data(reply, cmd == CMD_MODE_SENSE_10);
+			if (reply_length == 0)
+				status = check_condition(SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+			alloc_length = cmd == CMD_MODE_SENSE_10 ? (the_cmd[7] << 8) | the_cmd[8] : the_cmd[4];
+			break;
+
+		case CMD_READ_CAPACITY: {
+			uint32 last = target->num_blocks ? target->num_blocks - 1 : 0;
+			reply[0] = last >> 24;
+			reply[1] = last >> 16;
+			reply[2] = last >> 8;
+			reply[3] = last;
+			reply[4] = BLOCK_SIZE >> 24;
+			reply[5] = BLOCK_SIZE >> 16;
+			reply[6] = BLOCK_SIZE >> 8;
+			reply[7] = BLOCK_SIZE & 0xff;
+			reply_length = alloc_length = 8;
+			break;
+		}
+
+		case CMD_READ_6:
+		case CMD_WRITE_6: {
+			uint32 block = ((the_cmd[1] & 0x1f) << 16) | (the_cmd[2] << 8) | the_cmd[3];
+			uint32 count = the_cmd[4] ? the_cmd[4] : 256;
+			status = read_write(cmd == CMD_WRITE_6, block, count, data_length, sg_size, sg_ptr, sg_len);
+			break;
+		}
+
+		case CMD_READ_10:
+		case CMD_WRITE_10: {
+			uint32 block = (the_cmd[2] << 24) | (the_cmd[3] << 16) | (the_cmd[4] << 8) | the_cmd[5];
+			uint32 count = (the_cmd[7] << 8) | the_cmd[8];
+			status = read_write(cmd == CMD_WRITE_10, block, count, data_length, sg_size, sg_ptr, sg_len);
+			break;
+		}
+
+		default:
+			D(bug(" unsupported command %02x\n", cmd));
+			status = check_condition(SENSE_ILLEGAL_REQUEST, ASC_INVALID_COMMAND);
+			break;
+	}
+
+	// Return reply data
+	if (reply_length && status == STATUS_GOOD && reading) {
+		if (reply_length > alloc_length)
+			reply_length = alloc_length;
+		if (reply_length > data_length)
+			reply_length = data_length;
+		scatter_reply(reply, reply_length, sg_size, sg_ptr, sg_len);
+	}
+
+	*stat = status;
+	return true;
+}
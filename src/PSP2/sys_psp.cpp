@@ -18,6 +18,8 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <psp2/kernel/threadmgr.h>
+
 #include "sysdeps.h"
 
 #include <sys/stat.h>
@@ -33,6 +35,10 @@
 #include "prefs.h"
 #include "user_strings.h"
 #include "sys.h"
+#include "async_io.h"
+#include "block_cache.h"
+#include "cow_image.h"
+#include "zimage.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -50,6 +56,9 @@ struct file_handle {
 	loff_t file_size;	// Size of file data (only valid if is_file is true)
 	int toc_fd;         // filedesc for cdrom TOC file
     char *toc_name;     // copy of filename for CD TOC
+	block_cache_file *cache;	// Block cache state (NULL = uncached)
+	cow_image *cow;				// Copy-on-write overlay (NULL = plain image)
+	zimage *zimg;				// Compressed image (NULL = plain image)
 	file_handle *next;  // next handle in list
 };
 
@@ -126,6 +135,70 @@ void SysAddSerialPrefs(void)
 }
 
 
+/*
+ *  Uncached read/write, used by the block cache
+ */
+
+static size_t read_raw(void *arg, void *buffer, loff_t offset, size_t length)
+{
+	file_handle *fh = (file_handle *)arg;
+	if (fh->fd < 0)
+		return 0;
+	if (fh->cow)
+		return cow_image_read(fh->cow, buffer, offset + fh->start_byte, length);
+	if (fh->zimg)
+		return zimage_read(fh->zimg, buffer, offset + fh->start_byte, length);
+
+	// Seek to position
+	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
+		return 0;
+
+	// Read data
+	return read(fh->fd, buffer, length);
+}
+
+static size_t write_raw(void *arg, void *buffer, loff_t offset, size_t length)
+{
+	file_handle *fh = (file_handle *)arg;
+	if (fh->fd < 0)
+		return 0;
+	if (fh->cow)
+		return cow_image_write(fh->cow, buffer, offset + fh->start_byte, length);
+	if (fh->zimg)
+		return 0;
+
+	// Seek to position
+	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
+		return 0;
+
+	// Write data
+	return write(fh->fd, buffer, length);
+}
+
+
+/*
+ *  Detect disk image file layout, looking through overlay and compressed images
+ */
+
+static void detect_layout(file_handle *fh)
+{
+	loff_t size = 0;
+	uint8 data[256];
+	if (fh->cow) {
+		size = cow_image_size(fh->cow);
+		cow_image_read(fh->cow, data, 0, 256);
+	} else if (fh->zimg) {
+		size = zimage_size(fh->zimg);
+		zimage_read(fh->zimg, data, 0, 256);
+	} else {
+		size = lseek(fh->fd, 0, SEEK_END);
+		lseek(fh->fd, 0, SEEK_SET);
+		read(fh->fd, data, 256);
+	}
+	FileDiskLayout(size, data, fh->start_byte, fh->file_size);
+}
+
+
 /*
  *  Open file/device, create new file handle (returns NULL on error)
  */
@@ -157,6 +230,9 @@ void *Sys_open(const char *name, bool read_only)
 		fh->start_byte = 0;
 		fh->is_floppy = !strncmp(tmp, ".dsk", 4);
 		fh->is_cdrom = !fh->is_floppy;
+		fh->cow = NULL;
+		fh->zimg = NULL;
+		fh->cache = block_cache_open(fh, read_raw, write_raw, false);
 		if (fh->is_floppy)
             floppy_fh = fh;
         else
@@ -181,6 +257,28 @@ void *Sys_open(const char *name, bool read_only)
 
 	if (fd >= 0) {
 		file_handle *fh = new file_handle;
+		fh->cow = NULL;
+		fh->zimg = NULL;
+		uint8 data[256];
+		read(fd, data, 256);
+		if (is_file && cow_image_check(data)) {
+			// Overlay file, access the disk through it
+			fh->cow = cow_image_open(name, fd, read_only);
+			if (fh->cow == NULL) {
+				close(fd);
+				delete fh;
+				return NULL;
+			}
+		} else if (zimage_check(data)) {
+			// Compressed image, always read-only
+			fh->zimg = zimage_open(name, fd);
+			if (fh->zimg == NULL) {
+				close(fd);
+				delete fh;
+				return NULL;
+			}
+			read_only = true;
+		}
         fh->next = fh_list;
         fh_list = fh;
 		fh->name = strdup(name);
@@ -193,12 +291,7 @@ void *Sys_open(const char *name, bool read_only)
 		fh->is_cdrom = false;
 		if (fh->is_file) {
 			// Detect disk image file layout
-			loff_t size = 0;
-			size = lseek(fd, 0, SEEK_END);
-			uint8 data[256];
-			lseek(fd, 0, SEEK_SET);
-			read(fd, data, 256);
-			FileDiskLayout(size, data, fh->start_byte, fh->file_size);
+			detect_layout(fh);
 		} else {
 		    // determine if floppy or cdrom - is floppy only if extension is "dsk", otherwise is assumed to be a cdrom
 		    char *tmp = strrchr(name, '.');
@@ -207,14 +300,12 @@ void *Sys_open(const char *name, bool read_only)
 		        fh->is_floppy = !strncmp(tmp, ".dsk", 4);
 		        fh->is_cdrom = !fh->is_floppy;
                 // Detect disk image file layout
-                loff_t size = 0;
-                size = lseek(fd, 0, SEEK_END);
-                uint8 data[256];
-                lseek(fd, 0, SEEK_SET);
-                read(fd, data, 256);
-                FileDiskLayout(size, data, fh->start_byte, fh->file_size);
+                detect_layout(fh);
 		    }
 		}
+		// Removable media and floppy images are always written through, they may be swapped by the user
+		bool write_back = fh->is_file && !read_only && fh->file_size > MAX_FLOPPY_IMAGE_SIZE && PrefsFindBool("blockcachewb");
+		fh->cache = block_cache_open(fh, read_raw, write_raw, write_back);
 		if (fh->is_floppy)
             floppy_fh = fh;
         else if (fh->is_cdrom)
@@ -237,6 +328,12 @@ void Sys_close(void *arg)
 	if (!fh)
 		return;
 
+	if (fh->cache)
+		block_cache_close(fh->cache);
+	if (fh->cow)
+		cow_image_close(fh->cow);
+	if (fh->zimg)
+		zimage_close(fh->zimg);
     if (fh->fd >= 0)
         close(fh->fd);
 
@@ -257,15 +354,10 @@ size_t Sys_read(void *arg, void *buffer, loff_t offset, size_t length)
 	file_handle *fh = (file_handle *)arg;
 	if (!fh)
 		return 0;
-	if (fh->fd < 0)
-		return 0;
 
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
-
-	// Read data
-	return read(fh->fd, buffer, length);
+	if (fh->cache)
+		return block_cache_read(fh->cache, buffer, offset, length);
+	return read_raw(fh, buffer, offset, length);
 }
 
 
@@ -279,15 +371,25 @@ size_t Sys_write(void *arg, void *buffer, loff_t offset, size_t length)
 	file_handle *fh = (file_handle *)arg;
 	if (!fh)
 		return 0;
-	if (fh->fd < 0)
-		return 0;
 
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
+	if (fh->cache)
+		return block_cache_write(fh->cache, buffer, offset, length);
+	return write_raw(fh, buffer, offset, length);
+}
 
-	// Write data
-	return write(fh->fd, buffer, length);
+
+/*
+ *  Write back cached data of file/device
+ */
+
+void Sys_flush(void *arg)
+{
+	file_handle *fh = (file_handle *)arg;
+	if (!fh)
+		return;
+
+	if (fh->cache)
+		block_cache_flush(fh->cache);
 }
 
 
@@ -310,6 +412,8 @@ loff_t SysGetFileSize(void *arg)
         if (fh->fd < 0)
             return (loff_t)650*1024;
 
+		if (fh->zimg)
+			return zimage_size(fh->zimg) - fh->start_byte;
 		return lseek(fh->fd, 0, SEEK_END) - fh->start_byte;
 	}
 }
@@ -325,6 +429,8 @@ void SysEject(void *arg)
 	if (!fh)
 		return;
 
+	if (fh->cache)
+		block_cache_invalidate(fh->cache);
 	if (fh->is_floppy) {
 	    if (floppy_fh->fd >= 0) {
             close(floppy_fh->fd);
@@ -617,9 +723,15 @@ void SysCDGetVolume(void *arg, uint8 &left, uint8 &right)
 
 void Sys_drive_stop(void)
 {
+    AsyncIODrain();
+
     file_handle *fh = fh_list;
     while (fh)
     {
+        if (fh->cache)
+            block_cache_flush(fh->cache);
+        if (fh->cow)
+            cow_image_suspend(fh->cow);
         if (fh->fd >= 0)
             close(fh->fd); // is open - close
         if (fh->toc_fd >= 0)
@@ -635,8 +747,127 @@ void Sys_drive_restart(void)
     {
         if (fh->fd >= 0)
             fh->fd = open(fh->name, fh->read_only ? O_RDONLY : O_RDWR); // was open previously - reopen
+        if (fh->cow)
+            cow_image_resume(fh->cow, fh->fd);
+        if (fh->zimg)
+            zimage_reopen(fh->zimg, fh->fd);
         if (fh->toc_fd >= 0)
             fh->toc_fd = open(fh->toc_name, O_RDONLY); // was open previously - reopen
         fh = fh->next;
     }
 }
+
+
+#if USE_ASYNC_IO
+/*
+ *  Asynchronous disk I/O worker thread
+ */
+
+static SceUID async_io_thread = -1;
+static SceUID async_io_sem;					// Signalled once per queued request
+static SceUID async_io_done_sem;			// Signalled after each executed request
+static volatile bool async_io_thread_cancel;
+
+static int async_io_func(SceSize args, void *argp)
+{
+	while (!async_io_thread_cancel) {
+		sceKernelWaitSema(async_io_sem, 1, NULL);
+		if (async_io_thread_cancel)
+			break;
+		AsyncIOService();
+		sceKernelSignalSema(async_io_done_sem, 1);
+	}
+	sceKernelExitDeleteThread(0);
+	return 0;
+}
+
+bool async_io_thread_start(void)
+{
+	async_io_thread_cancel = false;
+	async_io_sem = sceKernelCreateSema("Async I/O", 0, 0, 255, 0);
+	async_io_done_sem = sceKernelCreateSema("Async I/O Done", 0, 0, 1, 0);
+	async_io_thread = sceKernelCreateThread("async_io_thread", async_io_func, 0x10000100, 0x4000, 0, 0, NULL);
+	if (async_io_thread < 0) {
+		printf("WARNING: Cannot create disk I/O thread, using synchronous I/O\n");
+		sceKernelDeleteSema(async_io_done_sem);
+		sceKernelDeleteSema(async_io_sem);
+		return false;
+	}
+	sceKernelStartThread(async_io_thread, 0, 0);
+	return true;
+}
+
+void async_io_thread_stop(void)
+{
+	if (async_io_thread >= 0) {
+		async_io_thread_cancel = true;
+		sceKernelSignalSema(async_io_sem, 1);
+		sceKernelDelayThread(100*1000);
+		async_io_thread = -1;
+	}
+	sceKernelDeleteSema(async_io_done_sem);
+	sceKernelDeleteSema(async_io_sem);
+}
+
+void async_io_wakeup(void)
+{
+	sceKernelSignalSema(async_io_sem, 1);
+}
+
+void async_io_wait_done(void)
+{
+	sceKernelWaitSema(async_io_done_sem, 1, NULL);
+}
+#endif
+
+
+#if BLOCK_CACHE_PREFETCH
+/*
+ *  Block cache prefetch thread
+ */
+
+static SceUID prefetch_thread = -1;
+static SceUID prefetch_sem;
+static volatile bool prefetch_thread_cancel;
+
+static int prefetch_func(SceSize args, void *argp)
+{
+	while (!prefetch_thread_cancel) {
+		sceKernelWaitSema(prefetch_sem, 1, NULL);
+		if (prefetch_thread_cancel)
+			break;
+		BlockCachePrefetch();
+	}
+	sceKernelExitDeleteThread(0);
+	return 0;
+}
+
+bool block_cache_prefetch_start(void)
+{
+	prefetch_thread_cancel = false;
+	prefetch_sem = sceKernelCreateSema("Prefetch", 0, 0, 1, 0);
+	prefetch_thread = sceKernelCreateThread("prefetch_thread", prefetch_func, 0x10000100, 0x4000, 0, 0, NULL);
+	if (prefetch_thread < 0) {
+		sceKernelDeleteSema(prefetch_sem);
+		return false;
+	}
+	sceKernelStartThread(prefetch_thread, 0, 0);
+	return true;
+}
+
+void block_cache_prefetch_stop(void)
+{
+	if (prefetch_thread >= 0) {
+		prefetch_thread_cancel = true;
+		sceKernelSignalSema(prefetch_sem, 1);
+		sceKernelDelayThread(100*1000);
+		prefetch_thread = -1;
+	}
+	sceKernelDeleteSema(prefetch_sem);
+}
+
+void block_cache_prefetch_wakeup(void)
+{
+	sceKernelSignalSema(prefetch_sem, 1);
+}
+#endif
@@ -63,10 +63,37 @@
 #define SUPPORTS_EXTFS 1
 
 /* BSD socket API supported */
-#define SUPPORTS_UDP_TUNNEL 0
+#define SUPPORTS_UDP_TUNNEL 1
 
 //#define SUPPORTS_VBL_IRQ 1
 
+/* Time Manager tasks are woken up by a host timer instead of the 60Hz tick */
+#define PRECISE_TIMING 1
+
+/* Time can be derived from the executed instruction count ("vtime" pref) */
+#define USE_VIRTUAL_TIME 1
+
+/* Asynchronous disk driver requests are executed by an I/O thread ("diskasync" pref) */
+#define USE_ASYNC_IO 1
+
+/* Disk block cache reads ahead of sequential streams in a separate thread */
+#define BLOCK_CACHE_PREFETCH 1
+
+/* Disk driver requests can be traced to a file ("disktrace" pref) */
+#define USE_DISK_TRACE 1
+
+/* Ethernet frames can be captured to a pcap file ("ethercapture" pref) */
+#define USE_ETHER_CAPTURE 1
+
+/* ExtFS can watch its root for changes made by the host ("extfswatch" pref) */
+#define EXTFS_WATCH 1
+
+/* zlib is linked (compressed disk images) */
+#define HAVE_LIBZ 1
+
+/* slirp is linked (user mode networking, "ether" pref set to "slirp") */
+#define HAVE_SLIRP 1
+
 /* Data types */
 typedef unsigned char uint8;
 typedef signed char int8;
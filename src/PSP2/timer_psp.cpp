@@ -19,16 +19,34 @@
  */
 #include <psp2/rtc.h>
 #include <psp2/kernel/processmgr.h>
+#include <psp2/kernel/threadmgr.h>
 
 #include "sysdeps.h"
+#include "cpu_emulation.h"
+#include "main.h"
 #include "macos_util.h"
 #include "timer.h"
+#include "clock.h"
 
 #define DEBUG 0
 #include "debug.h"
 
 
-uint32 TicksPerMicroSecond = 0xffffffff;
+/*
+ *  Monotonic host clock source
+ */
+
+uint64 clock_host_ticks(void)
+{
+	SceRtcTick tick;
+	sceRtcGetCurrentTick(&tick);
+	return tick.tick;
+}
+
+uint64 clock_host_frequency(void)
+{
+	return sceRtcGetTickResolution();
+}
 
 
 /*
@@ -40,14 +58,7 @@ void Microseconds(uint32 &hi, uint32 &lo)
 	D(bug("Microseconds\n"));
 
 #if 1
-	// Only do this once because it hurts
-	if (TicksPerMicroSecond == 0xffffffff)
-		TicksPerMicroSecond = (uint32)(sceRtcGetTickResolution() * 0.000001);
-
-	uint64 tl;
-	SceRtcTick tick;
-	sceRtcGetCurrentTick(&tick);
-	tl = tick.tick / TicksPerMicroSecond;
+	uint64 tl = ClockVirtual ? clock_virtual_usec() : clock_usec();
 #else
 	struct timeval t;
 	gettimeofday(&t, NULL);
@@ -64,6 +75,9 @@ void Microseconds(uint32 &hi, uint32 &lo)
 
 uint32 TimerDateTime(void)
 {
+	if (ClockVirtual)
+		return clock_virtual_date_time();
+
     time_t rawtime;
     SceDateTime time;
     //time(&rawtime);
@@ -81,13 +95,7 @@ uint32 TimerDateTime(void)
 void timer_current_time(tm_time_t &t)
 {
 #if 1
-	// Only do this once because it hurts
-	if (TicksPerMicroSecond == 0xffffffff)
-		TicksPerMicroSecond = (uint32)(sceRtcGetTickResolution() * 0.000001);
-
-    SceRtcTick tick;
-	sceRtcGetCurrentTick(&tick);
-	t = tick.tick / TicksPerMicroSecond;
+	t = ClockVirtual ? clock_virtual_usec() : clock_usec();
 #else
 	gettimeofday(&t, NULL);
 #endif
@@ -139,7 +147,7 @@ void timer_sub_time(tm_time_t &res, tm_time_t a, tm_time_t b)
 int timer_cmp_time(tm_time_t a, tm_time_t b)
 {
 #if 1
-    return a - b;
+	return a < b ? -1 : (a > b ? 1 : 0);
 #else
 	if (a.tv_sec == b.tv_sec)
 		return a.tv_usec - b.tv_usec;
@@ -183,7 +191,7 @@ void timer_mac2host_time(tm_time_t &res, int32 mactime)
 int32 timer_host2mac_time(tm_time_t hosttime)
 {
 #if 1
-	if (hosttime < 0)
+	if ((int64)hosttime < 0)
 		return 0;
 	else if (hosttime > 0x7fffffff)
 		return hosttime / 1000;	// Time in milliseconds
@@ -210,13 +218,7 @@ int32 timer_host2mac_time(tm_time_t hosttime)
 uint64 GetTicks_usec(void)
 {
 #if 1
-	// Only do this once because it hurts
-	if (TicksPerMicroSecond == 0xffffffff)
-		TicksPerMicroSecond = (uint32)(sceRtcGetTickResolution() * 0.000001);
-
-	SceRtcTick tick;
-	sceRtcGetCurrentTick(&tick);
-	return tick.tick / TicksPerMicroSecond;
+	return clock_usec();
 #else
 	struct timeval t;
 	gettimeofday(&t, NULL);
@@ -225,6 +227,109 @@ uint64 GetTicks_usec(void)
 }
 
 
+/*
+ *  Host wakeup timer for Time Manager tasks (PRECISE_TIMING)
+ */
+
+static SceUID timer_thread = -1;			// Wakeup timer thread
+static SceUID timer_wakeup_sem = -1;		// Signal to timer thread: wakeup time changed
+static SceUID timer_wakeup_lock = -1;		// Protects timer_wakeup_time
+static tm_time_t timer_wakeup_time = 0;		// Next wakeup time (0 = none)
+static volatile bool timer_thread_cancel = false;
+
+static tm_time_t get_wakeup_time(void)
+{
+	sceKernelLockMutex(timer_wakeup_lock, 1, NULL);
+	tm_time_t wakeup = timer_wakeup_time;
+	sceKernelUnlockMutex(timer_wakeup_lock, 1);
+	return wakeup;
+}
+
+static int timer_func(SceSize args, void *argp)
+{
+	while (!timer_thread_cancel) {
+		tm_time_t wakeup = get_wakeup_time();
+		if (wakeup == 0) {
+			// Nothing scheduled, sleep until a task is primed
+			sceKernelWaitSema(timer_wakeup_sem, 1, NULL);
+			continue;
+		}
+
+		tm_time_t now;
+		timer_current_time(now);
+		if (wakeup > now) {
+			// Sleep until wakeup time, or until it changes
+			SceUInt timeout = wakeup - now > 1000000 ? 1000000 : (SceUInt)(wakeup - now);
+			sceKernelWaitSema(timer_wakeup_sem, 1, &timeout);
+			continue;
+		}
+
+		// Wakeup time reached, trigger Time Manager interrupt (TimerInterrupt() rearms the timer)
+		sceKernelLockMutex(timer_wakeup_lock, 1, NULL);
+		if (timer_wakeup_time == wakeup)
+			timer_wakeup_time = 0;
+		sceKernelUnlockMutex(timer_wakeup_lock, 1);
+		SetInterruptFlag(INTFLAG_TIMER);
+		TriggerInterrupt();
+	}
+	sceKernelExitDeleteThread(0);
+	return 0;
+}
+
+void timer_wakeup_init(void)
+{
+	timer_wakeup_time = 0;
+	timer_thread_cancel = false;
+	timer_wakeup_sem = sceKernelCreateSema("Timer Wakeup", 0, 0, 1, 0);
+	timer_wakeup_lock = sceKernelCreateMutex("Timer Wakeup Lock", 0, 0, NULL);
+	timer_thread = sceKernelCreateThread("timer_thread", timer_func, 0x10000100, 0x1000, 0, 0, NULL);
+	if (timer_thread < 0) {
+		printf("FATAL: Cannot create Time Manager wakeup thread\n");
+		return;
+	}
+	sceKernelStartThread(timer_thread, 0, 0);
+}
+
+void timer_wakeup_exit(void)
+{
+	if (timer_thread >= 0) {
+		timer_thread_cancel = true;
+		sceKernelSignalSema(timer_wakeup_sem, 1);
+		sceKernelDelayThread(100*1000);
+		timer_thread = -1;
+	}
+	sceKernelDeleteMutex(timer_wakeup_lock);
+	sceKernelDeleteSema(timer_wakeup_sem);
+}
+
+void timer_wakeup_at(tm_time_t wakeup)
+{
+	if (wakeup == 0)	// 0 means "nothing scheduled"
+		wakeup = 1;
+	if (ClockVirtual) {
+		clock_virtual_wakeup_at(wakeup);
+		return;
+	}
+	sceKernelLockMutex(timer_wakeup_lock, 1, NULL);
+	bool changed = timer_wakeup_time != wakeup;
+	timer_wakeup_time = wakeup;
+	sceKernelUnlockMutex(timer_wakeup_lock, 1);
+	if (changed)
+		sceKernelSignalSema(timer_wakeup_sem, 1);
+}
+
+void timer_wakeup_cancel(void)
+{
+	if (ClockVirtual) {
+		clock_virtual_wakeup_at(0);
+		return;
+	}
+	sceKernelLockMutex(timer_wakeup_lock, 1, NULL);
+	timer_wakeup_time = 0;
+	sceKernelUnlockMutex(timer_wakeup_lock, 1);
+}
+
+
 /*
  *  Delay by specified number of microseconds (<1 second)
  */
@@ -241,7 +346,11 @@ void Delay_usec(uint32 usec)
 
 void idle_wait(void)
 {
-	sceKernelDelayThread(10000);
+	// In virtual time, sleeping would not bring the next event any closer
+	if (ClockVirtual)
+		clock_virtual_idle();
+	else
+		sceKernelDelayThread(10000);
 }
 
 
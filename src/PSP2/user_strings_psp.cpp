@@ -69,6 +69,7 @@ user_string_def platform_strings[] = {
 
     {STR_TICK_THREAD_ERR, "Cannot create thread for ticks."},
     {STR_NO_NET_THREAD_ERR, "Cannot create network thread."},
+	{STR_SLIRP_NO_DNS_FOUND_WARN, "Cannot get DNS address. Ethernet will not be available."},
 	{STR_NO_ACCESS_POINT_ERR, "Cannot connect to Access Point."},
 	{STR_DANZEFF_ERR, "Cannot initialize Danzeff OSK."},
 
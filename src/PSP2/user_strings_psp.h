@@ -55,6 +55,7 @@ enum {
 
     STR_TICK_THREAD_ERR,
     STR_NO_NET_THREAD_ERR,
+	STR_SLIRP_NO_DNS_FOUND_WARN,
 	STR_NO_ACCESS_POINT_ERR,
 	STR_DANZEFF_ERR,
 
@@ -0,0 +1,171 @@
+/*
+ *  cowtool.cpp - Create, inspect and commit copy-on-write overlay and sparse disk images
+ *  Compile as: make cowtool
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "cow_image.h"
+
+
+static void usage(const char *prg)
+{
+	printf("Usage: %s create OVERLAY BASE [BLOCKSIZE_KB]\n", prg);
+	printf("       %s sparse IMAGE SIZE_MB [BLOCKSIZE_KB]\n", prg);
+	printf("       %s info OVERLAY\n", prg);
+	printf("       %s commit --force OVERLAY\n", prg);
+	printf("       %s flatten OVERLAY OUTPUT\n", prg);
+	printf("\n");
+	printf("create   creates an empty overlay for BASE; a relative BASE path is\n");
+	printf("         relative to the directory of OVERLAY\n");
+	printf("sparse   creates an empty sparse image which only grows when written to\n");
+	printf("info     shows the base image and the number of changed blocks\n");
+	printf("commit   writes the changed blocks into the base image and empties the\n");
+	printf("         overlay; other overlays of the same base can't be opened\n");
+	printf("         afterwards, so this has to be confirmed with --force\n");
+	printf("flatten  writes the complete disk to a new plain image file\n");
+	exit(1);
+}
+
+
+/*
+ *  Open overlay for reading
+ */
+
+static cow_image *open_overlay(const char *name, int &fd)
+{
+	fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		printf("Cannot open %s (%s)\n", name, strerror(errno));
+		return NULL;
+	}
+	cow_image *img = cow_image_open(name, fd, true);
+	if (img == NULL)
+		close(fd);
+	return img;
+}
+
+
+/*
+ *  Print overlay parameters
+ */
+
+static bool info(const char *name)
+{
+	int fd;
+	cow_image *img = open_overlay(name, fd);
+	if (img == NULL)
+		return false;
+
+	const char *base_name;
+	uint32 block_size, num_blocks, num_allocated;
+	cow_image_info(img, base_name, block_size, num_blocks, num_allocated);
+	printf("Base image:     %s\n", base_name[0] ? base_name : "none (sparse image)");
+	printf("Disk size:      %llu bytes\n", (unsigned long long)cow_image_size(img));
+	printf("Block size:     %u bytes\n", block_size);
+	printf("Changed blocks: %u of %u (%u KB)\n", num_allocated, num_blocks, uint32((uint64)num_allocated * block_size / 1024));
+
+	cow_image_close(img);
+	close(fd);
+	return true;
+}
+
+
+/*
+ *  Copy virtual disk to plain image file
+ */
+
+static bool flatten(const char *name, const char *out_name)
+{
+	int fd;
+	cow_image *img = open_overlay(name, fd);
+	if (img == NULL)
+		return false;
+
+	int out_fd = open(out_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (out_fd < 0) {
+		printf("Cannot create %s (%s)\n", out_name, strerror(errno));
+		cow_image_close(img);
+		close(fd);
+		return false;
+	}
+
+	const size_t BUFFER_SIZE = 1024 * 1024;
+	uint8 *buffer = new uint8[BUFFER_SIZE];
+	loff_t size = cow_image_size(img);
+	bool ok = true;
+	for (loff_t pos = 0; pos < size && ok; pos += BUFFER_SIZE) {
+		size_t n = BUFFER_SIZE;
+		if ((loff_t)n > size - pos)
+			n = size - pos;
+		ok = cow_image_read(img, buffer, pos, n) == n && write(out_fd, buffer, n) == ssize_t(n);
+	}
+	delete[] buffer;
+	if (close(out_fd) < 0)
+		ok = false;
+	if (!ok)
+		printf("Writing %s failed (%s)\n", out_name, strerror(errno));
+
+	cow_image_close(img);
+	close(fd);
+	return ok;
+}
+
+
+/*
+ *  Main program
+ */
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		usage(argv[0]);
+
+	bool ok;
+	if (strcmp(argv[1], "create") == 0 && (argc == 4 || argc == 5)) {
+		uint32 block_size = COW_DEFAULT_BLOCK_SIZE;
+		if (argc == 5)
+			block_size = atoi(argv[4]) * 1024;
+		ok = cow_image_create(argv[2], argv[3], block_size);
+	} else if (strcmp(argv[1], "sparse") == 0 && (argc == 4 || argc == 5)) {
+		uint32 block_size = COW_DEFAULT_BLOCK_SIZE;
+		if (argc == 5)
+			block_size = atoi(argv[4]) * 1024;
+		ok = cow_image_create_sparse(argv[2], (loff_t)atoi(argv[3]) * 1024 * 1024, block_size);
+	} else if (strcmp(argv[1], "info") == 0 && argc == 3)
+		ok = info(argv[2]);
+	else if (strcmp(argv[1], "commit") == 0 && argc == 3) {
+		printf("Committing %s changes its base image, other overlays of it can't be used any more.\n", argv[2]);
+		printf("Use \"%s commit --force %s\" to commit anyway.\n", argv[0], argv[2]);
+		ok = false;
+	} else if (strcmp(argv[1], "commit") == 0 && argc == 4 && strcmp(argv[2], "--force") == 0)
+		ok = cow_image_commit(argv[3]);
+	else if (strcmp(argv[1], "flatten") == 0 && argc == 4)
+		ok = flatten(argv[2], argv[3]);
+	else
+		usage(argv[0]);
+	return ok ? 0 : 1;
+}
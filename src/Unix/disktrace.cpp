@@ -0,0 +1,577 @@
+/*
+ *  disktrace.cpp - Inspect and replay disk I/O traces
+ *  Compile as: make disktrace
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  A trace recorded with the "disktrace" prefs item is replayed through the
+ *  same layers the emulator uses for disk image files: overlay/compressed
+ *  image access, image header detection and the block cache. The cache is
+ *  configured with command line options instead of prefs items, so the
+ *  effect of different cache settings can be measured with the same
+ *  workload.
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/time.h>
+
+#include "main.h"
+#include "block_cache.h"
+#include "cow_image.h"
+#include "zimage.h"
+#include "disk_trace.h"
+
+
+// Cache settings (replace prefs items)
+static int32 cache_size = 0;			// "blockcache" in MB
+static int32 cache_chunk = 64;			// "blockcachechunk" in KB
+static int32 prefetch_size = 0;			// "prefetch" in KB
+static bool write_back = false;			// "blockcachewb"
+
+// Image opened for replay
+struct image {
+	int drive;					// Mac drive number
+	const char *name;
+	int fd;
+	bool read_only;
+	loff_t start_byte;			// Size of file header
+	cow_image *cow;
+	zimage *zimg;
+	block_cache_file *cache;
+};
+
+// Latency histogram
+const int NUM_BUCKETS = 7;
+static const uint32 bucket_limit[NUM_BUCKETS - 1] = {10, 100, 1000, 10000, 100000, 1000000};
+static const char *bucket_name[NUM_BUCKETS] = {"<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s"};
+
+struct latency_stats {
+	uint32 count;
+	uint64 sum;
+	uint32 max;
+	uint32 buckets[NUM_BUCKETS];
+};
+
+
+static void usage(const char *prg)
+{
+	printf("Usage: %s dump TRACE\n", prg);
+	printf("       %s replay [OPTIONS] TRACE DRIVE=IMAGE...\n", prg);
+	printf("\n");
+	printf("dump     lists the recorded requests, oldest first\n");
+	printf("replay   issues the recorded requests of the given Mac drive numbers\n");
+	printf("         to disk image files and compares the latencies\n");
+	printf("\n");
+	printf("Replay options:\n");
+	printf("  -c MB   block cache size (default off)\n");
+	printf("  -k KB   block cache chunk size (default 64)\n");
+	printf("  -p KB   maximum read-ahead window (default off)\n");
+	printf("  -b      write back cache\n");
+	printf("  -t      keep the recorded time between requests\n");
+	printf("  -w      execute write requests, which modifies the images\n");
+	exit(1);
+}
+
+
+/*
+ *  Replacements for emulator functions used by the disk layers
+ */
+
+const char *PrefsFindString(const char *name, int index)
+{
+	return NULL;
+}
+
+bool PrefsFindBool(const char *name)
+{
+	if (strcmp(name, "blockcachewb") == 0)
+		return write_back;
+	return false;
+}
+
+int32 PrefsFindInt32(const char *name)
+{
+	if (strcmp(name, "blockcache") == 0)
+		return cache_size;
+	else if (strcmp(name, "blockcachechunk") == 0)
+		return cache_chunk;
+	else if (strcmp(name, "prefetch") == 0)
+		return prefetch_size;
+	return 0;
+}
+
+struct B2_mutex {
+	pthread_mutex_t m;
+};
+
+B2_mutex *B2_create_mutex(void)
+{
+	B2_mutex *mutex = new B2_mutex;
+	pthread_mutex_init(&mutex->m, NULL);
+	return mutex;
+}
+
+void B2_lock_mutex(B2_mutex *mutex)
+{
+	pthread_mutex_lock(&mutex->m);
+}
+
+void B2_unlock_mutex(B2_mutex *mutex)
+{
+	pthread_mutex_unlock(&mutex->m);
+}
+
+void B2_delete_mutex(B2_mutex *mutex)
+{
+	pthread_mutex_destroy(&mutex->m);
+	delete mutex;
+}
+
+#if BLOCK_CACHE_PREFETCH
+static pthread_t prefetch_thread;
+static sem_t prefetch_signal;
+static volatile bool prefetch_thread_cancel;
+
+static void *prefetch_func(void *arg)
+{
+	while (!prefetch_thread_cancel) {
+		sem_wait(&prefetch_signal);
+		if (prefetch_thread_cancel)
+			break;
+		BlockCachePrefetch();
+	}
+	return NULL;
+}
+
+bool block_cache_prefetch_start(void)
+{
+	prefetch_thread_cancel = false;
+	if (sem_init(&prefetch_signal, 0, 0) < 0)
+		return false;
+	if (pthread_create(&prefetch_thread, NULL, prefetch_func, NULL) != 0) {
+		sem_destroy(&prefetch_signal);
+		return false;
+	}
+	return true;
+}
+
+void block_cache_prefetch_stop(void)
+{
+	prefetch_thread_cancel = true;
+	sem_post(&prefetch_signal);
+	pthread_join(prefetch_thread, NULL);
+	sem_destroy(&prefetch_signal);
+}
+
+void block_cache_prefetch_wakeup(void)
+{
+	sem_post(&prefetch_signal);
+}
+#endif
+
+// Same as FileDiskLayout() in macos_util.cpp
+static loff_t image_start_byte(loff_t size)
+{
+	if (size == 419284 || size == 838484)
+		return 84;
+	return size & 0x1ff;
+}
+
+
+/*
+ *  Host time in microseconds
+ */
+
+static uint64 now_usec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+/*
+ *  Big-endian fields
+ */
+
+static uint16 get_be16(const uint8 *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static uint32 get_be32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64 get_be64(const uint8 *p)
+{
+	return ((uint64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+
+/*
+ *  Read trace file, returns records in chronological order
+ */
+
+static uint8 *load_trace(const char *name, uint32 &num_records)
+{
+	int fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		printf("Cannot open %s (%s)\n", name, strerror(errno));
+		return NULL;
+	}
+
+	uint8 header[DTRACE_HEADER_SIZE];
+	if (read(fd, header, DTRACE_HEADER_SIZE) != DTRACE_HEADER_SIZE
+	 || memcmp(header + DTRACE_MAGIC, "B2DTRACE", 8) != 0
+	 || get_be32(header + DTRACE_VERSION) != 1
+	 || get_be32(header + DTRACE_RECORD_SIZE) != DTREC_SIZE
+	 || get_be32(header + DTRACE_CAPACITY) == 0) {
+		printf("%s is not a disk trace file\n", name);
+		close(fd);
+		return NULL;
+	}
+	uint32 capacity = get_be32(header + DTRACE_CAPACITY);
+	uint64 total = get_be64(header + DTRACE_TOTAL);
+
+	// When the ring has wrapped, the oldest record is in the next slot to be written
+	uint32 first = 0;
+	num_records = total;
+	if (total > capacity) {
+		first = total % capacity;
+		num_records = capacity;
+	}
+
+	uint8 *ring = new uint8[(size_t)num_records * DTREC_SIZE];
+	ssize_t ring_size = (ssize_t)num_records * DTREC_SIZE;
+	bool ok = read(fd, ring, ring_size) == ring_size;
+	close(fd);
+	if (!ok) {
+		printf("%s is truncated\n", name);
+		delete[] ring;
+		return NULL;
+	}
+	if (first == 0)
+		return ring;
+
+	uint8 *records = new uint8[(size_t)num_records * DTREC_SIZE];
+	size_t tail = (size_t)(num_records - first) * DTREC_SIZE;
+	memcpy(records, ring + (size_t)first * DTREC_SIZE, tail);
+	memcpy(records + tail, ring, (size_t)first * DTREC_SIZE);
+	delete[] ring;
+	return records;
+}
+
+
+/*
+ *  Latency statistics
+ */
+
+static void add_latency(latency_stats &s, uint32 usec)
+{
+	s.count++;
+	s.sum += usec;
+	if (usec > s.max)
+		s.max = usec;
+	int b = 0;
+	while (b < NUM_BUCKETS - 1 && usec >= bucket_limit[b])
+		b++;
+	s.buckets[b]++;
+}
+
+static void print_latencies(const latency_stats &traced, const latency_stats &replayed)
+{
+	printf("%-10s %12s %12s\n", "Latency", "Traced", "Replayed");
+	for (int b=0; b<NUM_BUCKETS; b++)
+		printf("%-10s %12u %12u\n", bucket_name[b], traced.buckets[b], replayed.buckets[b]);
+	printf("%-10s %10lluus %10lluus\n", "Mean",
+		(unsigned long long)(traced.count ? traced.sum / traced.count : 0),
+		(unsigned long long)(replayed.count ? replayed.sum / replayed.count : 0));
+	printf("%-10s %10uus %10uus\n", "Max", traced.max, replayed.max);
+}
+
+
+/*
+ *  List records
+ */
+
+static bool dump(const char *name)
+{
+	uint32 num_records;
+	uint8 *records = load_trace(name, num_records);
+	if (records == NULL)
+		return false;
+
+	printf("%12s %6s %6s %-6s %14s %8s %8s %10s\n", "Time(us)", "Drive", "RefNum", "Type", "Offset", "Length", "Actual", "Latency");
+	uint64 bytes = 0;
+	latency_stats traced;
+	memset(&traced, 0, sizeof(traced));
+	for (uint32 i=0; i<num_records; i++) {
+		const uint8 *r = records + (size_t)i * DTREC_SIZE;
+		uint8 flags = r[DTREC_FLAGS];
+		printf("%12llu %6d %6d %-6s %14llu %8u %8u %10u\n",
+			(unsigned long long)get_be64(r + DTREC_TIME),
+			int16(get_be16(r + DTREC_DRIVE)), int16(get_be16(r + DTREC_REFNUM)),
+			(flags & DTREC_WRITE) ? ((flags & DTREC_ASYNC) ? "WRITEA" : "WRITE") : ((flags & DTREC_ASYNC) ? "READA" : "READ"),
+			(unsigned long long)get_be64(r + DTREC_OFFSET),
+			get_be32(r + DTREC_LENGTH), get_be32(r + DTREC_ACTUAL), get_be32(r + DTREC_LATENCY));
+		bytes += get_be32(r + DTREC_ACTUAL);
+		add_latency(traced, get_be32(r + DTREC_LATENCY));
+	}
+	printf("%u requests, %llu bytes, mean latency %lluus\n", num_records, (unsigned long long)bytes,
+		(unsigned long long)(traced.count ? traced.sum / traced.count : 0));
+	delete[] records;
+	return true;
+}
+
+
+/*
+ *  Uncached image access, called by the block cache
+ */
+
+static size_t read_raw(void *arg, void *buffer, loff_t offset, size_t length)
+{
+	image *img = (image *)arg;
+	if (img->cow)
+		return cow_image_read(img->cow, buffer, offset + img->start_byte, length);
+	else if (img->zimg)
+		return zimage_read(img->zimg, buffer, offset + img->start_byte, length);
+	ssize_t actual = pread(img->fd, buffer, length, offset + img->start_byte);
+	return actual < 0 ? 0 : actual;
+}
+
+static size_t write_raw(void *arg, void *buffer, loff_t offset, size_t length)
+{
+	image *img = (image *)arg;
+	if (img->cow)
+		return cow_image_write(img->cow, buffer, offset + img->start_byte, length);
+	else if (img->zimg)
+		return 0;
+	ssize_t actual = pwrite(img->fd, buffer, length, offset + img->start_byte);
+	return actual < 0 ? 0 : actual;
+}
+
+
+/*
+ *  Open image like Sys_open() does, returns false on error
+ */
+
+static bool open_image(image &img, bool writable)
+{
+	img.read_only = !writable;
+	img.cow = NULL;
+	img.zimg = NULL;
+	img.cache = NULL;
+	img.fd = open(img.name, writable ? O_RDWR : O_RDONLY);
+	if (img.fd < 0) {
+		printf("Cannot open %s (%s)\n", img.name, strerror(errno));
+		return false;
+	}
+
+	uint8 data[256];
+	memset(data, 0, sizeof(data));
+	loff_t size = lseek(img.fd, 0, SEEK_END);
+	if (pread(img.fd, data, sizeof(data), 0) < 0)
+		size = 0;
+	if (cow_image_check(data)) {
+		img.cow = cow_image_open(img.name, img.fd, img.read_only);
+		if (img.cow == NULL) {
+			close(img.fd);
+			return false;
+		}
+		size = cow_image_size(img.cow);
+	} else if (zimage_check(data)) {
+		img.zimg = zimage_open(img.name, img.fd);
+		if (img.zimg == NULL) {
+			close(img.fd);
+			return false;
+		}
+		img.read_only = true;
+		size = zimage_size(img.zimg);
+	}
+	img.start_byte = image_start_byte(size);
+	img.cache = block_cache_open(&img, read_raw, write_raw, !img.read_only && write_back);
+	return true;
+}
+
+static void close_image(image &img)
+{
+	if (img.cache)
+		block_cache_close(img.cache);
+	cow_image_close(img.cow);
+	zimage_close(img.zimg);
+	close(img.fd);
+}
+
+
+/*
+ *  Replay records of mapped drives
+ */
+
+static bool replay(const char *name, image *images, int num_images, bool keep_timing, bool execute_writes)
+{
+	uint32 num_records;
+	uint8 *records = load_trace(name, num_records);
+	if (records == NULL)
+		return false;
+
+	BlockCacheInit();
+	int num_open = 0;
+	bool ok = true;
+	for (; num_open<num_images && ok; num_open++)
+		ok = open_image(images[num_open], execute_writes);
+	if (!ok)
+		num_open--;
+
+	// Buffer for largest request
+	uint32 max_length = 0;
+	for (uint32 i=0; i<num_records; i++) {
+		uint32 length = get_be32(records + (size_t)i * DTREC_SIZE + DTREC_LENGTH);
+		if (length > max_length)
+			max_length = length;
+	}
+	uint8 *buffer = new uint8[max_length ? max_length : 1];
+	memset(buffer, 0, max_length);
+
+	latency_stats traced, replayed;
+	memset(&traced, 0, sizeof(traced));
+	memset(&replayed, 0, sizeof(replayed));
+	uint32 num_skipped = 0, num_short = 0;
+	uint64 bytes = 0;
+	uint64 first_time = num_records ? get_be64(records + DTREC_TIME) : 0;
+	uint64 replay_start = now_usec();
+
+	for (uint32 i=0; i<num_records && ok; i++) {
+		const uint8 *r = records + (size_t)i * DTREC_SIZE;
+		int drive = int16(get_be16(r + DTREC_DRIVE));
+		bool write = r[DTREC_FLAGS] & DTREC_WRITE;
+		image *img = NULL;
+		for (int j=0; j<num_images; j++)
+			if (images[j].drive == drive)
+				img = images + j;
+		if (img == NULL || (write && (!execute_writes || img->read_only))) {
+			num_skipped++;
+			continue;
+		}
+
+		// Wait for recorded start time
+		if (keep_timing) {
+			uint64 due = replay_start + (get_be64(r + DTREC_TIME) - first_time);
+			uint64 now = now_usec();
+			if (due > now)
+				usleep(due - now);
+		}
+
+		loff_t offset = get_be64(r + DTREC_OFFSET);
+		uint32 length = get_be32(r + DTREC_LENGTH);
+		uint64 start = now_usec();
+		size_t actual;
+		if (write)
+			actual = img->cache ? block_cache_write(img->cache, buffer, offset, length) : write_raw(img, buffer, offset, length);
+		else
+			actual = img->cache ? block_cache_read(img->cache, buffer, offset, length) : read_raw(img, buffer, offset, length);
+		add_latency(replayed, uint32(now_usec() - start));
+		add_latency(traced, get_be32(r + DTREC_LATENCY));
+		if (actual != get_be32(r + DTREC_ACTUAL))
+			num_short++;
+		bytes += actual;
+	}
+
+	// Flushing write-back data is part of the workload
+	for (int j=0; j<num_open; j++)
+		close_image(images[j]);
+	uint64 elapsed = now_usec() - replay_start;
+	BlockCacheExit();
+
+	if (ok) {
+		printf("%u requests replayed, %u skipped, %u with different transfer size\n", replayed.count, num_skipped, num_short);
+		printf("%llu bytes in %.3fs (%.2f MB/s)\n", (unsigned long long)bytes, elapsed / 1e6,
+			elapsed ? (bytes / 1048576.0) / (elapsed / 1e6) : 0.0);
+		print_latencies(traced, replayed);
+	}
+	delete[] buffer;
+	delete[] records;
+	return ok;
+}
+
+
+/*
+ *  Main program
+ */
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		usage(argv[0]);
+
+	if (strcmp(argv[1], "dump") == 0) {
+		if (argc != 3)
+			usage(argv[0]);
+		return dump(argv[2]) ? 0 : 1;
+	} else if (strcmp(argv[1], "replay") != 0)
+		usage(argv[0]);
+
+	bool keep_timing = false, execute_writes = false;
+	int i = 2;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			cache_size = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+			cache_chunk = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			prefetch_size = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-b") == 0)
+			write_back = true;
+		else if (strcmp(argv[i], "-t") == 0)
+			keep_timing = true;
+		else if (strcmp(argv[i], "-w") == 0)
+			execute_writes = true;
+		else
+			usage(argv[0]);
+	}
+	if (argc - i < 2)
+		usage(argv[0]);
+	const char *trace_name = argv[i++];
+
+	// Parse drive mapping
+	int num_images = argc - i;
+	image *images = new image[num_images];
+	for (int j=0; j<num_images; j++) {
+		char *eq = strchr(argv[i + j], '=');
+		if (eq == NULL || eq == argv[i + j])
+			usage(argv[0]);
+		*eq = 0;
+		images[j].drive = atoi(argv[i + j]);
+		images[j].name = eq + 1;
+	}
+
+	bool ok = replay(trace_name, images, num_images, keep_timing, execute_writes);
+	delete[] images;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+/*
+ *  ether_bench.cpp - Benchmark Ethernet packet reception
+ *  Compile as: make ether_bench
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  ether_unix.cpp is compiled into this program, the rest of the emulator
+ *  is replaced by stubs below. A peer thread stands in for the sheep_net
+ *  device and sends frames through a datagram socket pair as fast as they
+ *  are read. The main thread plays the emulated CPU: it watches the
+ *  interrupt flag, calls EtherInterrupt() and runs a protocol handler
+ *  which copies each packet like ReadPacket does, optionally spending
+ *  some extra time per packet. Reception through the receive ring is
+ *  compared with the acknowledge per wakeup used when the ring can't be
+ *  allocated.
+ */
+
+#include "sysdeps.h"
+#undef HAVE_SLIRP			// Only the sheep_net path is measured
+
+#include <sys/time.h>
+#include <sched.h>
+
+#include "ether_unix.cpp"
+
+
+/*
+ *  Replacements for emulator functions used by ether_unix.cpp
+ */
+
+const uint32 RAM_SIZE = 1024 * 1024;
+static uint8 *ram;
+static uint32 ram_top;
+static bool use_ring;				// Let the receive ring allocation succeed?
+static uint32 legacy_packet;
+
+#if DIRECT_ADDRESSING
+uintptr MEMBaseDiff = 0;
+#endif
+
+uint32 ether_data = 0;
+uint32 InterruptFlags = 0;
+
+static uint32 mac_alloc(uint32 size)
+{
+	if (ram_top + size > RAM_SIZE)
+		return 0;
+	uint32 a = ram_top;
+	ram_top += (size + 15) & ~15;
+	return a;
+}
+
+void SetInterruptFlag(uint32 flag) { __sync_fetch_and_or(&InterruptFlags, flag); }
+void ClearInterruptFlag(uint32 flag) { __sync_fetch_and_and(&InterruptFlags, ~flag); }
+void TriggerInterrupt(void) {}
+void Delay_usec(uint32 usec) { usleep(usec); }
+void Set_pthread_attr(pthread_attr_t *attr, int priority) { pthread_attr_init(attr); }
+const char *GetString(int num) { return "Unix"; }
+const char *PrefsFindString(const char *name, int index) { return NULL; }
+void WarningAlert(const char *text) { printf("WARNING: %s\n", text); }
+int ether_udp_receive(uint32 packet) { return 0; }
+#if USE_ETHER_CAPTURE
+bool EtherCaptureEnabled = false;
+void ether_capture_packet(const uint8 *packet, int len) {}
+void EtherCaptureService(void) {}
+#endif
+
+#if !(SIZEOF_VOID_P == 4 && REAL_ADDRESSING)
+EthernetPacket::EthernetPacket() { packet = legacy_packet; }
+EthernetPacket::~EthernetPacket() {}
+#endif
+
+extern "C" void Execute68kTrap(uint16 trap, M68kRegisters *r)
+{
+	// NewPtrSysClear() for the receive ring
+	r->a[0] = use_ring ? mac_alloc(r->d[0]) : 0;
+}
+
+
+/*
+ *  Protocol handler
+ */
+
+static volatile uint32 num_received;
+static uint32 num_lost;
+static int handler_usec;
+
+static double now_sec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+extern "C" void Execute68k(uint32 addr, M68kRegisters *r)
+{
+	// Copy packet like ReadPacket and check its sequence number
+	uint8 data[1514];
+	memcpy(data, Mac2HostAddr(r->a[0]), r->d[1]);
+	uint32 seq = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+	if (seq != num_received)
+		num_lost += seq - num_received;
+	num_received = seq + 1;
+
+	// Time spent by the Mac protocol stack
+	if (handler_usec) {
+		double end = now_sec() + handler_usec * 1e-6;
+		while (now_sec() < end) ;
+	}
+}
+
+
+/*
+ *  Stand-in peer
+ */
+
+static int peer_fd;
+static uint32 peer_packets;
+static int peer_length;
+
+static void *peer_func(void *arg)
+{
+	uint8 frame[1514];
+	memset(frame, 0, sizeof(frame));
+	memset(frame, 0xff, 6);						// Destination: broadcast
+	memcpy(frame + 6, "\x52\x54\x00\x12\x34\x57", 6);
+	frame[12] = 0x08;							// Type: IP
+	for (uint32 i=0; i<peer_packets; i++) {
+		frame[14] = i >> 24;
+		frame[15] = i >> 16;
+		frame[16] = i >> 8;
+		frame[17] = i;
+		if (write(peer_fd, frame, peer_length) < 0)
+			break;
+	}
+	return NULL;
+}
+
+
+/*
+ *  Benchmark
+ */
+
+static bool run(bool ring, uint32 packets, int length)
+{
+	// Set up emulated driver
+	ram_top = 0x1000;
+	use_ring = ring;
+	ether_data = mac_alloc(SIZEOF_etherdata);
+	legacy_packet = mac_alloc(1516);
+	rx_ring = 0;
+	rx_ring_failed = false;
+	rx_head = rx_tail = 0;
+	memset(&counters, 0, sizeof(counters));
+	net_protocols.clear();
+	net_protocols[0x0800] = 0x1234;				// Any non-zero handler address
+	num_received = num_lost = 0;
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0) {
+		perror("socketpair");
+		return false;
+	}
+	fd = sv[0];
+	int nonblock = 1;
+	ioctl(fd, FIONBIO, &nonblock);
+	net_if_type = NET_IF_SHEEPNET;
+	udp_tunnel = false;
+	if (!start_thread())
+		return false;
+
+	peer_fd = sv[1];
+	peer_packets = packets;
+	peer_length = length;
+	pthread_t peer;
+	double start = now_sec();
+	pthread_create(&peer, NULL, peer_func, NULL);
+
+	// Emulated CPU, handle Ethernet interrupts until all packets arrived
+	while (num_received < packets) {
+		if (*(volatile uint32 *)&InterruptFlags & INTFLAG_ETHER) {
+			ClearInterruptFlag(INTFLAG_ETHER);
+			EtherInterrupt();
+		} else
+			sched_yield();
+	}
+	double elapsed = now_sec() - start;
+
+	pthread_join(peer, NULL);
+	stop_thread();
+	close(sv[0]);
+	close(sv[1]);
+
+	printf("%-8s %10.0f %10.1f %10u %10.1f %10u %8u\n", ring ? "ring" : "ack",
+		counters.rx_packets / elapsed, counters.rx_bytes / elapsed / 1e6,
+		counters.rx_interrupts, (double)counters.rx_packets / counters.rx_interrupts,
+		counters.rx_ring_full, num_lost);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	uint32 packets = 200000;
+	int length = 1514;
+	if (argc > 1)
+		packets = atoi(argv[1]);
+	if (argc > 2)
+		handler_usec = atoi(argv[2]);
+	if (argc > 3)
+		length = atoi(argv[3]);
+	if (packets == 0 || handler_usec < 0 || length < 18 || length > 1514) {
+		printf("Usage: %s [PACKETS [HANDLER_USEC [LENGTH]]]\n", argv[0]);
+		return 1;
+	}
+
+	ram = new uint8[RAM_SIZE];
+#if DIRECT_ADDRESSING
+	MEMBaseDiff = (uintptr)ram;
+#endif
+
+	printf("%u packets of %d bytes, %d usec per packet in protocol handler\n", packets, length, handler_usec);
+	printf("%-8s %10s %10s %10s %10s %10s %8s\n", "Mode", "packets/s", "MB/s", "IRQs", "pkts/IRQ", "ring full", "lost");
+	if (!run(false, packets, length) || !run(true, packets, length))
+		return 1;
+
+	delete[] ram;
+	return 0;
+}
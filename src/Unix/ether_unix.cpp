@@ -33,15 +33,13 @@
 #define USE_POLL 1
 #endif
 
-// Define to let the slirp library determine the right timeout for select()
-#define USE_SLIRP_TIMEOUT 1
-
 #ifdef HAVE_SYS_POLL_H
 #include <sys/poll.h>
 #endif
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -64,10 +62,6 @@
 #include <net/if_tun.h>
 #endif
 
-#ifdef HAVE_SLIRP
-#include "libslirp.h"
-#endif
-
 #include "cpu_emulation.h"
 #include "main.h"
 #include "macos_util.h"
@@ -75,6 +69,8 @@
 #include "user_strings.h"
 #include "ether.h"
 #include "ether_defs.h"
+#include "ether_slirp.h"
+#include "ether_capture.h"
 
 #ifndef NO_STD_NAMESPACE
 using std::map;
@@ -108,10 +104,8 @@ static bool udp_tunnel;						// Flag: UDP tunnelling active, fd is the socket de
 static int net_if_type = -1;				// Ethernet device type
 static char *net_if_name = NULL;			// TUN/TAP device name
 static const char *net_if_script = NULL;	// Network config script
-static pthread_t slirp_thread;				// Slirp reception thread
-static bool slirp_thread_active = false;	// Flag: Slirp reception threadinstalled
-static int slirp_output_fd = -1;			// fd of slirp output pipe
-static int slirp_input_fds[2] = { -1, -1 };	// fds of slirp input pipe
+static pthread_t slirp_thread;				// Slirp worker thread
+static bool slirp_thread_active = false;	// Flag: Slirp worker thread installed
 #ifdef SHEEPSHAVER
 static bool net_open = false;				// Flag: initialization succeeded, network device open
 static uint8 ether_addr[6];					// Our Ethernet address
@@ -122,6 +116,29 @@ const bool ether_driver_opened = true;		// Flag: is the MacOS driver opened?
 // Attached network protocols, maps protocol type to MacOS handler address
 static map<uint16, uint32> net_protocols;
 
+#ifndef SHEEPSHAVER
+// Receive ring of Mac-side packet buffers, filled by the reception thread
+// and drained by the Ethernet interrupt without an acknowledge per packet
+const int RX_RING_SIZE = 32;				// Number of buffers (power of 2)
+const int RX_BUFFER_SIZE = 1520;			// Size of one buffer (1514 bytes plus Linux ethertap header, long aligned)
+static volatile uint32 rx_ring = 0;			// Mac address of buffers, 0 = not allocated yet
+static bool rx_ring_failed = false;			// Flag: allocation of receive ring failed
+static volatile uint32 rx_head = 0;			// Next buffer to fill (reception thread)
+static volatile uint32 rx_tail = 0;			// Next buffer to dispatch (Ethernet interrupt)
+static volatile bool rx_ring_waiting = false;	// Flag: ring full, interrupt reads device until drained
+static pthread_mutex_t rx_ring_lock = PTHREAD_MUTEX_INITIALIZER;	// Held by reception thread while filling a buffer
+static int rx_length[RX_RING_SIZE];			// Lengths of received packets
+#endif
+
+// Throughput counters
+struct ether_counters {
+	uint32 rx_packets, tx_packets;
+	uint64 rx_bytes, tx_bytes;
+	uint32 rx_interrupts;					// Ethernet interrupts handled
+	uint32 rx_ring_full;					// Times the reception thread waited for free buffers
+};
+static ether_counters counters;
+
 // Prototypes
 static void *receive_func(void *arg);
 static void *slirp_receive_func(void *arg);
@@ -143,23 +160,25 @@ static bool start_thread(void)
 		return false;
 	}
 
-	Set_pthread_attr(&ether_thread_attr, 1);
-	thread_active = (pthread_create(&ether_thread, &ether_thread_attr, receive_func, NULL) == 0);
-	if (!thread_active) {
-		printf("WARNING: Cannot start Ethernet thread");
-		return false;
-	}
-
 #ifdef HAVE_SLIRP
+	// The slirp worker thread also triggers the Ethernet interrupt
 	if (net_if_type == NET_IF_SLIRP) {
 		slirp_thread_active = (pthread_create(&slirp_thread, NULL, slirp_receive_func, NULL) == 0);
 		if (!slirp_thread_active) {
 			printf("WARNING: Cannot start slirp reception thread\n");
+			sem_destroy(&int_ack);
 			return false;
 		}
+		return true;
 	}
 #endif
 
+	Set_pthread_attr(&ether_thread_attr, 1);
+	thread_active = (pthread_create(&ether_thread, &ether_thread_attr, receive_func, NULL) == 0);
+	if (!thread_active) {
+		printf("WARNING: Cannot start Ethernet thread");
+		return false;
+	}
 	return true;
 }
 
@@ -176,6 +195,7 @@ static void stop_thread(void)
 		pthread_cancel(slirp_thread);
 #endif
 		pthread_join(slirp_thread, NULL);
+		sem_destroy(&int_ack);
 		slirp_thread_active = false;
 	}
 #endif
@@ -262,22 +282,11 @@ bool ether_init(void)
 #ifdef HAVE_SLIRP
 	// Initialize slirp library
 	if (net_if_type == NET_IF_SLIRP) {
-		if (slirp_init() < 0) {
+		if (!ether_slirp_init(NULL)) {
 			sprintf(str, GetString(STR_SLIRP_NO_DNS_FOUND_WARN));
 			WarningAlert(str);
 			return false;
 		}
-
-		// Open slirp output pipe
-		int fds[2];
-		if (pipe(fds) < 0)
-			return false;
-		fd = fds[0];
-		slirp_output_fd = fds[1];
-
-		// Open slirp input pipe
-		if (pipe(slirp_input_fds) < 0)
-			return false;
 	}
 #endif
 
@@ -347,20 +356,22 @@ bool ether_init(void)
 #endif
 
 	// Set nonblocking I/O
+	if (net_if_type != NET_IF_SLIRP) {
 #ifdef USE_FIONBIO
-	if (ioctl(fd, FIONBIO, &nonblock) < 0) {
-		sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
-		WarningAlert(str);
-		goto open_error;
-	}
+		if (ioctl(fd, FIONBIO, &nonblock) < 0) {
+			sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
+			WarningAlert(str);
+			goto open_error;
+		}
 #else
-	val = fcntl(fd, F_GETFL, 0);
-	if (val < 0 || fcntl(fd, F_SETFL, val | O_NONBLOCK) < 0) {
-		sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
-		WarningAlert(str);
-		goto open_error;
-	}
+		val = fcntl(fd, F_GETFL, 0);
+		if (val < 0 || fcntl(fd, F_SETFL, val | O_NONBLOCK) < 0) {
+			sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
+			WarningAlert(str);
+			goto open_error;
+		}
 #endif
+	}
 
 	// Get Ethernet address
 	if (net_if_type == NET_IF_ETHERTAP) {
@@ -373,12 +384,7 @@ bool ether_init(void)
 		ether_addr[5] = p;
 #ifdef HAVE_SLIRP
 	} else if (net_if_type == NET_IF_SLIRP) {
-		ether_addr[0] = 0x52;
-		ether_addr[1] = 0x54;
-		ether_addr[2] = 0x00;
-		ether_addr[3] = 0x12;
-		ether_addr[4] = 0x34;
-		ether_addr[5] = 0x56;
+		memcpy(ether_addr, ether_slirp_addr, 6);
 #endif
 	} else
 		ioctl(fd, SIOCGIFADDR, ether_addr);
@@ -398,18 +404,10 @@ open_error:
 		close(fd);
 		fd = -1;
 	}
-	if (slirp_input_fds[0] >= 0) {
-		close(slirp_input_fds[0]);
-		slirp_input_fds[0] = -1;
-	}
-	if (slirp_input_fds[1] >= 0) {
-		close(slirp_input_fds[1]);
-		slirp_input_fds[1] = -1;
-	}
-	if (slirp_output_fd >= 0) {
-		close(slirp_output_fd);
-		slirp_output_fd = -1;
-	}
+#ifdef HAVE_SLIRP
+	if (net_if_type == NET_IF_SLIRP)
+		ether_slirp_exit();
+#endif
 	return false;
 }
 
@@ -435,18 +433,18 @@ void ether_exit(void)
 	if (fd > 0)
 		close(fd);
 
-	// Close slirp input buffer
-	if (slirp_input_fds[0] >= 0)
-		close(slirp_input_fds[0]);
-	if (slirp_input_fds[1] >= 0)
-		close(slirp_input_fds[1]);
-
-	// Close slirp output buffer
-	if (slirp_output_fd > 0)
-		close(slirp_output_fd);
+#ifdef HAVE_SLIRP
+	// Discard queued slirp packets, close the wakeup pipe
+	if (net_if_type == NET_IF_SLIRP)
+		ether_slirp_exit();
+#endif
 
 #if STATISTICS
 	// Show statistics
+	printf("%u packets received (%llu bytes) in %u interrupts\n", counters.rx_packets, (unsigned long long)counters.rx_bytes, counters.rx_interrupts);
+	printf("%u packets transmitted (%llu bytes)\n", counters.tx_packets, (unsigned long long)counters.tx_bytes);
+	printf("receive ring was full %u times\n", counters.rx_ring_full);
+#ifdef SHEEPSHAVER
 	printf("%ld messages put on write queue\n", num_wput);
 	printf("%ld error acks\n", num_error_acks);
 	printf("%ld packets transmitted (%ld raw, %ld normal)\n", num_tx_packets, num_tx_raw_packets, num_tx_normal_packets);
@@ -459,6 +457,7 @@ void ether_exit(void)
 	printf("%ld rx packets dropped because stream not ready\n", num_rx_stream_not_ready);
 	printf("%ld rx packets dropped because no memory for unitdata_ind\n", num_rx_no_unitdata_mem);
 #endif
+#endif
 }
 
 
@@ -588,6 +587,8 @@ static inline int ether_arg_to_buffer(uint32 wds, uint8 *p)
 // Dispatch packet to protocol handler
 static void ether_dispatch_packet(uint32 p, uint32 length)
 {
+	EtherCapture(Mac2HostAddr(p), length);
+
 	// Get packet type
 	uint16 type = ReadMacInt16(p + 12);
 
@@ -636,6 +637,20 @@ void EtherInterrupt(void)
 void ether_reset(void)
 {
 	net_protocols.clear();
+
+#ifndef SHEEPSHAVER
+	// The receive ring went away with the system heap, discard queued packets
+	// (the lock makes sure the reception thread is not reading into a buffer)
+	pthread_mutex_lock(&rx_ring_lock);
+	rx_ring = 0;
+	rx_ring_failed = false;
+	rx_tail = rx_head;
+	pthread_mutex_unlock(&rx_ring_lock);
+	if (rx_ring_waiting) {
+		rx_ring_waiting = false;
+		sem_post(&int_ack);
+	}
+#endif
 }
 
 
@@ -734,17 +749,19 @@ static int16 ether_do_write(uint32 arg)
 	// Transmit packet
 #ifdef HAVE_SLIRP
 	if (net_if_type == NET_IF_SLIRP) {
-		const int slirp_input_fd = slirp_input_fds[1];
-		write(slirp_input_fd, &len, sizeof(len));
-		write(slirp_input_fd, packet, len);
-		return noErr;
+		if (!ether_slirp_write(packet, len)) {
+			D(bug("WARNING: Couldn't transmit packet\n"));
+			return excessCollsns;
+		}
 	} else
 #endif
 	if (write(fd, packet, len) < 0) {
 		D(bug("WARNING: Couldn't transmit packet\n"));
 		return excessCollsns;
-	} else
-		return noErr;
+	}
+	counters.tx_packets++;
+	counters.tx_bytes += len;
+	return noErr;
 }
 
 
@@ -772,57 +789,26 @@ void ether_stop_udp_thread(void)
 
 
 /*
- *  SLIRP output buffer glue
+ *  SLIRP worker thread
  */
 
 #ifdef HAVE_SLIRP
-int slirp_can_output(void)
-{
-	return 1;
-}
-
-void slirp_output(const uint8 *packet, int len)
-{
-	write(slirp_output_fd, packet, len);
-}
-
 void *slirp_receive_func(void *arg)
 {
-	const int slirp_input_fd = slirp_input_fds[0];
-
 	for (;;) {
-		// Wait for packets to arrive
-		fd_set rfds, wfds, xfds;
-		int nfds;
-		struct timeval tv;
+		// Feed packets to slirp and process socket activity, packets
+		// from the Mac and slirp timers wake the thread earlier
+		ether_slirp_poll(100000);
 
-		// ... in the input queue
-		FD_ZERO(&rfds);
-		FD_SET(slirp_input_fd, &rfds);
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		if (select(slirp_input_fd + 1, &rfds, NULL, NULL, &tv) > 0) {
-			int len;
-			read(slirp_input_fd, &len, sizeof(len));
-			uint8 packet[1516];
-			assert(len <= sizeof(packet));
-			read(slirp_input_fd, packet, len);
-			slirp_input(packet, len);
-		}
+		if (ether_slirp_pending() && ether_driver_opened) {
+			// Trigger Ethernet interrupt
+			D(bug(" packet received, triggering Ethernet interrupt\n"));
+			SetInterruptFlag(INTFLAG_ETHER);
+			TriggerInterrupt();
 
-		// ... in the output queue
-		nfds = -1;
-		FD_ZERO(&rfds);
-		FD_ZERO(&wfds);
-		FD_ZERO(&xfds);
-		int timeout = slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
-#if ! USE_SLIRP_TIMEOUT
-		timeout = 10000;
-#endif
-		tv.tv_sec = 0;
-		tv.tv_usec = timeout;
-		if (select(nfds + 1, &rfds, &wfds, &xfds, &tv) >= 0)
-			slirp_select_poll(&rfds, &wfds, &xfds);
+			// Wait for interrupt acknowledge by EtherInterrupt()
+			sem_wait(&int_ack);
+		}
 
 #ifdef HAVE_PTHREAD_TESTCANCEL
 		// Explicit cancellation point if select() was not covered
@@ -844,10 +830,137 @@ void slirp_output(const uint8 *packet, int len)
 #endif
 
 
+#if USE_ETHER_CAPTURE
+/*
+ *  Packet capture writer thread
+ */
+
+static pthread_t capture_thread;
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+static bool capture_thread_cancel;
+static bool capture_wakeup_pending;
+
+static void *capture_func(void *arg)
+{
+	pthread_mutex_lock(&capture_lock);
+	while (!capture_thread_cancel) {
+		if (!capture_wakeup_pending) {
+			// Look at the capture ring at least every 100ms
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			struct timespec ts;
+			ts.tv_sec = tv.tv_sec;
+			ts.tv_nsec = tv.tv_usec * 1000 + 100000000;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&capture_cond, &capture_lock, &ts);
+		}
+		capture_wakeup_pending = false;
+		if (capture_thread_cancel)
+			break;
+		pthread_mutex_unlock(&capture_lock);
+		EtherCaptureService();
+		pthread_mutex_lock(&capture_lock);
+	}
+	pthread_mutex_unlock(&capture_lock);
+	return NULL;
+}
+
+bool ether_capture_thread_start(void)
+{
+	capture_thread_cancel = false;
+	capture_wakeup_pending = false;
+	pthread_attr_t thread_attr;
+	Set_pthread_attr(&thread_attr, 0);
+	return pthread_create(&capture_thread, &thread_attr, capture_func, NULL) == 0;
+}
+
+void ether_capture_thread_stop(void)
+{
+	pthread_mutex_lock(&capture_lock);
+	capture_thread_cancel = true;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_lock);
+	pthread_join(capture_thread, NULL);
+}
+
+void ether_capture_wakeup(void)
+{
+	pthread_mutex_lock(&capture_lock);
+	capture_wakeup_pending = true;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_lock);
+}
+#endif
+
+
 /*
  *  Packet reception thread
  */
 
+#ifndef SHEEPSHAVER
+static inline bool rx_ring_full(void)
+{
+	return rx_head - rx_tail >= (uint32)RX_RING_SIZE;
+}
+
+// Read all pending packets into the receive ring, then trigger the Ethernet interrupt
+static void fill_rx_ring(void)
+{
+	bool queued = false;
+	pthread_mutex_lock(&rx_ring_lock);
+	for (;;) {
+
+		// Ring full, let the interrupt read the device itself until it is drained
+		if (rx_ring_full()) {
+			counters.rx_ring_full++;
+			while (sem_trywait(&int_ack) == 0) ;	// Discard acknowledges of earlier interrupts
+			rx_ring_waiting = true;
+			__sync_synchronize();
+			SetInterruptFlag(INTFLAG_ETHER);
+			TriggerInterrupt();
+			pthread_mutex_unlock(&rx_ring_lock);
+			while (rx_ring_waiting)
+				sem_wait(&int_ack);
+			pthread_mutex_lock(&rx_ring_lock);
+			queued = false;
+		}
+
+		// Ring discarded by ether_reset()
+		uint32 ring = rx_ring;
+		if (ring == 0)
+			break;
+
+		uint32 slot = rx_head % RX_RING_SIZE;
+#if defined(__linux__)
+		ssize_t length = read(fd, Mac2HostAddr(ring + slot * RX_BUFFER_SIZE), net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
+#else
+		ssize_t length = read(fd, Mac2HostAddr(ring + slot * RX_BUFFER_SIZE), 1514);
+#endif
+		if (length < 0)
+			break;
+		if (length < 14)
+			continue;
+
+		rx_length[slot] = length;
+		__sync_synchronize();			// Publish packet before head
+		rx_head++;
+		queued = true;
+	}
+	pthread_mutex_unlock(&rx_ring_lock);
+
+	if (queued) {
+		// Trigger Ethernet interrupt, it drains the whole ring
+		D(bug(" packets received, triggering Ethernet interrupt\n"));
+		SetInterruptFlag(INTFLAG_ETHER);
+		TriggerInterrupt();
+	}
+}
+#endif
+
 static void *receive_func(void *arg)
 {
 	for (;;) {
@@ -874,6 +987,14 @@ static void *receive_func(void *arg)
 			break;
 
 		if (ether_driver_opened) {
+#ifndef SHEEPSHAVER
+			// Queue packets without waiting for the interrupt once the ring is set up
+			if (rx_ring && !udp_tunnel) {
+				fill_rx_ring();
+				continue;
+			}
+#endif
+
 			// Trigger Ethernet interrupt
 			D(bug(" packet received, triggering Ethernet interrupt\n"));
 			SetInterruptFlag(INTFLAG_ETHER);
@@ -892,8 +1013,80 @@ static void *receive_func(void *arg)
  *  Ethernet interrupt - activate deferred tasks to call IODone or protocol handlers
  */
 
+#ifndef SHEEPSHAVER
+// Allocate receive ring, the Mac Memory Manager can't be called before the first interrupt
+static void alloc_rx_ring(void)
+{
+	M68kRegisters r;
+	r.d[0] = RX_RING_SIZE * RX_BUFFER_SIZE;
+	Execute68kTrap(0xa71e, &r);		// NewPtrSysClear()
+	if (r.a[0] == 0) {
+		D(bug("WARNING: Cannot allocate receive ring\n"));
+		rx_ring_failed = true;
+		return;
+	}
+	D(bug(" receive ring at %08x\n", r.a[0]));
+	rx_tail = rx_head;
+	__sync_synchronize();
+	rx_ring = r.a[0];
+}
+
+// Dispatch all packets queued in the receive ring
+static void drain_rx_ring(void)
+{
+	uint32 ring = rx_ring;
+	while (rx_tail != rx_head) {
+		__sync_synchronize();			// Read head before packet
+		uint32 slot = rx_tail % RX_RING_SIZE;
+		uint32 p = ring + slot * RX_BUFFER_SIZE;
+		uint32 length = rx_length[slot];
+		counters.rx_packets++;
+		counters.rx_bytes += length;
+
+#if MONITOR
+		bug("Receiving Ethernet packet:\n");
+		for (int i=0; i<length; i++) {
+			bug("%02x ", ReadMacInt8(p + i));
+		}
+		bug("\n");
+#endif
+
+#if defined(__linux__)
+		if (net_if_type == NET_IF_ETHERTAP) {
+			p += 2;			// Linux ethertap has two random bytes before the packet
+			length -= 2;
+		}
+#endif
+
+		// Buffer is released after the protocol handler has read the packet
+		ether_dispatch_packet(p, length);
+		__sync_synchronize();
+		rx_tail++;
+	}
+}
+#endif
+
 void ether_do_interrupt(void)
 {
+#ifndef SHEEPSHAVER
+	counters.rx_interrupts++;
+	bool ring_waiting = false;
+	if (!udp_tunnel && net_if_type != NET_IF_SLIRP) {
+		if (rx_ring) {
+			drain_rx_ring();
+
+			// Ring was full, read the device directly as long as packets keep
+			// coming, the reception thread waits for the end of this interrupt
+			ring_waiting = rx_ring_waiting;
+			if (!ring_waiting)
+				return;
+		} else if (!rx_ring_failed) {
+			// The reception thread waits for this interrupt and switches to the ring afterwards
+			alloc_rx_ring();
+		}
+	}
+#endif
+
 	// Call protocol handler for received packets
 	EthernetPacket ether_packet;
 	uint32 packet = ether_packet.addr();
@@ -903,19 +1096,20 @@ void ether_do_interrupt(void)
 #ifndef SHEEPSHAVER
 		if (udp_tunnel) {
 
-			// Read packet from socket
-			struct sockaddr_in from;
-			socklen_t from_len = sizeof(from);
-			length = recvfrom(fd, Mac2HostAddr(packet), 1514, 0, (struct sockaddr *)&from, &from_len);
-			if (length < 14)
-				break;
-			ether_udp_read(packet, length, &from);
+			// Read packets from socket in batches and pass them to ether_udp_read()
+			counters.rx_packets += ether_udp_receive(packet);
+			break;
 
 		} else
 #endif
 		{
 
-			// Read packet from sheep_net device
+			// Read packet from slirp or sheep_net device
+#ifdef HAVE_SLIRP
+			if (net_if_type == NET_IF_SLIRP)
+				length = ether_slirp_read(Mac2HostAddr(packet), 1514);
+			else
+#endif
 #if defined(__linux__)
 			length = read(fd, Mac2HostAddr(packet), net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
 #else
@@ -932,6 +1126,9 @@ void ether_do_interrupt(void)
 			bug("\n");
 #endif
 
+			counters.rx_packets++;
+			counters.rx_bytes += length;
+
 			// Pointer to packet data (Ethernet header)
 			uint32 p = packet;
 #if defined(__linux__)
@@ -945,4 +1142,10 @@ void ether_do_interrupt(void)
 			ether_dispatch_packet(p, length);
 		}
 	}
+
+#ifndef SHEEPSHAVER
+	// Device drained, the reception thread fills the ring again after the acknowledge
+	if (ring_waiting)
+		rx_ring_waiting = false;
+#endif
 }
@@ -0,0 +1,222 @@
+/*
+ *  extfs_bench.cpp - Benchmark ExtFS FSItem lookups
+ *  Compile as: make extfs_bench
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The FSItem functions are static, so extfs.cpp is compiled into this
+ *  program. The rest of the emulator is replaced by stubs below; no Mac
+ *  code is run. The FSItem list is populated like after browsing a large
+ *  shared folder, then lookups through the hash tables are timed against
+ *  the former linear search of the FSItem list.
+ */
+
+#include <sys/time.h>
+
+#define sceIoMkdir mkdir		// Only used by fs_dir_create()
+#include "../extfs.cpp"
+
+
+/*
+ *  Replacements for emulator functions used by extfs.cpp
+ */
+
+#if DIRECT_ADDRESSING
+uintptr MEMBaseDiff = 0;
+#endif
+
+extern "C" void Execute68k(uint32 addr, M68kRegisters *r) {}
+extern "C" void Execute68kTrap(uint16 trap, M68kRegisters *r) {}
+int FindFreeDriveNumber(int num) { return num; }
+const char *GetString(int num) { return "Unix"; }
+const char *PrefsFindString(const char *name, int index) { return NULL; }
+void QuitEmulator(void) { exit(1); }
+uint32 TimeToMacTime(time_t t) { return 0; }
+const char *host_encoding_to_macroman(const char *filename) { return filename; }
+const char *macroman_to_host_encoding(const char *filename) { return filename; }
+
+void add_path_component(char *path, const char *component)
+{
+	int l = strlen(path);
+	if (l < MAX_PATH_LENGTH-1 && path[l-1] != '/') {
+		path[l] = '/';
+		path[l+1] = 0;
+	}
+	strncat(path, component, MAX_PATH_LENGTH-1);
+}
+
+void extfs_init(void) {}
+void extfs_exit(void) {}
+void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir) {}
+void set_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir) {}
+uint32 get_rfork_size(const char *path) { return 0; }
+int open_rfork(const char *path, int flag) { return -1; }
+void close_rfork(const char *path, int fd) {}
+ssize_t extfs_read(int fd, void *buffer, size_t length) { return -1; }
+ssize_t extfs_write(int fd, void *buffer, size_t length) { return -1; }
+ssize_t extfs_pread(int fd, void *buffer, size_t length, off_t offset) { return -1; }
+ssize_t extfs_pwrite(int fd, void *buffer, size_t length, off_t offset) { return -1; }
+bool extfs_remove(const char *path) { return false; }
+bool extfs_rename(const char *old_path, const char *new_path) { return false; }
+#if EXTFS_WATCH
+bool PrefsFindBool(const char *name) { return false; }
+B2_mutex *B2_create_mutex(void) { return NULL; }
+void B2_lock_mutex(B2_mutex *mutex) {}
+void B2_unlock_mutex(B2_mutex *mutex) {}
+void B2_delete_mutex(B2_mutex *mutex) {}
+bool extfs_watch_init(void) { return false; }
+void extfs_watch_exit(void) {}
+bool extfs_watch_dir(uint32 dir_id, const char *path) { return false; }
+void extfs_unwatch_dir(uint32 dir_id) {}
+#endif
+
+
+/*
+ *  Former linear lookups
+ */
+
+static FSItem *linear_find_by_id(uint32 cnid)
+{
+	for (FSItem *p = first_fs_item; p; p = p->next)
+		if (p->id == cnid)
+			return p;
+	return NULL;
+}
+
+static FSItem *linear_find(const char *name, FSItem *parent)
+{
+	for (FSItem *p = first_fs_item; p; p = p->next)
+		if (p->parent == parent && !strcmp(p->name, name))
+			return p;
+	return NULL;
+}
+
+static FSItem *linear_find_guest(const char *guest_name, FSItem *parent)
+{
+	for (FSItem *p = first_fs_item; p; p = p->next)
+		if (p->parent == parent && !strcmp(p->guest_name, guest_name))
+			return p;
+	return NULL;
+}
+
+
+/*
+ *  Benchmark
+ */
+
+static double now_sec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static FSItem **dirs;
+static int num_dirs, files_per_dir;
+
+static void item_name(char *name, int dir, int file)
+{
+	sprintf(name, "File %d of folder %d", file, dir);
+}
+
+// Time n random lookups, returns usec per lookup
+static double time_lookups(int kind, bool linear, int n)
+{
+	char name[64];
+	uint32 found = 0;
+	srand(1);
+	double start = now_sec();
+	for (int i=0; i<n; i++) {
+		int d = rand() % num_dirs, f = rand() % files_per_dir;
+		FSItem *p = NULL;
+		switch (kind) {
+			case 0: {
+				// Items were created directory by directory
+				uint32 cnid = dirs[d]->id + 1 + f;
+				p = linear ? linear_find_by_id(cnid) : find_fsitem_by_id(cnid);
+				break;
+			}
+			case 1:
+				item_name(name, d, f);
+				p = linear ? linear_find(name, dirs[d]) : find_fsitem(name, dirs[d]);
+				break;
+			case 2:
+				item_name(name, d, f);
+				p = linear ? linear_find_guest(name, dirs[d]) : find_fsitem_guest(name, dirs[d]);
+				break;
+		}
+		if (p)
+			found++;
+	}
+	double usec = (now_sec() - start) * 1e6 / n;
+	if (found != (uint32)n)
+		printf("WARNING: %u of %d items not found\n", n - found, n);
+	return usec;
+}
+
+int main(int argc, char **argv)
+{
+	int num_items = 100000;
+	if (argc > 1)
+		num_items = atoi(argv[1]);
+	num_dirs = 100;
+	files_per_dir = num_items / num_dirs;
+	if (files_per_dir < 1) {
+		printf("Usage: %s [NUM_ITEMS]\n", argv[0]);
+		return 1;
+	}
+
+	ExtFSInit();
+	FSItem *root = find_fsitem_by_id(ROOT_ID);
+
+	// Populate, each directory followed by its files
+	double start = now_sec();
+	char name[64];
+	dirs = new FSItem *[num_dirs];
+	for (int d=0; d<num_dirs; d++) {
+		sprintf(name, "Folder %d", d);
+		dirs[d] = find_fsitem(name, root);
+		for (int f=0; f<files_per_dir; f++) {
+			item_name(name, d, f);
+			find_fsitem(name, dirs[d]);
+		}
+	}
+	double populate = now_sec() - start;
+	printf("%u FSItems created in %.3f s\n", num_fs_items, populate);
+
+	// Linear search is O(n), keep its run time reasonable
+	int n_hashed = 1000000;
+	int n_linear = 200000000 / num_fs_items;
+	if (n_linear < 10)
+		n_linear = 10;
+	if (n_linear > n_hashed)
+		n_linear = n_hashed;
+
+	static const char *kind_name[3] = {"by CNID", "by host name", "by guest name"};
+	printf("%-16s %14s %14s %10s\n", "Lookup", "linear (us)", "hashed (us)", "speedup");
+	for (int kind=0; kind<3; kind++) {
+		double t_linear = time_lookups(kind, true, n_linear);
+		double t_hashed = time_lookups(kind, false, n_hashed);
+		printf("%-16s %14.3f %14.3f %9.0fx\n", kind_name[kind], t_linear, t_hashed, t_hashed > 0 ? t_linear / t_hashed : 0);
+	}
+
+	delete[] dirs;
+	ExtFSExit();
+	return 0;
+}
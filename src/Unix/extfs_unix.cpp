@@ -27,9 +27,18 @@
 #include <errno.h>
 
 #include "sysdeps.h"
+#include "main.h"
 #include "extfs.h"
 #include "extfs_defs.h"
 
+#if EXTFS_WATCH
+#include <pthread.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
 #define DEBUG 0
 #include "debug.h"
 
@@ -218,6 +227,48 @@ static const ext2type e2t_translation[] = {
 	{NULL, 0, 0}	// End marker
 };
 
+// Hash table of e2t_translation[] indices (+1, 0 = empty slot), by extension
+const int E2T_HASH_SIZE = 128;	// Power of 2, more than twice the number of extensions
+static uint8 e2t_hash[E2T_HASH_SIZE];
+static bool e2t_hash_valid = false;
+
+static uint32 hash_ext(const char *ext)
+{
+	uint32 h = 2166136261u;
+	while (*ext)
+		h = (h ^ (uint8)*ext++) * 16777619u;
+	return h;
+}
+
+static void init_e2t_hash(void)
+{
+	for (int i=0; e2t_translation[i].ext; i++) {
+		uint32 slot = hash_ext(e2t_translation[i].ext) & (E2T_HASH_SIZE - 1);
+		while (e2t_hash[slot])
+			slot = (slot + 1) & (E2T_HASH_SIZE - 1);
+		e2t_hash[slot] = i + 1;
+	}
+	e2t_hash_valid = true;
+}
+
+// Find translation for file name extension of path, NULL if none
+static const ext2type *find_e2t(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+	if (ext == NULL || strchr(ext, '/'))
+		return NULL;
+	if (!e2t_hash_valid)
+		init_e2t_hash();
+	uint32 slot = hash_ext(ext) & (E2T_HASH_SIZE - 1);
+	while (e2t_hash[slot]) {
+		const ext2type *e = e2t_translation + e2t_hash[slot] - 1;
+		if (!strcmp(ext, e->ext))
+			return e;
+		slot = (slot + 1) & (E2T_HASH_SIZE - 1);
+	}
+	return NULL;
+}
+
 void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 {
 	// Set default finder info
@@ -240,16 +291,10 @@ void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 
 	// No Finder info file, translate file name extension to MacOS type/creator
 	if (!is_dir) {
-		int path_len = strlen(path);
-		for (int i=0; e2t_translation[i].ext; i++) {
-			int ext_len = strlen(e2t_translation[i].ext);
-			if (path_len < ext_len)
-				continue;
-			if (!strcmp(path + path_len - ext_len, e2t_translation[i].ext)) {
-				WriteMacInt32(finfo + fdType, e2t_translation[i].type);
-				WriteMacInt32(finfo + fdCreator, e2t_translation[i].creator);
-				break;
-			}
+		const ext2type *e = find_e2t(path);
+		if (e) {
+			WriteMacInt32(finfo + fdType, e->type);
+			WriteMacInt32(finfo + fdCreator, e->creator);
 		}
 	}
 }
@@ -275,17 +320,13 @@ void set_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 
 uint32 get_rfork_size(const char *path)
 {
-	// Open resource file
-	int fd = open_rsrc(path, O_RDONLY);
-	if (fd < 0)
+	// Stat resource file instead of opening it
+	char helper_path[MAX_PATH_LENGTH];
+	make_helper_path(path, helper_path, ".rsrc/");
+	struct stat st;
+	if (stat(helper_path, &st) < 0 || !S_ISREG(st.st_mode))
 		return 0;
-
-	// Get size
-	off_t size = lseek(fd, 0, SEEK_END);
-	
-	// Close file and return size
-	close(fd);
-	return size < 0 ? 0 : size;
+	return st.st_size;
 }
 
 int open_rfork(const char *path, int flag)
@@ -321,6 +362,22 @@ ssize_t extfs_write(int fd, void *buffer, size_t length)
 }
 
 
+/*
+ *  Read/write "length" bytes at file offset "offset" without changing
+ *  the file position, returns number of bytes transferred (or -1 on error)
+ */
+
+ssize_t extfs_pread(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pread(fd, buffer, length, offset);
+}
+
+ssize_t extfs_pwrite(int fd, void *buffer, size_t length, off_t offset)
+{
+	return pwrite(fd, buffer, length, offset);
+}
+
+
 /*
  *  Remove file/directory (and associated helper files),
  *  returns false on error (and sets errno)
@@ -377,6 +434,191 @@ bool extfs_rename(const char *old_path, const char *new_path)
 }
 
 
+#if EXTFS_WATCH
+/*
+ *  Host change watcher: uses inotify on Linux, otherwise (or if inotify
+ *  is not available) the watched directories are polled for changed
+ *  modification times once per second
+ */
+
+const int MAX_WATCHED_DIRS = 16;
+
+struct watched_dir {
+	uint32 dir_id;			// CNID of directory (0 = unused)
+	int wd;					// inotify watch descriptor
+	time_t mtime;			// Last seen modification time (polling)
+	char path[MAX_PATH_LENGTH];
+};
+
+static watched_dir watched_dirs[MAX_WATCHED_DIRS];
+static B2_mutex *watch_lock;
+static int inotify_fd = -1;
+static pthread_t watch_thread;
+static volatile bool watch_thread_cancel;
+
+static void poll_watched_dirs(void)
+{
+	uint32 changed[MAX_WATCHED_DIRS];
+	int num_changed = 0;
+	B2_lock_mutex(watch_lock);
+	for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+		watched_dir *w = watched_dirs + i;
+		if (w->dir_id == 0)
+			continue;
+		struct stat st;
+		time_t mtime = stat(w->path, &st) < 0 ? 0 : st.st_mtime;
+		if (mtime != w->mtime) {
+			w->mtime = mtime;
+			changed[num_changed++] = w->dir_id;
+		}
+	}
+	B2_unlock_mutex(watch_lock);
+	for (int i=0; i<num_changed; i++)
+		ExtFSHostChanged(changed[i], NULL);
+}
+
+#ifdef __linux__
+static void read_inotify_events(void)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len = read(inotify_fd, buf, sizeof(buf));
+	for (char *p = buf; len > 0 && p < buf + len; ) {
+		struct inotify_event *ev = (struct inotify_event *)p;
+		p += sizeof(struct inotify_event) + ev->len;
+		if (ev->mask & IN_Q_OVERFLOW) {		// Events lost, report all directories
+			B2_lock_mutex(watch_lock);
+			for (int i=0; i<MAX_WATCHED_DIRS; i++)
+				if (watched_dirs[i].dir_id)
+					ExtFSHostChanged(watched_dirs[i].dir_id, NULL);
+			B2_unlock_mutex(watch_lock);
+			continue;
+		}
+		if (ev->mask & IN_IGNORED)
+			continue;
+		uint32 dir_id = 0;
+		B2_lock_mutex(watch_lock);
+		for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+			if (watched_dirs[i].dir_id && watched_dirs[i].wd == ev->wd) {
+				dir_id = watched_dirs[i].dir_id;
+				break;
+			}
+		}
+		B2_unlock_mutex(watch_lock);
+		if (dir_id)
+			ExtFSHostChanged(dir_id, ev->len ? ev->name : NULL);
+	}
+}
+#endif
+
+static void *watch_func(void *arg)
+{
+	while (!watch_thread_cancel) {
+#ifdef __linux__
+		if (inotify_fd >= 0) {
+			struct pollfd pfd;
+			pfd.fd = inotify_fd;
+			pfd.events = POLLIN;
+			if (poll(&pfd, 1, 200) > 0)
+				read_inotify_events();
+			continue;
+		}
+#endif
+		poll_watched_dirs();
+		for (int i=0; i<10 && !watch_thread_cancel; i++)
+			usleep(100000);
+	}
+	return NULL;
+}
+
+bool extfs_watch_init(void)
+{
+	memset(watched_dirs, 0, sizeof(watched_dirs));
+	watch_lock = B2_create_mutex();
+#ifdef __linux__
+	inotify_fd = inotify_init();
+	if (inotify_fd < 0) {
+		D(bug("inotify not available (%s), polling\n", strerror(errno)));
+	}
+#endif
+	watch_thread_cancel = false;
+	pthread_attr_t thread_attr;
+	Set_pthread_attr(&thread_attr, 0);
+	if (pthread_create(&watch_thread, &thread_attr, watch_func, NULL) != 0) {
+		watch_thread_cancel = true;
+		extfs_watch_exit();
+		return false;
+	}
+	return true;
+}
+
+void extfs_watch_exit(void)
+{
+	if (watch_lock == NULL)
+		return;
+	if (!watch_thread_cancel) {
+		watch_thread_cancel = true;
+		pthread_join(watch_thread, NULL);
+	}
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+	B2_delete_mutex(watch_lock);
+	watch_lock = NULL;
+}
+
+bool extfs_watch_dir(uint32 dir_id, const char *path)
+{
+	B2_lock_mutex(watch_lock);
+	watched_dir *w = NULL;
+	for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+		if (watched_dirs[i].dir_id == 0) {
+			w = watched_dirs + i;
+			break;
+		}
+	}
+	bool ok = false;
+	if (w) {
+		w->wd = -1;
+#ifdef __linux__
+		if (inotify_fd >= 0)
+			w->wd = inotify_add_watch(inotify_fd, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+		ok = inotify_fd < 0 || w->wd >= 0;
+#else
+		ok = true;
+#endif
+		if (ok) {
+			struct stat st;
+			w->mtime = stat(path, &st) < 0 ? 0 : st.st_mtime;
+			strncpy(w->path, path, MAX_PATH_LENGTH - 1);
+			w->path[MAX_PATH_LENGTH - 1] = 0;
+			w->dir_id = dir_id;
+		}
+	}
+	B2_unlock_mutex(watch_lock);
+	D(bug("watching %s (%d): %s\n", path, dir_id, ok ? "ok" : "failed"));
+	return ok;
+}
+
+void extfs_unwatch_dir(uint32 dir_id)
+{
+	B2_lock_mutex(watch_lock);
+	for (int i=0; i<MAX_WATCHED_DIRS; i++) {
+		watched_dir *w = watched_dirs + i;
+		if (w->dir_id == dir_id) {
+#ifdef __linux__
+			if (inotify_fd >= 0 && w->wd >= 0)
+				inotify_rm_watch(inotify_fd, w->wd);
+#endif
+			w->dir_id = 0;
+			break;
+		}
+	}
+	B2_unlock_mutex(watch_lock);
+}
+#endif
+
+
 // Convert from the host OS filename encoding to MacRoman
 const char *host_encoding_to_macroman(const char *filename)
 {
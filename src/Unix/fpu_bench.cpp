@@ -0,0 +1,482 @@
+/*
+ *  fpu_bench.cpp - Check and benchmark host double fast path and transcendental functions of SoftFloat FPU core
+ *  Compile as: make fpu_bench
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  fpu_soft.cpp is compiled into this program with FPU_HYBRID, whatever
+ *  FPU core configure selected for the emulator, and the rest of the CPU
+ *  emulation is replaced by stubs below. Register to register instructions
+ *  are executed with the fast path switched off and on, for random and
+ *  special operands in all rounding modes and precisions, and the
+ *  destination registers and FPSR must come out bit for bit the same.
+ *  The same is checked for instruction sequences which switch the FPCR
+ *  with FMOVE Dn,FPCR between double precision/round to nearest, which
+ *  the fast path and the JIT's SSE2 code are made for, and other modes.
+ *  Then the arithmetic instructions are timed with both.
+ *
+ *  The transcendental instructions are compared with the host's long
+ *  double library where that is x87 extended precision, in the accurate
+ *  and the fast mode, and timed against conversion to double and the
+ *  host's double precision library.
+ */
+
+#include "sysdeps.h"
+#undef FPU_IEEE
+#undef FPU_X86
+#undef FPU_UAE
+#define FPU_SOFT 1
+#define FPU_HYBRID 1
+#undef HOST_FLOAT_FORMAT
+#define HOST_FLOAT_FORMAT SOFT_FLOAT_FORMAT
+
+#include <sys/time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#define HAVE_X87_LONG_DOUBLE 1
+#endif
+
+#include "../uae_cpu/fpu/fpu_soft.cpp"
+
+
+/*
+ *  Replacements for emulator functions used by fpu_soft.cpp
+ */
+
+int CPUType = 4;
+regstruct regs;
+
+#if DIRECT_ADDRESSING
+uintptr MEMBaseDiff = 0;
+#endif
+
+static uint32 illegal_ops;
+
+void REGPARAM2 op_illg(uae_u32 opcode) { illegal_ops++; }
+void Exception(int nr, uaecptr oldpc) {}
+uae_u32 get_disp_ea_020(uae_u32 base, uae_u32 dp) { return 0; }
+bool PrefsFindBool(const char *name) { return true; }
+
+
+/*
+ *  Random operands
+ */
+
+static uint64 rand64(void)
+{
+	return ((uint64)(rand() & 0xffff) << 48) | ((uint64)(rand() & 0xffff) << 32) | ((uint64)(rand() & 0xffff) << 16) | (rand() & 0xffff);
+}
+
+static fpu_register make_reg(int sign, int exp, uint64 mant)
+{
+	fpu_register r;
+	r.high = (sign ? 0x8000 : 0) | (exp & 0x7fff);
+	r.low = mant;
+	return r;
+}
+
+// Normal number with exponent e and the given number of significant bits
+static fpu_register random_normal(int e, int bits)
+{
+	uint64 mant = rand64() | (UINT64_C(1) << 63);
+	if (bits < 64)
+		mant &= ~((UINT64_C(1) << (64 - bits)) - 1);
+	return make_reg(rand() & 1, e + 0x3fff, mant);
+}
+
+static fpu_register random_operand(void)
+{
+	static const int edges[] = {-16383, -1022, -401, -400, -399, -126, -125, 0, 126, 127, 128, 399, 400, 401, 1023, 1024, 16383};
+	switch (rand() % 10) {
+		case 0: case 1: case 2:		// Double
+			return random_normal(rand() % 121 - 60, 53);
+		case 3: case 4:				// Single
+			return random_normal(rand() % 61 - 30, 24);
+		case 5:						// Short mantissa, products and quotients are often exact
+			return random_normal(rand() % 21 - 10, 1 + rand() % 8);
+		case 6:						// Extended
+			return random_normal(rand() % 121 - 60, 64);
+		case 7:						// Exponent range limits
+			return random_normal(edges[rand() % (sizeof(edges) / sizeof(edges[0]))], rand() & 1 ? 53 : 24);
+		case 8:						// Mantissa just beyond double or single
+			return random_normal(rand() % 21 - 10, rand() & 1 ? 54 : 25);
+		default:					// Zeros, infinities, NaNs, denormals (no unnormals, SoftFloat's square root loops on them)
+			switch (rand() % 4) {
+				case 0: return make_reg(rand() & 1, 0, 0);
+				case 1: return make_reg(rand() & 1, 0x7fff, 0);
+				case 2: return make_reg(rand() & 1, 0x7fff, UINT64_C(0xc000000000000000) | (rand64() >> 2));
+				default: return make_reg(rand() & 1, 0, rand64() >> 1);
+			}
+	}
+}
+
+
+/*
+ *  Differential test
+ */
+
+struct op_desc {
+	uae_u32 op;
+	const char *name;
+};
+
+static const op_desc test_ops[] = {
+	{0x04, "FSQRT"}, {0x20, "FDIV"}, {0x22, "FADD"}, {0x23, "FMUL"}, {0x24, "FSGLDIV"},
+	{0x27, "FSGLMUL"}, {0x28, "FSUB"}, {0x38, "FCMP"}, {0x41, "FSSQRT"}, {0x45, "FDSQRT"},
+	{0x60, "FSDIV"}, {0x62, "FSADD"}, {0x63, "FSMUL"}, {0x64, "FDDIV"}, {0x66, "FDADD"},
+	{0x67, "FDMUL"}, {0x68, "FSSUB"}, {0x6c, "FDSUB"}, {0x00, "FMOVE"}, {0x1a, "FNEG"}
+};
+const int NUM_TEST_OPS = sizeof(test_ops) / sizeof(test_ops[0]);
+
+const uae_u32 FOP = 0xf200;			// Coprocessor 1, general instruction
+
+struct fpu_state {
+	fpu_register dst;
+	uae_u32 fpsr;
+};
+
+// Execute FPn op FP1 -> FP0 and return FP0 and FPSR
+static fpu_state run_op(bool hybrid, uae_u32 fpcr, uae_u32 op, fpu_register const &dst, fpu_register const &src)
+{
+	fpu_hybrid = hybrid;
+	set_fpcr(fpcr);
+	set_fpsr(0);
+	FPU registers[0] = dst;
+	FPU registers[1] = src;
+	fpuop_arithmetic(FOP, (1 << 10) | (0 << 7) | op);
+
+	fpu_state s;
+	s.dst = FPU registers[0];
+	s.fpsr = get_fpsr();
+	return s;
+}
+
+static int check_ops(int n)
+{
+	static const uae_u32 precisions[] = {FPCR_PRECISION_SINGLE, FPCR_PRECISION_DOUBLE, FPCR_PRECISION_EXTENDED};
+	static const uae_u32 modes[] = {FPCR_ROUND_NEAR, FPCR_ROUND_ZERO, FPCR_ROUND_MINF, FPCR_ROUND_PINF};
+	int errors = 0;
+
+	for (int i = 0; i < n; i++) {
+		uae_u32 fpcr = precisions[rand() % 3] | (rand() % 4 ? FPCR_ROUND_NEAR : modes[rand() % 4]);
+		if (rand() % 16 == 0)
+			fpcr |= 0x0800;			// INEX2 exception enabled
+		const op_desc &d = test_ops[rand() % NUM_TEST_OPS];
+		fpu_register dst = random_operand();
+		fpu_register src = random_operand();
+
+		fpu_state soft = run_op(false, fpcr, d.op, dst, src);
+		fpu_state hybrid = run_op(true, fpcr, d.op, dst, src);
+		if (soft.dst.high != hybrid.dst.high || soft.dst.low != hybrid.dst.low || soft.fpsr != hybrid.fpsr) {
+			if (errors++ < 10)
+				printf("MISMATCH %s fpcr %04x, %04x:%016llx %04x:%016llx -> soft %04x:%016llx fpsr %08x, hybrid %04x:%016llx fpsr %08x\n",
+					d.name, fpcr, dst.high, (unsigned long long)dst.low, src.high, (unsigned long long)src.low,
+					soft.dst.high, (unsigned long long)soft.dst.low, soft.fpsr,
+					hybrid.dst.high, (unsigned long long)hybrid.dst.low, hybrid.fpsr);
+		}
+	}
+	return errors;
+}
+
+// FMOVE D0,FPCR followed by an arithmetic instruction, alternating
+// between double/nearest and other FPCR values, as a loop toggling the
+// rounding mode would. Results must follow the FPCR of each iteration.
+static int check_fpcr_toggle(int n)
+{
+	static const uae_u32 other_fpcrs[] = {
+		FPCR_PRECISION_EXTENDED | FPCR_ROUND_NEAR, FPCR_PRECISION_DOUBLE | FPCR_ROUND_ZERO,
+		FPCR_PRECISION_SINGLE | FPCR_ROUND_MINF, FPCR_PRECISION_DOUBLE | FPCR_ROUND_PINF
+	};
+	int errors = 0;
+
+	for (int i = 0; i < n; i++) {
+		uae_u32 fpcr = (i & 1) ? other_fpcrs[(i >> 1) % 4] : FPCR_PRECISION_DOUBLE | FPCR_ROUND_NEAR;
+		const op_desc &d = test_ops[rand() % NUM_TEST_OPS];
+		fpu_register dst = random_operand();
+		fpu_register src = random_operand();
+
+		fpu_state soft = run_op(false, fpcr, d.op, dst, src);
+
+		fpu_hybrid = true;
+		m68k_dreg(regs, 0) = fpcr;
+		fpuop_arithmetic(FOP, 0x9000);
+		set_fpsr(0);
+		FPU registers[0] = dst;
+		FPU registers[1] = src;
+		fpuop_arithmetic(FOP, (1 << 10) | (0 << 7) | d.op);
+		if (get_fpcr() != fpcr || soft.dst.high != FPU registers[0].high || soft.dst.low != FPU registers[0].low || soft.fpsr != get_fpsr()) {
+			if (errors++ < 10)
+				printf("MISMATCH %s after FMOVE #%04x,FPCR (now %04x), %04x:%016llx %04x:%016llx -> soft %04x:%016llx fpsr %08x, hybrid %04x:%016llx fpsr %08x\n",
+					d.name, fpcr, get_fpcr(), dst.high, (unsigned long long)dst.low, src.high, (unsigned long long)src.low,
+					soft.dst.high, (unsigned long long)soft.dst.low, soft.fpsr,
+					FPU registers[0].high, (unsigned long long)FPU registers[0].low, get_fpsr());
+		}
+	}
+	return errors;
+}
+
+
+/*
+ *  Benchmark
+ */
+
+static double now_sec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+const int NUM_OPERANDS = 256;
+
+// Time op on double operands, returns nsec per instruction
+static double time_op(bool hybrid, uae_u32 fpcr, uae_u32 op, const fpu_register *dst, const fpu_register *src, int n)
+{
+	fpu_hybrid = hybrid;
+	set_fpcr(fpcr);
+	double start = now_sec();
+	for (int i = 0; i < n; i++) {
+		FPU registers[0] = dst[i % NUM_OPERANDS];
+		FPU registers[1] = src[i % NUM_OPERANDS];
+		fpuop_arithmetic(FOP, (1 << 10) | (0 << 7) | op);
+	}
+	return (now_sec() - start) * 1e9 / n;
+}
+
+
+/*
+ *  Transcendental functions
+ */
+
+static double host_exp10(double x) { return pow(10.0, x); }
+
+#if HAVE_X87_LONG_DOUBLE
+static long double ref_exp10(long double x) { return powl(10.0L, x); }
+#define REF(f) f
+#else
+#define REF(f) NULL
+#endif
+
+enum {
+	ARG_LINEAR,		// Uniform in range, and scaled down by up to 2^-63
+	ARG_TRIG,		// Like ARG_LINEAR, some arguments up to 2^62
+	ARG_LOG			// Positive, exponent uniform in range, some close to 1
+};
+
+struct math_desc {
+	uae_u32 op;
+	const char *name;
+	fpu_register (*func)(fpu_register const &);
+	double (*host)(double);		// Host double precision library
+#if HAVE_X87_LONG_DOUBLE
+	long double (*ref)(long double);
+#endif
+	int arg_kind;
+	double lo, hi;
+};
+
+static const math_desc math_ops[] = {
+	{0x0e, "FSIN", fp_do_sin, sin, REF(sinl), ARG_TRIG, -100, 100},
+	{0x1d, "FCOS", fp_do_cos, cos, REF(cosl), ARG_TRIG, -100, 100},
+	{0x0f, "FTAN", fp_do_tan, tan, REF(tanl), ARG_TRIG, -100, 100},
+	{0x0a, "FATAN", fp_do_atan, atan, REF(atanl), ARG_LINEAR, -1000, 1000},
+	{0x0c, "FASIN", fp_do_asin, asin, REF(asinl), ARG_LINEAR, -1, 1},
+	{0x1c, "FACOS", fp_do_acos, acos, REF(acosl), ARG_LINEAR, -1, 1},
+	{0x0d, "FATANH", fp_do_atanh, atanh, REF(atanhl), ARG_LINEAR, -1, 1},
+	{0x02, "FSINH", fp_do_sinh, sinh, REF(sinhl), ARG_LINEAR, -100, 100},
+	{0x19, "FCOSH", fp_do_cosh, cosh, REF(coshl), ARG_LINEAR, -100, 100},
+	{0x09, "FTANH", fp_do_tanh, tanh, REF(tanhl), ARG_LINEAR, -30, 30},
+	{0x10, "FETOX", fp_do_exp, exp, REF(expl), ARG_LINEAR, -700, 700},
+	{0x11, "FTWOTOX", fp_do_exp2, exp2, REF(exp2l), ARG_LINEAR, -1000, 1000},
+	{0x12, "FTENTOX", fp_do_exp10, host_exp10, REF(ref_exp10), ARG_LINEAR, -300, 300},
+	{0x08, "FETOXM1", fp_do_expm1, expm1, REF(expm1l), ARG_LINEAR, -50, 50},
+	{0x14, "FLOGN", fp_do_log, log, REF(logl), ARG_LOG, -1000, 1000},
+	{0x15, "FLOG10", fp_do_log10, log10, REF(log10l), ARG_LOG, -1000, 1000},
+	{0x16, "FLOG2", fp_do_log2, log2, REF(log2l), ARG_LOG, -1000, 1000},
+	{0x06, "FLOGNP1", fp_do_log1p, log1p, REF(log1pl), ARG_LINEAR, -1, 100}
+};
+const int NUM_MATH_OPS = sizeof(math_ops) / sizeof(math_ops[0]);
+
+// Argument with 64 significant bits
+static fpu_register math_arg(const math_desc &d)
+{
+	double u = (double)rand64() / 18446744073709551616.0;
+	double x;
+	switch (d.arg_kind) {
+		case ARG_LOG:
+			if (rand() % 4 == 0)
+				x = 1.0 + (u - 0.5) * ldexp(1.0, -(rand() % 64));
+			else
+				x = ldexp(1.0 + u, (int)(d.lo + (d.hi - d.lo) * ((double)rand() / RAND_MAX)));
+			break;
+		case ARG_TRIG:
+			if (rand() % 8 == 0) {
+				x = ldexp(1.0 + u, rand() % 62);
+				break;
+			}
+			// fall through
+		default:
+			x = d.lo + (d.hi - d.lo) * u;
+			if (rand() % 4 == 0)
+				x = ldexp(x, -(rand() % 64));
+			break;
+	}
+	fpu_register r = fx_from_double(x);
+	if (r.high & 0x7fff)
+		r.low ^= rand() & 0x7ff;
+	return r;
+}
+
+#if HAVE_X87_LONG_DOUBLE
+static long double to_long_double(fpu_register const &r)
+{
+	long double x = 0;
+	memcpy(&x, &r.low, 8);
+	memcpy((char *)&x + 8, &r.high, 2);
+	return x;
+}
+
+// Error of extended precision result in units of the last place of the reference
+static double ulp_error(fpu_register const &r, long double ref)
+{
+	long double x = to_long_double(r);
+	if (isnan(ref) || isinf(ref))
+		return isnan(x) == isnan(ref) && x == ref ? 0 : 1e30;
+	if (ref == 0)
+		return x == 0 ? 0 : 1e30;
+	int exp;
+	frexpl(ref, &exp);
+	if (exp < -16381)
+		exp = -16381;
+	return (double)(fabsl(x - ref) / ldexpl(1.0L, exp - 64));
+}
+#endif
+
+// Execute instruction on argument and return FP0
+static fpu_register run_math_op(bool fast, uae_u32 op, fpu_register const &arg)
+{
+	fpu_fast_math = fast;
+	return run_op(false, FPCR_PRECISION_EXTENDED | FPCR_ROUND_NEAR, op, arg, arg).dst;
+}
+
+// Returns number of results further than max_ulp from the reference
+static int check_math(int n, double max_ulp)
+{
+	int errors = 0;
+#if HAVE_X87_LONG_DOUBLE
+	printf("%-10s %14s %14s %14s\n", "ulp error", "double", "accurate", "fast");
+	for (int i = 0; i < NUM_MATH_OPS; i++) {
+		const math_desc &d = math_ops[i];
+		double max_host = 0, max_accurate = 0, max_fast = 0;
+		for (int j = 0; j < n; j++) {
+			fpu_register x = math_arg(d);
+			long double ref = d.ref(to_long_double(x));
+			if (isinf(ref) || fabsl(ref) < LDBL_MIN)
+				continue;
+			double host = ulp_error(fx_from_double(d.host(fx_to_double(x))), ref);
+			double accurate = ulp_error(run_math_op(false, d.op, x), ref);
+			double fast = ulp_error(run_math_op(true, d.op, x), ref);
+			if (host > max_host)
+				max_host = host;
+			if (fast > max_fast)
+				max_fast = fast;
+			if (accurate > max_accurate)
+				max_accurate = accurate;
+			if (accurate > max_ulp && errors++ < 10)
+				printf("INACCURATE %s %04x:%016llx -> %.2f ulp\n", d.name, x.high, (unsigned long long)x.low, accurate);
+		}
+		printf("%-10s %14.3g %14.2f %14.2f\n", d.name, max_host, max_accurate, max_fast);
+	}
+#else
+	printf("No extended precision reference on this host\n");
+#endif
+	return errors;
+}
+
+// Time function on arguments, returns nsec per call
+static double time_math(const math_desc &d, int mode, const fpu_register *args, int n)
+{
+	volatile uae_u16 sink = 0;
+	fpu_fast_math = mode == 2;
+	double start = now_sec();
+	for (int i = 0; i < n; i++) {
+		fpu_register x = args[i % NUM_OPERANDS];
+		if (mode == 0)
+			x = fx_from_double(d.host(fx_to_double(x)));
+		else
+			x = d.func(x);
+		sink += x.high;
+	}
+	return (now_sec() - start) * 1e9 / n;
+}
+
+int main(int argc, char **argv)
+{
+	int n = 1000000;
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (n <= 0) {
+		printf("Usage: %s [ITERATIONS]\n", argv[0]);
+		return 1;
+	}
+
+	fpu_init(true);
+
+	int errors = check_ops(n);
+	printf("Fast path bit exactness (%d instructions): %s\n", n, errors ? "FAILED" : "ok");
+	int toggle_errors = check_fpcr_toggle(n / 10);
+	printf("FPCR changes between instructions (%d instructions): %s\n", n / 10, toggle_errors ? "FAILED" : "ok");
+	if (illegal_ops)
+		printf("%u illegal instructions\n", illegal_ops);
+
+	// Positive operands of 53 bits, square roots and quotients are defined
+	fpu_register dst[NUM_OPERANDS], src[NUM_OPERANDS];
+	for (int i = 0; i < NUM_OPERANDS; i++) {
+		dst[i] = random_normal(rand() % 21 - 10, 53);
+		src[i] = random_normal(rand() % 21 - 10, 53);
+		dst[i].high &= 0x7fff;
+		src[i].high &= 0x7fff;
+	}
+
+	// FMOVE doesn't take the fast path, it shows the cost of decoding and FPSR update
+	static const op_desc bench_ops[] = {
+		{0x00, "FMOVE"}, {0x22, "FADD"}, {0x28, "FSUB"}, {0x23, "FMUL"}, {0x20, "FDIV"}, {0x04, "FSQRT"}, {0x38, "FCMP"}, {0x66, "FDADD"}, {0x63, "FSMUL"}
+	};
+	printf("%-10s %14s %14s %10s\n", "double", "soft (ns)", "hybrid (ns)", "speedup");
+	for (int i = 0; i < (int)(sizeof(bench_ops) / sizeof(bench_ops[0])); i++) {
+		double t_soft = time_op(false, FPCR_PRECISION_DOUBLE, bench_ops[i].op, dst, src, n);
+		double t_hybrid = time_op(true, FPCR_PRECISION_DOUBLE, bench_ops[i].op, dst, src, n);
+		printf("%-10s %14.1f %14.1f %9.1fx\n", bench_ops[i].name, t_soft, t_hybrid, t_soft / t_hybrid);
+	}
+
+	// The long double library is itself up to about 2.7 ulp off for FATANH and FTANH
+	int math_errors = check_math(n / 20, 3.0);
+	printf("Transcendental functions within 3 ulp (%d arguments each): %s\n", n / 20, math_errors ? "FAILED" : "ok");
+
+	printf("%-10s %14s %14s %14s\n", "extended", "double (ns)", "accurate (ns)", "fast (ns)");
+	for (int i = 0; i < NUM_MATH_OPS; i++) {
+		for (int j = 0; j < NUM_OPERANDS; j++)
+			dst[j] = math_arg(math_ops[i]);
+		double t_host = time_math(math_ops[i], 0, dst, n / 10);
+		double t_accurate = time_math(math_ops[i], 1, dst, n / 10);
+		double t_fast = time_math(math_ops[i], 2, dst, n / 10);
+		printf("%-10s %14.1f %14.1f %14.1f\n", math_ops[i].name, t_host, t_accurate, t_fast);
+	}
+	return errors || toggle_errors || math_errors ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+ *  imgzip.cpp - Convert disk images to and from the compressed image format
+ *  Compile as: make imgzip
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+
+#include "zimage.h"
+
+
+static void usage(const char *prg)
+{
+	printf("Usage: %s [-c CHUNK_KB] [-n] INPUT OUTPUT\n", prg);
+	printf("       %s -d INPUT OUTPUT\n", prg);
+	printf("\n");
+	printf("Compresses the disk or CD-ROM image INPUT (default chunk size %u KB)\n", ZIMAGE_DEFAULT_CHUNK_SIZE / 1024);
+	printf("  -c  chunk size in KB (power of two)\n");
+	printf("  -n  don't store chunk checksums\n");
+	printf("  -d  decompress INPUT to a plain image\n");
+	exit(1);
+}
+
+
+/*
+ *  Big-endian fields
+ */
+
+static void put_be32(uint8 *p, uint32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void put_be64(uint8 *p, uint64 v)
+{
+	put_be32(p, uint32(v >> 32));
+	put_be32(p + 4, uint32(v));
+}
+
+
+/*
+ *  Write whole buffer, returns false on error
+ */
+
+static bool write_all(int fd, const void *buffer, size_t length)
+{
+	return write(fd, buffer, length) == ssize_t(length);
+}
+
+
+/*
+ *  Compress plain image
+ */
+
+static bool compress_image(const char *in_name, const char *out_name, uint32 chunk_size, bool checksums)
+{
+	int in_fd = open(in_name, O_RDONLY);
+	if (in_fd < 0) {
+		printf("Cannot open %s (%s)\n", in_name, strerror(errno));
+		return false;
+	}
+	loff_t size = lseek(in_fd, 0, SEEK_END);
+	lseek(in_fd, 0, SEEK_SET);
+
+	int out_fd = open(out_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (out_fd < 0) {
+		printf("Cannot create %s (%s)\n", out_name, strerror(errno));
+		close(in_fd);
+		return false;
+	}
+
+	uint32 num_chunks = (size + chunk_size - 1) / chunk_size;
+	size_t index_size = (num_chunks + 1) * 8;
+	size_t checksum_size = checksums ? num_chunks * 4 : 0;
+	uint8 *table = (uint8 *)calloc(1, ZIMAGE_HEADER_SIZE + index_size + checksum_size);
+	uint8 *in_buf = new uint8[chunk_size];
+	uLongf out_max = compressBound(chunk_size);
+	uint8 *out_buf = new uint8[out_max];
+
+	// Chunk data follows header and tables
+	loff_t pos = ZIMAGE_HEADER_SIZE + index_size + checksum_size;
+	bool ok = lseek(out_fd, pos, SEEK_SET) == pos;
+	uint32 num_zero = 0, num_stored = 0;
+	for (uint32 chunk=0; chunk<num_chunks && ok; chunk++) {
+		size_t length = chunk_size;
+		if ((loff_t)length > size - (loff_t)chunk * chunk_size)
+			length = size - (loff_t)chunk * chunk_size;
+		if (read(in_fd, in_buf, length) != ssize_t(length)) {
+			ok = false;
+			break;
+		}
+		put_be64(table + ZIMAGE_HEADER_SIZE + chunk * 8, pos);
+		if (checksums)
+			put_be32(table + ZIMAGE_HEADER_SIZE + index_size + chunk * 4, adler32(adler32(0, NULL, 0), in_buf, length));
+
+		size_t i = 0;
+		while (i < length && in_buf[i] == 0)
+			i++;
+		if (i == length) {
+			num_zero++;			// Zero chunk, nothing stored
+			continue;
+		}
+
+		uLongf out_length = out_max;
+		if (compress2(out_buf, &out_length, in_buf, length, Z_BEST_COMPRESSION) == Z_OK && out_length < length) {
+			ok = write_all(out_fd, out_buf, out_length);
+			pos += out_length;
+		} else {
+			ok = write_all(out_fd, in_buf, length);
+			pos += length;
+			num_stored++;
+		}
+	}
+	put_be64(table + ZIMAGE_HEADER_SIZE + num_chunks * 8, pos);
+
+	// Write header and tables
+	memcpy(table + ZIMAGE_MAGIC, "B2ZIMAGE", 8);
+	put_be32(table + ZIMAGE_VERSION, 1);
+	put_be32(table + ZIMAGE_CHUNK_SIZE, chunk_size);
+	put_be64(table + ZIMAGE_DISK_SIZE, size);
+	put_be32(table + ZIMAGE_NUM_CHUNKS, num_chunks);
+	put_be32(table + ZIMAGE_FLAGS, checksums ? ZIMAGE_CHECKSUMS : 0);
+	if (ok)
+		ok = lseek(out_fd, 0, SEEK_SET) == 0 && write_all(out_fd, table, ZIMAGE_HEADER_SIZE + index_size + checksum_size);
+	if (close(out_fd) < 0)
+		ok = false;
+	close(in_fd);
+
+	if (ok)
+		printf("%s: %llu -> %llu bytes (%d%%), %u chunks, %u empty, %u stored\n", out_name,
+			(unsigned long long)size, (unsigned long long)pos, size ? int(pos * 100 / size) : 100,
+			num_chunks, num_zero, num_stored);
+	else
+		printf("Compressing %s failed (%s)\n", in_name, strerror(errno));
+	free(table);
+	delete[] in_buf;
+	delete[] out_buf;
+	return ok;
+}
+
+
+/*
+ *  Decompress image to plain image
+ */
+
+static bool decompress_image(const char *in_name, const char *out_name)
+{
+	int in_fd = open(in_name, O_RDONLY);
+	if (in_fd < 0) {
+		printf("Cannot open %s (%s)\n", in_name, strerror(errno));
+		return false;
+	}
+	zimage *img = zimage_open(in_name, in_fd);
+	if (img == NULL) {
+		close(in_fd);
+		return false;
+	}
+
+	int out_fd = open(out_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (out_fd < 0) {
+		printf("Cannot create %s (%s)\n", out_name, strerror(errno));
+		zimage_close(img);
+		close(in_fd);
+		return false;
+	}
+
+	const size_t BUFFER_SIZE = 1024 * 1024;
+	uint8 *buffer = new uint8[BUFFER_SIZE];
+	loff_t size = zimage_size(img);
+	bool ok = true;
+	for (loff_t pos = 0; pos < size && ok; pos += BUFFER_SIZE) {
+		size_t n = BUFFER_SIZE;
+		if ((loff_t)n > size - pos)
+			n = size - pos;
+		ok = zimage_read(img, buffer, pos, n) == n && write_all(out_fd, buffer, n);
+	}
+	delete[] buffer;
+	if (close(out_fd) < 0)
+		ok = false;
+	if (!ok)
+		printf("Decompressing %s failed\n", in_name);
+
+	zimage_close(img);
+	close(in_fd);
+	return ok;
+}
+
+
+/*
+ *  Main program
+ */
+
+int main(int argc, char **argv)
+{
+	uint32 chunk_size = ZIMAGE_DEFAULT_CHUNK_SIZE;
+	bool checksums = true;
+	bool decompress = false;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			chunk_size = atoi(argv[++i]) * 1024;
+		else if (strcmp(argv[i], "-n") == 0)
+			checksums = false;
+		else if (strcmp(argv[i], "-d") == 0)
+			decompress = true;
+		else
+			usage(argv[0]);
+	}
+	if (argc - i != 2)
+		usage(argv[0]);
+	if (chunk_size < 512 || (chunk_size & (chunk_size - 1))) {
+		printf("Invalid chunk size\n");
+		return 1;
+	}
+
+	bool ok;
+	if (decompress)
+		ok = decompress_image(argv[i], argv[i + 1]);
+	else
+		ok = compress_image(argv[i], argv[i + 1], chunk_size, checksums);
+	return ok ? 0 : 1;
+}
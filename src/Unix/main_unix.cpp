@@ -76,6 +76,7 @@ using std::string;
 #include "rom_patches.h"
 #include "xpram.h"
 #include "timer.h"
+#include "clock.h"
 #include "video.h"
 #include "emul_op.h"
 #include "prefs.h"
@@ -149,6 +150,7 @@ static pthread_t xpram_thread;						// XPRAM watchdog
 static bool tick_thread_active = false;				// Flag: 60Hz thread installed
 static volatile bool tick_thread_cancel = false;	// Flag: Cancel 60Hz thread
 static pthread_t tick_thread;						// 60Hz thread
+static ClockTicker tick_ticker;						// 60Hz deadlines and jitter statistics
 static pthread_attr_t tick_thread_attr;				// 60Hz thread attributes
 
 static pthread_mutex_t intflag_lock = PTHREAD_MUTEX_INITIALIZER;	// Mutex to protect InterruptFlags
@@ -388,6 +390,7 @@ int main(int argc, char **argv)
 	ROMBaseHost = NULL;
 	srand(time(NULL));
 	tzset();
+	ClockInit();
 
 	// Print some info
 	printf(GetString(STR_ABOUT_TEXT1), VERSION_MAJOR, VERSION_MINOR);
@@ -846,6 +849,7 @@ void QuitEmulator(void)
 		pthread_cancel(tick_thread);
 #endif
 		pthread_join(tick_thread, NULL);
+		clock_ticker_report(tick_ticker, "60Hz thread");
 	}
 #elif defined(HAVE_TIMER_CREATE) && defined(_POSIX_REALTIME_SIGNALS)
 	// Stop 60Hz timer
@@ -1179,21 +1183,11 @@ static void one_tick(...)
 #ifdef USE_PTHREADS_SERVICES
 static void *tick_func(void *arg)
 {
-	uint64 start = GetTicks_usec();
-	int64 ticks = 0;
-	uint64 next = GetTicks_usec();
+	clock_ticker_init(tick_ticker, 16625);
 	while (!tick_thread_cancel) {
 		one_tick();
-		next += 16625;
-		int64 delay = next - GetTicks_usec();
-		if (delay > 0)
-			Delay_usec(delay);
-		else if (delay < -16625)
-			next = GetTicks_usec();
-		ticks++;
+		clock_ticker_wait(tick_ticker);
 	}
-	uint64 end = GetTicks_usec();
-	D(bug("%lld ticks in %lld usec = %f ticks/sec\n", ticks, end - start, ticks * 1000000.0 / (end - start)));
 	return NULL;
 }
 #endif
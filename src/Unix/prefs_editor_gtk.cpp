@@ -23,6 +23,7 @@
 #include <gtk/gtk.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
@@ -577,10 +578,14 @@ static void create_volume_ok(GtkWidget *button, file_req_assoc *assoc)
 	const gchar *str = gtk_entry_get_text(GTK_ENTRY(assoc->entry));
 	int size = atoi(str);
 
-	char cmd[1024];
-	sprintf(cmd, "dd if=/dev/zero \"of=%s\" bs=1024k count=%d", file, size);
-	int ret = system(cmd);
-	if (ret == 0)
+	// Create sparse file, blocks are only allocated when written to
+	bool ok = false;
+	int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd >= 0) {
+		ok = ftruncate(fd, (loff_t)size * 1024 * 1024) == 0;
+		close(fd);
+	}
+	if (ok)
 		gtk_clist_append(GTK_CLIST(volume_list), &file);
 	gtk_widget_destroy(GTK_WIDGET(assoc->req));
 	delete assoc;
@@ -1558,6 +1563,8 @@ static void read_settings(void)
 #include <errno.h>
 #include <sys/wait.h>
 #include "rpc.h"
+#include "block_cache.h"
+#include "zimage.h"
 
 /*
  *  Fake unused data and functions
@@ -1566,6 +1573,19 @@ static void read_settings(void)
 uint8 XPRAM[XPRAM_SIZE];
 void MountVolume(void *fh) { }
 void FileDiskLayout(loff_t size, uint8 *data, loff_t &start_byte, loff_t &real_size) { }
+block_cache_file *block_cache_open(void *fh, block_cache_io_func read_func, block_cache_io_func write_func, bool write_back) { return NULL; }
+void block_cache_close(block_cache_file *f) { }
+void block_cache_flush(block_cache_file *f) { }
+void block_cache_invalidate(block_cache_file *f) { }
+size_t block_cache_read(block_cache_file *f, void *buffer, loff_t offset, size_t length) { return 0; }
+size_t block_cache_write(block_cache_file *f, void *buffer, loff_t offset, size_t length) { return 0; }
+#ifdef HAVE_LIBZ
+bool zimage_check(const uint8 *header) { return false; }
+zimage *zimage_open(const char *name, int fd) { return NULL; }
+void zimage_close(zimage *img) { }
+loff_t zimage_size(zimage *img) { return 0; }
+size_t zimage_read(zimage *img, void *buffer, loff_t offset, size_t length) { return 0; }
+#endif
 
 #if defined __APPLE__ && defined __MACH__
 void DarwinSysInit(void) { }
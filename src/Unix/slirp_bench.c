@@ -0,0 +1,372 @@
+/*
+ *  slirp_bench.c - Check and benchmark slirp checksum and mbuf pool
+ *  Compile as: make slirp_bench
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  cksum.c and mbuf.c are compiled into this program, the rest of slirp
+ *  is replaced by stubs below. cksum() is compared bit for bit with the
+ *  former 16 bit loop for all lengths and start alignments, then both
+ *  are timed on full size packets. mbuf allocation through the pool is
+ *  timed against the former free list allocator, which malloc()ed mbufs
+ *  beyond mbuf_thresh and M_EXT buffers.
+ */
+
+#include "../slirp/cksum.c"
+#include "../slirp/mbuf.c"
+
+#include <sys/time.h>
+
+
+/*
+ *  Replacements for slirp functions and variables used by mbuf.c
+ */
+
+int if_mtu = 1500, if_mru = 1500;
+int if_maxlinkhdr = 2 + 14 + 40;
+int slirp_debug = 0;
+FILE *dfd = NULL;
+
+struct quehead {
+	struct quehead *qh_link;
+	struct quehead *qh_rlink;
+};
+
+void slirp_insque(void *a, void *b)
+{
+	struct quehead *element = (struct quehead *)a;
+	struct quehead *head = (struct quehead *)b;
+	element->qh_link = head->qh_link;
+	head->qh_link = element;
+	element->qh_rlink = head;
+	element->qh_link->qh_rlink = element;
+}
+
+void slirp_remque(void *a)
+{
+	struct quehead *element = (struct quehead *)a;
+	element->qh_link->qh_rlink = element->qh_rlink;
+	element->qh_rlink->qh_link = element->qh_link;
+	element->qh_rlink = NULL;
+}
+
+
+/*
+ *  Former mbuf allocator: a free list of at most 30 mbufs, anything beyond
+ *  is malloc()ed and free()d again, M_EXT buffers always are
+ */
+
+static struct mbuf old_freelist, old_usedlist;
+static int old_alloced = 0;
+static const int old_thresh = 30;
+
+static struct mbuf *old_m_get(void)
+{
+	register struct mbuf *m;
+	int flags = 0;
+
+	if (old_freelist.m_next == &old_freelist) {
+		m = (struct mbuf *)malloc(msize);
+		if (m == NULL) goto end_error;
+		old_alloced++;
+		if (old_alloced > old_thresh)
+			flags = M_DOFREE;
+	} else {
+		m = old_freelist.m_next;
+		remque(m);
+	}
+
+	/* Insert it in the used list */
+	insque(m,&old_usedlist);
+	m->m_flags = (flags | M_USEDLIST);
+
+	/* Initialise it */
+	m->m_size = msize - sizeof(struct m_hdr);
+	m->m_data = m->m_dat;
+	m->m_len = 0;
+	m->m_nextpkt = 0;
+	m->m_prevpkt = 0;
+end_error:
+	return m;
+}
+
+static void old_m_free(struct mbuf *m)
+{
+  if(m) {
+	/* Remove from m_usedlist */
+	if (m->m_flags & M_USEDLIST)
+	   remque(m);
+
+	/* If it's M_EXT, free() it */
+	if (m->m_flags & M_EXT)
+	   free(m->m_ext);
+
+	/*
+	 * Either free() it or put it on the free list
+	 */
+	if (m->m_flags & M_DOFREE) {
+		free(m);
+		old_alloced--;
+	} else if ((m->m_flags & M_FREELIST) == 0) {
+		insque(m,&old_freelist);
+		m->m_flags = M_FREELIST; /* Clobber other flags */
+	}
+  } /* if(m) */
+}
+
+static void old_m_inc(struct mbuf *m, int size)
+{
+       int datasize;
+
+        if(m->m_size>size) return;
+
+        if (m->m_flags & M_EXT) {
+         datasize = m->m_data - m->m_ext;
+	  m->m_ext = (char *)realloc(m->m_ext,size);
+         m->m_data = m->m_ext + datasize;
+        } else {
+	  char *dat;
+	  datasize = m->m_data - m->m_dat;
+	  dat = (char *)malloc(size);
+	  memcpy(dat, m->m_dat, m->m_size);
+
+	  m->m_ext = dat;
+	  m->m_data = m->m_ext + datasize;
+	  m->m_flags |= M_EXT;
+        }
+
+        m->m_size = size;
+}
+
+
+/*
+ *  Former checksum loop
+ */
+
+#define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
+#define OLD_REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
+
+static int old_cksum(struct mbuf *m, int len)
+{
+	register u_int16_t *w;
+	register int sum = 0;
+	register int mlen = 0;
+	int byte_swapped = 0;
+
+	union {
+		u_int8_t	c[2];
+		u_int16_t	s;
+	} s_util;
+	union {
+		u_int16_t s[2];
+		u_int32_t l;
+	} l_util;
+
+	if (m->m_len == 0)
+	   goto cont;
+	w = mtod(m, u_int16_t *);
+
+	mlen = m->m_len;
+
+	if (len < mlen)
+	   mlen = len;
+	len -= mlen;
+	if ((1 & (long) w) && (mlen > 0)) {
+		OLD_REDUCE;
+		sum <<= 8;
+		s_util.c[0] = *(u_int8_t *)w;
+		w = (u_int16_t *)((int8_t *)w + 1);
+		mlen--;
+		byte_swapped = 1;
+	}
+	while ((mlen -= 32) >= 0) {
+		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
+		sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
+		sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
+		sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
+		w += 16;
+	}
+	mlen += 32;
+	while ((mlen -= 8) >= 0) {
+		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
+		w += 4;
+	}
+	mlen += 8;
+	if (mlen == 0 && byte_swapped == 0)
+	   goto cont;
+	OLD_REDUCE;
+	while ((mlen -= 2) >= 0) {
+		sum += *w++;
+	}
+
+	if (byte_swapped) {
+		OLD_REDUCE;
+		sum <<= 8;
+		byte_swapped = 0;
+		if (mlen == -1) {
+			s_util.c[1] = *(u_int8_t *)w;
+			sum += s_util.s;
+			mlen = 0;
+		} else
+		   mlen = -1;
+	} else if (mlen == -1)
+	   s_util.c[0] = *(u_int8_t *)w;
+
+cont:
+	if (mlen == -1) {
+		s_util.c[1] = 0;
+		sum += s_util.s;
+	}
+	OLD_REDUCE;
+	return (~sum & 0xffff);
+}
+
+
+/*
+ *  Benchmark
+ */
+
+static double now_sec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+#define MAX_LEN 9000
+
+// Compare cksum() with the former loop, returns number of mismatches
+static int check_cksum(struct mbuf *m, u_int8_t *buf)
+{
+	int align, len, pattern, errors = 0;
+
+	for (pattern = 0; pattern < 3; pattern++) {
+		for (len = 0; len < MAX_LEN + 8; len++) {
+			switch (pattern) {
+				case 0: buf[len] = rand(); break;
+				case 1: buf[len] = 0xff; break;		// Worst case for carries
+				case 2: buf[len] = 0; break;
+			}
+		}
+		for (align = 0; align < 8; align++) {
+			for (len = 0; len <= MAX_LEN; len++) {
+				m->m_data = (caddr_t)buf + align;
+				m->m_len = len;
+				if (cksum(m, len) != old_cksum(m, len)) {
+					if (errors++ < 10)
+						printf("MISMATCH pattern %d, align %d, len %d: %04x, former %04x\n",
+							pattern, align, len, cksum(m, len), old_cksum(m, len));
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+// Time checksums of len bytes, returns MB/s
+static double time_cksum(struct mbuf *m, u_int8_t *buf, int len, int old, int n)
+{
+	int i;
+	volatile int sum = 0;
+	double start;
+
+	m->m_data = (caddr_t)buf;
+	m->m_len = len;
+	start = now_sec();
+	for (i = 0; i < n; i++)
+		sum += old ? old_cksum(m, len) : cksum(m, len);
+	return (double)len * n / (now_sec() - start) / 1e6;
+}
+
+// Time packets through mbufs like the TCP path does, returns nsec per packet
+static double time_mbufs(int pool, int ext, int n)
+{
+	struct mbuf *q[64];
+	int i, j;
+	double start = now_sec();
+
+	for (i = 0; i < n; i += 64) {
+		for (j = 0; j < 64; j++) {
+			if (pool) {
+				q[j] = m_get();
+				if (ext)
+					m_inc(q[j], q[j]->m_size + MINCSIZE);
+			} else {
+				q[j] = old_m_get();
+				if (ext)
+					old_m_inc(q[j], q[j]->m_size + MINCSIZE);
+			}
+		}
+		for (j = 0; j < 64; j++) {
+			if (pool)
+				m_free(q[j]);
+			else
+				old_m_free(q[j]);
+		}
+	}
+	return (now_sec() - start) * 1e9 / n;
+}
+
+int main(int argc, char **argv)
+{
+	int n = 200000, errors;
+	struct mbuf *m;
+	u_int8_t *buf;
+
+	if (argc > 1)
+		n = atoi(argv[1]);
+	if (n <= 0) {
+		printf("Usage: %s [ITERATIONS]\n", argv[0]);
+		return 1;
+	}
+
+	m_init();
+	old_freelist.m_next = old_freelist.m_prev = &old_freelist;
+	old_usedlist.m_next = old_usedlist.m_prev = &old_usedlist;
+	m = m_get();
+	buf = (u_int8_t *)malloc(MAX_LEN + 16);
+
+	errors = check_cksum(m, buf);
+	printf("cksum() bit exactness: %s\n", errors ? "FAILED" : "ok");
+
+	printf("%-12s %14s %14s %10s\n", "cksum", "former (MB/s)", "new (MB/s)", "speedup");
+	{
+		static const int lens[3] = {20, 576, 1500};
+		int i;
+		for (i = 0; i < 3; i++) {
+			double t_old = time_cksum(m, buf, lens[i], 1, n * 10);
+			double t_new = time_cksum(m, buf, lens[i], 0, n * 10);
+			printf("%5d bytes  %14.0f %14.0f %9.1fx\n", lens[i], t_old, t_new, t_new / t_old);
+		}
+	}
+	m_free(m);
+
+	printf("%-12s %14s %14s %10s\n", "mbufs", "former (ns)", "pool (ns)", "speedup");
+	{
+		int ext;
+		for (ext = 0; ext < 2; ext++) {
+			double t_old = time_mbufs(0, ext, n);
+			double t_pool = time_mbufs(1, ext, n);
+			printf("%-12s %14.1f %14.1f %9.1fx\n", ext ? "with M_EXT" : "plain", t_old, t_pool, t_old / t_pool);
+		}
+	}
+
+	free(buf);
+	return errors ? 1 : 0;
+}
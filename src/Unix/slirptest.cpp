@@ -0,0 +1,463 @@
+/*
+ *  slirptest.cpp - Test slirp Ethernet backend against local services
+ *  Compile as: make slirptest
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  This program plays the emulated Mac: it runs ether_slirp.cpp with a
+ *  worker thread like the PSP2 Ethernet driver does, and exchanges raw
+ *  Ethernet frames with it through ether_slirp_write()/ether_slirp_read().
+ *  The peers are sockets on the local host:
+ *   - ARP resolution of the gateway
+ *   - TCP connection from the Mac to a host listener, with data
+ *   - UDP datagram from the Mac to a host socket and back
+ *   - UDP round trips, the worker must be woken up by queued packets
+ *     instead of waiting for its poll timeout
+ *   - TCP connection to a "redir" host port, forwarded to the Mac
+ *  Build with -DUSE_WAKEUP_SOCKET=1 to test the wakeup socket used on PSP2.
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ether_slirp.h"
+
+// Addresses of the slirp network
+static const uint8 gateway_ether[6] = {0x52, 0x54, 0x00, 0x12, 0x35, 0x02};
+static const uint32 mac_ip = 0x0a00020f;		// 10.0.2.15
+static const uint32 gateway_ip = 0x0a000202;	// 10.0.2.2
+
+// Port redirection set up through the "redir" prefs item
+static char redir_pref[64];
+static int redir_host_port, redir_guest_port;
+
+// Poll timeout of the worker thread, long enough to make missed wakeups obvious
+const int WORKER_POLL_USEC = 1000000;
+
+static volatile bool worker_active;
+static int failures;
+
+
+/*
+ *  Replacements for emulator functions used by ether_slirp.cpp
+ */
+
+const char *PrefsFindString(const char *name, int index)
+{
+	if (strcmp(name, "redir") == 0 && index == 0)
+		return redir_pref;
+	return NULL;
+}
+
+
+/*
+ *  slirp worker thread
+ */
+
+static void *worker_func(void *arg)
+{
+	while (worker_active)
+		ether_slirp_poll(WORKER_POLL_USEC);
+	return NULL;
+}
+
+
+/*
+ *  Packet construction
+ */
+
+static void put16(uint8 *p, uint16 v) { p[0] = v >> 8; p[1] = v; }
+static void put32(uint8 *p, uint32 v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static uint16 get16(const uint8 *p) { return (p[0] << 8) | p[1]; }
+static uint32 get32(const uint8 *p) { return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+static uint32 cksum_add(uint32 sum, const uint8 *p, int len)
+{
+	for (int i=0; i<len-1; i+=2)
+		sum += get16(p + i);
+	if (len & 1)
+		sum += p[len - 1] << 8;
+	return sum;
+}
+
+static uint16 cksum_fold(uint32 sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+static int build_ip(uint8 *packet, uint8 proto, uint32 dst_ip, const uint8 *l4, int l4_len)
+{
+	memcpy(packet, gateway_ether, 6);
+	memcpy(packet + 6, ether_slirp_addr, 6);
+	put16(packet + 12, 0x0800);
+
+	uint8 *ip = packet + 14;
+	memset(ip, 0, 20);
+	ip[0] = 0x45;
+	put16(ip + 2, 20 + l4_len);
+	ip[8] = 64;
+	ip[9] = proto;
+	put32(ip + 12, mac_ip);
+	put32(ip + 16, dst_ip);
+	put16(ip + 10, cksum_fold(cksum_add(0, ip, 20)));
+	memcpy(ip + 20, l4, l4_len);
+
+	// TCP/UDP checksum over pseudo header
+	uint8 pseudo[12];
+	memcpy(pseudo, ip + 12, 8);
+	pseudo[8] = 0;
+	pseudo[9] = proto;
+	put16(pseudo + 10, l4_len);
+	uint16 sum = cksum_fold(cksum_add(cksum_add(0, pseudo, 12), ip + 20, l4_len));
+	put16(ip + 20 + (proto == 6 ? 16 : 6), sum);
+	return 14 + 20 + l4_len;
+}
+
+static void send_tcp(uint16 sport, uint32 dst_ip, uint16 dport, uint32 seq, uint32 ack, uint8 flags, const char *data)
+{
+	uint8 tcp[20 + 64], packet[1514];
+	int data_len = data ? strlen(data) : 0;
+	memset(tcp, 0, 20);
+	put16(tcp, sport);
+	put16(tcp + 2, dport);
+	put32(tcp + 4, seq);
+	put32(tcp + 8, ack);
+	tcp[12] = 5 << 4;
+	tcp[13] = flags;
+	put16(tcp + 14, 8192);
+	memcpy(tcp + 20, data, data_len);
+	ether_slirp_write(packet, build_ip(packet, 6, dst_ip, tcp, 20 + data_len));
+}
+
+static void send_udp(uint16 sport, uint32 dst_ip, uint16 dport, const char *data)
+{
+	uint8 udp[8 + 64], packet[1514];
+	int data_len = strlen(data);
+	put16(udp, sport);
+	put16(udp + 2, dport);
+	put16(udp + 4, 8 + data_len);
+	put16(udp + 6, 0);
+	memcpy(udp + 8, data, data_len);
+	ether_slirp_write(packet, build_ip(packet, 17, dst_ip, udp, 8 + data_len));
+}
+
+
+/*
+ *  Wait for packet of given IP protocol (0 = ARP), returns pointer to IP payload or NULL
+ */
+
+static uint8 rx_packet[1514];
+
+static uint8 *wait_packet(int proto, uint16 dport)
+{
+	struct timeval start, now;
+	gettimeofday(&start, NULL);
+	do {
+		int len = ether_slirp_read(rx_packet, sizeof(rx_packet));
+		if (len >= 42) {
+			uint16 type = get16(rx_packet + 12);
+			if (proto == 0 && type == 0x0806)
+				return rx_packet + 14;
+			uint8 *ip = rx_packet + 14;
+			if (type == 0x0800 && ip[9] == proto && get16(ip + 20 + 2) == dport)
+				return ip + (ip[0] & 15) * 4;
+		} else
+			usleep(1000);
+		gettimeofday(&now, NULL);
+	} while ((now.tv_sec - start.tv_sec) * 1000000 + now.tv_usec - start.tv_usec < 2000000);
+	return NULL;
+}
+
+static void check(bool ok, const char *what)
+{
+	printf("%-50s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+
+/*
+ *  Host sockets
+ */
+
+static int host_socket(int type, int *port)
+{
+	int s = socket(PF_INET, type, 0);
+	int on = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_ANY);
+	socklen_t sa_len = sizeof(sa);
+	if (bind(s, (struct sockaddr *)&sa, sizeof(sa)) < 0 || getsockname(s, (struct sockaddr *)&sa, &sa_len) < 0) {
+		perror("bind");
+		exit(1);
+	}
+	*port = ntohs(sa.sin_port);
+	return s;
+}
+
+static bool wait_readable(int s)
+{
+	fd_set rfds;
+	FD_ZERO(&rfds);
+	FD_SET(s, &rfds);
+	struct timeval tv = {2, 0};
+	return select(s + 1, &rfds, NULL, NULL, &tv) > 0;
+}
+
+
+/*
+ *  Tests
+ */
+
+static void test_arp(void)
+{
+	uint8 arp[28], packet[60];
+	memset(packet, 0, sizeof(packet));
+	memset(packet, 0xff, 6);
+	memcpy(packet + 6, ether_slirp_addr, 6);
+	put16(packet + 12, 0x0806);
+	put16(arp, 1);					// Ethernet
+	put16(arp + 2, 0x0800);			// IP
+	arp[4] = 6;
+	arp[5] = 4;
+	put16(arp + 6, 1);				// Request
+	memcpy(arp + 8, ether_slirp_addr, 6);
+	put32(arp + 14, mac_ip);
+	memset(arp + 18, 0, 6);
+	put32(arp + 24, gateway_ip);
+	memcpy(packet + 14, arp, sizeof(arp));
+	ether_slirp_write(packet, sizeof(packet));
+
+	uint8 *reply = wait_packet(0, 0);
+	check(reply && get16(reply + 6) == 2 && get32(reply + 14) == gateway_ip, "ARP reply for gateway");
+}
+
+static void test_tcp_out(void)
+{
+	int port;
+	int ls = host_socket(SOCK_STREAM, &port);
+	listen(ls, 1);
+
+	// SYN from Mac to gateway is connected to the host
+	const uint16 mac_port = 1025;
+	uint32 seq = 1000;
+	send_tcp(mac_port, gateway_ip, port, seq, 0, 0x02, NULL);
+	uint8 *tcp = wait_packet(6, mac_port);
+	bool ok = tcp && (tcp[13] & 0x12) == 0x12 && get32(tcp + 8) == seq + 1;
+	check(ok, "TCP SYN to host listener answered with SYN-ACK");
+	if (!ok) {
+		close(ls);
+		return;
+	}
+	int cs = wait_readable(ls) ? accept(ls, NULL, NULL) : -1;
+	check(cs >= 0, "TCP connection accepted by host");
+
+	// Data from Mac arrives at host
+	uint32 ack = get32(tcp + 4) + 1;
+	seq++;
+	send_tcp(mac_port, gateway_ip, port, seq, ack, 0x18, "Hello host");
+	char buf[64];
+	int n = cs >= 0 && wait_readable(cs) ? read(cs, buf, sizeof(buf) - 1) : -1;
+	if (n >= 0)
+		buf[n] = 0;
+	check(n == 10 && strcmp(buf, "Hello host") == 0, "TCP data from Mac received by host");
+
+	// Out-of-order segments are reassembled
+	seq += 10;
+	send_tcp(mac_port, gateway_ip, port, seq + 3, ack, 0x18, "def");
+	send_tcp(mac_port, gateway_ip, port, seq, ack, 0x18, "abc");
+	seq += 6;
+	n = 0;
+	while (cs >= 0 && n < 6 && wait_readable(cs)) {
+		int r = read(cs, buf + n, sizeof(buf) - 1 - n);
+		if (r <= 0)
+			break;
+		n += r;
+	}
+	buf[n] = 0;
+	check(n == 6 && strcmp(buf, "abcdef") == 0, "TCP segments out of order reassembled");
+
+	// Data from host arrives at Mac
+	if (cs >= 0)
+		write(cs, "Hello Mac", 9);
+	bool got = false;
+	while ((tcp = wait_packet(6, mac_port)) != NULL) {
+		int len = get16(rx_packet + 14 + 2) - 20 - (tcp[12] >> 4) * 4;
+		if (len == 9 && memcmp(tcp + (tcp[12] >> 4) * 4, "Hello Mac", 9) == 0) {
+			got = true;
+			break;
+		}
+	}
+	check(got, "TCP data from host received by Mac");
+
+	if (cs >= 0)
+		close(cs);
+	close(ls);
+}
+
+static void test_udp(void)
+{
+	int port;
+	int s = host_socket(SOCK_DGRAM, &port);
+
+	const uint16 mac_port = 1026;
+	send_udp(mac_port, gateway_ip, port, "ping");
+	char buf[64];
+	struct sockaddr_in from;
+	socklen_t from_len = sizeof(from);
+	int n = wait_readable(s) ? recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len) : -1;
+	check(n == 4 && memcmp(buf, "ping", 4) == 0, "UDP datagram from Mac received by host");
+
+	if (n > 0)
+		sendto(s, "pong", 4, 0, (struct sockaddr *)&from, from_len);
+	uint8 *udp = wait_packet(17, mac_port);
+	check(udp && get16(udp + 4) == 12 && memcmp(udp + 8, "pong", 4) == 0, "UDP reply from host received by Mac");
+	close(s);
+}
+
+static void test_udp_frag(void)
+{
+	int port;
+	int s = host_socket(SOCK_DGRAM, &port);
+
+	// Build the datagram, then send it as two fragments, last one first
+	const uint16 mac_port = 1027;
+	const char *data = "fragmented datagram payload";
+	int data_len = strlen(data);
+	uint8 udp[8 + 64], packet[1514], frag[1514];
+	put16(udp, mac_port);
+	put16(udp + 2, port);
+	put16(udp + 4, 8 + data_len);
+	put16(udp + 6, 0);
+	memcpy(udp + 8, data, data_len);
+	int len = build_ip(packet, 17, gateway_ip, udp, 8 + data_len);
+
+	const int split = 16;	// multiple of 8
+	for (int i=1; i>=0; i--) {
+		int off = i ? split : 0;
+		int frag_len = i ? len - 34 - split : split;
+		memcpy(frag, packet, 34);
+		memcpy(frag + 34, packet + 34 + off, frag_len);
+		uint8 *ip = frag + 14;
+		put16(ip + 2, 20 + frag_len);
+		put16(ip + 4, 0x1234);
+		put16(ip + 6, (i ? 0 : 0x2000) | (off >> 3));	// MF on the first fragment
+		put16(ip + 10, 0);
+		put16(ip + 10, cksum_fold(cksum_add(0, ip, 20)));
+		ether_slirp_write(frag, 34 + frag_len);
+	}
+
+	char buf[64];
+	int n = wait_readable(s) ? recv(s, buf, sizeof(buf), 0) : -1;
+	check(n == data_len && memcmp(buf, data, data_len) == 0, "IP fragments from Mac reassembled");
+	close(s);
+}
+
+static void test_udp_latency(void)
+{
+	int port;
+	int s = host_socket(SOCK_DGRAM, &port);
+
+	const uint16 mac_port = 1027;
+	const int ROUNDS = 100;
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	int i;
+	for (i=0; i<ROUNDS; i++) {
+		send_udp(mac_port, gateway_ip, port, "ping");
+		char buf[64];
+		struct sockaddr_in from;
+		socklen_t from_len = sizeof(from);
+		if (!wait_readable(s) || recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len) != 4)
+			break;
+		sendto(s, "pong", 4, 0, (struct sockaddr *)&from, from_len);
+		if (wait_packet(17, mac_port) == NULL)
+			break;
+	}
+	gettimeofday(&end, NULL);
+	double usec = ((end.tv_sec - start.tv_sec) * 1e6 + end.tv_usec - start.tv_usec) / ROUNDS;
+	printf("UDP round trip: %.0f usec\n", usec);
+	check(i == ROUNDS && usec < WORKER_POLL_USEC / 10, "Queued packets wake up the worker thread");
+	close(s);
+}
+
+static void test_redir(void)
+{
+	int s = socket(PF_INET, SOCK_STREAM, 0);
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sa.sin_port = htons(redir_host_port);
+	connect(s, (struct sockaddr *)&sa, sizeof(sa));
+
+	uint8 *tcp = wait_packet(6, redir_guest_port);
+	check(tcp && (tcp[13] & 0x12) == 0x02, "Redirected host port connects to Mac");
+	close(s);
+}
+
+
+int main(int argc, char **argv)
+{
+	// Pick a free host port for the redirection
+	int s = host_socket(SOCK_STREAM, &redir_host_port);
+	close(s);
+	redir_guest_port = 7;
+	sprintf(redir_pref, "tcp:%d:%d", redir_host_port, redir_guest_port);
+
+	// Use given DNS server if the host has no /etc/resolv.conf
+	if (!ether_slirp_init(argc > 1 ? argv[1] : NULL) && !ether_slirp_init("10.0.2.3")) {
+		printf("Cannot initialize slirp\n");
+		return 1;
+	}
+
+	pthread_t worker;
+	worker_active = true;
+	pthread_create(&worker, NULL, worker_func, NULL);
+
+	test_arp();
+	test_tcp_out();
+	test_udp();
+	test_udp_frag();
+	test_udp_latency();
+	test_redir();
+
+	worker_active = false;
+	pthread_join(worker, NULL);
+	ether_slirp_exit();
+
+	printf("%s\n", failures ? "Some tests FAILED" : "All tests passed");
+	return failures ? 1 : 0;
+}
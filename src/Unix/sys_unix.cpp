@@ -24,6 +24,11 @@
 #include <sys/stat.h>
 #include <errno.h>
 
+#if BLOCK_CACHE_PREFETCH
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
 #ifdef HAVE_AVAILABILITYMACROS_H
 #include <AvailabilityMacros.h>
 #endif
@@ -55,6 +60,9 @@
 #include "prefs.h"
 #include "user_strings.h"
 #include "sys.h"
+#include "block_cache.h"
+#include "cow_image.h"
+#include "zimage.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -71,6 +79,9 @@ struct file_handle {
 	loff_t start_byte;	// Size of file header (if any)
 	loff_t file_size;	// Size of file data (only valid if is_file is true)
 	bool is_media_present;		// Flag: media is inserted and available
+	block_cache_file *cache;	// Block cache state (NULL = uncached)
+	cow_image *cow;				// Copy-on-write overlay (NULL = plain image)
+	zimage *zimg;				// Compressed image (NULL = plain image)
 
 #if defined(__linux__)
 	int cdrom_cap;		// CD-ROM capability flags (only valid if is_cdrom is true)
@@ -492,6 +503,43 @@ static bool is_drive_mounted(const char *dev_name, char *mount_name)
 }
 
 
+/*
+ *  Uncached read/write, used by the block cache
+ */
+
+static size_t read_raw(void *arg, void *buffer, loff_t offset, size_t length)
+{
+	file_handle *fh = (file_handle *)arg;
+	if (fh->cow)
+		return cow_image_read(fh->cow, buffer, offset + fh->start_byte, length);
+	if (fh->zimg)
+		return zimage_read(fh->zimg, buffer, offset + fh->start_byte, length);
+
+	// Seek to position
+	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
+		return 0;
+
+	// Read data
+	return read(fh->fd, buffer, length);
+}
+
+static size_t write_raw(void *arg, void *buffer, loff_t offset, size_t length)
+{
+	file_handle *fh = (file_handle *)arg;
+	if (fh->cow)
+		return cow_image_write(fh->cow, buffer, offset + fh->start_byte, length);
+	if (fh->zimg)
+		return 0;
+
+	// Seek to position
+	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
+		return 0;
+
+	// Write data
+	return write(fh->fd, buffer, length);
+}
+
+
 /*
  *  Open file/device, create new file handle (returns NULL on error)
  */
@@ -568,6 +616,9 @@ void *Sys_open(const char *name, bool read_only)
 		fh->is_floppy = is_floppy;
 		fh->is_cdrom = is_cdrom;
 		fh->is_media_present = false;
+		fh->cache = NULL;
+		fh->cow = NULL;
+		fh->zimg = NULL;
 #if defined __MACOSX__
 		fh->ioctl_fd = -1;
 		fh->ioctl_name = NULL;
@@ -580,7 +631,35 @@ void *Sys_open(const char *name, bool read_only)
 			uint8 data[256];
 			lseek(fd, 0, SEEK_SET);
 			read(fd, data, 256);
+			if (cow_image_check(data)) {
+				// Overlay file, access the disk through it
+				fh->cow = cow_image_open(name, fd, read_only);
+				if (fh->cow == NULL) {
+					close(fd);
+					free(fh->name);
+					delete fh;
+					return NULL;
+				}
+				size = cow_image_size(fh->cow);
+				cow_image_read(fh->cow, data, 0, 256);
+			} else if (zimage_check(data)) {
+				// Compressed image, always read-only
+				fh->zimg = zimage_open(name, fd);
+				if (fh->zimg == NULL) {
+					close(fd);
+					free(fh->name);
+					delete fh;
+					return NULL;
+				}
+				fh->read_only = read_only = true;
+				size = zimage_size(fh->zimg);
+				zimage_read(fh->zimg, data, 0, 256);
+			}
 			FileDiskLayout(size, data, fh->start_byte, fh->file_size);
+
+			// Floppy images are always written through, they may be swapped by the user
+			bool write_back = !read_only && fh->file_size > MAX_FLOPPY_IMAGE_SIZE && PrefsFindBool("blockcachewb");
+			fh->cache = block_cache_open(fh, read_raw, write_raw, write_back);
 		} else {
 			struct stat st;
 			if (fstat(fd, &st) == 0) {
@@ -645,6 +724,12 @@ void Sys_close(void *arg)
 
 	sys_remove_file_handle(fh);
 
+	if (fh->cache)
+		block_cache_close(fh->cache);
+	if (fh->cow)
+		cow_image_close(fh->cow);
+	if (fh->zimg)
+		zimage_close(fh->zimg);
 	if (fh->is_cdrom)
 		cdrom_close(fh);
 	if (fh->fd >= 0)
@@ -666,12 +751,9 @@ size_t Sys_read(void *arg, void *buffer, loff_t offset, size_t length)
 	if (!fh)
 		return 0;
 
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
-
-	// Read data
-	return read(fh->fd, buffer, length);
+	if (fh->cache)
+		return block_cache_read(fh->cache, buffer, offset, length);
+	return read_raw(fh, buffer, offset, length);
 }
 
 
@@ -686,12 +768,9 @@ size_t Sys_write(void *arg, void *buffer, loff_t offset, size_t length)
 	if (!fh)
 		return 0;
 
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
-
-	// Write data
-	return write(fh->fd, buffer, length);
+	if (fh->cache)
+		return block_cache_write(fh->cache, buffer, offset, length);
+	return write_raw(fh, buffer, offset, length);
 }
 
 
@@ -741,6 +820,9 @@ void SysEject(void *arg)
 	if (!fh)
 		return;
 
+	if (fh->cache)
+		block_cache_invalidate(fh->cache);
+
 #if defined(__linux__)
 	if (fh->is_floppy) {
 		if (fh->fd >= 0) {
@@ -1318,3 +1400,52 @@ void SysCDGetVolume(void *arg, uint8 &left, uint8 &right)
 #endif
 	}
 }
+
+
+#if BLOCK_CACHE_PREFETCH
+/*
+ *  Block cache prefetch thread
+ */
+
+static pthread_t prefetch_thread;
+static sem_t prefetch_signal;
+static volatile bool prefetch_thread_cancel;
+
+static void *prefetch_func(void *arg)
+{
+	while (!prefetch_thread_cancel) {
+		sem_wait(&prefetch_signal);
+		if (prefetch_thread_cancel)
+			break;
+		BlockCachePrefetch();
+	}
+	return NULL;
+}
+
+bool block_cache_prefetch_start(void)
+{
+	prefetch_thread_cancel = false;
+	if (sem_init(&prefetch_signal, 0, 0) < 0)
+		return false;
+	pthread_attr_t thread_attr;
+	Set_pthread_attr(&thread_attr, 0);
+	if (pthread_create(&prefetch_thread, &thread_attr, prefetch_func, NULL) != 0) {
+		sem_destroy(&prefetch_signal);
+		return false;
+	}
+	return true;
+}
+
+void block_cache_prefetch_stop(void)
+{
+	prefetch_thread_cancel = true;
+	sem_post(&prefetch_signal);
+	pthread_join(prefetch_thread, NULL);
+	sem_destroy(&prefetch_signal);
+}
+
+void block_cache_prefetch_wakeup(void)
+{
+	sem_post(&prefetch_signal);
+}
+#endif
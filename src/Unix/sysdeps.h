@@ -114,6 +114,25 @@
 #ifdef HAVE_PTHREADS
 #define USE_PTHREADS_SERVICES
 #endif
+
+/* Disk block cache reads ahead of sequential streams in a separate thread */
+#ifdef HAVE_PTHREADS
+#define BLOCK_CACHE_PREFETCH 1
+#endif
+
+/* Disk driver requests can be traced to a file ("disktrace" pref) */
+#define USE_DISK_TRACE 1
+
+/* Ethernet frames can be captured to a pcap file ("ethercapture" pref) */
+#ifdef HAVE_PTHREADS
+#define USE_ETHER_CAPTURE 1
+#endif
+
+/* ExtFS can watch its root for changes made by the host ("extfswatch" pref) */
+#ifdef HAVE_PTHREADS
+#define EXTFS_WATCH 1
+#endif
+
 #if EMULATED_68K
 #if defined(__NetBSD__)
 #define USE_CPU_EMUL_SERVICES
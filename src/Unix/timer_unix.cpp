@@ -21,6 +21,7 @@
 #include "sysdeps.h"
 #include "macos_util.h"
 #include "timer.h"
+#include "clock.h"
 
 #include <errno.h>
 
@@ -34,21 +35,40 @@
 
 
 /*
- *  Return microseconds since boot (64 bit)
+ *  Monotonic host clock source
  */
 
-void Microseconds(uint32 &hi, uint32 &lo)
+uint64 clock_host_ticks(void)
 {
-	D(bug("Microseconds\n"));
-#ifdef HAVE_CLOCK_GETTIME
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
 	struct timespec t;
-	clock_gettime(CLOCK_REALTIME, &t);
-	uint64 tl = (uint64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64)t.tv_sec * 1000000000 + t.tv_nsec;
 #else
 	struct timeval t;
 	gettimeofday(&t, NULL);
-	uint64 tl = (uint64)t.tv_sec * 1000000 + t.tv_usec;
+	return (uint64)t.tv_sec * 1000000 + t.tv_usec;
 #endif
+}
+
+uint64 clock_host_frequency(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	return 1000000000;
+#else
+	return 1000000;
+#endif
+}
+
+
+/*
+ *  Return microseconds since boot (64 bit)
+ */
+
+void Microseconds(uint32 &hi, uint32 &lo)
+{
+	D(bug("Microseconds\n"));
+	uint64 tl = clock_usec();
 	hi = tl >> 32;
 	lo = tl;
 }
@@ -206,15 +226,7 @@ int32 timer_host2mac_time(tm_time_t hosttime)
 
 uint64 GetTicks_usec(void)
 {
-#ifdef HAVE_CLOCK_GETTIME
-	struct timespec t;
-	clock_gettime(CLOCK_REALTIME, &t);
-	return (uint64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
-#else
-	struct timeval t;
-	gettimeofday(&t, NULL);
-	return (uint64)t.tv_sec * 1000000 + t.tv_usec;
-#endif
+	return clock_usec();
 }
 
 
@@ -248,6 +260,7 @@ void Delay_usec(uint32 usec)
 	pthread_cond_t delay_cond = PTHREAD_COND_INITIALIZER;
 	pthread_mutex_t delay_mutex = PTHREAD_MUTEX_INITIALIZER;
 	struct timespec elapsed;
+	struct timeval now;
 	uint64 future;
 #else
 	struct timeval tv;
@@ -264,7 +277,9 @@ void Delay_usec(uint32 usec)
     elapsed.tv_sec = 0;
     elapsed.tv_nsec = usec * 1000;
 #elif defined(USE_COND_TIMEDWAIT)
-	future = GetTicks_usec() + usec;
+	// pthread_cond_timedwait() wants an absolute wall-clock time
+	gettimeofday(&now, NULL);
+	future = (uint64)now.tv_sec * 1000000 + now.tv_usec + usec;
 	elapsed.tv_sec = future / 1000000;
 	elapsed.tv_nsec = (future % 1000000) * 1000;
 #else
@@ -0,0 +1,276 @@
+/*
+ *  async_io.cpp - Asynchronous disk driver I/O
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Asynchronous Prime() requests of the .Sony, .Disk and .AppleCD drivers
+ *  are handed to an I/O worker thread and the driver returns "in progress"
+ *  to the Device Manager. When the worker has finished a request, it raises
+ *  INTFLAG_DISK; the interrupt routine then calls the driver's completion
+ *  function and queues a Deferred Task that jumps to IODone.
+ *
+ *  Requests are executed strictly in the order they were issued. A
+ *  synchronous request waits for all outstanding asynchronous ones before
+ *  it does its own I/O on the emulation thread.
+ *
+ *  SEE ALSO
+ *    Inside Macintosh: Devices, chapter 1 "Device Manager"
+ */
+
+#include <stdio.h>
+
+#include "sysdeps.h"
+#include "cpu_emulation.h"
+#include "main.h"
+#include "macos_util.h"
+#include "prefs.h"
+#include "sys.h"
+#include "clock.h"
+#include "async_io.h"
+#include "disk_trace.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+#if USE_ASYNC_IO
+
+// Number of request slots (the Device Manager issues at most one request per driver at a time)
+const int NUM_REQS = 8;
+
+// Number of latency histogram buckets (bucket 0: < 128 usec, bucket i: [64<<i, 64<<(i+1)) usec)
+const int NUM_LATENCY_BUCKETS = 16;
+
+// Queued request
+struct AsyncIOReq {
+	uint32 pb;					// Mac parameter block
+	uint32 dce;					// Driver's DCE
+	void *fh;					// File handle
+	void *buffer;				// Host data buffer
+	loff_t offset;				// Absolute file offset
+	size_t length;				// Requested length
+	bool write;					// Flag: write request
+	async_io_done_func done;	// Driver completion function
+	size_t actual;				// Transferred length, set by worker
+	uint64 start;				// Time of submission (usec)
+};
+
+static AsyncIOReq reqs[NUM_REQS];
+
+// Request counters, slot of request n is n % NUM_REQS
+static uint32 num_issued = 0;				// Requests queued by emulation thread
+static volatile uint32 num_serviced = 0;	// Requests executed by worker thread
+static uint32 num_completed = 0;			// Requests passed to IODone
+
+static bool async_io_enabled = false;		// Flag: worker thread running
+static uint32 async_io_dt = 0;				// Deferred Task structures (one per slot) in Mac memory
+
+// Statistics
+static uint64 stat_requests = 0;
+static uint64 stat_bytes = 0;
+static uint64 stat_depth[NUM_REQS + 1];					// Queue depth at submission
+static uint64 stat_latency[NUM_LATENCY_BUCKETS];		// Submission to completion
+static uint32 stat_latency_max = 0;
+
+
+/*
+ *  Initialization
+ */
+
+void AsyncIOInit(void)
+{
+	num_issued = num_serviced = num_completed = 0;
+	async_io_dt = 0;
+	stat_requests = stat_bytes = 0;
+	memset(stat_depth, 0, sizeof(stat_depth));
+	memset(stat_latency, 0, sizeof(stat_latency));
+	stat_latency_max = 0;
+
+	async_io_enabled = false;
+	if (PrefsFindBool("diskasync"))
+		async_io_enabled = async_io_thread_start();
+	D(bug("AsyncIOInit, worker %s\n", async_io_enabled ? "running" : "disabled"));
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void AsyncIOExit(void)
+{
+	if (async_io_enabled) {
+		AsyncIODrain();
+		async_io_thread_stop();
+		async_io_enabled = false;
+	}
+
+	if (stat_requests) {
+		printf("Async disk I/O: %llu requests, %llu bytes, max latency %u usec\n",
+			(unsigned long long)stat_requests, (unsigned long long)stat_bytes, stat_latency_max);
+		printf(" queue depth:");
+		for (int i=1; i<=NUM_REQS; i++)
+			printf(" %llu", (unsigned long long)stat_depth[i]);
+		printf("\n latency (usec):");
+		for (int i=0; i<NUM_LATENCY_BUCKETS; i++)
+			if (stat_latency[i])
+				printf(" <%u:%llu", 128 << i, (unsigned long long)stat_latency[i]);
+		printf("\n");
+	}
+}
+
+
+/*
+ *  Allocate Deferred Task structures, called from the drivers' Open() routines
+ */
+
+void AsyncIOInstall(void)
+{
+	if (!async_io_enabled || async_io_dt)
+		return;
+
+	M68kRegisters r;
+	r.d[0] = SIZEOF_aiodt * NUM_REQS;
+	Execute68kTrap(0xa71e, &r);		// NewPtrSysClear()
+	if (r.a[0] == 0)
+		return;
+	async_io_dt = r.a[0];
+	D(bug(" async_io_dt %08lx\n", async_io_dt));
+
+	for (int i=0; i<NUM_REQS; i++) {
+		uint32 dt = async_io_dt + i * SIZEOF_aiodt;
+		WriteMacInt16(dt + qType, dtQType);
+		WriteMacInt32(dt + dtAddr, dt + aiodtCode);
+		WriteMacInt32(dt + dtParam, dt + aiodtResult);
+														// Deferred function for signalling that Prime is complete (pointer to aiodtResult in a1)
+		WriteMacInt16(dt + aiodtCode, 0x2019);			// move.l	(a1)+,d0	(result)
+		WriteMacInt16(dt + aiodtCode + 2, 0x2251);		// move.l	(a1),a1		(dce)
+		WriteMacInt32(dt + aiodtCode + 4, 0x207808fc);	// move.l	JIODone,a0
+		WriteMacInt16(dt + aiodtCode + 8, 0x4ed0);		// jmp		(a0)
+	}
+}
+
+
+/*
+ *  Queue Prime() request if the Mac issued it asynchronously, returns false
+ *  if the caller has to perform the request synchronously
+ */
+
+bool AsyncIOPrime(uint32 pb, uint32 dce, void *fh, void *buffer, loff_t offset, size_t length, bool write, async_io_done_func done)
+{
+	uint16 trap = ReadMacInt16(pb + ioTrap);
+	bool async = (trap & (1 << asyncTrpBit)) && !(trap & (1 << noQueueBit));
+#if USE_VIRTUAL_TIME
+	if (ClockVirtual)	// Completion time would depend on the host
+		async = false;
+#endif
+	if (!async || !async_io_enabled || async_io_dt == 0 || num_issued - num_completed == NUM_REQS) {
+		AsyncIODrain();
+		return false;
+	}
+
+	AsyncIOReq &req = reqs[num_issued % NUM_REQS];
+	req.pb = pb;
+	req.dce = dce;
+	req.fh = fh;
+	req.buffer = buffer;
+	req.offset = offset;
+	req.length = length;
+	req.write = write;
+	req.done = done;
+	req.actual = 0;
+	req.start = clock_usec();
+	D(bug("AsyncIOPrime %s pb %08lx, offset %08lx, length %08lx\n", write ? "write" : "read", pb, (uint32)offset, length));
+
+	num_issued++;
+	stat_depth[num_issued - num_completed]++;
+	async_io_wakeup();
+	return true;
+}
+
+
+/*
+ *  Wait until all queued requests have been executed by the worker
+ */
+
+void AsyncIODrain(void)
+{
+	while (num_serviced != num_issued)
+		async_io_wait_done();
+}
+
+
+/*
+ *  Execute next queued request (called by the worker thread)
+ */
+
+void AsyncIOService(void)
+{
+	if (num_serviced == num_issued)
+		return;
+
+	AsyncIOReq &req = reqs[num_serviced % NUM_REQS];
+	if (req.write)
+		req.actual = Sys_write(req.fh, req.buffer, req.offset, req.length);
+	else
+		req.actual = Sys_read(req.fh, req.buffer, req.offset, req.length);
+
+	__sync_synchronize();
+	num_serviced++;
+	SetInterruptFlag(INTFLAG_DISK);
+	TriggerInterrupt();
+}
+
+
+/*
+ *  Disk interrupt - requests completed, activate deferred tasks to call IODone
+ */
+
+void AsyncIOInterrupt(void)
+{
+	D(bug("AsyncIOInterrupt\n"));
+
+	uint32 serviced = num_serviced;
+	__sync_synchronize();
+	while (num_completed != serviced) {
+		int slot = num_completed % NUM_REQS;
+		AsyncIOReq &req = reqs[slot];
+
+		// Update statistics
+		uint32 latency = uint32(clock_usec() - req.start);
+		int bucket = 0;
+		while (bucket < NUM_LATENCY_BUCKETS - 1 && latency >= (128U << bucket))
+			bucket++;
+		stat_latency[bucket]++;
+		if (latency > stat_latency_max)
+			stat_latency_max = latency;
+		stat_requests++;
+		stat_bytes += req.actual;
+
+		// Let driver update ParamBlock and DCE, then call IODone
+		int16 result = req.done(req.pb, req.dce, req.buffer, req.length, req.actual, req.write);
+		DiskTrace(req.pb, req.dce, req.offset, req.length, req.actual, req.write, true, req.start);
+		uint32 dt = async_io_dt + slot * SIZEOF_aiodt;
+		WriteMacInt32(dt + aiodtResult, uint16(result));
+		WriteMacInt32(dt + aiodtDCE, req.dce);
+		EnqueueMac(dt, 0xd92);
+		num_completed++;
+	}
+}
+
+#endif
@@ -0,0 +1,760 @@
+/*
+ *  block_cache.cpp - Host-side block cache for disk images
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The cache holds fixed-size chunks of the files opened with Sys_open(),
+ *  shared by all drives. Replacement follows the simplified 2Q scheme:
+ *  chunks enter a FIFO queue when first read, and are promoted to an LRU
+ *  queue when they are referenced again. One-time sequential reads (disk
+ *  copies, boot) therefore can't flush the frequently used B-tree blocks
+ *  out of the cache.
+ *
+ *  Writes either go straight to the file and update cached copies
+ *  (write-through), or only dirty the cached chunks which are written back
+ *  on eviction, block_cache_flush() and close (write-back).
+ *
+ *  When a file is read sequentially, a background thread reads ahead of
+ *  the stream into the cache. The read-ahead window starts at two chunks
+ *  and doubles with every further sequential read, up to the size given
+ *  by the "prefetch" prefs item. Any non-sequential read ends the stream.
+ *  The prefetch thread claims a chunk under the cache lock but reads it
+ *  with only the I/O lock of its file held, so other disks and cache hits
+ *  don't have to wait for the read-ahead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sysdeps.h"
+#include "main.h"
+#include "prefs.h"
+#include "block_cache.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+// Chunk queues
+enum {
+	Q_FREE,		// Unused chunks
+	Q_IN,		// Referenced once (FIFO)
+	Q_MAIN,		// Referenced more than once (LRU)
+	NUM_QUEUES
+};
+
+// Descriptor of one cache chunk
+struct cache_chunk {
+	block_cache_file *file;	// Owner
+	loff_t pos;				// File offset of chunk
+	uint32 valid;			// Number of valid bytes (less than chunk_size at end of file)
+	bool dirty;				// Flag: chunk must be written back
+	bool prefetched;		// Flag: read ahead, not yet used
+	int queue;				// Queue the chunk is in
+	int prev, next;			// Queue links (towards head/tail)
+	int hash_next;			// Next chunk in hash chain
+};
+
+struct chunk_queue {
+	int head, tail;			// Head = most recently used
+	int count;
+};
+
+// Cached file
+struct block_cache_file {
+	block_cache_file *next;	// Next in list of open files
+	void *fh;				// File handle passed to I/O functions
+	block_cache_io_func read_func;
+	block_cache_io_func write_func;
+	B2_mutex *io_lock;		// Serializes calls to the I/O functions
+	bool write_back;		// Flag: write-back policy
+	int num_dirty;			// Number of dirty chunks
+
+	// Sequential stream detection
+	loff_t seq_end;			// End of last read
+	uint32 window;			// Current read-ahead window (0 = no stream)
+	loff_t prefetch_pos;	// Next chunk to read ahead
+	loff_t prefetch_end;	// End of read-ahead range
+};
+
+static B2_mutex *cache_lock = NULL;
+static block_cache_file *open_files = NULL;
+
+static uint8 *chunk_data = NULL;		// Chunk buffers
+static cache_chunk *chunks = NULL;		// Chunk descriptors
+static int num_chunks = 0;
+static uint32 chunk_size;
+static int chunk_shift;
+static int in_limit;					// Maximum number of chunks in Q_IN
+
+static int *hash_table = NULL;
+static uint32 hash_mask;
+
+static chunk_queue queues[NUM_QUEUES];
+
+static uint32 prefetch_max = 0;			// Maximum read-ahead window (0 = off)
+#if BLOCK_CACHE_PREFETCH
+static bool prefetch_thread_active = false;
+#endif
+
+// Statistics
+static uint64 stat_hits = 0;
+static uint64 stat_misses = 0;
+static uint64 stat_write_backs = 0;
+static uint64 stat_prefetched = 0;		// Chunks read ahead
+static uint64 stat_prefetch_hits = 0;	// Chunks read ahead and used
+static uint64 stat_prefetch_wasted = 0;	// Bytes read ahead and evicted unused
+
+
+/*
+ *  Queue and hash table management
+ */
+
+static inline uint8 *chunk_buffer(int i)
+{
+	return chunk_data + (size_t)i * chunk_size;
+}
+
+static void queue_remove(int i)
+{
+	cache_chunk &c = chunks[i];
+	chunk_queue &q = queues[c.queue];
+	if (c.prev >= 0)
+		chunks[c.prev].next = c.next;
+	else
+		q.head = c.next;
+	if (c.next >= 0)
+		chunks[c.next].prev = c.prev;
+	else
+		q.tail = c.prev;
+	q.count--;
+}
+
+static void queue_add_head(int queue, int i)
+{
+	cache_chunk &c = chunks[i];
+	chunk_queue &q = queues[queue];
+	c.queue = queue;
+	c.prev = -1;
+	c.next = q.head;
+	if (q.head >= 0)
+		chunks[q.head].prev = i;
+	else
+		q.tail = i;
+	q.head = i;
+	q.count++;
+}
+
+static inline uint32 hash_chunk(const block_cache_file *f, loff_t pos)
+{
+	return ((uint32)(pos >> chunk_shift) * 2654435761U ^ (uint32)((uintptr)f >> 4)) & hash_mask;
+}
+
+// Chunks read ahead are filled with only the I/O lock of their file held,
+// taking it waits for the read to complete and makes the data visible
+static void wait_chunk(int i)
+{
+	if (chunks[i].prefetched) {
+		B2_lock_mutex(chunks[i].file->io_lock);
+		B2_unlock_mutex(chunks[i].file->io_lock);
+	}
+}
+
+static int find_chunk(const block_cache_file *f, loff_t pos)
+{
+	for (int i = hash_table[hash_chunk(f, pos)]; i >= 0; i = chunks[i].hash_next)
+		if (chunks[i].file == f && chunks[i].pos == pos) {
+			wait_chunk(i);
+			return i;
+		}
+	return -1;
+}
+
+static void hash_add(int i)
+{
+	uint32 h = hash_chunk(chunks[i].file, chunks[i].pos);
+	chunks[i].hash_next = hash_table[h];
+	hash_table[h] = i;
+}
+
+static void hash_remove(int i)
+{
+	int *link = &hash_table[hash_chunk(chunks[i].file, chunks[i].pos)];
+	while (*link != i)
+		link = &chunks[*link].hash_next;
+	*link = chunks[i].hash_next;
+}
+
+
+/*
+ *  File I/O through the I/O functions of the file
+ */
+
+static size_t read_file(block_cache_file *f, void *buffer, loff_t pos, size_t length)
+{
+	B2_lock_mutex(f->io_lock);
+	size_t actual = f->read_func(f->fh, buffer, pos, length);
+	B2_unlock_mutex(f->io_lock);
+	return actual;
+}
+
+static size_t write_file(block_cache_file *f, void *buffer, loff_t pos, size_t length)
+{
+	B2_lock_mutex(f->io_lock);
+	size_t actual = f->write_func(f->fh, buffer, pos, length);
+	B2_unlock_mutex(f->io_lock);
+	return actual;
+}
+
+
+/*
+ *  Write back dirty chunk
+ */
+
+static void write_chunk(int i)
+{
+	cache_chunk &c = chunks[i];
+	if (!c.dirty)
+		return;
+	D(bug("block_cache write back pos %08lx, %d bytes\n", (uint32)c.pos, c.valid));
+	write_file(c.file, chunk_buffer(i), c.pos, c.valid);
+	c.dirty = false;
+	c.file->num_dirty--;
+	stat_write_backs++;
+}
+
+
+/*
+ *  Remove chunk from cache and put it on the free queue
+ */
+
+static void free_chunk(int i)
+{
+	wait_chunk(i);
+	if (chunks[i].prefetched) {
+		stat_prefetch_wasted += chunks[i].valid;
+		chunks[i].prefetched = false;
+	}
+	write_chunk(i);
+	hash_remove(i);
+	queue_remove(i);
+	chunks[i].file = NULL;
+	queue_add_head(Q_FREE, i);
+}
+
+
+/*
+ *  Allocate chunk for file offset "pos" (chunk aligned, not in the cache) and
+ *  read it from the file if "fill" is true; returns -1 on read error
+ */
+
+static int load_chunk(block_cache_file *f, loff_t pos, bool fill)
+{
+	// Take a free chunk, or evict the oldest one of Q_IN (if it exceeds its share) or Q_MAIN
+	if (queues[Q_FREE].count == 0) {
+		if (queues[Q_IN].count > in_limit || queues[Q_MAIN].count == 0)
+			free_chunk(queues[Q_IN].tail);
+		else
+			free_chunk(queues[Q_MAIN].tail);
+	}
+	int i = queues[Q_FREE].head;
+
+	cache_chunk &c = chunks[i];
+	c.valid = 0;
+	if (fill) {
+		size_t actual = read_file(f, chunk_buffer(i), pos, chunk_size);
+		if (actual == 0 || actual > chunk_size)
+			return -1;
+		c.valid = actual;
+	}
+	c.file = f;
+	c.pos = pos;
+	c.dirty = false;
+	queue_remove(i);
+	queue_add_head(Q_IN, i);
+	hash_add(i);
+	return i;
+}
+
+
+/*
+ *  Get chunk at file offset "pos" (chunk aligned), reading it from the file
+ *  if it's not in the cache and "fill" is true; returns -1 on read error
+ */
+
+static int get_chunk(block_cache_file *f, loff_t pos, bool fill)
+{
+	int i = find_chunk(f, pos);
+	if (i >= 0 && fill && chunks[i].valid == 0) {
+		// Read ahead failed or hit end of file, try again
+		free_chunk(i);
+		i = -1;
+	}
+	if (i < 0) {
+		stat_misses++;
+		return load_chunk(f, pos, fill);
+	}
+
+	stat_hits++;
+	if (chunks[i].prefetched) {
+		// First use of read-ahead chunk, leave it in Q_IN
+		stat_prefetch_hits++;
+		chunks[i].prefetched = false;
+	} else {
+		queue_remove(i);
+		queue_add_head(Q_MAIN, i);
+	}
+	return i;
+}
+
+
+/*
+ *  Update stream detection for a read of "length" bytes at "offset",
+ *  returns true if the prefetch thread has to be woken up
+ */
+
+static bool detect_stream(block_cache_file *f, loff_t offset, size_t length)
+{
+	loff_t end = offset + length;
+	bool sequential = (offset == f->seq_end);
+	f->seq_end = end;
+	if (!sequential) {
+		f->window = 0;
+		f->prefetch_end = f->prefetch_pos;	// Cancel read-ahead
+		return false;
+	}
+
+	// Grow window while the stream continues
+	if (f->window == 0)
+		f->window = 2 * chunk_size;
+	else if (f->window < prefetch_max)
+		f->window *= 2;
+	if (f->window > prefetch_max)
+		f->window = prefetch_max;
+
+	loff_t start = end & ~(loff_t)(chunk_size - 1);
+	if (f->prefetch_pos < start)
+		f->prefetch_pos = start;
+	if (f->prefetch_end < end + f->window)
+		f->prefetch_end = end + f->window;
+	return f->prefetch_pos < f->prefetch_end;
+}
+
+
+#if BLOCK_CACHE_PREFETCH
+/*
+ *  Read ahead for all sequential streams (called by the prefetch thread),
+ *  returns when there is nothing left to do
+ */
+
+static bool is_open(const block_cache_file *f)
+{
+	for (block_cache_file *g = open_files; g; g = g->next)
+		if (g == f)
+			return true;
+	return false;
+}
+
+void BlockCachePrefetch(void)
+{
+	for (;;) {
+		B2_lock_mutex(cache_lock);
+
+		// Find stream with outstanding read-ahead
+		block_cache_file *f;
+		for (f = open_files; f; f = f->next)
+			if (f->prefetch_pos < f->prefetch_end)
+				break;
+		if (f == NULL) {
+			B2_unlock_mutex(cache_lock);
+			return;
+		}
+
+		loff_t pos = f->prefetch_pos;
+		f->prefetch_pos += chunk_size;
+		if (find_chunk(f, pos) >= 0) {
+			B2_unlock_mutex(cache_lock);
+			continue;
+		}
+
+		// Claim chunk and take the I/O lock before releasing the cache lock,
+		// so anyone finding the chunk waits for the read to complete
+		int i = load_chunk(f, pos, false);
+		cache_chunk &c = chunks[i];
+		c.prefetched = true;
+		stat_prefetched++;
+		B2_lock_mutex(f->io_lock);
+		B2_unlock_mutex(cache_lock);
+
+		size_t actual = f->read_func(f->fh, chunk_buffer(i), pos, chunk_size);
+		if (actual > chunk_size)
+			actual = 0;
+		c.valid = actual;
+		B2_unlock_mutex(f->io_lock);
+
+		// Error or end of file, stop read-ahead (unless the file was closed meanwhile)
+		if (actual < chunk_size) {
+			B2_lock_mutex(cache_lock);
+			if (is_open(f))
+				f->prefetch_end = f->prefetch_pos;
+			B2_unlock_mutex(cache_lock);
+		}
+	}
+}
+#endif
+
+
+/*
+ *  Initialization
+ */
+
+void BlockCacheInit(void)
+{
+	cache_lock = B2_create_mutex();
+	open_files = NULL;
+	stat_hits = stat_misses = stat_write_backs = 0;
+
+	// Get cache and chunk size, the cache is allocated when the first file is opened
+	int32 size = PrefsFindInt32("blockcache");
+	if (size <= 0)
+		return;
+	int32 chunk_kb = PrefsFindInt32("blockcachechunk");
+	if (chunk_kb < 4)
+		chunk_kb = 4;
+	else if (chunk_kb > 64)
+		chunk_kb = 64;
+	chunk_shift = 12;
+	while ((2 << chunk_shift) <= chunk_kb * 1024)
+		chunk_shift++;
+	chunk_size = 1 << chunk_shift;
+	num_chunks = (int)(((uint64)size << 20) >> chunk_shift);
+	in_limit = num_chunks / 4;
+
+#if BLOCK_CACHE_PREFETCH
+	// Get maximum read-ahead window
+	int32 prefetch_kb = PrefsFindInt32("prefetch");
+	if (prefetch_kb > 0) {
+		prefetch_max = prefetch_kb * 1024;
+		if (prefetch_max < 2 * chunk_size)
+			prefetch_max = 2 * chunk_size;
+		if (prefetch_max > (uint32)(num_chunks / 2) * chunk_size)	// Don't let read-ahead thrash the cache
+			prefetch_max = (num_chunks / 2) * chunk_size;
+	}
+#endif
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void BlockCacheExit(void)
+{
+#if BLOCK_CACHE_PREFETCH
+	// Stop prefetch thread
+	if (prefetch_thread_active) {
+		block_cache_prefetch_stop();
+		prefetch_thread_active = false;
+	}
+#endif
+	prefetch_max = 0;
+
+	// Write back chunks of files that are still open
+	for (block_cache_file *f = open_files; f; f = f->next)
+		block_cache_flush(f);
+
+	if (stat_hits + stat_misses) {
+		printf("Block cache: %d KB in %d KB chunks, %llu hits, %llu misses (%d%% hit rate), %llu write-backs\n",
+			(num_chunks * chunk_size) >> 10, chunk_size >> 10,
+			(unsigned long long)stat_hits, (unsigned long long)stat_misses,
+			(int)(stat_hits * 100 / (stat_hits + stat_misses)), (unsigned long long)stat_write_backs);
+	}
+	if (stat_prefetched) {
+		printf("Block cache prefetch: %llu chunks read ahead, %llu used (%d%% hit rate), %llu KB wasted\n",
+			(unsigned long long)stat_prefetched, (unsigned long long)stat_prefetch_hits,
+			(int)(stat_prefetch_hits * 100 / stat_prefetched), (unsigned long long)(stat_prefetch_wasted >> 10));
+	}
+
+	free(chunk_data);
+	chunk_data = NULL;
+	delete[] chunks;
+	chunks = NULL;
+	delete[] hash_table;
+	hash_table = NULL;
+	num_chunks = 0;
+	if (cache_lock) {
+		B2_delete_mutex(cache_lock);
+		cache_lock = NULL;
+	}
+}
+
+
+/*
+ *  Allocate chunks and hash table, returns false on error
+ */
+
+static bool alloc_cache(void)
+{
+	uint32 hash_size = 1;
+	while (hash_size < (uint32)num_chunks)
+		hash_size <<= 1;
+	hash_mask = hash_size - 1;
+	chunk_data = (uint8 *)malloc((size_t)num_chunks * chunk_size);
+	if (chunk_data == NULL) {
+		printf("WARNING: Cannot allocate %d KB block cache\n", (num_chunks * chunk_size) >> 10);
+		num_chunks = 0;
+		return false;
+	}
+	chunks = new cache_chunk[num_chunks];
+	hash_table = new int[hash_size];
+	D(bug("block cache: %d chunks of %d bytes\n", num_chunks, chunk_size));
+
+	for (uint32 h=0; h<hash_size; h++)
+		hash_table[h] = -1;
+	for (int q=0; q<NUM_QUEUES; q++) {
+		queues[q].head = queues[q].tail = -1;
+		queues[q].count = 0;
+	}
+	for (int i=0; i<num_chunks; i++) {
+		chunks[i].file = NULL;
+		chunks[i].dirty = false;
+		chunks[i].prefetched = false;
+		queue_add_head(Q_FREE, i);
+	}
+
+#if BLOCK_CACHE_PREFETCH
+	// Start prefetch thread
+	if (prefetch_max)
+		prefetch_thread_active = block_cache_prefetch_start();
+	if (!prefetch_thread_active)
+		prefetch_max = 0;
+#endif
+	return true;
+}
+
+
+/*
+ *  Start caching a file, returns NULL if the cache is disabled
+ */
+
+block_cache_file *block_cache_open(void *fh, block_cache_io_func read_func, block_cache_io_func write_func, bool write_back)
+{
+	if (num_chunks == 0)
+		return NULL;
+	if (chunks == NULL && !alloc_cache())
+		return NULL;
+
+	block_cache_file *f = new block_cache_file;
+	f->fh = fh;
+	f->read_func = read_func;
+	f->write_func = write_func;
+	f->io_lock = B2_create_mutex();
+	f->write_back = write_back;
+	f->num_dirty = 0;
+	f->seq_end = -1;
+	f->window = 0;
+	f->prefetch_pos = f->prefetch_end = 0;
+
+	B2_lock_mutex(cache_lock);
+	f->next = open_files;
+	open_files = f;
+	B2_unlock_mutex(cache_lock);
+	return f;
+}
+
+
+/*
+ *  Stop caching a file
+ */
+
+void block_cache_close(block_cache_file *f)
+{
+	block_cache_invalidate(f);
+
+	B2_lock_mutex(cache_lock);
+	block_cache_file **link = &open_files;
+	while (*link != f)
+		link = &(*link)->next;
+	*link = f->next;
+	B2_unlock_mutex(cache_lock);
+	B2_delete_mutex(f->io_lock);
+	delete f;
+}
+
+
+/*
+ *  Write back all dirty chunks of a file, in file order
+ */
+
+static int cmp_chunk_pos(const void *a, const void *b)
+{
+	loff_t pa = chunks[*(const int *)a].pos, pb = chunks[*(const int *)b].pos;
+	return pa < pb ? -1 : (pa > pb ? 1 : 0);
+}
+
+void block_cache_flush(block_cache_file *f)
+{
+	B2_lock_mutex(cache_lock);
+	if (f->num_dirty) {
+		int *dirty = new int[f->num_dirty];
+		int n = 0;
+		for (int i=0; i<num_chunks && n<f->num_dirty; i++)
+			if (chunks[i].file == f && chunks[i].dirty)
+				dirty[n++] = i;
+		qsort(dirty, n, sizeof(int), cmp_chunk_pos);
+		for (int j=0; j<n; j++)
+			write_chunk(dirty[j]);
+		delete[] dirty;
+	}
+	B2_unlock_mutex(cache_lock);
+}
+
+
+/*
+ *  Write back and drop all chunks of a file (e.g. on media change)
+ */
+
+void block_cache_invalidate(block_cache_file *f)
+{
+	block_cache_flush(f);
+
+	B2_lock_mutex(cache_lock);
+	f->seq_end = -1;
+	f->window = 0;
+	f->prefetch_end = f->prefetch_pos;
+	for (int i=0; i<num_chunks; i++)
+		if (chunks[i].file == f)
+			free_chunk(i);
+	B2_unlock_mutex(cache_lock);
+}
+
+
+/*
+ *  Read "length" bytes at "offset" through the cache, returns number of bytes read
+ */
+
+size_t block_cache_read(block_cache_file *f, void *buffer, loff_t offset, size_t length)
+{
+	uint8 *p = (uint8 *)buffer;
+	size_t done = 0;
+
+	B2_lock_mutex(cache_lock);
+	bool wakeup = prefetch_max && detect_stream(f, offset, length);
+	while (done < length) {
+		loff_t pos = (offset + done) & ~(loff_t)(chunk_size - 1);
+		uint32 off = (uint32)(offset + done - pos);
+		size_t n = chunk_size - off;
+		if (n > length - done)
+			n = length - done;
+
+		int i = get_chunk(f, pos, true);
+		if (i < 0 || chunks[i].valid <= off)
+			break;
+		size_t avail = chunks[i].valid - off;
+		memcpy(p + done, chunk_buffer(i) + off, avail < n ? avail : n);
+		if (avail < n) {	// End of file
+			done += avail;
+			break;
+		}
+		done += n;
+	}
+	B2_unlock_mutex(cache_lock);
+
+#if BLOCK_CACHE_PREFETCH
+	if (wakeup)
+		block_cache_prefetch_wakeup();
+#endif
+	return done;
+}
+
+
+/*
+ *  Write "length" bytes at "offset" through the cache, returns number of bytes written
+ */
+
+size_t block_cache_write(block_cache_file *f, void *buffer, loff_t offset, size_t length)
+{
+	uint8 *p = (uint8 *)buffer;
+	size_t done = 0;
+
+	B2_lock_mutex(cache_lock);
+	if (!f->write_back) {
+
+		// Write-through, update cached copies of the written range
+		done = write_file(f, buffer, offset, length);
+		if (done > length)
+			done = 0;
+		loff_t write_end = offset + (loff_t)done;
+		loff_t pos = offset & ~(loff_t)(chunk_size - 1);
+		for (; pos < write_end; pos += chunk_size) {
+			int i = find_chunk(f, pos);
+			if (i < 0)
+				continue;
+			loff_t start = offset > pos ? offset : pos;
+			loff_t end = write_end < pos + chunk_size ? write_end : pos + chunk_size;
+			uint32 off = (uint32)(start - pos);
+			if (off > chunks[i].valid) {
+				// Write leaves a gap behind the cached end of file, drop the chunk
+				free_chunk(i);
+				continue;
+			}
+			memcpy(chunk_buffer(i) + off, p + (start - offset), end - start);
+			if (end - pos > chunks[i].valid)
+				chunks[i].valid = (uint32)(end - pos);
+		}
+
+	} else {
+
+		// Write-back, modify cached chunks
+		while (done < length) {
+			loff_t pos = (offset + done) & ~(loff_t)(chunk_size - 1);
+			uint32 off = (uint32)(offset + done - pos);
+			size_t n = chunk_size - off;
+			if (n > length - done)
+				n = length - done;
+
+			int i = get_chunk(f, pos, n != chunk_size);
+			if (i < 0 || chunks[i].valid < off) {
+
+				// Chunk can't be read or write leaves a gap, write directly
+				// (a cached chunk would then end before the written data)
+				if (i >= 0)
+					free_chunk(i);
+				size_t actual = write_file(f, p + done, offset + done, n);
+				if (actual != n)
+					break;
+				done += n;
+				continue;
+			}
+
+			cache_chunk &c = chunks[i];
+			memcpy(chunk_buffer(i) + off, p + done, n);
+			if (off + n > c.valid)
+				c.valid = off + n;
+			if (!c.dirty) {
+				c.dirty = true;
+				f->num_dirty++;
+			}
+			done += n;
+		}
+	}
+	B2_unlock_mutex(cache_lock);
+	return done;
+}
@@ -43,6 +43,8 @@ using std::vector;
 #include "sys.h"
 #include "prefs.h"
 #include "cdrom.h"
+#include "async_io.h"
+#include "disk_trace.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -381,6 +383,7 @@ int16 CDROMOpen(uint32 pb, uint32 dce)
 	// Set up DCE
 	WriteMacInt32(dce + dCtlPosition, 0);
 	acc_run_called = false;
+	AsyncIOInstall();
 
 	// Install drives
 	drive_vec::iterator info, end = drives.end();
@@ -434,6 +437,26 @@ int16 CDROMOpen(uint32 pb, uint32 dce)
  *  Driver Prime() routine
  */
 
+// Check result of read and update ParamBlock and DCE
+static int16 cdrom_prime_done(uint32 pb, uint32 dce, void *buffer, size_t length, size_t actual, bool write)
+{
+	if (actual != length) {
+
+		// Read error, tried to read HFS root block?
+		if (length == 0x200 && ReadMacInt32(dce + dCtlPosition) == 0x400) {
+
+			// Yes, fake (otherwise audio CDs won't get mounted)
+			memset(buffer, 0, 0x200);
+			actual = 0x200;
+		} else
+			return readErr;
+	}
+
+	WriteMacInt32(pb + ioActCount, actual);
+	WriteMacInt32(dce + dCtlPosition, ReadMacInt32(dce + dCtlPosition) + actual);
+	return noErr;
+}
+
 int16 CDROMPrime(uint32 pb, uint32 dce)
 {
 	WriteMacInt32(pb + ioActCount, 0);
@@ -453,29 +476,20 @@ int16 CDROMPrime(uint32 pb, uint32 dce)
 		return paramErr;
 	info->twok_offset = (position + info->start_byte) & 0x7ff;
 
-	size_t actual = 0;
-	if ((ReadMacInt16(pb + ioTrap) & 0xff) == aRdCmd) {
+	if ((ReadMacInt16(pb + ioTrap) & 0xff) != aRdCmd)
+		return wPrErr;
 
-		// Read
-		actual = Sys_read(info->fh, buffer, position + info->start_byte, length);
-		if (actual != length) {
+	// Asynchronous request? Then hand it to the I/O thread
+	if (AsyncIOPrime(pb, dce, info->fh, buffer, position + info->start_byte, length, false, cdrom_prime_done))
+		return ioInProgress;
 
-			// Read error, tried to read HFS root block?
-			if (length == 0x200 && position == 0x400) {
-
-				// Yes, fake (otherwise audio CDs won't get mounted)
-				memset(buffer, 0, 0x200);
-				actual = 0x200;
-			} else
-				return readErr;
-		}
-	} else
-		return wPrErr;
+	// Read
+	uint64 start = DiskTraceStart();
+	size_t actual = Sys_read(info->fh, buffer, position + info->start_byte, length);
+	DiskTrace(pb, dce, position + info->start_byte, length, actual, false, false, start);
 
 	// Update ParamBlock and DCE
-	WriteMacInt32(pb + ioActCount, actual);
-	WriteMacInt32(dce + dCtlPosition, ReadMacInt32(dce + dCtlPosition) + actual);
-	return noErr;
+	return cdrom_prime_done(pb, dce, buffer, length, actual, false);
 }
 
 
@@ -527,6 +541,7 @@ int16 CDROMControl(uint32 pb, uint32 dce)
 
 		case 7:			// EjectTheDisc
 			if (ReadMacInt8(info->status + dsDiskInPlace) > 0) {
+				AsyncIODrain();
 				SysAllowRemoval(info->fh);
 				SysEject(info->fh);
 				WriteMacInt8(info->status + dsDiskInPlace, 0);
@@ -0,0 +1,275 @@
+/*
+ *  clock.cpp - Monotonic host clock and periodic tick generator
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "sysdeps.h"
+#include "cpu_emulation.h"
+#include "main.h"
+#include "clock.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+// Conversion of host counter to microseconds: usec = (ticks * clock_mult) >> clock_shift
+static uint32 clock_mult;
+static int clock_shift;
+
+
+/*
+ *  Initialize clock, compute conversion factors
+ */
+
+void ClockInit(void)
+{
+	// Find the largest shift that keeps the multiplier in 32 bits
+	double usec_per_tick = 1000000.0 / (double)clock_host_frequency();
+	clock_shift = 0;
+	while (clock_shift < 63 && ldexp(usec_per_tick, clock_shift + 1) < 4294967295.0)
+		clock_shift++;
+	clock_mult = (uint32)floor(ldexp(usec_per_tick, clock_shift) + 0.5);
+	D(bug("ClockInit: %llu Hz, mult %u, shift %d\n", clock_host_frequency(), clock_mult, clock_shift));
+}
+
+
+/*
+ *  Get current value of host clock in microseconds
+ */
+
+uint64 clock_usec(void)
+{
+	// Two 32x32->64 multiplies instead of a 64-bit divide
+	uint64 ticks = clock_host_ticks();
+	uint64 hi = (uint64)(uint32)(ticks >> 32) * clock_mult;
+	uint64 lo = (uint64)(uint32)ticks * clock_mult;
+	if (clock_shift <= 32)
+		return (hi << (32 - clock_shift)) + (lo >> clock_shift);
+	else	// The low 32 bits of lo can't carry into bit clock_shift, the low bits of hi can
+		return (hi + (lo >> 32)) >> (clock_shift - 32);
+}
+
+
+/*
+ *  Start periodic ticker, first tick is due one period from now
+ */
+
+void clock_ticker_init(ClockTicker &t, uint32 period)
+{
+	t.period = period;
+	t.next = clock_usec();
+	t.oversleep = 0;
+	t.ticks = t.skipped = 0;
+	t.jitter_sum = 0;
+	t.jitter_max = 0;
+}
+
+
+/*
+ *  Wait for next tick
+ */
+
+void clock_ticker_wait(ClockTicker &t)
+{
+	t.next += t.period;
+	uint64 now = clock_usec();
+
+	// More than one period behind? Then drop the missed ticks instead of bursting
+	if (now > t.next + t.period) {
+		uint64 missed = (now - t.next) / t.period;
+		t.skipped += missed;
+		t.next += missed * t.period;
+	}
+
+	// Sleep until deadline, waking up early by the expected oversleep
+	int64 delay = (int64)(t.next - now) - t.oversleep;
+	if (delay > 0) {
+		Delay_usec(delay);
+		uint64 then = now + delay;
+		now = clock_usec();
+		int64 over = now > then ? now - then : 0;
+		if (over > t.period / 2)
+			over = t.period / 2;
+		t.oversleep = (t.oversleep * 7 + over) / 8;
+	}
+
+	// Record deviation from deadline
+	uint32 jitter = now > t.next ? now - t.next : t.next - now;
+	t.jitter_sum += jitter;
+	if (jitter > t.jitter_max)
+		t.jitter_max = jitter;
+	t.ticks++;
+}
+
+
+/*
+ *  Show ticker statistics
+ */
+
+void clock_ticker_report(const ClockTicker &t, const char *name)
+{
+	if (t.ticks == 0)
+		return;
+	printf("%s: %llu ticks, %llu skipped, jitter avg %llu usec, max %u usec, oversleep %u usec\n",
+		name, (unsigned long long)t.ticks, (unsigned long long)t.skipped,
+		(unsigned long long)(t.jitter_sum / t.ticks), t.jitter_max, t.oversleep);
+}
+
+
+#if USE_VIRTUAL_TIME
+/*
+ *  Virtual time
+ *
+ *  The CPU loop counts down emulated_ticks once per instruction. When it
+ *  reaches zero, clock_virtual_check() delivers the 60Hz tick and Time
+ *  Manager wakeups that are due, and sets up the countdown to the next
+ *  event. Events are thus raised at exact instruction counts and two runs
+ *  of the same workload see identical time values.
+ */
+
+const uint32 TICK_USEC = 16625;				// 60Hz tick period
+const uint32 VIRTUAL_EPOCH = 3029529600U;	// 1.1.2000 00:00:00 in Mac format
+
+bool ClockVirtual = false;
+int32 emulated_ticks = 0x7fffffff;			// Instructions left in current quantum
+
+static uint32 vt_ips;						// Emulated instructions per second
+static void (*vt_tick_func)(void);			// 60Hz tick function
+static uint64 vt_insns = 0;					// Instructions executed before current quantum
+static int32 vt_quantum = 0x7fffffff;		// Length of current quantum
+static uint64 vt_ticks;						// Number of 60Hz ticks delivered
+static uint64 vt_tick_insns;				// Instruction count of next 60Hz tick
+static uint64 vt_timer_insns;				// Instruction count of next Time Manager wakeup (0 = none)
+
+static uint64 usec_to_insns(uint64 usec)
+{
+	return (usec / 1000000) * vt_ips + ((usec % 1000000) * vt_ips + 999999) / 1000000;
+}
+
+static uint64 insns_to_usec(uint64 insns)
+{
+	return (insns / vt_ips) * 1000000 + (insns % vt_ips) * 1000000 / vt_ips;
+}
+
+// Instructions executed so far
+static inline uint64 current_insns(void)
+{
+	return vt_insns + (vt_quantum - emulated_ticks);
+}
+
+// Start new quantum that ends at the next pending event
+static void schedule_quantum(void)
+{
+	uint64 next = vt_tick_insns;
+	if (vt_timer_insns && vt_timer_insns < next)
+		next = vt_timer_insns;
+	uint64 count = next > vt_insns ? next - vt_insns : 1;
+	if (count > 0x7fffffff)
+		count = 0x7fffffff;
+	vt_quantum = emulated_ticks = count;
+}
+
+
+/*
+ *  Enter virtual time mode (before the 68k starts)
+ */
+
+void clock_virtual_start(uint32 ips, void (*tick_func)(void))
+{
+	D(bug("clock_virtual_start %u instructions/sec\n", ips));
+	vt_ips = ips ? ips : 10000000;
+	vt_tick_func = tick_func;
+	vt_insns = 0;
+	vt_ticks = 0;
+	vt_tick_insns = usec_to_insns(TICK_USEC);
+	vt_timer_insns = 0;
+	schedule_quantum();
+	ClockVirtual = true;
+}
+
+
+/*
+ *  Instruction countdown expired, deliver due events (called by CPU loop)
+ */
+
+void clock_virtual_check(void)
+{
+	vt_insns = current_insns();
+	if (!ClockVirtual) {
+		vt_quantum = emulated_ticks = 0x7fffffff;
+		return;
+	}
+
+	if (vt_insns >= vt_tick_insns) {
+		vt_ticks++;
+		vt_tick_insns = usec_to_insns((vt_ticks + 1) * TICK_USEC);
+		vt_tick_func();
+	}
+	if (vt_timer_insns && vt_insns >= vt_timer_insns) {
+		vt_timer_insns = 0;
+		SetInterruptFlag(INTFLAG_TIMER);
+		TriggerInterrupt();
+	}
+	schedule_quantum();
+}
+
+
+/*
+ *  Get current virtual time
+ */
+
+uint64 clock_virtual_usec(void)
+{
+	return insns_to_usec(current_insns());
+}
+
+uint32 clock_virtual_date_time(void)
+{
+	return VIRTUAL_EPOCH + current_insns() / vt_ips;
+}
+
+
+/*
+ *  Request INTFLAG_TIMER at given virtual time (0 = cancel)
+ */
+
+void clock_virtual_wakeup_at(uint64 usec)
+{
+	vt_insns = current_insns();
+	vt_timer_insns = 0;
+	if (usec) {
+		vt_timer_insns = usec_to_insns(usec);
+		if (vt_timer_insns == 0)
+			vt_timer_insns = 1;
+	}
+	schedule_quantum();
+}
+
+
+/*
+ *  68k is idle, advance virtual time to the next event
+ */
+
+void clock_virtual_idle(void)
+{
+	emulated_ticks = 1;
+}
+#endif
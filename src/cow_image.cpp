@@ -0,0 +1,635 @@
+/*
+ *  cow_image.cpp - Copy-on-write overlay (differencing) disk images
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  An overlay file stands in for a read-only base image. It consists of
+ *  a header naming the base image, a block map and the delta blocks:
+ *
+ *    0      header (COW_HEADER_SIZE bytes, see cow_image.h)
+ *    512    block map, one big-endian 32-bit entry per block of the disk:
+ *           0 = block unchanged (read from base image),
+ *           n = block stored in the n-th delta block
+ *    data   delta blocks, in the order they were first written
+ *
+ *  The block map is held in memory, so a read costs exactly one seek in
+ *  either the base image or the overlay, and runs of blocks with the same
+ *  source are transferred in one go. The first write to a block copies it
+ *  from the base image to a new delta block; the map entry is written
+ *  after the block data, so an interrupted write leaves at most an unused
+ *  block at the end of the file.
+ *
+ *  The header also records the size and modification time of the base
+ *  image. An overlay whose base image has changed since then, e.g. by
+ *  committing another overlay of the same base, would show a mix of old
+ *  and new blocks, so it is refused.
+ *
+ *  An overlay without a base image is a sparse image: unwritten blocks
+ *  read as zeroes, and writing zeroes to them doesn't allocate anything.
+ *  This gives instantly created, lazily allocated hardfiles on file
+ *  systems without sparse file support.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "sysdeps.h"
+#include "cow_image.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+static const char cow_magic[8] = {'B', '2', 'C', 'O', 'W', 'I', 'M', 'G'};
+
+// Open overlay image
+struct cow_image {
+	int fd;					// Overlay file
+	int base_fd;			// Base image
+	bool sparse;			// Flag: no base image
+	bool read_only;
+	char base_name[COW_HEADER_SIZE - COW_BASE_NAME];
+	char base_path[1024];	// Resolved path of base image
+	loff_t size;			// Size of virtual disk
+	loff_t base_size;		// Recorded size of base image (0 = not recorded)
+	uint64 base_mtime;		// Recorded modification time of base image
+	uint32 block_size;
+	int block_shift;
+	uint32 num_blocks;
+	uint32 num_allocated;	// Number of delta blocks
+	loff_t map_offset;
+	loff_t data_offset;
+	uint32 *map;			// Block map (host byte order)
+	uint8 *buffer;			// Block buffer for copy-on-write
+};
+
+
+/*
+ *  Big-endian header fields
+ */
+
+static uint32 get_be32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put_be32(uint8 *p, uint32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static uint64 get_be64(const uint8 *p)
+{
+	return ((uint64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static void put_be64(uint8 *p, uint64 v)
+{
+	put_be32(p, uint32(v >> 32));
+	put_be32(p + 4, uint32(v));
+}
+
+
+/*
+ *  Positioned I/O, returns number of bytes transferred
+ */
+
+static size_t read_at(int fd, void *buffer, loff_t offset, size_t length)
+{
+	if (lseek(fd, offset, SEEK_SET) < 0)
+		return 0;
+	ssize_t actual = read(fd, buffer, length);
+	return actual < 0 ? 0 : actual;
+}
+
+static size_t write_at(int fd, const void *buffer, loff_t offset, size_t length)
+{
+	if (lseek(fd, offset, SEEK_SET) < 0)
+		return 0;
+	ssize_t actual = write(fd, buffer, length);
+	return actual < 0 ? 0 : actual;
+}
+
+
+/*
+ *  Build path of base image from name stored in header
+ */
+
+static void base_path(char *path, size_t max, const char *overlay_name, const char *base_name)
+{
+	if (base_name[0] == '/' || strchr(base_name, ':')) {
+		// Absolute path (a device name like "ux0:" counts as absolute)
+		snprintf(path, max, "%s", base_name);
+		return;
+	}
+	const char *sep = strrchr(overlay_name, '/');
+	if (sep == NULL)
+		sep = strrchr(overlay_name, ':');
+	int dir_len = sep ? int(sep - overlay_name + 1) : 0;
+	snprintf(path, max, "%.*s%s", dir_len, overlay_name, base_name);
+}
+
+
+/*
+ *  Check for overlay file header
+ */
+
+bool cow_image_check(const uint8 *header)
+{
+	return memcmp(header + COW_MAGIC, cow_magic, sizeof(cow_magic)) == 0 && get_be32(header + COW_VERSION) == 1;
+}
+
+
+/*
+ *  Read header and block map of overlay file, returns NULL on error
+ */
+
+static cow_image *read_overlay(const char *name, int fd, bool read_only)
+{
+	uint8 header[COW_HEADER_SIZE];
+	if (read_at(fd, header, 0, COW_HEADER_SIZE) != COW_HEADER_SIZE || !cow_image_check(header)) {
+		printf("WARNING: %s is not a disk overlay file\n", name);
+		return NULL;
+	}
+
+	cow_image *img = new cow_image;
+	img->fd = fd;
+	img->base_fd = -1;
+	img->read_only = read_only;
+	memcpy(img->base_name, header + COW_BASE_NAME, sizeof(img->base_name));
+	img->base_name[sizeof(img->base_name) - 1] = 0;
+	img->sparse = img->base_name[0] == 0;
+	img->size = get_be64(header + COW_DISK_SIZE);
+	img->base_size = get_be64(header + COW_BASE_SIZE);
+	img->base_mtime = get_be64(header + COW_BASE_MTIME);
+	img->block_size = get_be32(header + COW_BLOCK_SIZE);
+	img->num_blocks = get_be32(header + COW_NUM_BLOCKS);
+	img->map_offset = get_be32(header + COW_MAP_OFFSET);
+	img->data_offset = get_be32(header + COW_DATA_OFFSET);
+	img->num_allocated = 0;
+	img->map = NULL;
+	img->buffer = NULL;
+
+	img->block_shift = 0;
+	while (img->block_shift < 31 && (1U << img->block_shift) < img->block_size)
+		img->block_shift++;
+	if (img->block_size < 512 || (1U << img->block_shift) != img->block_size
+	 || img->num_blocks != uint32((img->size + img->block_size - 1) >> img->block_shift)
+	 || img->data_offset < img->map_offset + (loff_t)img->num_blocks * 4)
+		goto corrupt;
+
+	img->map = (uint32 *)malloc(img->num_blocks * 4);
+	img->buffer = (uint8 *)malloc(img->block_size);
+	if (img->map == NULL || img->buffer == NULL)
+		goto corrupt;
+	if (read_at(fd, img->map, img->map_offset, img->num_blocks * 4) != img->num_blocks * 4)
+		goto corrupt;
+	for (uint32 i=0; i<img->num_blocks; i++) {
+		img->map[i] = get_be32((uint8 *)&img->map[i]);
+		if (img->map[i] > img->num_allocated)
+			img->num_allocated = img->map[i];
+	}
+
+	// Delta blocks past the end of the file mean the map is damaged
+	if (lseek(fd, 0, SEEK_END) < img->data_offset + ((loff_t)img->num_allocated << img->block_shift))
+		goto corrupt;
+	return img;
+
+corrupt:
+	printf("WARNING: Disk overlay file %s is damaged\n", name);
+	free(img->map);
+	free(img->buffer);
+	delete img;
+	return NULL;
+}
+
+
+/*
+ *  Get size and modification time of base image
+ */
+
+static bool base_fingerprint(int base_fd, loff_t &size, uint64 &mtime)
+{
+	struct stat st;
+	if (fstat(base_fd, &st) < 0)
+		return false;
+	size = st.st_size;
+	mtime = st.st_mtime;
+	return true;
+}
+
+
+/*
+ *  Check that base image is still the one the overlay was made for
+ *  (overlays without recorded base image are accepted)
+ */
+
+static bool base_unchanged(cow_image *img, int base_fd, const char *name)
+{
+	if (img->base_size == 0)
+		return true;
+	loff_t size;
+	uint64 mtime;
+	if (base_fingerprint(base_fd, size, mtime) && size == img->base_size && mtime == img->base_mtime)
+		return true;
+	printf("WARNING: Base image %s has changed since overlay %s was created or committed\n", img->base_path, name);
+	return false;
+}
+
+
+/*
+ *  Open overlay image, the base image is always opened read-only
+ */
+
+cow_image *cow_image_open(const char *name, int fd, bool read_only)
+{
+	D(bug("cow_image_open(%s, %s)\n", name, read_only ? "read-only" : "read/write"));
+
+	cow_image *img = read_overlay(name, fd, read_only);
+	if (img == NULL)
+		return NULL;
+	if (img->sparse) {
+		D(bug(" sparse, %u blocks of %u bytes, %u allocated\n", img->num_blocks, img->block_size, img->num_allocated));
+		return img;
+	}
+
+	base_path(img->base_path, sizeof(img->base_path), name, img->base_name);
+	img->base_fd = open(img->base_path, O_RDONLY);
+	if (img->base_fd < 0) {
+		printf("WARNING: Cannot open base image %s of %s (%s)\n", img->base_path, name, strerror(errno));
+		cow_image_close(img);
+		return NULL;
+	}
+	if (!base_unchanged(img, img->base_fd, name)) {
+		cow_image_close(img);
+		return NULL;
+	}
+	D(bug(" base %s, %u blocks of %u bytes, %u in overlay\n", img->base_path, img->num_blocks, img->block_size, img->num_allocated));
+	return img;
+}
+
+
+/*
+ *  Close and reopen files (when the host suspends)
+ */
+
+void cow_image_suspend(cow_image *img)
+{
+	if (img->base_fd >= 0)
+		close(img->base_fd);
+	img->base_fd = -1;
+	img->fd = -1;
+}
+
+void cow_image_resume(cow_image *img, int fd)
+{
+	img->fd = fd;
+	if (!img->sparse) {
+		img->base_fd = open(img->base_path, O_RDONLY);
+		if (img->base_fd >= 0 && !base_unchanged(img, img->base_fd, img->base_name)) {
+			close(img->base_fd);
+			img->base_fd = -1;
+		}
+	}
+}
+
+
+/*
+ *  Close overlay image (the overlay file itself stays open)
+ */
+
+void cow_image_close(cow_image *img)
+{
+	if (img == NULL)
+		return;
+	if (img->base_fd >= 0)
+		close(img->base_fd);
+	free(img->map);
+	free(img->buffer);
+	delete img;
+}
+
+
+/*
+ *  Return size of virtual disk
+ */
+
+loff_t cow_image_size(cow_image *img)
+{
+	return img->size;
+}
+
+
+/*
+ *  Read from virtual disk, returns number of bytes read
+ */
+
+size_t cow_image_read(cow_image *img, void *buffer, loff_t offset, size_t length)
+{
+	if (img->fd < 0 || (img->base_fd < 0 && !img->sparse) || offset >= img->size)
+		return 0;
+	if ((loff_t)length > img->size - offset)
+		length = img->size - offset;
+
+	uint8 *p = (uint8 *)buffer;
+	size_t done = 0;
+	while (done < length) {
+
+		// Collect run of blocks that are contiguous in the same file
+		loff_t pos = offset + done;
+		uint32 block = pos >> img->block_shift;
+		uint32 first = img->map[block];
+		size_t n = img->block_size - (pos & (img->block_size - 1));
+		for (uint32 b = block + 1; n < length - done && b < img->num_blocks; b++) {
+			if (first ? img->map[b] != first + (b - block) : img->map[b] != 0)
+				break;
+			n += img->block_size;
+		}
+		if (n > length - done)
+			n = length - done;
+
+		// Transfer run
+		size_t actual;
+		if (first)
+			actual = read_at(img->fd, p + done, img->data_offset + ((loff_t)(first - 1) << img->block_shift) + (pos & (img->block_size - 1)), n);
+		else {
+			actual = img->sparse ? 0 : read_at(img->base_fd, p + done, pos, n);
+			if (actual < n)		// Base image shorter than disk, or unallocated
+				memset(p + done + actual, 0, n - actual);
+			actual = n;
+		}
+		done += actual;
+		if (actual < n)
+			break;
+	}
+	return done;
+}
+
+
+/*
+ *  Write to virtual disk, returns number of bytes written
+ */
+
+size_t cow_image_write(cow_image *img, void *buffer, loff_t offset, size_t length)
+{
+	if (img->read_only || img->fd < 0 || (img->base_fd < 0 && !img->sparse) || offset >= img->size)
+		return 0;
+	if ((loff_t)length > img->size - offset)
+		length = img->size - offset;
+
+	uint8 *p = (uint8 *)buffer;
+	size_t done = 0;
+	while (done < length) {
+		loff_t pos = offset + done;
+		uint32 block = pos >> img->block_shift;
+		uint32 skip = pos & (img->block_size - 1);
+		size_t n = img->block_size - skip;
+		if (n > length - done)
+			n = length - done;
+
+		if (img->map[block]) {
+
+			// Block already in overlay
+			loff_t delta_pos = img->data_offset + ((loff_t)(img->map[block] - 1) << img->block_shift);
+			if (write_at(img->fd, p + done, delta_pos + skip, n) != n)
+				break;
+
+		} else {
+
+			// Zeroes need not be stored in unallocated blocks of sparse images
+			if (img->sparse) {
+				size_t i = 0;
+				while (i < n && p[done + i] == 0)
+					i++;
+				if (i == n) {
+					done += n;
+					continue;
+				}
+			}
+
+			// First write to block, copy from base image
+			loff_t block_pos = (loff_t)block << img->block_shift;
+			if (n < img->block_size) {
+				size_t actual = img->sparse ? 0 : read_at(img->base_fd, img->buffer, block_pos, img->block_size);
+				memset(img->buffer + actual, 0, img->block_size - actual);
+			}
+			memcpy(img->buffer + skip, p + done, n);
+
+			uint32 slot = img->num_allocated + 1;
+			loff_t delta_pos = img->data_offset + ((loff_t)(slot - 1) << img->block_shift);
+			if (write_at(img->fd, img->buffer, delta_pos, img->block_size) != img->block_size)
+				break;
+			uint8 entry[4];
+			put_be32(entry, slot);
+			if (write_at(img->fd, entry, img->map_offset + block * 4, 4) != 4)
+				break;
+			img->map[block] = slot;
+			img->num_allocated = slot;
+		}
+		done += n;
+	}
+	return done;
+}
+
+
+/*
+ *  Write header and empty block map of new overlay file
+ */
+
+static bool create_overlay(const char *name, const char *base_name, loff_t size, uint64 base_mtime, uint32 block_size)
+{
+	if (block_size < 512 || (block_size & (block_size - 1))) {
+		printf("Invalid block size %u\n", block_size);
+		return false;
+	}
+	if (strlen(base_name) >= COW_HEADER_SIZE - COW_BASE_NAME) {
+		printf("Base image name %s too long\n", base_name);
+		return false;
+	}
+
+	uint32 num_blocks = (size + block_size - 1) / block_size;
+	uint32 map_size = num_blocks * 4;
+	uint32 data_offset = (COW_HEADER_SIZE + map_size + 511) & ~511;
+
+	uint8 *data = (uint8 *)calloc(1, data_offset);
+	if (data == NULL)
+		return false;
+	memcpy(data + COW_MAGIC, cow_magic, sizeof(cow_magic));
+	put_be32(data + COW_VERSION, 1);
+	put_be32(data + COW_BLOCK_SIZE, block_size);
+	put_be64(data + COW_DISK_SIZE, size);
+	put_be32(data + COW_NUM_BLOCKS, num_blocks);
+	put_be32(data + COW_MAP_OFFSET, COW_HEADER_SIZE);
+	put_be32(data + COW_DATA_OFFSET, data_offset);
+	if (base_name[0]) {
+		put_be64(data + COW_BASE_SIZE, size);
+		put_be64(data + COW_BASE_MTIME, base_mtime);
+	}
+	strcpy((char *)data + COW_BASE_NAME, base_name);
+
+	int fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	if (fd < 0) {
+		printf("Cannot create %s (%s)\n", name, strerror(errno));
+		free(data);
+		return false;
+	}
+	bool ok = write_at(fd, data, 0, data_offset) == data_offset;
+	close(fd);
+	free(data);
+	if (!ok)
+		printf("Cannot write %s\n", name);
+	return ok;
+}
+
+
+/*
+ *  Create empty overlay file for base image
+ */
+
+bool cow_image_create(const char *name, const char *base_name, uint32 block_size)
+{
+	char path[1024];
+	base_path(path, sizeof(path), name, base_name);
+	int base_fd = open(path, O_RDONLY);
+	if (base_fd < 0) {
+		printf("Cannot open base image %s (%s)\n", path, strerror(errno));
+		return false;
+	}
+	loff_t size;
+	uint64 mtime;
+	bool ok = base_fingerprint(base_fd, size, mtime);
+	close(base_fd);
+	if (!ok) {
+		printf("Cannot get size of base image %s (%s)\n", path, strerror(errno));
+		return false;
+	}
+	return create_overlay(name, base_name, size, mtime, block_size);
+}
+
+
+/*
+ *  Create sparse image of given size
+ */
+
+bool cow_image_create_sparse(const char *name, loff_t size, uint32 block_size)
+{
+	return create_overlay(name, "", size, 0, block_size);
+}
+
+
+/*
+ *  Write all delta blocks of an overlay file back into its base image and
+ *  empty the overlay. The overlay is only emptied after the base image has
+ *  been synced, so an interrupted commit can simply be repeated. The new
+ *  size and time of the base image are recorded in the committed overlay,
+ *  other overlays of the same base can't be opened any more.
+ */
+
+bool cow_image_commit(const char *name)
+{
+	int fd = open(name, O_RDWR);
+	if (fd < 0) {
+		printf("Cannot open %s (%s)\n", name, strerror(errno));
+		return false;
+	}
+	cow_image *img = read_overlay(name, fd, false);
+	if (img == NULL) {
+		close(fd);
+		return false;
+	}
+	if (img->sparse) {
+		printf("%s is a sparse image without base image\n", name);
+		cow_image_close(img);
+		close(fd);
+		return false;
+	}
+
+	base_path(img->base_path, sizeof(img->base_path), name, img->base_name);
+	const char *path = img->base_path;
+	int base_fd = open(path, O_RDWR);
+	if (base_fd < 0) {
+		printf("Cannot open base image %s for writing (%s)\n", path, strerror(errno));
+		cow_image_close(img);
+		close(fd);
+		return false;
+	}
+	if (!base_unchanged(img, base_fd, name)) {
+		close(base_fd);
+		cow_image_close(img);
+		close(fd);
+		return false;
+	}
+
+	// Forget the old base image first, the overlay still matches the base
+	// image when the commit is interrupted and has to be repeated
+	uint8 fingerprint[16];
+	memset(fingerprint, 0, sizeof(fingerprint));
+	bool ok = write_at(fd, fingerprint, COW_BASE_SIZE, sizeof(fingerprint)) == sizeof(fingerprint) && fsync(fd) == 0;
+	for (uint32 block=0; block<img->num_blocks && ok; block++) {
+		if (img->map[block] == 0)
+			continue;
+		loff_t pos = (loff_t)block << img->block_shift;
+		size_t n = img->block_size;
+		if ((loff_t)n > img->size - pos)
+			n = img->size - pos;
+		ok = read_at(fd, img->buffer, img->data_offset + ((loff_t)(img->map[block] - 1) << img->block_shift), n) == n
+		  && write_at(base_fd, img->buffer, pos, n) == n;
+	}
+	if (ok)
+		ok = fsync(base_fd) == 0;
+	loff_t base_size;
+	uint64 base_mtime;
+	if (ok)
+		ok = base_fingerprint(base_fd, base_size, base_mtime);
+	if (ok) {
+		put_be64(fingerprint, base_size);
+		put_be64(fingerprint + 8, base_mtime);
+	}
+	close(base_fd);
+
+	if (ok) {
+		memset(img->map, 0, img->num_blocks * 4);
+		ok = write_at(fd, img->map, img->map_offset, img->num_blocks * 4) == img->num_blocks * 4
+		  && write_at(fd, fingerprint, COW_BASE_SIZE, sizeof(fingerprint)) == sizeof(fingerprint)
+		  && ftruncate(fd, img->data_offset) == 0;
+	}
+	if (!ok)
+		printf("Commit of %s to %s failed (%s)\n", name, path, strerror(errno));
+	cow_image_close(img);
+	close(fd);
+	return ok;
+}
+
+
+/*
+ *  Get overlay parameters
+ */
+
+void cow_image_info(cow_image *img, const char *&base_name, uint32 &block_size, uint32 &num_blocks, uint32 &num_allocated)
+{
+	base_name = img->base_name;
+	block_size = img->block_size;
+	num_blocks = img->num_blocks;
+	num_allocated = img->num_allocated;
+}
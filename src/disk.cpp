@@ -41,6 +41,8 @@ using std::vector;
 #include "sys.h"
 #include "prefs.h"
 #include "disk.h"
+#include "async_io.h"
+#include "disk_trace.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -253,6 +255,7 @@ int16 DiskOpen(uint32 pb, uint32 dce)
 	// Set up DCE
 	WriteMacInt32(dce + dCtlPosition, 0);
 	acc_run_called = false;
+	AsyncIOInstall();
 
 	// Install drives
 	drive_vec::iterator info, end = drives.end();
@@ -310,6 +313,16 @@ int16 DiskOpen(uint32 pb, uint32 dce)
  *  Driver Prime() routine
  */
 
+// Check result of read/write and update ParamBlock and DCE
+static int16 disk_prime_done(uint32 pb, uint32 dce, void *buffer, size_t length, size_t actual, bool write)
+{
+	if (actual != length)
+		return write ? writErr : readErr;
+	WriteMacInt32(pb + ioActCount, actual);
+	WriteMacInt32(dce + dCtlPosition, ReadMacInt32(dce + dCtlPosition) + actual);
+	return noErr;
+}
+
 int16 DiskPrime(uint32 pb, uint32 dce)
 {
 	WriteMacInt32(pb + ioActCount, 0);
@@ -330,28 +343,31 @@ int16 DiskPrime(uint32 pb, uint32 dce)
 	if ((length & 0x1ff) || (position & 0x1ff))
 		return paramErr;
 
+	bool write = (ReadMacInt16(pb + ioTrap) & 0xff) != aRdCmd;
+	if (write && info->read_only)
+		return wPrErr;
+
+	// Asynchronous request? Then hand it to the I/O thread
+	if (AsyncIOPrime(pb, dce, info->fh, buffer, position + info->start_byte, length, write, disk_prime_done))
+		return ioInProgress;
+
+	uint64 start = DiskTraceStart();
 	size_t actual = 0;
-	if ((ReadMacInt16(pb + ioTrap) & 0xff) == aRdCmd) {
+	if (!write) {
 
 		// Read
 		actual = Sys_read(info->fh, buffer, position + info->start_byte, length);
-		if (actual != length)
-			return readErr;
 
 	} else {
 
 		// Write
-		if (info->read_only)
-			return wPrErr;
 		actual = Sys_write(info->fh, buffer, position + info->start_byte, length);
-		if (actual != length)
-			return writErr;
 	}
 
+	DiskTrace(pb, dce, position + info->start_byte, length, actual, write, false, start);
+
 	// Update ParamBlock and DCE
-	WriteMacInt32(pb + ioActCount, actual);
-	WriteMacInt32(dce + dCtlPosition, ReadMacInt32(dce + dCtlPosition) + actual);
-	return noErr;
+	return disk_prime_done(pb, dce, buffer, length, actual, write);
 }
 
 
@@ -406,6 +422,7 @@ int16 DiskControl(uint32 pb, uint32 dce)
 				r.a[0] = 7;	// diskEvent
 				Execute68kTrap(0xa02f, &r);		// PostEvent()
 			} else if (ReadMacInt8(info->status + dsDiskInPlace) > 0) {
+				AsyncIODrain();
 				SysEject(info->fh);
 				WriteMacInt8(info->status + dsDiskInPlace, 0);
 			}
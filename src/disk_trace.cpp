@@ -0,0 +1,215 @@
+/*
+ *  disk_trace.cpp - Disk I/O trace capture
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  When the "disktrace" prefs item names a file, every Prime() request of
+ *  the .Sony, .Disk and .AppleCD drivers is logged to it with its start
+ *  time and host latency. The file is a ring of fixed-size records (see
+ *  disk_trace.h), so a long session keeps only the most recent requests.
+ *  Records are collected in memory and written out in batches.
+ *
+ *  The trace can be replayed against disk images with the disktrace tool.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "sysdeps.h"
+#include "cpu_emulation.h"
+#include "macos_util.h"
+#include "prefs.h"
+#include "clock.h"
+#include "disk_trace.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+#if USE_DISK_TRACE
+
+// Number of records collected before they are written
+const int BATCH_RECORDS = 256;
+
+bool DiskTraceEnabled = false;
+
+static int trace_fd = -1;
+static uint32 capacity;					// Number of record slots in file
+static uint64 total;					// Number of records written to file
+static uint64 trace_start;				// Host time of start of trace
+static uint8 batch[BATCH_RECORDS * DTREC_SIZE];
+static int batch_count;
+
+
+/*
+ *  Big-endian fields
+ */
+
+static void put_be16(uint8 *p, uint16 v)
+{
+	p[0] = v >> 8; p[1] = v;
+}
+
+static void put_be32(uint8 *p, uint32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void put_be64(uint8 *p, uint64 v)
+{
+	put_be32(p, uint32(v >> 32));
+	put_be32(p + 4, uint32(v));
+}
+
+
+/*
+ *  Write file header
+ */
+
+static bool write_header(void)
+{
+	uint8 header[DTRACE_HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header + DTRACE_MAGIC, "B2DTRACE", 8);
+	put_be32(header + DTRACE_VERSION, 1);
+	put_be32(header + DTRACE_RECORD_SIZE, DTREC_SIZE);
+	put_be32(header + DTRACE_CAPACITY, capacity);
+	put_be64(header + DTRACE_TOTAL, total);
+	return lseek(trace_fd, 0, SEEK_SET) == 0 && write(trace_fd, header, DTRACE_HEADER_SIZE) == DTRACE_HEADER_SIZE;
+}
+
+
+/*
+ *  Write collected records into ring
+ */
+
+static void flush_batch(void)
+{
+	int done = 0;
+	bool ok = true;
+	while (done < batch_count && ok) {
+		uint32 slot = total % capacity;
+		int n = batch_count - done;
+		if (n > int(capacity - slot))
+			n = capacity - slot;
+		loff_t pos = DTRACE_HEADER_SIZE + (loff_t)slot * DTREC_SIZE;
+		ok = lseek(trace_fd, pos, SEEK_SET) == pos
+		  && write(trace_fd, batch + done * DTREC_SIZE, n * DTREC_SIZE) == n * DTREC_SIZE;
+		done += n;
+		total += n;
+	}
+	batch_count = 0;
+	if (ok)
+		ok = write_header();
+
+	if (!ok) {
+		printf("WARNING: Disk trace write error (%s), tracing disabled\n", strerror(errno));
+		close(trace_fd);
+		trace_fd = -1;
+		DiskTraceEnabled = false;
+	}
+}
+
+
+/*
+ *  Initialization
+ */
+
+void DiskTraceInit(void)
+{
+	DiskTraceEnabled = false;
+	const char *name = PrefsFindString("disktrace");
+	if (name == NULL || name[0] == 0)
+		return;
+
+	int32 size = PrefsFindInt32("disktracesize");
+	if (size < 64)
+		size = 64;
+	capacity = (size * 1024) / DTREC_SIZE;
+	total = 0;
+	batch_count = 0;
+
+	trace_fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (trace_fd < 0 || !write_header()) {
+		printf("WARNING: Cannot create disk trace file %s (%s)\n", name, strerror(errno));
+		if (trace_fd >= 0)
+			close(trace_fd);
+		trace_fd = -1;
+		return;
+	}
+	trace_start = clock_usec();
+	DiskTraceEnabled = true;
+	D(bug("DiskTraceInit, %u records in %s\n", capacity, name));
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void DiskTraceExit(void)
+{
+	if (trace_fd < 0)
+		return;
+	if (batch_count)
+		flush_batch();
+	if (trace_fd >= 0) {
+		close(trace_fd);
+		trace_fd = -1;
+		printf("Disk trace: %llu requests recorded\n", (unsigned long long)total);
+	}
+	DiskTraceEnabled = false;
+}
+
+
+/*
+ *  Get start time of request
+ */
+
+uint64 DiskTraceStart(void)
+{
+	return DiskTraceEnabled ? clock_usec() : 0;
+}
+
+
+/*
+ *  Record request (called on the emulation thread)
+ */
+
+void disk_trace_record(uint32 pb, uint32 dce, loff_t offset, size_t length, size_t actual, bool write, bool async, uint64 start)
+{
+	uint64 now = clock_usec();
+	uint8 *r = batch + batch_count * DTREC_SIZE;
+	memset(r, 0, DTREC_SIZE);
+	put_be64(r + DTREC_TIME, start - trace_start);
+	put_be64(r + DTREC_OFFSET, offset);
+	put_be32(r + DTREC_LENGTH, length);
+	put_be32(r + DTREC_ACTUAL, actual);
+	put_be32(r + DTREC_LATENCY, uint32(now - start));
+	put_be16(r + DTREC_DRIVE, ReadMacInt16(pb + ioVRefNum));
+	put_be16(r + DTREC_REFNUM, ReadMacInt16(dce + dCtlRefNum));
+	r[DTREC_FLAGS] = (write ? DTREC_WRITE : 0) | (async ? DTREC_ASYNC : 0);
+
+	if (++batch_count == BATCH_RECORDS)
+		flush_batch();
+}
+
+#endif
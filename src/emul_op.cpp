@@ -35,6 +35,7 @@
 #include "sony.h"
 #include "disk.h"
 #include "cdrom.h"
+#include "async_io.h"
 #include "scsi.h"
 #include "video.h"
 #include "audio.h"
@@ -475,6 +476,14 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 				ClearInterruptFlag(INTFLAG_60HZ);
 			}
 
+#if PRECISE_TIMING
+			if (InterruptFlags & INTFLAG_TIMER) {
+				ClearInterruptFlag(INTFLAG_TIMER);
+				if (HasMacStarted())
+					TimerInterrupt();
+			}
+#endif
+
 			if (InterruptFlags & INTFLAG_1HZ) {
 				//ClearInterruptFlag(INTFLAG_1HZ);
 				if (HasMacStarted()) {
@@ -492,16 +501,26 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 			}
 
 			if (InterruptFlags & INTFLAG_ETHER) {
-				//ClearInterruptFlag(INTFLAG_ETHER);
-				EtherInterrupt();
+				// Cleared first, so packets queued while EtherInterrupt() runs raise it again
 				ClearInterruptFlag(INTFLAG_ETHER);
+				EtherInterrupt();
 			}
 
+			if (InterruptFlags & INTFLAG_ETHER_TX)
+				EtherFlush();
+
 			if (InterruptFlags & INTFLAG_AUDIO) {
 				ClearInterruptFlag(INTFLAG_AUDIO);
 				AudioInterrupt();
 			}
 
+#if USE_ASYNC_IO
+			if (InterruptFlags & INTFLAG_DISK) {
+				ClearInterruptFlag(INTFLAG_DISK);
+				AsyncIOInterrupt();
+			}
+#endif
+
 			if (InterruptFlags & INTFLAG_ADB) {
 				//ClearInterruptFlag(INTFLAG_ADB);
 				if (HasMacStarted())
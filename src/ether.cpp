@@ -36,6 +36,11 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
+#ifdef __vita__
+#include <fcntl.h>
+#else
+#include <sys/ioctl.h>
+#endif
 #endif
 
 #include "cpu_emulation.h"
@@ -43,8 +48,10 @@
 #include "macos_util.h"
 #include "emul_op.h"
 #include "prefs.h"
+#include "timer.h"
 #include "ether.h"
 #include "ether_defs.h"
+#include "ether_capture.h"
 
 #ifndef NO_STD_NAMESPACE
 using std::map;
@@ -54,6 +61,7 @@ using std::map;
 #include "debug.h"
 
 #define MONITOR 0
+#define STATISTICS 0
 
 
 #ifdef __BEOS__
@@ -68,6 +76,12 @@ using std::map;
 extern char *psp_local_ip_addr; // String: the local IP address for the PSP
 #endif
 
+#ifdef __vita__
+#include <arpa/inet.h>
+extern bool ether_init_net(char *local_ip);	// Load network modules, get local IP address
+extern void ether_exit_net(void);
+#endif
+
 
 // Global variables
 uint8 ether_addr[6];			// Ethernet address (set by ether_init())
@@ -83,6 +97,30 @@ uint32 ether_data = 0;
 // Attached network protocols for UDP tunneling, maps protocol type to MacOS handler address
 static map<uint16, uint32> udp_protocols;
 
+#if SUPPORTS_UDP_TUNNEL
+// Maximum number of packets per recvmmsg()/sendmmsg() call
+const int UDP_BATCH = 16;
+
+// Maximum time the oldest packet waits in the transmit queue while the Mac keeps sending (usec)
+const int UDP_TX_WINDOW = 1000;
+
+// Packets written by the Mac, sent by udp_flush()
+static uint8 udp_tx_data[UDP_BATCH][1514];
+static int udp_tx_len[UDP_BATCH];
+static struct sockaddr_in udp_tx_addr[UDP_BATCH];
+static int udp_tx_count = 0;
+static uint64 udp_tx_start;		// Time the oldest queued packet was written
+
+// Statistics
+static struct {
+	uint64 start;				// Time the socket was opened
+	uint32 rx_packets, rx_calls;
+	uint32 tx_packets, tx_calls, tx_errors;
+} udp_stats;
+
+static void udp_flush(void);
+#endif
+
 
 /*
  *  Initialization
@@ -90,8 +128,9 @@ static map<uint16, uint32> udp_protocols;
 
 void EtherInit(void)
 {
-	/*net_open = false;
+	net_open = false;
 	udp_tunnel = false;
+	EtherCaptureInit();
 
 #if SUPPORTS_UDP_TUNNEL
 	// UDP tunnelling requested?
@@ -99,10 +138,20 @@ void EtherInit(void)
 		udp_tunnel = true;
 		udp_port = PrefsFindInt32("udpport");
 
+#ifdef __vita__
+		// Sockets are only available after loading the network modules
+		char local_ip[16];
+		if (!ether_init_net(local_ip))
+			return;
+#endif
+
 		// Open UDP socket
 		udp_socket = socket(PF_INET, SOCK_DGRAM, 0);
 		if (udp_socket < 0) {
 			perror("socket");
+#ifdef __vita__
+			ether_exit_net();
+#endif
 			return;
 		}
 
@@ -116,6 +165,9 @@ void EtherInit(void)
 			perror("bind");
 			CLOSESOCKET(udp_socket);
 			udp_socket = -1;
+#ifdef __vita__
+			ether_exit_net();
+#endif
 			return;
 		}
 
@@ -126,6 +178,8 @@ void EtherInit(void)
 		if (udp_ip == INADDR_ANY || udp_ip == INADDR_LOOPBACK) {
 #ifdef PSP
 		    udp_ip = inet_addr (psp_local_ip_addr);
+#elif defined(__vita__)
+			udp_ip = inet_addr(local_ip);
 #else
 			char name[256];
 			gethostname(name, sizeof(name));
@@ -149,15 +203,25 @@ void EtherInit(void)
 		int on = 1;
 #if defined(__BEOS__) || defined(PSP)
 		setsockopt(udp_socket, SOL_SOCKET, SO_NONBLOCK, &on, sizeof(on));
+#elif defined(__vita__)
+		setsockopt(udp_socket, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+		fcntl(udp_socket, F_SETFL, O_NONBLOCK);
 #else
 		setsockopt(udp_socket, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
 		ioctl(udp_socket, FIONBIO, &on);
 #endif
 
+		udp_tx_count = 0;
+		memset(&udp_stats, 0, sizeof(udp_stats));
+		udp_stats.start = GetTicks_usec();
+
 		// Start thread for packet reception
 		if (!ether_start_udp_thread(udp_socket)) {
 			CLOSESOCKET(udp_socket);
 			udp_socket = -1;
+#ifdef __vita__
+			ether_exit_net();
+#endif
 			return;
 		}
 
@@ -165,7 +229,7 @@ void EtherInit(void)
 	} else
 #endif
 		if (ether_init())
-			net_open = true;*/
+			net_open = true;
 }
 
 
@@ -179,15 +243,29 @@ void EtherExit(void)
 #if SUPPORTS_UDP_TUNNEL
 		if (udp_tunnel) {
 			if (udp_socket >= 0) {
+				udp_flush();
 				ether_stop_udp_thread();
 				CLOSESOCKET(udp_socket);
 				udp_socket = -1;
+
+#if STATISTICS
+				// Show statistics
+				double secs = (GetTicks_usec() - udp_stats.start) / 1e6;
+				if (secs <= 0)
+					secs = 1;
+				printf("UDP receive: %u packets, %.1f packets/s, %.2f syscalls/packet\n", udp_stats.rx_packets, udp_stats.rx_packets / secs, udp_stats.rx_packets ? (double)udp_stats.rx_calls / udp_stats.rx_packets : 0.0);
+				printf("UDP transmit: %u packets, %.1f packets/s, %.2f syscalls/packet, %u errors\n", udp_stats.tx_packets, udp_stats.tx_packets / secs, udp_stats.tx_packets ? (double)udp_stats.tx_calls / udp_stats.tx_packets : 0.0, udp_stats.tx_errors);
+#endif
 			}
+#ifdef __vita__
+			ether_exit_net();
+#endif
 		} else
 #endif
 			ether_exit();
 		net_open = false;
 	}
+	EtherCaptureExit();
 }
 
 
@@ -198,6 +276,9 @@ void EtherExit(void)
 void EtherReset(void)
 {
 	udp_protocols.clear();
+#if SUPPORTS_UDP_TUNNEL
+	udp_tx_count = 0;
+#endif
 	ether_reset();
 }
 
@@ -225,7 +306,7 @@ static inline bool is_ethernet_broadcast(uint8 *p)
 
 int16 EtherOpen(uint32 pb, uint32 dce)
 {
-	/*D(bug("EtherOpen\n"));
+	D(bug("EtherOpen\n"));
 
 	// Allocate driver data
 	M68kRegisters r;
@@ -258,7 +339,7 @@ int16 EtherOpen(uint32 pb, uint32 dce)
 	WriteMacInt16(ether_data + ed_ReadPacket + 16, 0x4e75);	//  rts
 	WriteMacInt16(ether_data + ed_ReadPacket + 18, M68K_EMUL_OP_ETHER_READ_PACKET);	//2
 	WriteMacInt16(ether_data + ed_ReadPacket + 20, 0x4a43);	//  tst.w	d3
-	WriteMacInt16(ether_data + ed_ReadPacket + 22, 0x4e75);	//  rts*/
+	WriteMacInt16(ether_data + ed_ReadPacket + 22, 0x4e75);	//  rts
 	return 0;
 }
 
@@ -269,7 +350,7 @@ int16 EtherOpen(uint32 pb, uint32 dce)
 
 int16 EtherControl(uint32 pb, uint32 dce)
 {
-	/*uint16 code = ReadMacInt16(pb + csCode);
+	uint16 code = ReadMacInt16(pb + csCode);
 	D(bug("EtherControl %d\n", code));
 	switch (code) {
 		case 1:					// KillIO
@@ -330,8 +411,8 @@ int16 EtherControl(uint32 pb, uint32 dce)
 #if SUPPORTS_UDP_TUNNEL
 				if (udp_tunnel) {
 
-					// Copy packet to buffer
-					uint8 packet[1514];
+					// Copy packet to transmit queue
+					uint8 *packet = udp_tx_data[udp_tx_count];
 					int len = ether_wds_to_buffer(wds, packet);
 
 					// Extract destination address
@@ -342,6 +423,7 @@ int16 EtherControl(uint32 pb, uint32 dce)
 						dest_ip = INADDR_BROADCAST;
 					else
 						return eMultiErr;
+					EtherCapture(packet, len);
 
 #if MONITOR
 					bug("Sending Ethernet packet:\n");
@@ -351,18 +433,34 @@ int16 EtherControl(uint32 pb, uint32 dce)
 					bug("\n");
 #endif
 
-					// Send packet
-					struct sockaddr_in sa;
-					sa.sin_family = AF_INET;
-					sa.sin_addr.s_addr = htonl(dest_ip);
-					sa.sin_port = htons(udp_port);
-					if (sendto(udp_socket, packet, len, 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-						D(bug("WARNING: Couldn't transmit packet\n"));
-						return excessCollsns;
+					// Queue packet, it is sent with the following ones by
+					// udp_flush() when the queue is full, when the coalescing
+					// window has passed or when the Ethernet TX interrupt runs
+					uint64 now = GetTicks_usec();
+					if (udp_tx_count == 0) {
+						udp_tx_start = now;
+						SetInterruptFlag(INTFLAG_ETHER_TX);
+						TriggerInterrupt();
 					}
+					struct sockaddr_in *sa = &udp_tx_addr[udp_tx_count];
+					memset(sa, 0, sizeof(*sa));
+					sa->sin_family = AF_INET;
+					sa->sin_addr.s_addr = htonl(dest_ip);
+					sa->sin_port = htons(udp_port);
+					udp_tx_len[udp_tx_count++] = len;
+					if (udp_tx_count == UDP_BATCH || now - udp_tx_start >= UDP_TX_WINDOW)
+						udp_flush();
 				} else
+#endif
+				{
+#if USE_ETHER_CAPTURE
+					if (EtherCaptureEnabled) {
+						uint8 packet[1514];
+						EtherCapture(packet, ether_wds_to_buffer(wds, packet));
+					}
 #endif
 					return ether_write(wds);
+				}
 			}
 			return noErr;
 		}
@@ -391,8 +489,7 @@ int16 EtherControl(uint32 pb, uint32 dce)
 		default:
 			printf("WARNING: Unknown EtherControl(%d)\n", code);
 			return controlErr;
-	}*/
-	return noErr;
+	}
 }
 
 
@@ -419,9 +516,10 @@ void EtherReadPacket(uint32 &src, uint32 &dest, uint32 &len, uint32 &remaining)
 
 void ether_udp_read(uint32 packet, int length, struct sockaddr_in *from)
 {
-	/*// Drop packets sent by us
+	// Drop packets sent by us
 	if (memcmp(Mac2HostAddr(packet) + 6, ether_addr, 6) == 0)
 		return;
+	EtherCapture(Mac2HostAddr(packet), length);
 
 #if MONITOR
 	bug("Receiving Ethernet packet:\n");
@@ -454,11 +552,134 @@ void ether_udp_read(uint32 packet, int length, struct sockaddr_in *from)
 	r.a[3] = ether_data + ed_RHA + 14;				// Pointer behind header in RHA
 	r.a[4] = ether_data + ed_ReadPacket;			// Pointer to ReadPacket/ReadRest routines
 	D(bug(" calling protocol handler %08x, type %08x, length %08x, data %08x, rha %08x, read_packet %08x\n", handler, r.d[0], r.d[1], r.a[0], r.a[3], r.a[4]));
-	Execute68k(handler, &r);*/
+	Execute68k(handler, &r);
+}
+
+
+/*
+ *  Read all packets waiting on UDP socket and pass them to ether_udp_read(),
+ *  packet is the Mac buffer to use, returns number of packets
+ */
+
+int ether_udp_receive(uint32 packet)
+{
+	int num_packets = 0;
+
+#ifdef HAVE_RECVMMSG
+	static uint8 buf[UDP_BATCH][1514];
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	struct sockaddr_in from[UDP_BATCH];
+
+	for (;;) {
+		for (int i=0; i<UDP_BATCH; i++) {
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = sizeof(buf[i]);
+			memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_name = &from[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int n = recvmmsg(udp_socket, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+		udp_stats.rx_calls++;
+		if (n <= 0)
+			break;
+		for (int i=0; i<n; i++) {
+			int length = msgs[i].msg_len;
+			if (length < 14)
+				continue;
+			Host2Mac_memcpy(packet, buf[i], length);
+			ether_udp_read(packet, length, &from[i]);
+		}
+		num_packets += n;
+
+		// A short batch emptied the socket, save the call that would return EAGAIN
+		if (n < UDP_BATCH)
+			break;
+	}
+#else
+	for (;;) {
+		struct sockaddr_in from;
+		socklen_t from_len = sizeof(from);
+		int length = recvfrom(udp_socket, Mac2HostAddr(packet), 1514, 0, (struct sockaddr *)&from, &from_len);
+		udp_stats.rx_calls++;
+		if (length < 14)
+			break;
+		ether_udp_read(packet, length, &from);
+		num_packets++;
+	}
+#endif
+
+	udp_stats.rx_packets += num_packets;
+	return num_packets;
+}
+
+
+/*
+ *  Send packets queued by EtherControl(kENetWrite)
+ */
+
+static void udp_flush(void)
+{
+	int count = udp_tx_count;
+	udp_tx_count = 0;
+	ClearInterruptFlag(INTFLAG_ETHER_TX);
+	if (count == 0 || udp_socket < 0)
+		return;
+
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	for (int i=0; i<count; i++) {
+		iov[i].iov_base = udp_tx_data[i];
+		iov[i].iov_len = udp_tx_len[i];
+		memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_name = &udp_tx_addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(udp_tx_addr[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int sent = 0;
+	while (sent < count) {
+		int n = sendmmsg(udp_socket, msgs + sent, count - sent, 0);
+		udp_stats.tx_calls++;
+		if (n <= 0) {
+			// Skip the packet that failed and try the rest
+			D(bug("WARNING: Couldn't transmit packet\n"));
+			udp_stats.tx_errors++;
+			n = 1;
+		} else
+			udp_stats.tx_packets += n;
+		sent += n;
+	}
+#else
+	for (int i=0; i<count; i++) {
+		udp_stats.tx_calls++;
+		if (sendto(udp_socket, udp_tx_data[i], udp_tx_len[i], 0, (struct sockaddr *)&udp_tx_addr[i], sizeof(udp_tx_addr[i])) < 0) {
+			D(bug("WARNING: Couldn't transmit packet\n"));
+			udp_stats.tx_errors++;
+		} else
+			udp_stats.tx_packets++;
+	}
+#endif
 }
 #endif
 
 
+/*
+ *  Ethernet TX interrupt - send packets queued for the UDP tunnel
+ */
+
+void EtherFlush(void)
+{
+#if SUPPORTS_UDP_TUNNEL
+	if (udp_tunnel)
+		udp_flush();
+#endif
+}
+
+
 /*
  *  Ethernet packet allocator
  */
@@ -0,0 +1,286 @@
+/*
+ *  ether_capture.cpp - Ethernet packet capture to pcap file
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  When the "ethercapture" prefs item names a file, every Ethernet frame
+ *  sent or received by the Mac is written to it in pcap format, to be
+ *  examined with Wireshark or tcpdump. Capturing stops when the file has
+ *  reached "ethercapturesize" KB or "ethercapturecount" packets.
+ *
+ *  The emulation thread only copies frames into a ring buffer. A writer
+ *  thread takes them out and does the file I/O, so it never waits for the
+ *  disk. The ring has a single producer and a single consumer and needs no
+ *  locking; when it is full, frames are dropped and counted.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "sysdeps.h"
+#include "prefs.h"
+#include "clock.h"
+#include "ether_capture.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+#if USE_ETHER_CAPTURE
+
+// Size of capture ring in bytes (power of 2)
+const uint32 RING_SIZE = 256 * 1024;
+
+// Frames are cut to this length
+const int SNAP_LEN = 1518;
+
+// Size of buffer for pcap records written in one call
+const int WRITE_BUF_SIZE = 32 * 1024;
+
+// Frame in capture ring, followed by the data and padded to a multiple of 16 bytes
+struct capture_record {
+	uint64 time;				// Host time in usec (clock_usec())
+	uint32 len;					// Captured length, or PAD_RECORD
+	uint32 orig_len;			// Length of frame
+};
+
+const uint32 PAD_RECORD = 0xffffffff;	// Rest of ring unused, next record at start
+
+// pcap file format (native byte order, microsecond timestamps)
+const uint32 PCAP_MAGIC = 0xa1b2c3d4;
+const uint32 LINKTYPE_ETHERNET = 1;
+
+struct pcap_file_header {
+	uint32 magic;
+	uint16 version_major;
+	uint16 version_minor;
+	int32 thiszone;
+	uint32 sigfigs;
+	uint32 snaplen;
+	uint32 linktype;
+};
+
+struct pcap_record_header {
+	uint32 ts_sec;
+	uint32 ts_usec;
+	uint32 incl_len;
+	uint32 orig_len;
+};
+
+bool EtherCaptureEnabled = false;
+
+static uint8 *ring = NULL;
+static volatile uint32 ring_head;		// Next byte to fill (emulation thread)
+static volatile uint32 ring_tail;		// Next byte to write to file (writer thread)
+
+static int capture_fd = -1;
+static bool thread_active = false;		// Flag: writer thread running
+static uint64 file_size, max_file_size;
+static uint32 num_packets, max_packets;
+static volatile uint32 num_dropped;		// Frames which didn't fit into the ring
+static time_t start_time;				// Wall clock time of start of capture
+static uint64 start_usec;				// Host time of start of capture
+
+
+/*
+ *  Initialization
+ */
+
+void EtherCaptureInit(void)
+{
+	EtherCaptureEnabled = false;
+	const char *name = PrefsFindString("ethercapture");
+	if (name == NULL || name[0] == 0)
+		return;
+
+	max_file_size = (uint64)PrefsFindInt32("ethercapturesize") * 1024;
+	max_packets = PrefsFindInt32("ethercapturecount");
+	file_size = 0;
+	num_packets = num_dropped = 0;
+	ring_head = ring_tail = 0;
+
+	ring = new uint8[RING_SIZE];
+	capture_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (capture_fd < 0) {
+		printf("WARNING: Cannot create packet capture file %s (%s)\n", name, strerror(errno));
+		goto init_error;
+	}
+
+	pcap_file_header header;
+	header.magic = PCAP_MAGIC;
+	header.version_major = 2;
+	header.version_minor = 4;
+	header.thiszone = 0;
+	header.sigfigs = 0;
+	header.snaplen = SNAP_LEN;
+	header.linktype = LINKTYPE_ETHERNET;
+	if (write(capture_fd, &header, sizeof(header)) != sizeof(header)) {
+		printf("WARNING: Cannot write packet capture file %s (%s)\n", name, strerror(errno));
+		goto init_error;
+	}
+	file_size = sizeof(header);
+
+	start_time = time(NULL);
+	start_usec = clock_usec();
+	EtherCaptureEnabled = true;
+	thread_active = ether_capture_thread_start();
+	if (!thread_active) {
+		printf("WARNING: Cannot start packet capture thread\n");
+		EtherCaptureEnabled = false;
+		goto init_error;
+	}
+	D(bug("EtherCaptureInit, capturing to %s\n", name));
+	return;
+
+init_error:
+	if (capture_fd >= 0)
+		close(capture_fd);
+	capture_fd = -1;
+	delete[] ring;
+	ring = NULL;
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void EtherCaptureExit(void)
+{
+	if (capture_fd < 0)
+		return;
+	EtherCaptureEnabled = false;
+	if (thread_active) {
+		ether_capture_thread_stop();
+		thread_active = false;
+	}
+
+	// Write what is left in the ring
+	EtherCaptureService();
+	close(capture_fd);
+	capture_fd = -1;
+	delete[] ring;
+	ring = NULL;
+	printf("Packet capture: %u packets recorded, %u dropped\n", num_packets, num_dropped);
+}
+
+
+/*
+ *  Copy frame into ring (called on the emulation thread)
+ */
+
+void ether_capture_packet(const uint8 *packet, int len)
+{
+	if (len <= 0)
+		return;
+	uint32 cap_len = len > SNAP_LEN ? SNAP_LEN : len;
+	uint32 size = (sizeof(capture_record) + cap_len + 15) & ~15;
+
+	// Records don't wrap, the rest of the ring is skipped instead
+	uint32 head = ring_head;
+	uint32 pos = head % RING_SIZE;
+	uint32 pad = pos + size > RING_SIZE ? RING_SIZE - pos : 0;
+	uint32 used = head - ring_tail;
+	if (used + pad + size > RING_SIZE) {
+		num_dropped++;
+		return;
+	}
+	if (pad) {
+		((capture_record *)(ring + pos))->len = PAD_RECORD;
+		head += pad;
+		pos = 0;
+	}
+
+	capture_record *r = (capture_record *)(ring + pos);
+	r->time = clock_usec();
+	r->len = cap_len;
+	r->orig_len = len;
+	memcpy(r + 1, packet, cap_len);
+	__sync_synchronize();			// Publish record before head
+	ring_head = head + size;
+
+	// Wake up writer when the ring gets half full, it looks by itself otherwise
+	if (used < RING_SIZE / 2 && used + pad + size >= RING_SIZE / 2)
+		ether_capture_wakeup();
+}
+
+
+/*
+ *  Write frames from ring to file (called on the writer thread)
+ */
+
+void EtherCaptureService(void)
+{
+	static uint8 buf[WRITE_BUF_SIZE];
+	int buf_len = 0;
+	bool full = false;
+
+	uint32 tail = ring_tail;
+	while (tail != ring_head) {
+		__sync_synchronize();		// Read head before record
+		uint32 pos = tail % RING_SIZE;
+		capture_record *r = (capture_record *)(ring + pos);
+		if (r->len == PAD_RECORD) {
+			tail += RING_SIZE - pos;
+			continue;
+		}
+		uint32 size = (sizeof(capture_record) + r->len + 15) & ~15;
+		uint32 rec_size = sizeof(pcap_record_header) + r->len;
+
+		// Stop when a limit is reached, the rest of the ring is discarded
+		if ((max_file_size && file_size + rec_size > max_file_size) || (max_packets && num_packets >= max_packets))
+			full = true;
+
+		if (!full) {
+			if (buf_len + rec_size > sizeof(buf)) {
+				if (write(capture_fd, buf, buf_len) != buf_len)
+					full = true;
+				buf_len = 0;
+			}
+			uint64 t = r->time - start_usec;
+			pcap_record_header h;
+			h.ts_sec = start_time + uint32(t / 1000000);
+			h.ts_usec = uint32(t % 1000000);
+			h.incl_len = r->len;
+			h.orig_len = r->orig_len;
+			memcpy(buf + buf_len, &h, sizeof(h));
+			memcpy(buf + buf_len + sizeof(h), r + 1, r->len);
+			buf_len += rec_size;
+			file_size += rec_size;
+			num_packets++;
+		}
+
+		__sync_synchronize();		// Finish copy before releasing space
+		tail += size;
+		ring_tail = tail;
+	}
+
+	if (buf_len && write(capture_fd, buf, buf_len) != buf_len)
+		full = true;
+
+	if (full && EtherCaptureEnabled) {
+		EtherCaptureEnabled = false;
+		printf("Packet capture stopped after %u packets (%llu bytes)\n", num_packets, (unsigned long long)file_size);
+	}
+}
+
+#endif
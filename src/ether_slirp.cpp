@@ -0,0 +1,364 @@
+/*
+ *  ether_slirp.cpp - Portable slirp (user mode NAT) Ethernet backend
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The slirp library implements a complete TCP/IP stack on top of host
+ *  sockets, so the emulated Mac gets network access through NAT without
+ *  TAP devices or privileges. The Mac sees a 10.0.2.0/24 network with
+ *  the gateway at 10.0.2.2, the DNS forwarder at 10.0.2.3 and itself at
+ *  10.0.2.15 (served by BOOTP/DHCP).
+ *
+ *  slirp is not thread-safe, so all calls into it are made by a single
+ *  worker thread which calls ether_slirp_poll() in a loop. Packets are
+ *  passed between the worker and the emulation thread through two
+ *  single-producer/single-consumer queues which need no locking.
+ *  The worker sleeps in slirp_poll() until a socket or timer needs it;
+ *  packets from the Mac wake it through a pipe, or on the Vita, whose
+ *  select() only handles sockets, through a loopback UDP socket which
+ *  sends to itself.
+ *
+ *  Host ports are forwarded to the Mac with "redir" prefs items of the
+ *  form "[tcp|udp]:host_port:[guest_addr:]guest_port".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "sysdeps.h"
+#include "prefs.h"
+#include "ether_slirp.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+#ifdef HAVE_SLIRP
+
+#include "libslirp.h"
+
+// Ethernet address of emulated Mac, slirp uses it in ARP replies
+const uint8 ether_slirp_addr[6] = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+
+// Number of packets per queue (power of 2)
+const int QUEUE_SIZE = 64;
+
+// Maximum Ethernet packet size (with some headroom)
+const int MAX_PACKET_SIZE = 1516;
+
+// Packet queue with one producer and one consumer thread
+struct packet_queue {
+	volatile uint32 head;			// Next slot to fill (producer)
+	volatile uint32 tail;			// Next slot to empty (consumer)
+	int len[QUEUE_SIZE];
+	uint8 data[QUEUE_SIZE][MAX_PACKET_SIZE];
+};
+
+static packet_queue tx_queue;		// Emulated Mac -> slirp
+static packet_queue rx_queue;		// slirp -> emulated Mac
+static uint32 tx_dropped, rx_dropped;
+
+// Pipe or loopback UDP socket to wake up the worker thread when packets are queued
+#ifdef __vita__
+#define USE_WAKEUP_SOCKET 1
+#endif
+static int wakeup_pipe[2] = {-1, -1};	// Read and write end, both the socket if USE_WAKEUP_SOCKET
+static volatile int wakeup_pending;	// Byte written to pipe and not yet drained
+
+
+/*
+ *  Queue operations
+ */
+
+static void queue_reset(packet_queue *q)
+{
+	q->head = q->tail = 0;
+}
+
+static inline bool queue_full(const packet_queue *q)
+{
+	return q->head - q->tail >= (uint32)QUEUE_SIZE;
+}
+
+static inline bool queue_empty(const packet_queue *q)
+{
+	return q->head == q->tail;
+}
+
+static bool queue_put(packet_queue *q, const uint8 *packet, int len)
+{
+	if (len <= 0 || len > MAX_PACKET_SIZE || queue_full(q))
+		return false;
+	uint32 slot = q->head % QUEUE_SIZE;
+	memcpy(q->data[slot], packet, len);
+	q->len[slot] = len;
+	__sync_synchronize();			// Publish packet before head
+	q->head++;
+	return true;
+}
+
+static int queue_get(packet_queue *q, uint8 *packet, int max_len)
+{
+	if (queue_empty(q))
+		return 0;
+	__sync_synchronize();			// Read head before packet
+	uint32 slot = q->tail % QUEUE_SIZE;
+	int len = q->len[slot];
+	if (len > max_len)
+		len = max_len;
+	memcpy(packet, q->data[slot], len);
+	__sync_synchronize();			// Finish copy before releasing slot
+	q->tail++;
+	return len;
+}
+
+
+/*
+ *  Wakeup of the worker thread
+ */
+
+static void wakeup_open(void)
+{
+	if (wakeup_pipe[0] >= 0)
+		return;
+#if USE_WAKEUP_SOCKET
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s < 0)
+		return;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	 || getsockname(s, (struct sockaddr *)&addr, &addr_len) < 0
+	 || connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(s);
+		return;
+	}
+	fcntl(s, F_SETFL, O_NONBLOCK);
+	wakeup_pipe[0] = wakeup_pipe[1] = s;
+#else
+	if (pipe(wakeup_pipe) == 0) {
+		for (int i=0; i<2; i++) {
+			fcntl(wakeup_pipe[i], F_SETFL, O_NONBLOCK);
+			fcntl(wakeup_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+#endif
+}
+
+static void wakeup_close(void)
+{
+	if (wakeup_pipe[0] >= 0)
+		close(wakeup_pipe[0]);
+	if (wakeup_pipe[1] >= 0 && wakeup_pipe[1] != wakeup_pipe[0])
+		close(wakeup_pipe[1]);
+	wakeup_pipe[0] = wakeup_pipe[1] = -1;
+}
+
+static void wakeup_drain(void)
+{
+	uint8 buf[64];
+#if USE_WAKEUP_SOCKET
+	while (recv(wakeup_pipe[0], buf, sizeof(buf), 0) > 0) ;
+#else
+	while (read(wakeup_pipe[0], buf, sizeof(buf)) > 0) ;
+#endif
+}
+
+static bool wakeup_send(void)
+{
+	uint8 b = 0;
+#if USE_WAKEUP_SOCKET
+	return send(wakeup_pipe[1], &b, 1, 0) == 1;
+#else
+	return write(wakeup_pipe[1], &b, 1) == 1;
+#endif
+}
+
+
+/*
+ *  Parse "redir" prefs item and set up port redirection
+ */
+
+static bool add_redir(const char *str)
+{
+	int is_udp = 0;
+	if (strncmp(str, "tcp:", 4) == 0)
+		str += 4;
+	else if (strncmp(str, "udp:", 4) == 0) {
+		is_udp = 1;
+		str += 4;
+	}
+
+	char *end;
+	long host_port = strtol(str, &end, 10);
+	if (end == str || *end != ':' || host_port <= 0 || host_port > 65535)
+		return false;
+	str = end + 1;
+
+	// Optional guest address, default is the address given to the Mac by DHCP
+	struct in_addr guest_addr;
+	inet_aton("10.0.2.15", &guest_addr);
+	const char *colon = strchr(str, ':');
+	if (colon) {
+		char addr[16];
+		int n = colon - str;
+		if (n >= (int)sizeof(addr))
+			return false;
+		memcpy(addr, str, n);
+		addr[n] = 0;
+		if (n && !inet_aton(addr, &guest_addr))
+			return false;
+		str = colon + 1;
+	}
+
+	long guest_port = strtol(str, &end, 10);
+	if (end == str || *end != 0 || guest_port <= 0 || guest_port > 65535)
+		return false;
+
+	D(bug("slirp redirection %s port %ld -> %s:%ld\n", is_udp ? "udp" : "tcp", host_port, inet_ntoa(guest_addr), guest_port));
+	return slirp_redir(is_udp, host_port, guest_addr, guest_port) == 0;
+}
+
+
+/*
+ *  Initialization
+ */
+
+bool ether_slirp_init(const char *dns_addr)
+{
+	queue_reset(&tx_queue);
+	queue_reset(&rx_queue);
+	tx_dropped = rx_dropped = 0;
+
+	if (dns_addr && dns_addr[0]) {
+		strncpy(slirp_dns_server, dns_addr, sizeof(slirp_dns_server) - 1);
+		slirp_dns_server[sizeof(slirp_dns_server) - 1] = 0;
+	}
+	if (slirp_init() < 0)
+		return false;
+
+	wakeup_open();
+	wakeup_pending = 0;
+
+	const char *str;
+	for (int i=0; (str = PrefsFindString("redir", i)) != NULL; i++) {
+		if (!add_redir(str))
+			printf("WARNING: Invalid or unavailable port redirection '%s'\n", str);
+	}
+	return true;
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void ether_slirp_exit(void)
+{
+	D(bug("slirp: %u packets to slirp dropped, %u packets to Mac dropped\n", tx_dropped, rx_dropped));
+	queue_reset(&tx_queue);
+	queue_reset(&rx_queue);
+	wakeup_close();
+}
+
+
+/*
+ *  Worker thread iteration: feed queued packets into slirp, then wait for
+ *  socket activity and let slirp process it and run its timers
+ */
+
+void ether_slirp_poll(int timeout_usec)
+{
+	uint8 packet[MAX_PACKET_SIZE];
+	int len;
+
+	// Drain the wakeup pipe before the queue, so a packet queued after
+	// the queue was emptied always finds a byte in the pipe
+	if (wakeup_pending) {
+		wakeup_drain();
+		wakeup_pending = 0;
+		__sync_synchronize();
+	}
+
+	while ((len = queue_get(&tx_queue, packet, sizeof(packet))) > 0)
+		slirp_input(packet, len);
+
+	slirp_poll(timeout_usec, wakeup_pipe[0]);
+}
+
+
+/*
+ *  Queue packet from emulated Mac
+ */
+
+bool ether_slirp_write(const uint8 *packet, int len)
+{
+	if (queue_put(&tx_queue, packet, len)) {
+		// One byte in the pipe is enough until the worker drains it
+		__sync_synchronize();
+		if (wakeup_pipe[1] >= 0 && __sync_lock_test_and_set(&wakeup_pending, 1) == 0) {
+			if (!wakeup_send())
+				wakeup_pending = 0;
+		}
+		return true;
+	}
+	tx_dropped++;
+	return false;
+}
+
+
+/*
+ *  Get packet for emulated Mac
+ */
+
+int ether_slirp_read(uint8 *packet, int max_len)
+{
+	return queue_get(&rx_queue, packet, max_len);
+}
+
+bool ether_slirp_pending(void)
+{
+	return !queue_empty(&rx_queue);
+}
+
+
+/*
+ *  slirp output glue (called on the worker thread)
+ */
+
+int slirp_can_output(void)
+{
+	return !queue_full(&rx_queue);
+}
+
+void slirp_output(const uint8 *packet, int len)
+{
+	if (!queue_put(&rx_queue, packet, len))
+		rx_dropped++;
+}
+
+#endif
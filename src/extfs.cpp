@@ -111,6 +111,11 @@ static const char *RootPath;
 static bool ready = false;
 static struct stat root_stat;
 
+#if EXTFS_WATCH
+// Flag: host change watcher running
+static bool watching = false;
+#endif
+
 // File system ID/media type
 const int16 MY_FSID = EMULATOR_ID_2;
 const uint32 MY_MEDIA_TYPE = EMULATOR_ID_4;
@@ -156,6 +161,9 @@ const uint8 ExtFSIcon[256] = {
 // These objects are used to map CNIDs to path names
 struct FSItem {
 	FSItem *next;			// Pointer to next FSItem in list
+	FSItem *next_by_id;		// Next FSItem in CNID hash chain
+	FSItem *next_by_name;	// Next FSItem in host name hash chain
+	FSItem *next_by_guest;	// Next FSItem in guest name hash chain
 	uint32 id;				// CNID of this file/dir
 	uint32 parent_id;		// CNID of parent file/dir
 	FSItem *parent;			// Pointer to parent
@@ -163,12 +171,39 @@ struct FSItem {
 	char guest_name[32];	// Object name (C string) - Guest OS
 	time_t mtime;			// Modification time for get_cat_info caching
 	int cache_dircount;		// Cached number of files in directory
+	time_t meta_mtime;		// Modification time the cached metadata belongs to
+	time_t meta_time;		// Time the cached metadata was read
+	uint32 meta_valid;		// Which cached metadata is valid (META_* flags)
+	uint32 cache_rf_size;	// Cached resource fork size
+	uint8 cache_finfo[SIZEOF_FInfo + SIZEOF_FXInfo];	// Cached Finder info
+};
+
+// Cached FSItem metadata
+enum {
+	META_FINFO = 1,			// cache_finfo valid
+	META_RF_SIZE = 2		// cache_rf_size valid
 };
 
 static FSItem *first_fs_item, *last_fs_item;
 
 static uint32 next_cnid = fsUsrCNID;	// Next available CNID
 
+// FSItems are found by CNID and by (parent, host name) and (parent, guest name)
+// through hash tables, which grow with the number of items
+const uint32 MIN_FSITEM_HASH_SIZE = 1024;
+static FSItem **id_hash, **name_hash, **guest_hash;
+static uint32 fsitem_hash_mask;
+static uint32 num_fs_items;
+
+// FSItems and their names are never freed before ExtFSExit(), so they are
+// allocated from large pool blocks instead of individually
+const size_t FSITEM_POOL_BLOCK_SIZE = 65536;
+struct pool_block {
+	pool_block *next;
+	size_t used;
+};
+static pool_block *fsitem_pool;
+
 
 /*
  *  Get object creation time
@@ -208,17 +243,136 @@ static uint32 get_creation_time(const char *path)
 #endif
 
 
+/*
+ *  Allocate memory for FSItems and names from pool
+ */
+
+static void *pool_alloc(size_t size)
+{
+	const size_t header_size = (sizeof(pool_block) + 7) & ~7;
+	size = (size + 7) & ~7;
+	pool_block *b = fsitem_pool;
+	if (b == NULL || b->used + size > FSITEM_POOL_BLOCK_SIZE) {
+		size_t block_size = FSITEM_POOL_BLOCK_SIZE;
+		if (header_size + size > block_size)
+			block_size = header_size + size;
+		b = (pool_block *)new uint8[block_size];
+		b->next = fsitem_pool;
+		b->used = header_size;
+		fsitem_pool = b;
+	}
+	void *p = (uint8 *)b + b->used;
+	b->used += size;
+	return p;
+}
+
+static void pool_free_all(void)
+{
+	pool_block *b = fsitem_pool;
+	while (b) {
+		pool_block *next = b->next;
+		delete[] (uint8 *)b;
+		b = next;
+	}
+	fsitem_pool = NULL;
+}
+
+
+/*
+ *  FSItem hash tables
+ */
+
+static inline uint32 hash_name(const FSItem *parent, const char *name)
+{
+	uint32 h = 2166136261U ^ (uint32)(uintptr)parent;
+	while (*name)
+		h = (h ^ (uint8)*name++) * 16777619U;
+	return h ^ (h >> 16);
+}
+
+// Items are appended to the chains, so of several items with the same name
+// the oldest one is found first, as with the former linear search
+static void id_hash_add(FSItem *p)
+{
+	FSItem **q = &id_hash[p->id & fsitem_hash_mask];
+	while (*q)
+		q = &(*q)->next_by_id;
+	*q = p;
+	p->next_by_id = NULL;
+}
+
+static void id_hash_remove(FSItem *p)
+{
+	FSItem **q = &id_hash[p->id & fsitem_hash_mask];
+	while (*q != p)
+		q = &(*q)->next_by_id;
+	*q = p->next_by_id;
+}
+
+static void name_hash_add(FSItem *p)
+{
+	FSItem **q = &name_hash[hash_name(p->parent, p->name) & fsitem_hash_mask];
+	while (*q)
+		q = &(*q)->next_by_name;
+	*q = p;
+	p->next_by_name = NULL;
+
+	q = &guest_hash[hash_name(p->parent, p->guest_name) & fsitem_hash_mask];
+	while (*q)
+		q = &(*q)->next_by_guest;
+	*q = p;
+	p->next_by_guest = NULL;
+}
+
+static void alloc_fsitem_hash(uint32 size)
+{
+	delete[] id_hash;
+	delete[] name_hash;
+	delete[] guest_hash;
+	id_hash = new FSItem *[size];
+	name_hash = new FSItem *[size];
+	guest_hash = new FSItem *[size];
+	memset(id_hash, 0, size * sizeof(FSItem *));
+	memset(name_hash, 0, size * sizeof(FSItem *));
+	memset(guest_hash, 0, size * sizeof(FSItem *));
+	fsitem_hash_mask = size - 1;
+}
+
+// Add FSItem to list and hash tables
+static void add_fsitem(FSItem *p)
+{
+	p->next = NULL;
+	if (last_fs_item)
+		last_fs_item->next = p;
+	else
+		first_fs_item = p;
+	last_fs_item = p;
+
+	if (++num_fs_items > fsitem_hash_mask + 1) {
+		// Double hash table size, rehash in list order
+		alloc_fsitem_hash((fsitem_hash_mask + 1) * 2);
+		for (FSItem *q = first_fs_item; q; q = q->next) {
+			id_hash_add(q);
+			name_hash_add(q);
+		}
+	} else {
+		id_hash_add(p);
+		name_hash_add(p);
+	}
+}
+
+
 /*
  *  Find FSItem for given CNID
  */
 
 static FSItem *find_fsitem_by_id(uint32 cnid)
 {
-	FSItem *p = first_fs_item;
+	FSItem *p = id_hash[cnid & fsitem_hash_mask];
 	while (p) {
 		if (p->id == cnid)
 			return p;
-		p = p->next;
+		p = p->next_by_id;
 	}
 	return NULL;
 }
@@ -227,35 +381,50 @@ static FSItem *find_fsitem_by_id(uint32 cnid)
  *  Create FSItem with the given parameters
  */
 
-static FSItem *create_fsitem(const char *name, const char *guest_name, FSItem *parent)
+static FSItem *new_fsitem(uint32 id, const char *name, const char *guest_name, FSItem *parent)
 {
-	FSItem *p = new FSItem;
-	last_fs_item->next = p;
-	p->next = NULL;
-	last_fs_item = p;
-	p->id = next_cnid++;
-	p->parent_id = parent->id;
+	FSItem *p = (FSItem *)pool_alloc(sizeof(FSItem));
+	p->id = id;
+	p->parent_id = parent ? parent->id : 0;
 	p->parent = parent;
-	p->name = new char[strlen(name) + 1];
+	p->name = (char *)pool_alloc(strlen(name) + 1);
 	strcpy(p->name, name);
 	strncpy(p->guest_name, guest_name, 31);
 	p->guest_name[31] = 0;
 	p->mtime = 0;
+	p->cache_dircount = 0;
+	p->meta_mtime = 0;
+	p->meta_time = 0;
+	p->meta_valid = 0;
+	add_fsitem(p);
 	return p;
 }
 
+static FSItem *create_fsitem(const char *name, const char *guest_name, FSItem *parent)
+{
+	return new_fsitem(next_cnid++, name, guest_name, parent);
+}
+
 /*
  *  Find FSItem for given name and parent, construct new FSItem if not found
  */
 
-static FSItem *find_fsitem(const char *name, FSItem *parent)
+static FSItem *lookup_fsitem(const char *name, FSItem *parent)
 {
-	FSItem *p = first_fs_item;
+	FSItem *p = name_hash[hash_name(parent, name) & fsitem_hash_mask];
 	while (p) {
 		if (p->parent == parent && !strcmp(p->name, name))
 			return p;
-		p = p->next;
+		p = p->next_by_name;
 	}
+	return NULL;
+}
+
+static FSItem *find_fsitem(const char *name, FSItem *parent)
+{
+	FSItem *p = lookup_fsitem(name, parent);
+	if (p)
+		return p;
 
 	// Not found, construct new FSItem
 	return create_fsitem(name, host_encoding_to_macroman(name), parent);
@@ -267,11 +436,11 @@ static FSItem *find_fsitem(const char *name, FSItem *parent)
 
 static FSItem *find_fsitem_guest(const char *guest_name, FSItem *parent)
 {
-	FSItem *p = first_fs_item;
+	FSItem *p = guest_hash[hash_name(parent, guest_name) & fsitem_hash_mask];
 	while (p) {
 		if (p->parent == parent && !strcmp(p->guest_name, guest_name))
 			return p;
-		p = p->next;
+		p = p->next_by_guest;
 	}
 
 	// Not found, construct new FSItem
@@ -320,6 +489,496 @@ static void swap_parent_ids(uint32 parent1, uint32 parent2)
 }
 
 
+/*
+ *  Exchange CNIDs of two FSItems (the CNID of a renamed or moved file/dir has to stay the same)
+ */
+
+static void swap_fsitem_ids(FSItem *item1, FSItem *item2)
+{
+	swap_parent_ids(item1->id, item2->id);
+	id_hash_remove(item1);
+	id_hash_remove(item2);
+	uint32 t = item1->id;
+	item1->id = item2->id;
+	item2->id = t;
+	id_hash_add(item1);
+	id_hash_add(item2);
+}
+
+
+/*
+ *  Directory listing cache for indexed fs_get_cat_info()/fs_get_file_info()
+ *
+ *  The Finder enumerates a directory by querying the items with index
+ *  1..N. Instead of reading the directory up to the n-th entry for every
+ *  call, the sorted listing is kept together with the stat() results of
+ *  the entries already queried. A listing is reused as long as the
+ *  modification time of the directory stays the same and is dropped by
+ *  all ExtFS calls which create, delete, rename or write files. Host
+ *  changes to the content of a file leave the directory alone, so the
+ *  stat() results are only trusted for CACHED_STAT_TTL seconds.
+ */
+
+// Seconds stat() results and metadata of items are used without checking
+const time_t CACHED_STAT_TTL = 2;
+
+struct dir_entry {
+	const char *name;		// Host name
+	time_t stat_time;		// Time st was read (0 = not valid)
+	struct stat st;
+};
+
+struct dir_listing {
+	FSItem *dir;			// Listed directory (NULL = unused)
+	time_t mtime;			// Modification time of directory when listed
+	int num_entries;
+	dir_entry *entries;		// Sorted by name
+	char *names;			// Storage for entry names
+	uint32 last_used;
+#if EXTFS_WATCH
+	bool watched;			// Flag: directory watched for host changes
+#endif
+};
+
+const int NUM_DIR_LISTINGS = 4;
+static dir_listing dir_listings[NUM_DIR_LISTINGS];
+static uint32 dir_listing_clock;
+
+static void free_dir_listing(dir_listing *l)
+{
+#if EXTFS_WATCH
+	if (l->watched)
+		extfs_unwatch_dir(l->dir->id);
+	l->watched = false;
+#endif
+	delete[] l->entries;
+	delete[] l->names;
+	l->entries = NULL;
+	l->names = NULL;
+	l->num_entries = 0;
+	l->dir = NULL;
+}
+
+// Drop listing of given directory
+static void invalidate_dir_listing(FSItem *dir)
+{
+	for (int i=0; i<NUM_DIR_LISTINGS; i++)
+		if (dir_listings[i].dir && dir_listings[i].dir == dir)
+			free_dir_listing(dir_listings + i);
+}
+
+// Drop all listings
+static void invalidate_dir_listings(void)
+{
+	for (int i=0; i<NUM_DIR_LISTINGS; i++)
+		free_dir_listing(dir_listings + i);
+}
+
+static int cmp_dir_entry(const void *a, const void *b)
+{
+	return strcmp(((const dir_entry *)a)->name, ((const dir_entry *)b)->name);
+}
+
+// Get listing of given directory (full_path must be its path), returns NULL on error
+static dir_listing *get_dir_listing(FSItem *dir)
+{
+	dir_listing *l = NULL;
+	for (int i=0; i<NUM_DIR_LISTINGS; i++) {
+		if (dir_listings[i].dir == dir) {
+			l = dir_listings + i;
+			break;
+		}
+	}
+
+#if EXTFS_WATCH
+	// Watched listings are dropped on changes, no need to check them
+	if (l && l->watched) {
+		l->last_used = ++dir_listing_clock;
+		return l;
+	}
+#endif
+
+	// Up-to-date listing available?
+	struct stat st;
+	if (stat(full_path, &st) < 0 || !S_ISDIR(st.st_mode))
+		return NULL;
+	if (l && l->mtime == st.st_mtime) {
+		l->last_used = ++dir_listing_clock;
+		return l;
+	}
+
+	// No, read directory into least recently used slot
+	if (l == NULL) {
+		l = dir_listings;
+		for (int i=1; i<NUM_DIR_LISTINGS; i++)
+			if (dir_listings[i].last_used < l->last_used)
+				l = dir_listings + i;
+	}
+	free_dir_listing(l);
+
+#if EXTFS_WATCH
+	// Start watching before reading, so no change is missed
+	bool watched = watching && extfs_watch_dir(dir->id, full_path);
+#endif
+	DIR *d = opendir(full_path);
+	if (d == NULL) {
+#if EXTFS_WATCH
+		if (watched)
+			extfs_unwatch_dir(dir->id);
+#endif
+		return NULL;
+	}
+	int max_entries = 64, num_entries = 0;
+	size_t names_size = 4096, names_used = 0;
+	size_t *name_offsets = new size_t[max_entries];
+	char *names = new char[names_size];
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
+		size_t len = strlen(de->d_name) + 1;
+		if (names_used + len > names_size) {
+			while (names_used + len > names_size)
+				names_size *= 2;
+			char *new_names = new char[names_size];
+			memcpy(new_names, names, names_used);
+			delete[] names;
+			names = new_names;
+		}
+		if (num_entries == max_entries) {
+			size_t *new_offsets = new size_t[max_entries * 2];
+			memcpy(new_offsets, name_offsets, max_entries * sizeof(size_t));
+			delete[] name_offsets;
+			name_offsets = new_offsets;
+			max_entries *= 2;
+		}
+		memcpy(names + names_used, de->d_name, len);
+		name_offsets[num_entries++] = names_used;
+		names_used += len;
+	}
+	closedir(d);
+
+	l->entries = new dir_entry[num_entries ? num_entries : 1];
+	for (int i=0; i<num_entries; i++) {
+		l->entries[i].name = names + name_offsets[i];
+		l->entries[i].stat_time = 0;
+	}
+	delete[] name_offsets;
+	qsort(l->entries, num_entries, sizeof(dir_entry), cmp_dir_entry);
+	l->names = names;
+	l->num_entries = num_entries;
+	l->mtime = st.st_mtime;
+	l->dir = dir;
+	l->last_used = ++dir_listing_clock;
+#if EXTFS_WATCH
+	l->watched = watched;
+#endif
+	D(bug("  listed %s, %d entries\n", full_path, num_entries));
+	return l;
+}
+
+// Get n-th (1-based) entry of directory, add its name to full_path and get its FSItem;
+// returns NULL if there is no such entry
+static dir_entry *get_dir_entry(FSItem *dir, int index, FSItem *&item, int16 &result)
+{
+	dir_listing *l = get_dir_listing(dir);
+	if (l == NULL) {
+		result = dirNFErr;
+		return NULL;
+	}
+	if (index > l->num_entries) {
+		result = fnfErr;
+		return NULL;
+	}
+	dir_entry *e = l->entries + index - 1;
+	add_path_comp(e->name);
+	item = find_fsitem(e->name, dir);
+	result = noErr;
+	return e;
+}
+
+// stat() through cached directory entry, if available
+static int stat_dir_entry(dir_entry *e, struct stat *st)
+{
+	if (e == NULL)
+		return stat(full_path, st);
+	time_t now = time(NULL);
+	if (e->stat_time == 0 || now - e->stat_time >= CACHED_STAT_TTL) {
+		e->stat_time = 0;
+		if (stat(full_path, &e->st) < 0)
+			return -1;
+		e->stat_time = now;
+	}
+	*st = e->st;
+	return 0;
+}
+
+
+/*
+ *  Metadata cache for fs_get_cat_info()/fs_get_file_info()
+ *
+ *  Getting the Finder info and resource fork size of an item takes several
+ *  host file operations on the helper files (and the translation of the
+ *  file name extension), which is slow on some hosts. The results are kept
+ *  in the FSItem for as long as the modification time of the item stays the
+ *  same, but no longer than CACHED_STAT_TTL seconds, as the host may change
+ *  the helper files without touching the item. Changes made through ExtFS
+ *  (set_finfo(), writing the resource fork, deleting, renaming) invalidate
+ *  the cached data explicitly.
+ */
+
+static void invalidate_metadata(FSItem *item)
+{
+	if (item)
+		item->meta_valid = 0;
+}
+
+static void check_metadata(FSItem *item, time_t mtime)
+{
+	time_t now = time(NULL);
+	if (item->meta_mtime != mtime || now - item->meta_time >= CACHED_STAT_TTL) {
+		item->meta_mtime = mtime;
+		item->meta_time = now;
+		item->meta_valid = 0;
+	}
+}
+
+// Get Finder info of item (full_path must be its path), fxinfo may be 0
+static void get_item_finfo(FSItem *item, time_t mtime, uint32 finfo, uint32 fxinfo, bool is_dir)
+{
+	check_metadata(item, mtime);
+	if (item->meta_valid & META_FINFO) {
+		Host2Mac_memcpy(finfo, item->cache_finfo, SIZEOF_FInfo);
+		if (fxinfo)
+			Host2Mac_memcpy(fxinfo, item->cache_finfo + SIZEOF_FInfo, SIZEOF_FXInfo);
+		return;
+	}
+	get_finfo(full_path, finfo, fxinfo, is_dir);
+	if (fxinfo) {	// Only complete Finder info is cached
+		Mac2Host_memcpy(item->cache_finfo, finfo, SIZEOF_FInfo);
+		Mac2Host_memcpy(item->cache_finfo + SIZEOF_FInfo, fxinfo, SIZEOF_FXInfo);
+		item->meta_valid |= META_FINFO;
+	}
+}
+
+// Get resource fork size of item (full_path must be its path)
+static uint32 get_item_rfork_size(FSItem *item, time_t mtime)
+{
+	check_metadata(item, mtime);
+	if (!(item->meta_valid & META_RF_SIZE)) {
+		item->cache_rf_size = get_rfork_size(full_path);
+		item->meta_valid |= META_RF_SIZE;
+	}
+	return item->cache_rf_size;
+}
+
+
+/*
+ *  Positioned file access for fs_read()/fs_write()
+ *
+ *  The mark of an open file is kept in fcbCrPs only, the host file is
+ *  read and written with extfs_pread()/extfs_pwrite() at that position
+ *  instead of seeking it. Small reads (the Resource Manager reads resource
+ *  maps and resources in small pieces) are served from a few read buffers,
+ *  each holding a block of one open file. The buffers are dropped when any
+ *  file is written or truncated, and when their file is closed.
+ */
+
+const int NUM_READ_BUFFERS = 4;
+const size_t READ_BUFFER_SIZE = 8192;
+
+struct read_buffer {
+	int fd;					// Buffered file (-1 = unused)
+	uint32 offset;			// File offset of buffered data
+	size_t length;			// Length of buffered data
+	uint32 last_used;
+	uint8 data[READ_BUFFER_SIZE];
+};
+
+static read_buffer read_buffers[NUM_READ_BUFFERS];
+static uint32 read_buffer_clock;
+
+// Drop buffer of given file
+static void invalidate_read_buffer(int fd)
+{
+	for (int i=0; i<NUM_READ_BUFFERS; i++)
+		if (read_buffers[i].fd == fd)
+			read_buffers[i].fd = -1;
+}
+
+// Drop all buffers
+static void invalidate_read_buffers(void)
+{
+	for (int i=0; i<NUM_READ_BUFFERS; i++)
+		read_buffers[i].fd = -1;
+}
+
+// Read "length" bytes at offset "pos", returns number of bytes read (or -1 on error)
+static ssize_t buffered_read(int fd, void *buffer, size_t length, uint32 pos)
+{
+	if (length > READ_BUFFER_SIZE / 2)
+		return extfs_pread(fd, buffer, length, pos);
+
+	// Data in buffer of this file?
+	read_buffer *b = NULL, *lru = read_buffers;
+	for (int i=0; i<NUM_READ_BUFFERS; i++) {
+		if (read_buffers[i].fd == fd) {
+			b = read_buffers + i;
+			break;
+		}
+		if (read_buffers[i].last_used < lru->last_used)
+			lru = read_buffers + i;
+	}
+	if (b && pos >= b->offset && pos - b->offset + length <= b->length) {
+		memcpy(buffer, b->data + (pos - b->offset), length);
+		b->last_used = ++read_buffer_clock;
+		return length;
+	}
+
+	// No, refill buffer starting at requested position
+	if (b == NULL)
+		b = lru;
+	ssize_t actual = extfs_pread(fd, b->data, READ_BUFFER_SIZE, pos);
+	if (actual < 0) {
+		b->fd = -1;
+		return actual;
+	}
+	b->fd = fd;
+	b->offset = pos;
+	b->length = actual;
+	b->last_used = ++read_buffer_clock;
+	if (length > (size_t)actual)
+		length = actual;
+	memcpy(buffer, b->data, length);
+	return length;
+}
+
+// Get new mark from ioPosMode/ioPosOffset
+static int16 get_new_fpos(uint32 pb, uint32 fcb, int fd, uint32 &pos)
+{
+	int32 offset = ReadMacInt32(pb + ioPosOffset);
+	int64 new_pos;
+	switch (ReadMacInt16(pb + ioPosMode) & 3) {
+		case fsFromStart:
+			new_pos = (uint32)offset;
+			break;
+		case fsFromLEOF: {
+			struct stat st;
+			if (fstat(fd, &st) < 0)
+				return posErr;
+			new_pos = (int64)st.st_size + offset;
+			break;
+		}
+		case fsFromMark:
+			new_pos = (int64)ReadMacInt32(fcb + fcbCrPs) + offset;
+			break;
+		default:	// fsAtMark
+			new_pos = ReadMacInt32(fcb + fcbCrPs);
+			break;
+	}
+	if (new_pos < 0 || new_pos > 0xffffffff)
+		return posErr;
+	pos = (uint32)new_pos;
+	return noErr;
+}
+
+
+#if EXTFS_WATCH
+/*
+ *  Host change watcher
+ *
+ *  With the "extfswatch" prefs item, the directories of the cached
+ *  listings are watched by a platform specific background thread (see
+ *  extfs_watch_dir()), which reports changes with ExtFSHostChanged().
+ *  Changes are queued and processed on the emulation thread before the
+ *  next ExtFS call: the listing and the cached data of the changed items
+ *  are dropped and the volume modification date is bumped, which makes
+ *  the Finder update its windows. In return, listings are used without
+ *  stat()ing their directories while the watcher runs.
+ */
+
+const int MAX_HOST_CHANGES = 32;
+
+struct host_change {
+	uint32 dir_id;			// CNID of changed directory
+	char name[256];			// Changed entry (empty = unknown)
+};
+
+static host_change host_changes[MAX_HOST_CHANGES];
+static int num_host_changes;
+static bool host_changes_overflow;		// Flag: changes were lost, drop everything
+static volatile bool host_changes_pending;
+static B2_mutex *host_change_lock;
+
+// Report change of entry "name" (NULL = unknown) in watched directory (called by watcher thread)
+void ExtFSHostChanged(uint32 dir_id, const char *name)
+{
+	if (name == NULL)
+		name = "";
+	B2_lock_mutex(host_change_lock);
+	int i;
+	for (i=0; i<num_host_changes; i++)
+		if (host_changes[i].dir_id == dir_id && !strcmp(host_changes[i].name, name))
+			break;
+	if (i == num_host_changes) {
+		if (num_host_changes < MAX_HOST_CHANGES) {
+			host_change *c = host_changes + num_host_changes++;
+			c->dir_id = dir_id;
+			strncpy(c->name, name, sizeof(c->name) - 1);
+			c->name[sizeof(c->name) - 1] = 0;
+		} else
+			host_changes_overflow = true;
+	}
+	host_changes_pending = true;
+	B2_unlock_mutex(host_change_lock);
+}
+
+// Drop data invalidated by queued changes (called before each ExtFS call)
+static void process_host_changes(uint32 vcb)
+{
+	static host_change changes[MAX_HOST_CHANGES];
+	B2_lock_mutex(host_change_lock);
+	int num_changes = num_host_changes;
+	memcpy(changes, host_changes, num_changes * sizeof(host_change));
+	bool overflow = host_changes_overflow;
+	num_host_changes = 0;
+	host_changes_overflow = false;
+	host_changes_pending = false;
+	B2_unlock_mutex(host_change_lock);
+
+	if (overflow) {
+		D(bug("ExtFS host changes lost, dropping all cached data\n"));
+		invalidate_dir_listings();
+		for (FSItem *p = first_fs_item; p; p = p->next) {
+			p->mtime = 0;
+			invalidate_metadata(p);
+		}
+	} else {
+		for (int i=0; i<num_changes; i++) {
+			FSItem *dir = find_fsitem_by_id(changes[i].dir_id);
+			D(bug("ExtFS host change in dir %d, entry \"%s\"\n", changes[i].dir_id, changes[i].name));
+			if (dir == NULL)
+				continue;
+			invalidate_dir_listing(dir);
+			dir->mtime = 0;		// Count files again
+			if (changes[i].name[0]) {
+				FSItem *item = lookup_fsitem(changes[i].name, dir);
+				if (item) {
+					item->mtime = 0;
+					invalidate_metadata(item);
+				}
+			}
+		}
+	}
+
+	// Bump volume modification date
+	root_stat.st_mtime = time(NULL);
+	if (vcb && ReadMacInt16(vcb + vcbFSID) == MY_FSID)
+		WriteMacInt32(vcb + vcbLsMod, TimeToMacTime(root_stat.st_mtime));
+}
+#endif
+
+
 /*
  *  String handling functions
  */
@@ -411,29 +1070,15 @@ void ExtFSInit(void)
 	cstr2pstr(VOLUME_NAME, GetString(STR_EXTFS_VOLUME_NAME));
 
 	// Create root's parent FSItem
-	FSItem *p = new FSItem;
-	first_fs_item = last_fs_item = p;
-	p->next = NULL;
-	p->id = ROOT_PARENT_ID;
-	p->parent_id = 0;
-	p->parent = NULL;
-	p->name = new char[1];
-	p->name[0] = 0;
-	p->guest_name[0] = 0;
+	first_fs_item = last_fs_item = NULL;
+	num_fs_items = 0;
+	alloc_fsitem_hash(MIN_FSITEM_HASH_SIZE);
+	FSItem *p = new_fsitem(ROOT_PARENT_ID, "", "", NULL);
+	invalidate_read_buffers();
 
 	// Create root FSItem
-	p = new FSItem;
-	last_fs_item->next = p;
-	p->next = NULL;
-	last_fs_item = p;
-	p->id = ROOT_ID;
-	p->parent_id = ROOT_PARENT_ID;
-	p->parent = first_fs_item;
 	const char *volume_name = GetString(STR_EXTFS_VOLUME_NAME);
-	p->name = new char[strlen(volume_name) + 1];
-	strcpy(p->name, volume_name);
-	strncpy(p->guest_name, host_encoding_to_macroman(p->name), 32);
-	p->guest_name[31] = 0;
+	new_fsitem(ROOT_ID, volume_name, host_encoding_to_macroman(volume_name), p);
 
 	// Find path for root
 	if ((RootPath = PrefsFindString("extfs")) != NULL) {
@@ -443,6 +1088,18 @@ void ExtFSInit(void)
 			return;
 		ready = true;
 	}
+
+#if EXTFS_WATCH
+	// Start host change watcher
+	if (ready && PrefsFindBool("extfswatch")) {
+		host_change_lock = B2_create_mutex();
+		num_host_changes = 0;
+		host_changes_overflow = false;
+		host_changes_pending = false;
+		watching = extfs_watch_init();
+		D(bug("ExtFS host change watcher %s\n", watching ? "started" : "not available"));
+	}
+#endif
 }
 
 
@@ -453,14 +1110,25 @@ void ExtFSInit(void)
 void ExtFSExit(void)
 {
 	// Delete all FSItems
-	FSItem *p = first_fs_item, *next;
-	while (p) {
-		next = p->next;
-		delete[] p->name;
-		delete p;
-		p = next;
+	invalidate_dir_listings();
+	invalidate_read_buffers();
+#if EXTFS_WATCH
+	if (watching) {
+		extfs_watch_exit();
+		watching = false;
 	}
+	if (host_change_lock) {
+		B2_delete_mutex(host_change_lock);
+		host_change_lock = NULL;
+	}
+#endif
+	pool_free_all();
+	delete[] id_hash;
+	delete[] name_hash;
+	delete[] guest_hash;
+	id_hash = name_hash = guest_hash = NULL;
 	first_fs_item = last_fs_item = NULL;
+	num_fs_items = 0;
 
 	// System specific deinitialization
 	extfs_exit();
@@ -1252,6 +1920,7 @@ static int16 fs_get_file_info(uint32 pb, bool hfs, uint32 dirID)
 	D(bug(" fs_get_file_info(%08lx), vRefNum %d, name %.31s, idx %d, dirID %d\n", pb, ReadMacInt16(pb + ioVRefNum), Mac2HostAddr(ReadMacInt32(pb + ioNamePtr) + 1), ReadMacInt16(pb + ioFDirIndex), dirID));
 
 	FSItem *fs_item;
+	dir_entry *entry = NULL;
 	int16 dir_index = ReadMacInt16(pb + ioFDirIndex);
 	if (dir_index <= 0) {		// Query item specified by ioDirID and ioNamePtr
 
@@ -1272,32 +1941,16 @@ static int16 fs_get_file_info(uint32 pb, bool hfs, uint32 dirID)
 			return dirNFErr;
 		get_path_for_fsitem(p);
 
-		// Look for nth item in directory and add name to path
-		DIR *d = opendir(full_path);
-		if (d == NULL)
-			return dirNFErr;
-		struct dirent *de = NULL;
-		for (int i=0; i<dir_index; i++) {
-read_next_de:
-			de = readdir(d);
-			if (de == NULL) {
-				closedir(d);
-				return fnfErr;
-			}
-			if (de->d_name[0] == '.')
-				goto read_next_de;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
-			//!! suppress directories
-		}
-		add_path_comp(de->d_name);
-
-		// Get FSItem for queried item
-		fs_item = find_fsitem(de->d_name, p);
-		closedir(d);
+		// Look up nth item in directory listing and add name to path
+		//!! suppress directories
+		entry = get_dir_entry(p, dir_index, fs_item, result);
+		if (entry == NULL)
+			return result;
 	}
 
 	// Get stats
 	struct stat st;
-	if (stat(full_path, &st))
+	if (stat_dir_entry(entry, &st))
 		return fnfErr;
 	if (S_ISDIR(st.st_mode))
 		return fnfErr;
@@ -1318,14 +1971,14 @@ read_next_de:
 #endif
 	WriteMacInt32(pb + ioFlMdDat, TimeToMacTime(st.st_mtime));
 
-	get_finfo(full_path, pb + ioFlFndrInfo, hfs ? pb + ioFlXFndrInfo : 0, false);
+	get_item_finfo(fs_item, st.st_mtime, pb + ioFlFndrInfo, hfs ? pb + ioFlXFndrInfo : 0, false);
 
 	WriteMacInt16(pb + ioFlStBlk, 0);
 	uint32 file_size = (uint32) st.st_size;
 	WriteMacInt32(pb + ioFlLgLen, file_size);
 	WriteMacInt32(pb + ioFlPyLen, (file_size | (AL_BLK_SIZE - 1)) + 1);
 	WriteMacInt16(pb + ioFlRStBlk, 0);
-	uint32 rf_size = get_rfork_size(full_path);
+	uint32 rf_size = get_item_rfork_size(fs_item, st.st_mtime);
 	WriteMacInt32(pb + ioFlRLgLen, rf_size);
 	WriteMacInt32(pb + ioFlRPyLen, (rf_size | (AL_BLK_SIZE - 1)) + 1);
 
@@ -1357,6 +2010,7 @@ static int16 fs_set_file_info(uint32 pb, bool hfs, uint32 dirID)
 
 	// Set Finder info
 	set_finfo(full_path, pb + ioFlFndrInfo, hfs ? pb + ioFlXFndrInfo : 0, false);
+	invalidate_metadata(fs_item);
 
 	//!! times
 	return noErr;
@@ -1368,6 +2022,7 @@ static int16 fs_get_cat_info(uint32 pb)
 	D(bug(" fs_get_cat_info(%08lx), vRefNum %d, name %.31s, idx %d, dirID %d\n", pb, ReadMacInt16(pb + ioVRefNum), Mac2HostAddr(ReadMacInt32(pb + ioNamePtr) + 1), ReadMacInt16(pb + ioFDirIndex), ReadMacInt32(pb + ioDirID)));
 
 	FSItem *fs_item;
+	dir_entry *entry = NULL;
 	int16 dir_index = ReadMacInt16(pb + ioFDirIndex);
 	if (dir_index < 0) {			// Query directory specified by ioDirID
 
@@ -1396,32 +2051,16 @@ static int16 fs_get_cat_info(uint32 pb)
 			return dirNFErr;
 		get_path_for_fsitem(p);
 
-		// Look for nth item in directory and add name to path
-		DIR *d = opendir(full_path);
-		if (d == NULL)
-			return dirNFErr;
-		struct dirent *de = NULL;
-		for (int i=0; i<dir_index; i++) {
-read_next_de:
-			de = readdir(d);
-			if (de == NULL) {
-				closedir(d);
-				return fnfErr;
-			}
-			if (de->d_name[0] == '.')
-				goto read_next_de;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
-		}
-		add_path_comp(de->d_name);
-
-		// Get FSItem for queried item
-		fs_item = find_fsitem(de->d_name, p);
-		closedir(d);
+		// Look up nth item in directory listing and add name to path
+		entry = get_dir_entry(p, dir_index, fs_item, result);
+		if (entry == NULL)
+			return result;
 	}
 	D(bug("  path %s\n", full_path));
 
 	// Get stats
 	struct stat st;
-	if (stat(full_path, &st) < 0)
+	if (stat_dir_entry(entry, &st) < 0)
 		return errno2oserr();
 	if (dir_index == -1 && !S_ISDIR(st.st_mode))
 		return dirNFErr;
@@ -1450,7 +2089,7 @@ read_next_de:
 	WriteMacInt32(pb + ioFlMdDat, TimeToMacTime(mtime));
 	WriteMacInt32(pb + ioFlBkDat, 0);
 
-	get_finfo(full_path, pb + ioFlFndrInfo, pb + ioFlXFndrInfo, S_ISDIR(st.st_mode));
+	get_item_finfo(fs_item, mtime, pb + ioFlFndrInfo, pb + ioFlXFndrInfo, S_ISDIR(st.st_mode));
 
 	if (S_ISDIR(st.st_mode)) {
 
@@ -1482,7 +2121,7 @@ read_next_de:
 		WriteMacInt32(pb + ioFlLgLen, file_size);
 		WriteMacInt32(pb + ioFlPyLen, (file_size | (AL_BLK_SIZE - 1)) + 1);
 		WriteMacInt16(pb + ioFlRStBlk, 0);
-		uint32 rf_size = get_rfork_size(full_path);
+		uint32 rf_size = get_item_rfork_size(fs_item, mtime);
 		WriteMacInt32(pb + ioFlRLgLen, rf_size);
 		WriteMacInt32(pb + ioFlRPyLen, (rf_size | (AL_BLK_SIZE - 1)) + 1);
 		WriteMacInt32(pb + ioFlClpSiz, 0);
@@ -1508,6 +2147,7 @@ static int16 fs_set_cat_info(uint32 pb)
 
 	// Set Finder info
 	set_finfo(full_path, pb + ioFlFndrInfo, pb + ioFlXFndrInfo, S_ISDIR(st.st_mode));
+	invalidate_metadata(fs_item);
 
 	//!! times
 	return noErr;
@@ -1620,6 +2260,7 @@ static int16 fs_close(uint32 pb)
 	int fd = ReadMacInt32(fcb + fcbCatPos);
 
 	// Close file
+	invalidate_read_buffer(fd);
 	if (ReadMacInt8(fcb + fcbFlags) & fcbResourceMask) {
 		FSItem *item = find_fsitem_by_id(ReadMacInt32(fcb + fcbFlNm));
 		if (item) {
@@ -1744,8 +2385,11 @@ static int16 fs_set_eof(uint32 pb)
 
 	// Truncate file
 	uint32 size = ReadMacInt32(pb + ioMisc);
+	invalidate_read_buffers();
 	if (ftruncate(fd, size) < 0)
 		return errno2oserr();
+	invalidate_dir_listing(find_fsitem_by_id(ReadMacInt32(fcb + fcbDirID)));
+	invalidate_metadata(find_fsitem_by_id(ReadMacInt32(fcb + fcbFlNm)));
 
 	// Adjust FCBs
 	WriteMacInt32(fcb + fcbEOF, size);
@@ -1781,10 +2425,8 @@ static int16 fs_get_fpos(uint32 pb)
 			return fnOpnErr;
 	}
 
-	// Get file position
-	uint32 pos = (uint32) lseek(fd, 0, SEEK_CUR);
-	WriteMacInt32(fcb + fcbCrPs, pos);
-	WriteMacInt32(pb + ioPosOffset, pos);
+	// Get file position (kept in FCB)
+	WriteMacInt32(pb + ioPosOffset, ReadMacInt32(fcb + fcbCrPs));
 	return noErr;
 }
 
@@ -1809,23 +2451,10 @@ static int16 fs_set_fpos(uint32 pb)
 	}
 
 	// Set file position
-	switch (ReadMacInt16(pb + ioPosMode) & 3) {
-		case fsFromStart:
-			if (lseek(fd, ReadMacInt32(pb + ioPosOffset), SEEK_SET) < 0)
-				return posErr;
-			break;
-		case fsFromLEOF:
-			if (lseek(fd, (int32)ReadMacInt32(pb + ioPosOffset), SEEK_END) < 0)
-				return posErr;
-			break;
-		case fsFromMark:
-			if (lseek(fd, (int32)ReadMacInt32(pb + ioPosOffset), SEEK_CUR) < 0)
-				return posErr;
-			break;
-		default:
-			break;
-	}
-	uint32 pos = (uint32) lseek(fd, 0, SEEK_CUR);
+	uint32 pos;
+	int16 result = get_new_fpos(pb, fcb, fd, pos);
+	if (result != noErr)
+		return result;
 	WriteMacInt32(fcb + fcbCrPs, pos);
 	WriteMacInt32(pb + ioPosOffset, pos);
 	return noErr;
@@ -1855,28 +2484,19 @@ static int16 fs_read(uint32 pb)
 			return fnOpnErr;
 	}
 
-	// Seek
-	switch (ReadMacInt16(pb + ioPosMode) & 3) {
-		case fsFromStart:
-			if (lseek(fd, ReadMacInt32(pb + ioPosOffset), SEEK_SET) < 0)
-				return posErr;
-			break;
-		case fsFromLEOF:
-			if (lseek(fd, (int32)ReadMacInt32(pb + ioPosOffset), SEEK_END) < 0)
-				return posErr;
-			break;
-		case fsFromMark:
-			if (lseek(fd, (int32)ReadMacInt32(pb + ioPosOffset), SEEK_CUR) < 0)
-				return posErr;
-			break;
-	}
+	// Get position
+	uint32 pos;
+	int16 result = get_new_fpos(pb, fcb, fd, pos);
+	if (result != noErr)
+		return result;
 
 	// Read
-	ssize_t actual = extfs_read(fd, Mac2HostAddr(ReadMacInt32(pb + ioBuffer)), ReadMacInt32(pb + ioReqCount));
+	ssize_t actual = buffered_read(fd, Mac2HostAddr(ReadMacInt32(pb + ioBuffer)), ReadMacInt32(pb + ioReqCount), pos);
 	int16 read_err = errno2oserr();
 	D(bug("  actual %d\n", actual));
 	WriteMacInt32(pb + ioActCount, actual >= 0 ? actual : 0);
-	uint32 pos = (uint32) lseek(fd, 0, SEEK_CUR);
+	if (actual > 0)
+		pos += actual;
 	WriteMacInt32(fcb + fcbCrPs, pos);
 	WriteMacInt32(pb + ioPosOffset, pos);
 	if (actual != (ssize_t)ReadMacInt32(pb + ioReqCount))
@@ -1909,28 +2529,22 @@ static int16 fs_write(uint32 pb)
 			return fnOpnErr;
 	}
 
-	// Seek
-	switch (ReadMacInt16(pb + ioPosMode) & 3) {
-		case fsFromStart:
-			if (lseek(fd, ReadMacInt32(pb + ioPosOffset), SEEK_SET) < 0)
-				return posErr;
-			break;
-		case fsFromLEOF:
-			if (lseek(fd, (int32)ReadMacInt32(pb + ioPosOffset), SEEK_END) < 0)
-				return posErr;
-			break;
-		case fsFromMark:
-			if (lseek(fd, (int32)ReadMacInt32(pb + ioPosOffset), SEEK_CUR) < 0)
-				return posErr;
-			break;
-	}
+	// Get position
+	uint32 pos;
+	int16 result = get_new_fpos(pb, fcb, fd, pos);
+	if (result != noErr)
+		return result;
 
 	// Write
-	ssize_t actual = extfs_write(fd, Mac2HostAddr(ReadMacInt32(pb + ioBuffer)), ReadMacInt32(pb + ioReqCount));
+	invalidate_read_buffers();
+	ssize_t actual = extfs_pwrite(fd, Mac2HostAddr(ReadMacInt32(pb + ioBuffer)), ReadMacInt32(pb + ioReqCount), pos);
 	int16 write_err = errno2oserr();
+	invalidate_dir_listing(find_fsitem_by_id(ReadMacInt32(fcb + fcbDirID)));
+	invalidate_metadata(find_fsitem_by_id(ReadMacInt32(fcb + fcbFlNm)));
 	D(bug("  actual %d\n", actual));
 	WriteMacInt32(pb + ioActCount, actual >= 0 ? actual : 0);
-	uint32 pos = (uint32) lseek(fd, 0, SEEK_CUR);
+	if (actual > 0)
+		pos += actual;
 	WriteMacInt32(fcb + fcbCrPs, pos);
 	WriteMacInt32(pb + ioPosOffset, pos);
 	if (actual != (ssize_t)ReadMacInt32(pb + ioReqCount))
@@ -1955,6 +2569,8 @@ static int16 fs_create(uint32 pb, uint32 dirID)
 		return dupFNErr;
 
 	// Create file
+	invalidate_dir_listings();
+	invalidate_metadata(fs_item);
 	int fd = open(full_path, O_CREAT, 0666);
 	if (fd < 0)
 		return errno2oserr();
@@ -1980,6 +2596,8 @@ static int16 fs_dir_create(uint32 pb)
 		return dupFNErr;
 
 	// Create directory
+	invalidate_dir_listings();
+	invalidate_metadata(fs_item);
 	if (sceIoMkdir(full_path, 0777) < 0)
 		return errno2oserr();
 	else {
@@ -2000,6 +2618,8 @@ static int16 fs_delete(uint32 pb, uint32 dirID)
 		return result;
 
 	// Delete file
+	invalidate_dir_listings();
+	invalidate_metadata(fs_item);
 	if (!extfs_remove(full_path))
 		return errno2oserr();
 	else
@@ -2035,14 +2655,14 @@ static int16 fs_rename(uint32 pb, uint32 dirID)
 
 	// Rename item
 	D(bug("  renaming %s -> %s\n", old_path, full_path));
+	invalidate_dir_listings();
+	invalidate_metadata(fs_item);
+	invalidate_metadata(new_item);
 	if (!extfs_rename(old_path, full_path))
 		return errno2oserr();
 	else {
 		// The ID of the old file/dir has to stay the same, so we swap the IDs of the FSItems
-		swap_parent_ids(fs_item->id, new_item->id);
-		uint32 t = fs_item->id;
-		fs_item->id = new_item->id;
-		new_item->id = t;
+		swap_fsitem_ids(fs_item, new_item);
 		return noErr;
 	}
 }
@@ -2079,17 +2699,16 @@ static int16 fs_cat_move(uint32 pb)
 
 	// Move item
 	D(bug("  moving %s -> %s\n", old_path, full_path));
+	invalidate_dir_listings();
 	if (!extfs_rename(old_path, full_path))
 		return errno2oserr();
 	else {
 		// The ID of the old file/dir has to stay the same, so we swap the IDs of the FSItems
 		FSItem *new_item = find_fsitem(fs_item->name, new_dir_item);
-		if (new_item) {
-			swap_parent_ids(fs_item->id, new_item->id);
-			uint32 t = fs_item->id;
-			fs_item->id = new_item->id;
-			new_item->id = t;
-		}
+		invalidate_metadata(fs_item);
+		invalidate_metadata(new_item);
+		if (new_item)
+			swap_fsitem_ids(fs_item, new_item);
 		return noErr;
 	}
 }
@@ -2164,6 +2783,10 @@ int16 ExtFSHFS(uint32 vcb, uint16 selectCode, uint32 paramBlock, uint32 globalsP
 {
 	uint16 trapWord = selectCode & 0xf0ff;
 	bool hfs = (selectCode & kHFSMask) != 0;
+#if EXTFS_WATCH
+	if (host_changes_pending)
+		process_host_changes(vcb);
+#endif
 	switch (trapWord) {
 		case kFSMOpen:
 			return fs_open(paramBlock, hfs ? ReadMacInt32(paramBlock + ioDirID) : 0, vcb, false);
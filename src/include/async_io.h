@@ -0,0 +1,58 @@
+/*
+ *  async_io.h - Asynchronous disk driver I/O
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+// Completion function of a driver Prime() request, called on the emulation thread; returns the result code
+typedef int16 (*async_io_done_func)(uint32 pb, uint32 dce, void *buffer, size_t length, size_t actual, bool write);
+
+#if USE_ASYNC_IO
+extern void AsyncIOInit(void);
+extern void AsyncIOExit(void);
+
+extern void AsyncIOInstall(void);
+extern bool AsyncIOPrime(uint32 pb, uint32 dce, void *fh, void *buffer, loff_t offset, size_t length, bool write, async_io_done_func done);
+extern void AsyncIODrain(void);
+extern void AsyncIOInterrupt(void);
+
+// System specific and internal functions/data
+extern bool async_io_thread_start(void);	// Start I/O worker thread, which calls AsyncIOService() once per async_io_wakeup()
+extern void async_io_thread_stop(void);
+extern void async_io_wakeup(void);			// Request queued
+extern void async_io_wait_done(void);		// Wait until the worker has finished a request
+extern void AsyncIOService(void);
+#else
+static inline void AsyncIOInit(void) {}
+static inline void AsyncIOExit(void) {}
+static inline void AsyncIOInstall(void) {}
+static inline bool AsyncIOPrime(uint32 pb, uint32 dce, void *fh, void *buffer, loff_t offset, size_t length, bool write, async_io_done_func done) { return false; }
+static inline void AsyncIODrain(void) {}
+#endif
+
+// Deferred Task structure for calling IODone
+enum {
+	aiodtCode = 20,		// DT code is stored here
+	aiodtResult = 30,
+	aiodtDCE = 34,
+	SIZEOF_aiodt = 38
+};
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ *  block_cache.h - Host-side block cache for disk images
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+// Uncached I/O function of a file handle, returns number of bytes transferred
+typedef size_t (*block_cache_io_func)(void *fh, void *buffer, loff_t offset, size_t length);
+
+// Images up to this size are floppies, which are never cached write-back
+const loff_t MAX_FLOPPY_IMAGE_SIZE = 1440 * 1024;
+
+struct block_cache_file;
+
+extern void BlockCacheInit(void);
+extern void BlockCacheExit(void);
+
+// These are called by the Sys_*() routines of the platform
+extern block_cache_file *block_cache_open(void *fh, block_cache_io_func read_func, block_cache_io_func write_func, bool write_back);
+extern void block_cache_close(block_cache_file *f);			// Flush and release
+extern void block_cache_flush(block_cache_file *f);			// Write back dirty chunks
+extern void block_cache_invalidate(block_cache_file *f);	// Flush and drop all chunks (media change)
+extern size_t block_cache_read(block_cache_file *f, void *buffer, loff_t offset, size_t length);
+extern size_t block_cache_write(block_cache_file *f, void *buffer, loff_t offset, size_t length);
+
+#if BLOCK_CACHE_PREFETCH
+// System specific and internal functions/data
+extern bool block_cache_prefetch_start(void);	// Start prefetch thread, which calls BlockCachePrefetch() after each wakeup
+extern void block_cache_prefetch_stop(void);
+extern void block_cache_prefetch_wakeup(void);	// Read-ahead requested
+extern void BlockCachePrefetch(void);
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ *  clock.h - Monotonic host clock and periodic tick generator
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+extern void ClockInit(void);
+
+// Current host clock in microseconds (monotonic, thread-safe after ClockInit())
+extern uint64 clock_usec(void);
+
+// Periodic tick generator, scheduled on absolute deadlines
+struct ClockTicker {
+	uint32 period;		// Tick period in microseconds
+	uint64 next;		// Deadline of next tick
+	uint32 oversleep;	// Estimated oversleep of Delay_usec()
+
+	// Statistics
+	uint64 ticks;		// Number of ticks delivered
+	uint64 skipped;		// Number of ticks dropped after falling behind
+	uint64 jitter_sum;	// Sum of absolute deviations from deadline (usec)
+	uint32 jitter_max;	// Largest absolute deviation from deadline (usec)
+};
+
+extern void clock_ticker_init(ClockTicker &t, uint32 period);
+extern void clock_ticker_wait(ClockTicker &t);
+extern void clock_ticker_report(const ClockTicker &t, const char *name);
+
+#if USE_VIRTUAL_TIME
+// Virtual time: time is derived from the number of executed 68k instructions
+extern bool ClockVirtual;								// Flag: virtual time mode active
+extern void clock_virtual_start(uint32 ips, void (*tick_func)(void));	// Enter virtual time mode
+extern uint64 clock_virtual_usec(void);					// Current virtual time in microseconds
+extern uint32 clock_virtual_date_time(void);			// Current virtual date/time in Mac format
+extern void clock_virtual_wakeup_at(uint64 usec);		// Raise INTFLAG_TIMER at given virtual time
+extern void clock_virtual_idle(void);					// Skip ahead to the next virtual time event
+#endif
+
+// System specific and internal functions/data
+extern uint64 clock_host_ticks(void);		// Raw monotonic host counter
+extern uint64 clock_host_frequency(void);	// Host counter ticks per second
+
+#endif
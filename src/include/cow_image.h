@@ -0,0 +1,61 @@
+/*
+ *  cow_image.h - Copy-on-write overlay (differencing) disk images
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef COW_IMAGE_H
+#define COW_IMAGE_H
+
+// Overlay file header
+enum {
+	COW_MAGIC = 0,				// "B2COWIMG"
+	COW_VERSION = 8,			// Format version (1)
+	COW_BLOCK_SIZE = 12,		// Size of a block in bytes (power of two)
+	COW_DISK_SIZE = 16,			// Size of the virtual disk in bytes (64 bit)
+	COW_NUM_BLOCKS = 24,		// Number of blocks (entries in the block map)
+	COW_MAP_OFFSET = 28,		// File offset of block map
+	COW_DATA_OFFSET = 32,		// File offset of first delta block
+	COW_BASE_SIZE = 36,			// Size of base image when the overlay was created or committed (64 bit, 0 = not recorded)
+	COW_BASE_MTIME = 44,		// Modification time of base image then (64 bit, seconds since 1970)
+	COW_BASE_NAME = 64,			// Path of base image, relative to the overlay file unless absolute (empty = sparse image)
+	COW_HEADER_SIZE = 512
+};
+
+const uint32 COW_DEFAULT_BLOCK_SIZE = 16384;
+
+struct cow_image;
+
+// Check for overlay file header (first 256 bytes of file)
+extern bool cow_image_check(const uint8 *header);
+
+// Open overlay on already opened file (which stays owned by the caller), returns NULL on error
+extern cow_image *cow_image_open(const char *name, int fd, bool read_only);
+extern void cow_image_close(cow_image *img);
+extern void cow_image_suspend(cow_image *img);			// Close base image, overlay file will be closed by caller
+extern void cow_image_resume(cow_image *img, int fd);	// Reopen base image, overlay file has been reopened as fd
+extern loff_t cow_image_size(cow_image *img);
+extern size_t cow_image_read(cow_image *img, void *buffer, loff_t offset, size_t length);
+extern size_t cow_image_write(cow_image *img, void *buffer, loff_t offset, size_t length);
+
+// Creation and offline operations (used by cowtool and the prefs editor)
+extern bool cow_image_create(const char *name, const char *base_name, uint32 block_size);
+extern bool cow_image_create_sparse(const char *name, loff_t size, uint32 block_size);
+extern bool cow_image_commit(const char *name);
+extern void cow_image_info(cow_image *img, const char *&base_name, uint32 &block_size, uint32 &num_blocks, uint32 &num_allocated);
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ *  disk_trace.h - Disk I/O trace capture
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DISK_TRACE_H
+#define DISK_TRACE_H
+
+// Trace file header
+enum {
+	DTRACE_MAGIC = 0,			// "B2DTRACE"
+	DTRACE_VERSION = 8,			// Format version (1)
+	DTRACE_RECORD_SIZE = 12,	// Size of a record in bytes
+	DTRACE_CAPACITY = 16,		// Number of record slots in ring
+	DTRACE_TOTAL = 24,			// Number of records written so far (64 bit), next slot is TOTAL % CAPACITY
+	DTRACE_HEADER_SIZE = 64		// Record ring follows
+};
+
+// Trace record (all fields big-endian)
+enum {
+	DTREC_TIME = 0,				// Time of request since start of trace in usec (64 bit)
+	DTREC_OFFSET = 8,			// Byte offset in file handle (64 bit)
+	DTREC_LENGTH = 16,			// Requested length
+	DTREC_ACTUAL = 20,			// Transferred length
+	DTREC_LATENCY = 24,			// Host time until completion in usec
+	DTREC_DRIVE = 28,			// Mac drive number (16 bit)
+	DTREC_REFNUM = 30,			// Driver reference number (16 bit)
+	DTREC_FLAGS = 32,			// Flags, see below (8 bit)
+	DTREC_SIZE = 40
+};
+
+// Record flags
+enum {
+	DTREC_WRITE = 1,			// Write request
+	DTREC_ASYNC = 2				// Executed by the I/O thread
+};
+
+#if USE_DISK_TRACE
+extern void DiskTraceInit(void);
+extern void DiskTraceExit(void);
+
+// Start time of a request (clock_usec(), 0 when tracing is off)
+extern uint64 DiskTraceStart(void);
+
+// Record a completed Prime() request
+extern bool DiskTraceEnabled;
+extern void disk_trace_record(uint32 pb, uint32 dce, loff_t offset, size_t length, size_t actual, bool write, bool async, uint64 start);
+
+static inline void DiskTrace(uint32 pb, uint32 dce, loff_t offset, size_t length, size_t actual, bool write, bool async, uint64 start)
+{
+	if (DiskTraceEnabled)
+		disk_trace_record(pb, dce, offset, length, actual, write, async, start);
+}
+#else
+static inline void DiskTraceInit(void) {}
+static inline void DiskTraceExit(void) {}
+static inline uint64 DiskTraceStart(void) { return 0; }
+static inline void DiskTrace(uint32 pb, uint32 dce, loff_t offset, size_t length, size_t actual, bool write, bool async, uint64 start) {}
+#endif
+
+#endif
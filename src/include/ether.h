@@ -33,6 +33,7 @@ extern void EtherReadPacket(uint32 &src, uint32 &dest, uint32 &len, uint32 &rema
 // System specific and internal functions/data
 extern void EtherReset(void);
 extern void EtherInterrupt(void);
+extern void EtherFlush(void);
 
 extern bool ether_init(void);
 extern void ether_exit(void);
@@ -45,6 +46,7 @@ extern int16 ether_write(uint32 wds);
 extern bool ether_start_udp_thread(int socket_fd);
 extern void ether_stop_udp_thread(void);
 extern void ether_udp_read(uint32 packet, int length, struct sockaddr_in *from);
+extern int ether_udp_receive(uint32 packet);
 
 extern uint8 ether_addr[6];	// Ethernet address (set by ether_init())
 
@@ -0,0 +1,49 @@
+/*
+ *  ether_capture.h - Ethernet packet capture to pcap file
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ETHER_CAPTURE_H
+#define ETHER_CAPTURE_H
+
+#if USE_ETHER_CAPTURE
+extern void EtherCaptureInit(void);
+extern void EtherCaptureExit(void);
+
+// Copy frame sent or received by the Mac into the capture ring (emulation thread)
+extern bool EtherCaptureEnabled;
+extern void ether_capture_packet(const uint8 *packet, int len);
+
+static inline void EtherCapture(const uint8 *packet, int len)
+{
+	if (EtherCaptureEnabled)
+		ether_capture_packet(packet, len);
+}
+
+// System specific and internal functions/data
+extern bool ether_capture_thread_start(void);	// Start writer thread, which calls EtherCaptureService() after each wakeup and at least every 100ms
+extern void ether_capture_thread_stop(void);
+extern void ether_capture_wakeup(void);			// Capture ring half full
+extern void EtherCaptureService(void);
+#else
+static inline void EtherCaptureInit(void) {}
+static inline void EtherCaptureExit(void) {}
+static inline void EtherCapture(const uint8 *packet, int len) {}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ *  ether_slirp.h - Portable slirp (user mode NAT) Ethernet backend
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ETHER_SLIRP_H
+#define ETHER_SLIRP_H
+
+// Ethernet address of the emulated Mac in the slirp network (10.0.2.15)
+extern const uint8 ether_slirp_addr[6];
+
+// Set up slirp and the "redir" port redirections, dns_addr overrides /etc/resolv.conf
+extern bool ether_slirp_init(const char *dns_addr);
+extern void ether_slirp_exit(void);
+
+// One iteration of the slirp worker thread, waits at most timeout_usec for socket activity
+extern void ether_slirp_poll(int timeout_usec);
+
+// Queue packet from emulated Mac for the worker thread (emulation thread)
+extern bool ether_slirp_write(const uint8 *packet, int len);
+
+// Get next packet for emulated Mac, returns length or 0 (emulation thread)
+extern int ether_slirp_read(uint8 *packet, int max_len);
+
+// Packets for emulated Mac waiting?
+extern bool ether_slirp_pending(void);
+
+#endif
@@ -41,6 +41,8 @@ extern int open_rfork(const char *path, int flag);
 extern void close_rfork(const char *path, int fd);
 extern ssize_t extfs_read(int fd, void *buffer, size_t length);
 extern ssize_t extfs_write(int fd, void *buffer, size_t length);
+extern ssize_t extfs_pread(int fd, void *buffer, size_t length, off_t offset);
+extern ssize_t extfs_pwrite(int fd, void *buffer, size_t length, off_t offset);
 extern off_t extfs_seek(int fd, off_t offset, int whence);
 extern int extfs_fstat(int fd, struct stat *buf);
 extern int extfs_ftruncate(int fildes, off_t length);
@@ -49,6 +51,15 @@ extern bool extfs_rename(const char *old_path, const char *new_path);
 extern const char *host_encoding_to_macroman(const char *filename); // What if the guest OS is using MacJapanese or MacArabic? Oh well...
 extern const char *macroman_to_host_encoding(const char *filename); // What if the guest OS is using MacJapanese or MacArabic? Oh well...
 
+#if EXTFS_WATCH
+// Host change watcher (watcher thread reports changes with ExtFSHostChanged())
+extern bool extfs_watch_init(void);
+extern void extfs_watch_exit(void);
+extern bool extfs_watch_dir(uint32 dir_id, const char *path);
+extern void extfs_unwatch_dir(uint32 dir_id);
+extern void ExtFSHostChanged(uint32 dir_id, const char *name);
+#endif
+
 // Maximum length of full path name
 const int MAX_PATH_LENGTH = 1024;
 
@@ -67,7 +67,9 @@ enum {
 	INTFLAG_AUDIO = 16,	// Audio block read
 	INTFLAG_TIMER = 32,	// Time Manager
 	INTFLAG_ADB = 64,	// ADB
-	INTFLAG_NMI = 128	// NMI
+	INTFLAG_NMI = 128,	// NMI
+	INTFLAG_DISK = 256,	// Asynchronous disk I/O completed
+	INTFLAG_ETHER_TX = 512	// Ethernet packets queued for sending
 };
 
 extern uint32 InterruptFlags;									// Currently pending interrupts
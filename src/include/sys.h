@@ -54,6 +54,7 @@ extern void *Sys_open(const char *name, bool read_only);
 extern void Sys_close(void *fh);
 extern size_t Sys_read(void *fh, void *buffer, loff_t offset, size_t length);
 extern size_t Sys_write(void *fh, void *buffer, loff_t offset, size_t length);
+extern void Sys_flush(void *fh);		// Write back cached data (only where Sys_write() caches, e.g. PSP2)
 extern loff_t SysGetFileSize(void *fh);
 extern void SysEject(void *fh);
 extern bool SysFormat(void *fh);
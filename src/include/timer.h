@@ -42,6 +42,14 @@ extern int timer_cmp_time(tm_time_t a, tm_time_t b);
 extern void timer_mac2host_time(tm_time_t &res, int32 mactime);
 extern int32 timer_host2mac_time(tm_time_t hosttime);
 
+#if PRECISE_TIMING
+// Host timer that raises INTFLAG_TIMER at the earliest Time Manager wakeup time
+extern void timer_wakeup_init(void);
+extern void timer_wakeup_exit(void);
+extern void timer_wakeup_at(tm_time_t wakeup);
+extern void timer_wakeup_cancel(void);
+#endif
+
 // Suspend execution of emulator thread and resume it on events
 extern void idle_wait(void);
 extern void idle_resume(void);
@@ -0,0 +1,63 @@
+/*
+ *  zimage.h - Compressed, seekable disk images
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ZIMAGE_H
+#define ZIMAGE_H
+
+// Image file header
+enum {
+	ZIMAGE_MAGIC = 0,			// "B2ZIMAGE"
+	ZIMAGE_VERSION = 8,			// Format version (1)
+	ZIMAGE_CHUNK_SIZE = 12,		// Uncompressed size of a chunk in bytes (power of two)
+	ZIMAGE_DISK_SIZE = 16,		// Size of the uncompressed disk in bytes (64 bit)
+	ZIMAGE_NUM_CHUNKS = 24,		// Number of chunks
+	ZIMAGE_FLAGS = 28,			// Flags, see below
+	ZIMAGE_HEADER_SIZE = 64		// Chunk index follows
+};
+
+// Header flags
+enum {
+	ZIMAGE_CHECKSUMS = 1		// Adler-32 of every uncompressed chunk follows the chunk index
+};
+
+const uint32 ZIMAGE_DEFAULT_CHUNK_SIZE = 65536;
+
+struct zimage;
+
+#ifdef HAVE_LIBZ
+// Check for image file header (first 256 bytes of file)
+extern bool zimage_check(const uint8 *header);
+
+// Open image on already opened file (which stays owned by the caller), returns NULL on error
+extern zimage *zimage_open(const char *name, int fd);
+extern void zimage_close(zimage *img);
+extern void zimage_reopen(zimage *img, int fd);		// File has been reopened as fd (after host suspend)
+extern loff_t zimage_size(zimage *img);
+extern size_t zimage_read(zimage *img, void *buffer, loff_t offset, size_t length);
+#else
+static inline bool zimage_check(const uint8 *header) { return false; }
+static inline zimage *zimage_open(const char *name, int fd) { return NULL; }
+static inline void zimage_close(zimage *img) {}
+static inline void zimage_reopen(zimage *img, int fd) {}
+static inline loff_t zimage_size(zimage *img) { return 0; }
+static inline size_t zimage_read(zimage *img, void *buffer, loff_t offset, size_t length) { return 0; }
+#endif
+
+#endif
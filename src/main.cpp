@@ -26,6 +26,9 @@
 #include "sony.h"
 #include "disk.h"
 #include "cdrom.h"
+#include "async_io.h"
+#include "block_cache.h"
+#include "disk_trace.h"
 #include "scsi.h"
 #include "extfs.h"
 #include "audio.h"
@@ -141,6 +144,9 @@ bool InitAll(void)
 	XPRAM[0x7b] = i16 & 0xff;
 
 	// Init drivers
+	BlockCacheInit();
+	DiskTraceInit();
+	AsyncIOInit();
 	SonyInit();
 	DiskInit();
 	CDROMInit();
@@ -244,10 +250,13 @@ void ExitAll(void)
 #endif
 
 	// Exit drivers
+	AsyncIOExit();
+	DiskTraceExit();
 	SCSIExit();
 	CDROMExit();
 	DiskExit();
 	SonyExit();
+	BlockCacheExit();
 }
 
 
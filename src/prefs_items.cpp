@@ -32,6 +32,7 @@ prefs_desc common_prefs_items[] = {
 	{"floppy", TYPE_STRING, true,     "device/file name of Mac floppy drive"},
 	{"cdrom", TYPE_STRING, true,      "device/file names of Mac CD-ROM drive"},
 	{"extfs", TYPE_STRING, false,     "root path of ExtFS"},
+	{"extfswatch", TYPE_BOOLEAN, false, "watch ExtFS root for changes made by the host"},
 	{"scsi0", TYPE_STRING, false,     "SCSI target for Mac SCSI ID 0"},
 	{"scsi1", TYPE_STRING, false,     "SCSI target for Mac SCSI ID 1"},
 	{"scsi2", TYPE_STRING, false,     "SCSI target for Mac SCSI ID 2"},
@@ -46,6 +47,10 @@ prefs_desc common_prefs_items[] = {
 	{"etherconfig", TYPE_STRING, false,"path of network config script"},
 	{"udptunnel", TYPE_BOOLEAN, false, "tunnel all network packets over UDP"},
 	{"udpport", TYPE_INT32, false,    "IP port number for tunneling"},
+	{"redir", TYPE_STRING, true,      "slirp port redirection ([tcp|udp]:host_port:[guest_addr:]guest_port)"},
+	{"ethercapture", TYPE_STRING, false, "file to capture Ethernet packets to (pcap format)"},
+	{"ethercapturesize", TYPE_INT32, false, "maximum size of packet capture file in KB (0 = unlimited)"},
+	{"ethercapturecount", TYPE_INT32, false, "maximum number of captured packets (0 = unlimited)"},
 	{"rom", TYPE_STRING, false,       "path of ROM file"},
 	{"bootdrive", TYPE_INT32, false,  "boot drive number"},
 	{"bootdriver", TYPE_INT32, false, "boot driver number"},
@@ -54,12 +59,22 @@ prefs_desc common_prefs_items[] = {
 	{"modelid", TYPE_INT32, false,    "Mac Model ID (Gestalt Model ID minus 6)"},
 	{"cpu", TYPE_INT32, false,        "CPU type (0 = 68000, 1 = 68010 etc.)"},
 	{"fpu", TYPE_BOOLEAN, false,      "enable FPU emulation"},
+	{"fpuhybrid", TYPE_BOOLEAN, false, "compute single/double precision FPU arithmetic with host doubles"},
+	{"fpufastmath", TYPE_BOOLEAN, false, "FPU transcendental functions in host double precision"},
 	{"nocdrom", TYPE_BOOLEAN, false,  "don't install CD-ROM driver"},
 	{"nosound", TYPE_BOOLEAN, false,  "don't enable sound output"},
 	{"noclipconversion", TYPE_BOOLEAN, false, "don't convert clipboard contents"},
 	{"nogui", TYPE_BOOLEAN, false,    "disable GUI"},
+	{"diskasync", TYPE_BOOLEAN, false, "execute asynchronous disk requests in I/O thread"},
+	{"blockcache", TYPE_INT32, false, "size of disk block cache in MB (0 = off)"},
+	{"blockcachechunk", TYPE_INT32, false, "disk block cache chunk size in KB"},
+	{"blockcachewb", TYPE_BOOLEAN, false, "use write-back caching for hard disk images"},
+	{"prefetch", TYPE_INT32, false,   "maximum disk read-ahead in KB (0 = off)"},
+	{"disktrace", TYPE_STRING, false, "file to record disk I/O trace to"},
+	{"disktracesize", TYPE_INT32, false, "size of disk I/O trace ring in KB"},
 	{"jit", TYPE_BOOLEAN, false,         "enable JIT compiler"},
 	{"jitfpu", TYPE_BOOLEAN, false,      "enable JIT compilation of FPU instructions"},
+	{"jitfpusse2", TYPE_BOOLEAN, false,  "compile FPU instructions to SSE2 code in double precision"},
 	{"jitdebug", TYPE_BOOLEAN, false,    "enable JIT debugger (requires mon builtin)"},
 	{"jitcachesize", TYPE_INT32, false,  "translation cache size in KB"},
 	{"jitlazyflush", TYPE_BOOLEAN, false, "enable lazy invalidation of translation cache"},
@@ -79,6 +94,8 @@ void AddPrefsDefaults(void)
 	SysAddSerialPrefs();
 	PrefsAddBool("udptunnel", false);
 	PrefsAddInt32("udpport", 6066);
+	PrefsAddInt32("ethercapturesize", 65536);
+	PrefsAddInt32("ethercapturecount", 0);
 	PrefsAddInt32("bootdriver", 0);
 	PrefsAddInt32("bootdrive", 0);
 	PrefsAddInt32("ramsize", 8 * 1024 * 1024);
@@ -86,15 +103,27 @@ void AddPrefsDefaults(void)
 	PrefsAddInt32("modelid", 5);	// Mac IIci
 	PrefsAddInt32("cpu", 3);		// 68030
 	PrefsAddBool("fpu", false);
+	PrefsAddBool("fpuhybrid", true);
+	PrefsAddBool("fpufastmath", false);
 	PrefsAddBool("nocdrom", false);
 	PrefsAddBool("nosound", false);
 	PrefsAddBool("noclipconversion", false);
 	PrefsAddBool("nogui", false);
+	PrefsAddInt32("blockcache", 8);
+	PrefsAddInt32("blockcachechunk", 16);
+	PrefsAddBool("blockcachewb", false);
+	PrefsAddInt32("prefetch", 256);
+	PrefsAddInt32("disktracesize", 4096);
+	PrefsAddBool("extfswatch", false);
+#if USE_ASYNC_IO
+	PrefsAddBool("diskasync", true);
+#endif
 	
 #if USE_JIT
 	// JIT compiler specific options
 	PrefsAddBool("jit", true);
 	PrefsAddBool("jitfpu", true);
+	PrefsAddBool("jitfpusse2", false);
 	PrefsAddBool("jitdebug", false);
 	PrefsAddInt32("jitcachesize", 8192);
 	PrefsAddBool("jitlazyflush", true);
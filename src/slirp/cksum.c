@@ -36,106 +36,167 @@
 
 #include <slirp.h>
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CKSUM_NEON 1
+#endif
+
 /*
  * Checksum routine for Internet Protocol family headers (Portable Version).
  *
  * This routine is very heavily used in the network
  * code and should be modified for each CPU to be as fast as possible.
- * 
+ *
+ * The one's complement sum doesn't depend on byte order and can be
+ * accumulated in wider words and folded to 16 bits at the end. 64 bit
+ * hosts add 64 bit words and count the carries, 32 bit hosts add 32 bit
+ * words to a 64 bit accumulator, which can't overflow for any packet.
+ * With NEON, 16 bit words are added pairwise into four 32 bit lanes.
+ * A buffer starting at an odd address is summed from the next byte and
+ * the sum byte swapped.
+ *
  * XXX Since we will never span more than 1 mbuf, we can optimise this
  */
 
-#define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
-
-int cksum(struct mbuf *m, int len)
+static u_int32_t cksum_fold(u_int64_t sum)
 {
-	register u_int16_t *w;
-	register int sum = 0;
-	register int mlen = 0;
-	int byte_swapped = 0;
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (u_int32_t)sum;
+}
 
+/* Sum of len bytes at the even address p, not folded */
+static u_int64_t cksum_add(const u_int8_t *p, int len)
+{
+	register const u_int32_t *w;
+	register u_int64_t sum = 0;
 	union {
 		u_int8_t	c[2];
 		u_int16_t	s;
 	} s_util;
-	union {
-		u_int16_t s[2];
-		u_int32_t l;
-	} l_util;
-	
-	if (m->m_len == 0)
-	   goto cont;
-	w = mtod(m, u_int16_t *);
-	
-	mlen = m->m_len;
-	
-	if (len < mlen)
-	   mlen = len;
-	len -= mlen;
-	/*
-	 * Force to even boundary.
-	 */
-	if ((1 & (long) w) && (mlen > 0)) {
-		REDUCE;
-		sum <<= 8;
-		s_util.c[0] = *(u_int8_t *)w;
-		w = (u_int16_t *)((int8_t *)w + 1);
-		mlen--;
-		byte_swapped = 1;
+
+	if (len >= 2 && ((long)p & 2)) {
+		sum += *(const u_int16_t *)p;
+		p += 2;
+		len -= 2;
+	}
+#if SIZEOF_CHAR_P == 8
+	if (len >= 4 && ((long)p & 4)) {
+		sum += *(const u_int32_t *)p;
+		p += 4;
+		len -= 4;
 	}
+	if (len >= 8) {
+		register const u_int64_t *l = (const u_int64_t *)p;
+		register u_int64_t lsum = 0, x;
+		register u_int32_t carry = 0;
+
+		/*
+		 * Unroll the loop to make overhead from
+		 * branches &c small.
+		 */
+		while ((len -= 32) >= 0) {
+			x = l[0]; lsum += x; carry += lsum < x;
+			x = l[1]; lsum += x; carry += lsum < x;
+			x = l[2]; lsum += x; carry += lsum < x;
+			x = l[3]; lsum += x; carry += lsum < x;
+			l += 4;
+		}
+		len += 32;
+		while ((len -= 8) >= 0) {
+			x = *l++; lsum += x; carry += lsum < x;
+		}
+		len += 8;
+		/* 2^64 is 1 in one's complement arithmetic */
+		sum += (lsum & 0xffffffff) + (lsum >> 32) + carry;
+		p = (const u_int8_t *)l;
+	}
+	w = (const u_int32_t *)p;
+#elif CKSUM_NEON
+	if (len >= 32) {
+		const u_int16_t *h = (const u_int16_t *)p;
+		uint32x4_t acc = vdupq_n_u32(0);
+		uint64x2_t acc64;
+
+		/* A lane grows by at most 4 * 0xffff per round, no overflow below 512K */
+		while ((len -= 32) >= 0) {
+			acc = vpadalq_u16(acc, vld1q_u16(h));
+			acc = vpadalq_u16(acc, vld1q_u16(h + 8));
+			h += 16;
+		}
+		len += 32;
+		acc64 = vpaddlq_u32(acc);
+		sum += vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1);
+		p = (const u_int8_t *)h;
+	}
+	w = (const u_int32_t *)p;
+#else
+	w = (const u_int32_t *)p;
+
 	/*
 	 * Unroll the loop to make overhead from
 	 * branches &c small.
 	 */
-	while ((mlen -= 32) >= 0) {
+	while ((len -= 32) >= 0) {
 		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
 		sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-		sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-		sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-		w += 16;
+		w += 8;
 	}
-	mlen += 32;
-	while ((mlen -= 8) >= 0) {
-		sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-		w += 4;
-	}
-	mlen += 8;
-	if (mlen == 0 && byte_swapped == 0)
-	   goto cont;
-	REDUCE;
-	while ((mlen -= 2) >= 0) {
+	len += 32;
+#endif
+	while ((len -= 4) >= 0)
 		sum += *w++;
+	len += 4;
+
+	p = (const u_int8_t *)w;
+	if (len & 2) {
+		sum += *(const u_int16_t *)p;
+		p += 2;
+	}
+	if (len & 1) {
+		/* The odd byte is the first byte of a zero padded word */
+		s_util.c[0] = *p;
+		s_util.c[1] = 0;
+		sum += s_util.s;
 	}
-	
-	if (byte_swapped) {
-		REDUCE;
-		sum <<= 8;
-		byte_swapped = 0;
-		if (mlen == -1) {
-			s_util.c[1] = *(u_int8_t *)w;
-			sum += s_util.s;
-			mlen = 0;
-		} else
-		   
-		   mlen = -1;
-	} else if (mlen == -1)
-	   s_util.c[0] = *(u_int8_t *)w;
-	
-cont:
+	return sum;
+}
+
+int cksum(struct mbuf *m, int len)
+{
+	const u_int8_t *p;
+	u_int32_t sum;
+	int mlen;
+	union {
+		u_int8_t	c[2];
+		u_int16_t	s;
+	} s_util;
+
+	mlen = m->m_len;
+	if (len < mlen)
+	   mlen = len;
 #ifdef DEBUG
-	if (len) {
+	if (len > mlen) {
 		DEBUG_ERROR((dfd, "cksum: out of data\n"));
-		DEBUG_ERROR((dfd, " len = %d\n", len));
+		DEBUG_ERROR((dfd, " len = %d\n", len - mlen));
 	}
 #endif
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		 standard (the odd byte may be shifted left by 8 bits
-			   or not as determined by endian-ness of the machine) */
+	if (mlen <= 0)
+	   return 0xffff;
+
+	p = mtod(m, const u_int8_t *);
+	if ((long)p & 1) {
+		/* The words of the rest are byte swapped */
+		sum = cksum_fold(cksum_add(p + 1, mlen - 1));
+		sum = ((sum >> 8) | (sum << 8)) & 0xffff;
+		s_util.c[0] = *p;
 		s_util.c[1] = 0;
 		sum += s_util.s;
-	}
-	REDUCE;
+		sum = cksum_fold(sum);
+	} else
+		sum = cksum_fold(cksum_add(p, mlen));
+
 	return (~sum & 0xffff);
 }
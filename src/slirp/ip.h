@@ -199,23 +199,13 @@ struct	ip_timestamp {
 
 #define	IP_MSS		576		/* default maximum segment size */
 
-#ifdef HAVE_SYS_TYPES32_H  /* Overcome some Solaris 2.x junk */
-#include <sys/types32.h>
-#else
-#if SIZEOF_CHAR_P == 4
-typedef caddr_t caddr32_t;
-#else
-typedef u_int32_t caddr32_t;
-#endif
-#endif
-
-#if SIZEOF_CHAR_P == 4
-typedef struct ipq *ipqp_32;
-typedef struct ipasfrag *ipasfragp_32;
-#else
-typedef caddr32_t ipqp_32;
-typedef caddr32_t ipasfragp_32;
-#endif
+/*
+ * Queue links kept in front of an ip header, in the space slirp_input()
+ * leaves for the ethernet header, so they are pointer-sized on all hosts.
+ */
+struct qlink {
+	void *next, *prev;
+};
 
 /*
  * Overlay for ip header used by other protocols (tcp, udp).
@@ -224,8 +214,16 @@ typedef caddr32_t ipasfragp_32;
 #pragma pack(1)
 #endif
 
+/* Back pointer to the mbuf of a queued segment, 8 bytes on all hosts */
+struct mbuf_ptr {
+	struct mbuf *mptr;
+#if SIZEOF_CHAR_P == 4
+	u_int32_t dummy;
+#endif
+} PACKED__;
+
 struct ipovly {
-	caddr32_t	ih_next, ih_prev;	/* for protocol sequence q's */
+	struct mbuf_ptr	ih_mbuf;	/* backpointer to mbuf */
 	u_int8_t	ih_x1;			/* (unused) */
 	u_int8_t	ih_pr;			/* protocol */
 	u_int16_t	ih_len;			/* protocol length */
@@ -242,47 +240,39 @@ struct ipovly {
  * being reassembled is attached to one of these structures.
  * They are timed out after ipq_ttl drops to 0, and may also
  * be reclaimed if memory becomes tight.
- * size 28 bytes
+ * size 28 bytes (44 on LP64)
  */
 struct ipq {
-	ipqp_32 next,prev;	/* to other reass headers */
+	struct ipq *next,*prev;	/* to other reass headers */
 	u_int8_t	ipq_ttl;		/* time for reass q to live */
 	u_int8_t	ipq_p;			/* protocol of this fragment */
 	u_int16_t	ipq_id;			/* sequence id for reassembly */
-	ipasfragp_32 ipq_next,ipq_prev;
-					/* to ip headers of fragments */
+	struct qlink ipq_frags;		/* to ip headers of fragments */
 	struct	in_addr ipq_src,ipq_dst;
 };
 
 /*
- * Ip header, when holding a fragment.
- *
- * Note: ipf_next must be at same offset as ipq_next above
+ * Ip header, when holding a fragment, with the queue links in front.
+ * The list head is the ipq_frags of the reassembly header.
  */
 struct	ipasfrag {
-#ifdef WORDS_BIGENDIAN
-	u_char	ip_v:4,
- 		ip_hl:4;
-#else
-	u_char	ip_hl:4,
-		ip_v:4;
-#endif
-                                        /* BUG : u_int changed to u_int8_t.
-                                         * sizeof(u_int)==4 on linux 2.0
-					 */
-        u_int8_t ipf_mff;		/* XXX overlays ip_tos: use low bit
-					 * to avoid destroying tos (PPPDTRuu);
-					 * copied from (ip_off&IP_MF) */
-	u_int16_t	ip_len;
-	u_int16_t	ip_id;
-	u_int16_t	ip_off;
-	u_int8_t	ip_ttl;
-	u_int8_t	ip_p;
-	u_int16_t	ip_sum;
-	ipasfragp_32 ipf_next;		/* next fragment */
-	ipasfragp_32 ipf_prev;		/* previous fragment */
+	struct qlink ipf_link;
+	struct ip ipf_ip;
 };
 
+#define	ipf_next	ipf_link.next
+#define	ipf_prev	ipf_link.prev
+#define	ipf_off		ipf_ip.ip_off
+#define	ipf_len		ipf_ip.ip_len
+#define	ipf_mff		ipf_ip.ip_tos	/* XXX use low bit to avoid destroying
+					 * tos (PPPDTRuu); copied from
+					 * (ip_off&IP_MF) */
+
+#define	iptofrag(P)	((struct ipasfrag *)(((char *)(P)) - sizeof(struct qlink)))
+#define	fragtoip(F)	(&(F)->ipf_ip)
+#define	ipq_first(FP)	((struct ipasfrag *)(FP)->ipq_frags.next)
+#define	ipq_end(FP)	((struct ipasfrag *)&(FP)->ipq_frags)
+
 /*
  * Structure stored in mbuf in inpcb.ip_options
  * and passed to ip_output when ip options are in use.
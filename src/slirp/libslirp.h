@@ -20,6 +20,11 @@ int slirp_select_fill(int *pnfds,
 
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds);
 
+/* wait at most timeout_usec for socket activity, the next timer or
+   wakeup_fd (-1 = none) becoming readable, and process sockets and
+   timers; returns 1 if wakeup_fd is readable */
+int slirp_poll(int timeout_usec, int wakeup_fd);
+
 void slirp_input(const uint8 *pkt, int pkt_len);
 
 /* you must provide the following functions: */
@@ -33,6 +38,7 @@ int slirp_add_exec(int do_pty, const char *args, int addr_low_byte,
 
 extern const char *tftp_prefix;
 extern char slirp_hostname[33];
+extern char slirp_dns_server[16];
 
 #ifdef __cplusplus
 }
@@ -31,7 +31,6 @@ extern int ctty_closed;
 extern char *slirp_tty;
 extern char *exec_shell;
 extern u_int curtime;
-extern fd_set *global_readfds, *global_writefds, *global_xfds;
 extern struct in_addr ctl_addr;
 extern struct in_addr special_addr;
 extern struct in_addr alias_addr;
@@ -52,3 +51,5 @@ extern uint8_t client_ethaddr[6];
 #endif
 
 void if_encap(const uint8_t *ip_data, int ip_data_len);
+void slirp_rewatch _P((struct socket *));
+void slirp_unwatch _P((struct socket *));
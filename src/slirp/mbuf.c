@@ -13,19 +13,31 @@
  * could hold, an external malloced buffer is pointed to
  * by m_ext (and the data pointers) and M_EXT is set in
  * the flags
+ *
+ * mbufs are carved from slabs of MBUF_SLAB mbufs and recycled
+ * through m_freelist, so the heap is only touched when the pool
+ * grows. External buffers of up to MCLBYTES are clusters, which
+ * are recycled through their own free list.
  */
 
 #include <stdlib.h>
 #include <slirp.h>
 
+#define MBUF_SLAB 16	/* mbufs malloced at once */
+
 struct	mbuf *mbutl;
 char	*mclrefcnt;
 int mbuf_alloced = 0;
 struct mbuf m_freelist, m_usedlist;
-int mbuf_thresh = 30;
+int mbuf_thresh = 256;	/* Max. mbufs from slabs */
 int mbuf_max = 0;
 int msize;
 
+static int mbuf_slabbed;	/* mbufs carved from slabs so far */
+static char *mcl_freelist;	/* Free clusters, linked through their first word */
+static int mcl_free;
+static int mcl_thresh = 16;	/* Max. free clusters kept */
+
 void
 m_init()
 {
@@ -40,17 +52,46 @@ msize_init()
 	/*
 	 * Find a nice value for msize
 	 * XXX if_maxlinkhdr already in mtu
+	 * Keep mbufs in a slab aligned
 	 */
 	msize = (if_mtu>if_mru?if_mtu:if_mru) + 
 			if_maxlinkhdr + sizeof(struct m_hdr ) + 6;
+	msize = (msize + 7) & ~7;
+}
+
+/*
+ * Put a new slab of mbufs on the free list
+ */
+static int
+m_grow()
+{
+	register struct mbuf *m;
+	char *slab;
+	int i;
+
+	if (mbuf_slabbed + MBUF_SLAB > mbuf_thresh)
+		return 0;
+	slab = (char *)malloc(MBUF_SLAB * msize);
+	if (slab == NULL)
+		return 0;
+	for (i = 0; i < MBUF_SLAB; i++) {
+		m = (struct mbuf *)(slab + i * msize);
+		insque(m,&m_freelist);
+		m->m_flags = M_FREELIST;
+	}
+	mbuf_slabbed += MBUF_SLAB;
+	mbuf_alloced += MBUF_SLAB;
+	if (mbuf_alloced > mbuf_max)
+		mbuf_max = mbuf_alloced;
+	return 1;
 }
 
 /*
  * Get an mbuf from the free list, if there are none
- * malloc one
+ * get a new slab
  * 
- * Because fragmentation can occur if we alloc new mbufs and
- * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
+ * Slabs are never freed. Once mbuf_thresh mbufs have been carved
+ * from them, mbufs are malloced one by one and marked M_DOFREE,
  * which tells m_free to actually free() it
  */
 struct mbuf *
@@ -61,12 +102,11 @@ m_get()
 	
 	DEBUG_CALL("m_get");
 	
-	if (m_freelist.m_next == &m_freelist) {
+	if (m_freelist.m_next == &m_freelist && !m_grow()) {
 		m = (struct mbuf *)malloc(msize);
 		if (m == NULL) goto end_error;
 		mbuf_alloced++;
-		if (mbuf_alloced > mbuf_thresh)
-			flags = M_DOFREE;
+		flags = M_DOFREE;
 		if (mbuf_alloced > mbuf_max)
 			mbuf_max = mbuf_alloced;
 	} else {
@@ -89,6 +129,35 @@ end_error:
 	return m;
 }
 
+/*
+ * Get a cluster of MCLBYTES from the free list or the heap
+ */
+static char *
+m_clget()
+{
+	char *c;
+
+	if ((c = mcl_freelist) != NULL) {
+		mcl_freelist = *(char **)c;
+		mcl_free--;
+		return c;
+	}
+	return (char *)malloc(MCLBYTES);
+}
+
+static void
+m_clfree(c)
+	char *c;
+{
+	if (mcl_free >= mcl_thresh) {
+		free(c);
+		return;
+	}
+	*(char **)c = mcl_freelist;
+	mcl_freelist = c;
+	mcl_free++;
+}
+
 void
 m_free(m)
 	struct mbuf *m;
@@ -102,9 +171,13 @@ m_free(m)
 	if (m->m_flags & M_USEDLIST)
 	   remque(m);
 	
-	/* If it's M_EXT, free() it */
-	if (m->m_flags & M_EXT)
-	   free(m->m_ext);
+	/* If it's M_EXT, recycle or free() it */
+	if (m->m_flags & M_EXT) {
+	   if (m->m_flags & M_CLUSTER)
+	      m_clfree(m->m_ext);
+	   else
+	      free(m->m_ext);
+	}
 
 	/*
 	 * Either free() it or put it on the free list
@@ -121,7 +194,7 @@ m_free(m)
 
 /*
  * Copy data from one mbuf to the end of
- * the other.. if result is too big for one mbuf, malloc()
+ * the other.. if result is too big for one mbuf, get
  * an M_EXT data segment
  */
 void
@@ -147,12 +220,13 @@ m_inc(m, size)
         struct mbuf *m;
         int size;
 {
-       int datasize;
+	char *dat;
+	int datasize;
 
 	/* some compiles throw up on gotos.  This one we can fake. */
         if(m->m_size>size) return;
 
-        if (m->m_flags & M_EXT) {
+        if ((m->m_flags & (M_EXT|M_CLUSTER)) == M_EXT) {
          datasize = m->m_data - m->m_ext;
 	  m->m_ext = (char *)realloc(m->m_ext,size);
 /*		if (m->m_ext == NULL)
@@ -160,17 +234,31 @@ m_inc(m, size)
  */		
          m->m_data = m->m_ext + datasize;
         } else {
-	  char *dat;
-	  datasize = m->m_data - m->m_dat;
-	  dat = (char *)malloc(size);
+	  /* Small enough for a cluster? */
+	  if (size <= MCLBYTES) {
+	    dat = m_clget();
+	    size = MCLBYTES;
+	  } else
+	    dat = (char *)malloc(size);
 /*		if (dat == NULL)
  *			return (struct mbuf *)NULL;
  */
-	  memcpy(dat, m->m_dat, m->m_size);
+	  if (m->m_flags & M_EXT) {
+	    datasize = m->m_data - m->m_ext;
+	    memcpy(dat, m->m_ext, m->m_size);
+	    m_clfree(m->m_ext);
+	  } else {
+	    datasize = m->m_data - m->m_dat;
+	    memcpy(dat, m->m_dat, m->m_size);
+	  }
 	  
 	  m->m_ext = dat;
 	  m->m_data = m->m_ext + datasize;
 	  m->m_flags |= M_EXT;
+	  if (size == MCLBYTES)
+	    m->m_flags |= M_CLUSTER;
+	  else
+	    m->m_flags &= ~M_CLUSTER;
         }
  
         m->m_size = size;
@@ -41,6 +41,7 @@
 
 
 #define MINCSIZE 4096	/* Amount to increase mbuf if too small */
+#define MCLBYTES 16384	/* Size of recycled M_EXT clusters */
 
 /*
  * Macros for type conversion
@@ -119,6 +120,7 @@ struct mbuf {
 #define M_USEDLIST		0x04	/* XXX mbuf is on used list (for dtom()) */
 #define M_DOFREE		0x08	/* when m_free is called on the mbuf, free()
 					 * it rather than putting it on the free list */
+#define M_CLUSTER		0x10	/* m_ext is a cluster of MCLBYTES */
 
 /*
  * Mbuf statistics. XXX
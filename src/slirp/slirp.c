@@ -18,17 +18,16 @@ const uint8_t special_ethaddr[6] = {
 
 uint8_t client_ethaddr[6];
 
-int do_slowtimo;
 int link_up;
 struct timeval tt;
 FILE *lfd;
 struct ex_list *exec_list;
 
-/* XXX: suppress those select globals */
-fd_set *global_readfds, *global_writefds, *global_xfds;
-
 char slirp_hostname[33];
 
+/* DNS server to use instead of the one found in the host configuration */
+char slirp_dns_server[16];
+
 #ifdef _WIN32
 
 static int get_dns_addr(struct in_addr *pdns_addr)
@@ -150,7 +149,10 @@ int slirp_init(void)
     /* set default addresses */
     inet_aton("127.0.0.1", &loopback_addr);
 
-    if (get_dns_addr(&dns_addr) < 0)
+    if (slirp_dns_server[0]) {
+        if (!inet_aton(slirp_dns_server, &dns_addr))
+            return -1;
+    } else if (get_dns_addr(&dns_addr) < 0)
         return -1;
 
     inet_aton(CTL_SPECIAL, &special_addr);
@@ -161,7 +163,6 @@ int slirp_init(void)
 
 #define CONN_CANFSEND(so) (((so)->so_state & (SS_FCANTSENDMORE|SS_ISFCONNECTED)) == SS_ISFCONNECTED)
 #define CONN_CANFRCV(so) (((so)->so_state & (SS_FCANTRCVMORE|SS_ISFCONNECTED)) == SS_ISFCONNECTED)
-#define UPD_NFDS(x) if (nfds < (x)) nfds = (x)
 
 /*
  * curtime kept to an accuracy of 1ms
@@ -179,342 +180,911 @@ static void updtime(void)
 static void updtime(void)
 {
 	gettimeofday(&tt, 0);
-	
+
 	curtime = (u_int)tt.tv_sec * (u_int)1000;
 	curtime += (u_int)tt.tv_usec / (u_int)1000;
-	
+
 	if ((tt.tv_usec % 1000) >= 500)
 	   curtime++;
 }
 #endif
 
-int slirp_select_fill(int *pnfds, 
-					  fd_set *readfds, fd_set *writefds, fd_set *xfds)
+/*
+ * Timers. Delayed ACKs are sent within FAST_TIMO ms of when they were
+ * requested. The TCP timers and IP reassembly run every SLOW_TIMO ms;
+ * the TCP timers sit on a wheel indexed by tcp_now, so a tick only
+ * touches the connections which actually expire.
+ */
+#define SLOW_TIMO 5
+#define FAST_TIMO 2
+
+#define IPQ_PENDING() (ipq.next != &ipq)
+
+static void slirp_timers(void)
 {
-    struct socket *so, *so_next;
-    int nfds;
-    int timeout, tmp_time;
+	u_int ticks;
+
+	if (!link_up)
+		return;
+
+	if (time_fasttimo && ((curtime - time_fasttimo) >= FAST_TIMO)) {
+		time_fasttimo = 0;	/* tcp_fasttimo() may request another one */
+		tcp_fasttimo();
+	}
+
+	ticks = (curtime - last_slowtimo) / SLOW_TIMO;
+	if (ticks == 0)
+		return;
+	last_slowtimo += ticks * SLOW_TIMO;
 
-    /* fail safe */
-    global_readfds = NULL;
-    global_writefds = NULL;
-    global_xfds = NULL;
-    
-    nfds = *pnfds;
 	/*
-	 * First, TCP sockets
+	 * After a long sleep, only the last turn of the wheel can
+	 * hold timers; skip the empty ticks before it
 	 */
-	do_slowtimo = 0;
-	if (link_up) {
-		/* 
-		 * *_slowtimo needs calling if there are IP fragments
-		 * in the fragment queue, or there are TCP connections active
-		 */
-		do_slowtimo = ((tcb.so_next != &tcb) ||
-			       ((struct ipasfrag *)&ipq != (struct ipasfrag *)ipq.next));
-		
+	if (ticks > TCP_WHEEL_SIZE) {
+		tcp_skiptimo(ticks - TCP_WHEEL_SIZE);
+		ticks = TCP_WHEEL_SIZE;
+	}
+	while (ticks--) {
+		if (IPQ_PENDING())
+			ip_slowtimo();
+		tcp_slowtimo();
+	}
+}
+
+/*
+ * Milliseconds until slirp_timers() has something to do, -1 = never
+ */
+static int slirp_timers_timeout(void)
+{
+	int timeout = -1, tmp_time, ticks;
+
+	if (!link_up)
+		return -1;
+
+	if (time_fasttimo) {
+		timeout = FAST_TIMO - (int)(curtime - time_fasttimo);
+		if (timeout < 0)
+			timeout = 0;
+	}
+
+	ticks = IPQ_PENDING() ? 1 : tcp_nexttimo();
+	if (ticks > 0) {
+		tmp_time = ticks * SLOW_TIMO - (int)(curtime - last_slowtimo);
+		if (tmp_time < 0)
+			tmp_time = 0;
+		if (timeout < 0 || tmp_time < timeout)
+			timeout = tmp_time;
+	}
+	return timeout;
+}
+
+/*
+ * Events a TCP socket waits for, SO_EV_*
+ */
+static int tcp_interest(struct socket *so)
+{
+	int events = 0;
+
+	/*
+	 * NOFDREF can include still connecting to local-host,
+	 * newly socreated() sockets etc. Don't want to select these.
+	 */
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+		return 0;
+
+	/*
+	 * Wait for reading on sockets which are accepting
+	 */
+	if (so->so_state & SS_FACCEPTCONN)
+		return SO_EV_IN;
+
+	/*
+	 * Wait for writing on sockets which are connecting
+	 */
+	if (so->so_state & SS_ISFCONNECTING)
+		return SO_EV_OUT;
+
+	/*
+	 * Wait for writing if we are connected, can send more, and
+	 * we have something to send
+	 */
+	if (CONN_CANFSEND(so) && so->so_rcv.sb_cc)
+		events |= SO_EV_OUT;
+
+	/*
+	 * Wait for reading (and urgent data) if we are connected, can
+	 * receive more, and we have room for it XXX /2 ?
+	 */
+	if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2)))
+		events |= SO_EV_IN | SO_EV_PRI;
+
+	return events;
+}
+
+/*
+ * Events a UDP socket waits for, SO_EV_*
+ */
+static int udp_interest(struct socket *so)
+{
+	/*
+	 * When UDP packets are received from over the
+	 * link, they're sendto()'d straight away, so
+	 * no need for waiting for writing
+	 * Limit the number of packets queued by this session
+	 * to 4.  Note that even though we try and limit this
+	 * to 4 packets, the session could have more queued
+	 * if the packets needed to be fragmented
+	 * (XXX <= 4 ?)
+	 */
+	if (so->s != -1 && (so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4)
+		return SO_EV_IN;
+	return 0;
+}
+
+/*
+ * Sockets whose events may have changed since slirp_scan() last looked
+ * at them: new sockets, sockets which got events or segments from the
+ * guest, had a TCP timer go off or packets leave the output queue.
+ * Everything else keeps waiting for the same events.
+ */
+static struct socket **rewatch_so;
+static int rewatch_num, rewatch_max;
+static int rewatch_all = 1;		/* Look at all sockets in the next scan */
+static u_int udp_expire_time;		/* Next walk through the UDP sockets */
+
+void slirp_rewatch(struct socket *so)
+{
+	struct socket **sop;
+
+	if (so->so_rewatch)
+		return;
+	if (rewatch_num == rewatch_max) {
+		sop = (struct socket **)realloc(rewatch_so, (rewatch_max + 64) * sizeof(*sop));
+		if (sop == NULL) {
+			rewatch_all = 1;
+			return;
+		}
+		rewatch_so = sop;
+		rewatch_max += 64;
+	}
+	rewatch_so[rewatch_num++] = so;
+	so->so_rewatch = 1;
+}
+
+/*
+ * Pass the events of the sockets queued by slirp_rewatch() to watch(),
+ * or of all sockets if all is set, and expire idle UDP sockets.
+ * Returns milliseconds until the next timer or expiry, -1 = none.
+ */
+static int slirp_scan(void (*watch)(struct socket *, int), int all)
+{
+	struct socket *so, *so_next;
+	int timeout, tmp_time, i;
+
+	timeout = slirp_timers_timeout();
+	if (!link_up) {
+		rewatch_all = 1;
+		return timeout;
+	}
+	if (rewatch_all) {
+		rewatch_all = 0;
+		all = 1;
+	}
+
+	if (all) {
 		for (so = tcb.so_next; so != &tcb; so = so_next) {
 			so_next = so->so_next;
-			
-			/*
-			 * See if we need a tcp_fasttimo
-			 */
-			if (time_fasttimo == 0 && so->so_tcpcb->t_flags & TF_DELACK)
-			   time_fasttimo = curtime; /* Flag when we want a fasttimo */
-			
-			/*
-			 * NOFDREF can include still connecting to local-host,
-			 * newly socreated() sockets etc. Don't want to select these.
-	 		 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-			
-			/*
-			 * Set for reading sockets which are accepting
-			 */
-			if (so->so_state & SS_FACCEPTCONN) {
-                                FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-			
-			/*
-			 * Set for writing sockets which are connecting
-			 */
-			if (so->so_state & SS_ISFCONNECTING) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-				continue;
-			}
-			
-			/*
-			 * Set for writing if we are connected, can send more, and
-			 * we have something to send
-			 */
-			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
-				FD_SET(so->s, writefds);
-				UPD_NFDS(so->s);
-			}
-			
-			/*
-			 * Set for reading (and urgent data) if we are connected, can
-			 * receive more, and we have room for it XXX /2 ?
-			 */
-			if (CONN_CANFRCV(so) && (so->so_snd.sb_cc < (so->so_snd.sb_datalen/2))) {
-				FD_SET(so->s, readfds);
-				FD_SET(so->s, xfds);
-				UPD_NFDS(so->s);
-			}
+			watch(so, tcp_interest(so));
 		}
-		
-		/*
-		 * UDP sockets
-		 */
+	}
+
+	/*
+	 * Expire idle UDP sockets. They are walked at the earliest expiry
+	 * time found by the last walk, and at least every SO_EXPIREFAST ms
+	 * for sockets created meanwhile.
+	 */
+	if (all || (int)(curtime - udp_expire_time) >= 0) {
+		udp_expire_time = curtime + SO_EXPIREFAST;
 		for (so = udb.so_next; so != &udb; so = so_next) {
 			so_next = so->so_next;
-			
-			/*
-			 * See if it's timed out
-			 */
 			if (so->so_expire) {
 				if (so->so_expire <= curtime) {
 					udp_detach(so);
 					continue;
-				} else
-					do_slowtimo = 1; /* Let socket expire */
-			}
-			
-			/*
-			 * When UDP packets are received from over the
-			 * link, they're sendto()'d straight away, so
-			 * no need for setting for writing
-			 * Limit the number of packets queued by this session
-			 * to 4.  Note that even though we try and limit this
-			 * to 4 packets, the session could have more queued
-			 * if the packets needed to be fragmented
-			 * (XXX <= 4 ?)
-			 */
-			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
-				FD_SET(so->s, readfds);
-				UPD_NFDS(so->s);
+				}
+				if ((int)(so->so_expire - udp_expire_time) < 0)
+					udp_expire_time = so->so_expire;
 			}
+			if (all)
+				watch(so, udp_interest(so));
 		}
 	}
-	
+	if (udb.so_next != &udb) {
+		tmp_time = udp_expire_time - curtime;
+		if (timeout < 0 || tmp_time < timeout)
+			timeout = tmp_time;
+	}
+
 	/*
-	 * Setup timeout to use minimum CPU usage, especially when idle
+	 * sofree() removes sockets closed meanwhile from the list
 	 */
+	for (i = 0; i < rewatch_num; i++) {
+		so = rewatch_so[i];
+		if (so == NULL)
+			continue;
+		so->so_rewatch = 0;
+		if (!all)
+			watch(so, so->so_tcpcb ? tcp_interest(so) : udp_interest(so));
+	}
+	rewatch_num = 0;
+	return timeout;
+}
 
-	timeout = -1;
+/*
+ * Handle so->so_revents of a TCP socket
+ */
+static void tcp_events(struct socket *so)
+{
+	int ret;
 
 	/*
-	 * If a slowtimo is needed, set timeout to 5ms from the last
-	 * slow timeout. If a fast timeout is needed, set timeout within
-	 * 2ms of when it was requested.
+	 * Events are meaningless on these sockets
+	 * (and they can crash the program)
 	 */
-#	define SLOW_TIMO 5
-#	define FAST_TIMO 2
-	if (do_slowtimo) {
-		timeout = (SLOW_TIMO - (curtime - last_slowtimo)) * 1000;
-		if (timeout < 0)
-		   timeout = 0;
-		else if (timeout > (SLOW_TIMO * 1000))
-		   timeout = SLOW_TIMO * 1000;
-		
-		/* Can only fasttimo if we also slowtimo */
-		if (time_fasttimo) {
-			tmp_time = (FAST_TIMO - (curtime - time_fasttimo)) * 1000;
-			if (tmp_time < 0)
-				tmp_time = 0;
-			
-			/* Choose the smallest of the 2 */
-			if (tmp_time < timeout)
-			   timeout = tmp_time;
-		}
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+	   return;
+
+	/*
+	 * Check for URG data
+	 * This will soread as well, so no need to
+	 * test for reading below if this succeeds
+	 */
+	if (so->so_revents & SO_EV_PRI)
+	   sorecvoob(so);
+	/*
+	 * Check sockets for reading
+	 */
+	else if (so->so_revents & SO_EV_IN) {
+		/*
+		 * Check for incoming connections
+		 */
+		if (so->so_state & SS_FACCEPTCONN) {
+			tcp_connect(so);
+			return;
+		} /* else */
+		ret = soread(so);
+
+		/* Output it if we read something */
+		if (ret > 0)
+		   tcp_output(sototcpcb(so));
+	}
+
+	/*
+	 * Check sockets for writing
+	 */
+	if (so->so_revents & SO_EV_OUT) {
+	  /*
+	   * Check for non-blocking, still-connecting sockets
+	   */
+	  if (so->so_state & SS_ISFCONNECTING) {
+	    /* Connected */
+	    so->so_state &= ~SS_ISFCONNECTING;
+
+	    ret = send(so->s, &ret, 0, 0);
+	    if (ret < 0) {
+	      /* XXXXX Must fix, zero bytes is a NOP */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+
+	      /* else failed */
+	      so->so_state = SS_NOFDREF;
+	    }
+	    /* else so->so_state &= ~SS_ISFCONNECTING; */
+
+	    /*
+	     * Continue tcp_input
+	     */
+	    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
+	    /* return; */
+	  } else
+	    ret = sowrite(so);
+	  /*
+	   * XXXXX If we wrote something (a lot), there
+	   * could be a need for a window update.
+	   * In the worst case, the remote will send
+	   * a window probe to get things going again
+	   */
 	}
-	*pnfds = nfds;
+
+	/*
+	 * Probe a still-connecting, non-blocking socket
+	 * to check if it's still alive
+	 */
+#ifdef PROBE_CONN
+	if (so->so_state & SS_ISFCONNECTING) {
+	  ret = recv(so->s, (char *)&ret, 0,0);
+
+	  if (ret < 0) {
+	    /* XXX */
+	    if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		errno == EINPROGRESS || errno == ENOTCONN)
+	      return; /* Still connecting, continue */
+
+	    /* else failed */
+	    so->so_state = SS_NOFDREF;
+
+	    /* tcp_input will take care of it */
+	  } else {
+	    ret = send(so->s, &ret, 0,0);
+	    if (ret < 0) {
+	      /* XXX */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+	      /* else failed */
+	      so->so_state = SS_NOFDREF;
+	    } else
+	      so->so_state &= ~SS_ISFCONNECTING;
+
+	  }
+	  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
+	} /* SS_ISFCONNECTING */
+#endif
+}
+
+/*
+ * Handle so->so_revents of a UDP socket.
+ * Incoming packets are sent straight away, they're not buffered.
+ * Incoming UDP data isn't buffered either.
+ */
+static void udp_events(struct socket *so)
+{
+	if (so->s != -1 && (so->so_revents & SO_EV_IN))
+		sorecvfrom(so);
+}
+
+/*
+ * select() interface
+ */
+static fd_set *sel_readfds, *sel_writefds, *sel_xfds;
+static int sel_nfds;
+
+static void select_watch(struct socket *so, int events)
+{
+	if (events == 0)
+		return;
+	if (events & SO_EV_IN)
+		FD_SET(so->s, sel_readfds);
+	if (events & SO_EV_OUT)
+		FD_SET(so->s, sel_writefds);
+	if (events & SO_EV_PRI)
+		FD_SET(so->s, sel_xfds);
+	if (sel_nfds < so->s)
+		sel_nfds = so->s;
+}
+
+static int select_revents(struct socket *so, fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+	int revents = 0;
+
+	if (so->s == -1)
+		return 0;
+	if (FD_ISSET(so->s, readfds))
+		revents |= SO_EV_IN;
+	if (FD_ISSET(so->s, writefds))
+		revents |= SO_EV_OUT;
+	if (FD_ISSET(so->s, xfds))
+		revents |= SO_EV_PRI;
+	return revents;
+}
+
+int slirp_select_fill(int *pnfds,
+					  fd_set *readfds, fd_set *writefds, fd_set *xfds)
+{
+	int timeout;
+
+	sel_readfds = readfds;
+	sel_writefds = writefds;
+	sel_xfds = xfds;
+	sel_nfds = *pnfds;
+	timeout = slirp_scan(select_watch, 1);
+	*pnfds = sel_nfds;
 
 	/*
 	 * Adjust the timeout to make the minimum timeout
 	 * 2ms (XXX?) to lessen the CPU load
 	 */
-	if (timeout < (FAST_TIMO * 1000))
-		timeout = FAST_TIMO * 1000;
+	if (timeout < FAST_TIMO)
+		timeout = FAST_TIMO;
 
-	return timeout;
-}	
+	return timeout * 1000;
+}
 
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
     struct socket *so, *so_next;
-    int ret;
-
-    global_readfds = readfds;
-    global_writefds = writefds;
-    global_xfds = xfds;
 
 	/* Update time */
 	updtime();
-	
+
 	/*
-	 * See if anything has timed out 
+	 * See if anything has timed out
 	 */
-	if (link_up) {
-		if (time_fasttimo && ((curtime - time_fasttimo) >= FAST_TIMO)) {
-			tcp_fasttimo();
-			time_fasttimo = 0;
-		}
-		if (do_slowtimo && ((curtime - last_slowtimo) >= SLOW_TIMO)) {
-			ip_slowtimo();
-			tcp_slowtimo();
-			last_slowtimo = curtime;
-		}
-	}
-	
+	slirp_timers();
+
 	/*
 	 * Check sockets
 	 */
 	if (link_up) {
-		/*
-		 * Check TCP sockets
-		 */
 		for (so = tcb.so_next; so != &tcb; so = so_next) {
 			so_next = so->so_next;
-			
-			/*
-			 * FD_ISSET is meaningless on these sockets
-			 * (and they can crash the program)
-			 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-			
-			/*
-			 * Check for URG data
-			 * This will soread as well, so no need to
-			 * test for readfds below if this succeeds
-			 */
-			if (FD_ISSET(so->s, xfds))
-			   sorecvoob(so);
-			/*
-			 * Check sockets for reading
-			 */
-			else if (FD_ISSET(so->s, readfds)) {
-				/*
-				 * Check for incoming connections
-				 */
-				if (so->so_state & SS_FACCEPTCONN) {
-					tcp_connect(so);
-					continue;
-				} /* else */
-				ret = soread(so);
-				
-				/* Output it if we read something */
-				if (ret > 0)
-				   tcp_output(sototcpcb(so));
-			}
-			
-			/*
-			 * Check sockets for writing
-			 */
-			if (FD_ISSET(so->s, writefds)) {
-			  /*
-			   * Check for non-blocking, still-connecting sockets
-			   */
-			  if (so->so_state & SS_ISFCONNECTING) {
-			    /* Connected */
-			    so->so_state &= ~SS_ISFCONNECTING;
-			    
-			    ret = send(so->s, &ret, 0, 0);
-			    if (ret < 0) {
-			      /* XXXXX Must fix, zero bytes is a NOP */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-			      
-			      /* else failed */
-			      so->so_state = SS_NOFDREF;
-			    }
-			    /* else so->so_state &= ~SS_ISFCONNECTING; */
-			    
-			    /*
-			     * Continue tcp_input
-			     */
-			    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
-			    /* continue; */
-			  } else
-			    ret = sowrite(so);
-			  /*
-			   * XXXXX If we wrote something (a lot), there 
-			   * could be a need for a window update.
-			   * In the worst case, the remote will send
-			   * a window probe to get things going again
-			   */
-			}
-			
-			/*
-			 * Probe a still-connecting, non-blocking socket
-			 * to check if it's still alive
-	 	 	 */
-#ifdef PROBE_CONN
-			if (so->so_state & SS_ISFCONNECTING) {
-			  ret = recv(so->s, (char *)&ret, 0,0);
-			  
-			  if (ret < 0) {
-			    /* XXX */
-			    if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				errno == EINPROGRESS || errno == ENOTCONN)
-			      continue; /* Still connecting, continue */
-			    
-			    /* else failed */
-			    so->so_state = SS_NOFDREF;
-			    
-			    /* tcp_input will take care of it */
-			  } else {
-			    ret = send(so->s, &ret, 0,0);
-			    if (ret < 0) {
-			      /* XXX */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-			      /* else failed */
-			      so->so_state = SS_NOFDREF;
-			    } else
-			      so->so_state &= ~SS_ISFCONNECTING;
-			    
-			  }
-			  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
-			} /* SS_ISFCONNECTING */
-#endif
+			so->so_revents = select_revents(so, readfds, writefds, xfds);
+			tcp_events(so);
 		}
-		
-		/*
-		 * Now UDP sockets.
-		 * Incoming packets are sent straight away, they're not buffered.
-		 * Incoming UDP data isn't buffered either.
-		 */
+
 		for (so = udb.so_next; so != &udb; so = so_next) {
 			so_next = so->so_next;
-			
-			if (so->s != -1 && FD_ISSET(so->s, readfds)) {
-                            sorecvfrom(so);
-                        }
+			so->so_revents = select_revents(so, readfds, writefds, xfds);
+			udp_events(so);
 		}
 	}
-	
+
 	/*
 	 * See if we can start outputting
 	 */
 	if (if_queued && link_up)
 	   if_start();
+}
+
+/*
+ * slirp_poll() interface. The backend keeps the events each socket
+ * waits for between polls, slirp_scan() only updates those of sockets
+ * queued by slirp_rewatch(). slirp_wait() sleeps and collects the
+ * sockets which got events into ready_so[]. Only those are dispatched.
+ */
+static struct socket **ready_so;
+static int *ready_events;
+static int ready_num, ready_max;
+
+static int ready_grow(int n)
+{
+	struct socket **so;
+	int *events;
+
+	if (n <= ready_max)
+		return 1;
+	n = (n + 63) & ~63;
+	so = (struct socket **)realloc(ready_so, n * sizeof(*so));
+	if (so == NULL)
+		return 0;
+	ready_so = so;
+	events = (int *)realloc(ready_events, n * sizeof(*events));
+	if (events == NULL)
+		return 0;
+	ready_events = events;
+	ready_max = n;
+	return 1;
+}
+
+static void ready_add(struct socket *so, int events)
+{
+	if (events && ready_grow(ready_num + 1)) {
+		ready_so[ready_num] = so;
+		ready_events[ready_num] = events;
+		ready_num++;
+	}
+}
+
+#if defined(HAVE_SYS_EPOLL_H)
+
+/*
+ * epoll backend: sockets stay registered, the kernel is only told
+ * when the events a socket waits for change
+ */
+#define EPOLL_MAX_EVENTS 64
+
+static int epoll_fd = -1;
+static int epoll_wakeup_fd = -1;
+
+static void slirp_watch(struct socket *so, int events)
+{
+	struct epoll_event ev;
+
+	/* Descriptors are unregistered by the kernel when they are closed */
+	if (so->so_evfd != so->s) {
+		so->so_evfd = -1;
+		so->so_events = 0;
+	}
+	if (events == so->so_events)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = ((events & SO_EV_IN) ? EPOLLIN : 0) |
+		    ((events & SO_EV_OUT) ? EPOLLOUT : 0) |
+		    ((events & SO_EV_PRI) ? EPOLLPRI : 0);
+	ev.data.ptr = so;
+	if (events == 0) {
+		/* Don't get EPOLLHUP over and over for sockets we ignore */
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, so->s, &ev);
+		so->so_evfd = -1;
+	} else if (so->so_evfd == -1) {
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, so->s, &ev) < 0) {
+			if (errno != EEXIST || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, so->s, &ev) < 0)
+				return;
+		}
+		so->so_evfd = so->s;
+	} else if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, so->s, &ev) < 0)
+		return;
+	so->so_events = events;
+}
+
+static void slirp_unwatch_backend(struct socket *so)
+{
+	struct epoll_event ev;
+
+	if (so->so_evfd != -1 && so->so_evfd == so->s)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, so->s, &ev);
+	so->so_evfd = -1;
+	so->so_events = 0;
+}
+
+static int slirp_wait(int timeout, int wakeup_fd)
+{
+	struct epoll_event ev[EPOLL_MAX_EVENTS];
+	struct socket *so;
+	int i, n, events, woken = 0;
+
+	if (wakeup_fd != epoll_wakeup_fd) {
+		if (epoll_wakeup_fd != -1)
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, epoll_wakeup_fd, &ev[0]);
+		epoll_wakeup_fd = -1;
+		memset(&ev[0], 0, sizeof(ev[0]));
+		ev[0].events = EPOLLIN;
+		ev[0].data.ptr = NULL;
+		if (wakeup_fd != -1 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev[0]) == 0)
+			epoll_wakeup_fd = wakeup_fd;
+	}
+
+	n = epoll_wait(epoll_fd, ev, EPOLL_MAX_EVENTS, timeout);
+	if (n <= 0)
+		return 0;
+	if (!ready_grow(n))
+		return 0;
+	for (i = 0; i < n; i++) {
+		so = (struct socket *)ev[i].data.ptr;
+		if (so == NULL) {
+			woken = 1;
+			continue;
+		}
+		events = ((ev[i].events & EPOLLIN) ? SO_EV_IN : 0) |
+			 ((ev[i].events & EPOLLOUT) ? SO_EV_OUT : 0) |
+			 ((ev[i].events & EPOLLPRI) ? SO_EV_PRI : 0);
+		/* select() reports errors and hangups as readable/writable */
+		if (ev[i].events & (EPOLLERR | EPOLLHUP))
+			events |= so->so_events & (SO_EV_IN | SO_EV_OUT);
+		ready_add(so, events & so->so_events);
+	}
+	return woken;
+}
+
+static int slirp_wait_init(void)
+{
+	if (epoll_fd == -1) {
+		epoll_fd = epoll_create(EPOLL_MAX_EVENTS);
+		if (epoll_fd == -1)
+			return 0;
+		fcntl(epoll_fd, F_SETFD, FD_CLOEXEC);
+	}
+	return 1;
+}
+
+#elif defined(HAVE_POLL) && defined(HAVE_SYS_POLL_H)
+
+/*
+ * poll() backend: sockets keep their slot in the pollfd array while
+ * they wait for events, slot 0 is the wakeup descriptor
+ */
+static struct pollfd *poll_fds;
+static struct socket **poll_so;
+static int poll_num, poll_max;
+
+static void slirp_unwatch_backend(struct socket *so)
+{
+	int i = so->so_evslot;
+
+	if (i != -1) {
+		poll_num--;
+		if (i != poll_num) {
+			poll_fds[i] = poll_fds[poll_num];
+			poll_so[i] = poll_so[poll_num];
+			poll_so[i]->so_evslot = i;
+		}
+		so->so_evslot = -1;
+	}
+	so->so_events = 0;
+}
+
+static void slirp_watch(struct socket *so, int events)
+{
+	struct pollfd *fds;
+	struct socket **sop;
+	int n;
+
+	if (events == 0) {
+		slirp_unwatch_backend(so);
+		return;
+	}
+	if (so->so_evslot == -1) {
+		if (poll_num == poll_max) {
+			n = poll_max + 64;
+			fds = (struct pollfd *)realloc(poll_fds, n * sizeof(*fds));
+			if (fds == NULL)
+				return;
+			poll_fds = fds;
+			sop = (struct socket **)realloc(poll_so, n * sizeof(*sop));
+			if (sop == NULL)
+				return;
+			poll_so = sop;
+			poll_max = n;
+		}
+		so->so_evslot = poll_num++;
+		poll_so[so->so_evslot] = so;
+	}
+	fds = &poll_fds[so->so_evslot];
+	fds->fd = so->s;
+	fds->events = ((events & SO_EV_IN) ? POLLIN : 0) |
+		      ((events & SO_EV_OUT) ? POLLOUT : 0) |
+		      ((events & SO_EV_PRI) ? POLLPRI : 0);
+	fds->revents = 0;
+	so->so_events = events;
+}
 
-	/* clear global file descriptor sets.
-	 * these reside on the stack in vl.c
-	 * so they're unusable if we're not in
-	 * slirp_select_fill or slirp_select_poll.
+static int slirp_wait(int timeout, int wakeup_fd)
+{
+	struct socket *so;
+	int i, n, events, woken = 0;
+
+	poll_fds[0].fd = wakeup_fd;
+	poll_fds[0].events = POLLIN;
+	poll_fds[0].revents = 0;
+	poll_so[0] = NULL;
+
+	n = poll(poll_fds, poll_num, timeout);
+	if (n <= 0 || !ready_grow(n))
+		return 0;
+	for (i = 0; i < poll_num && n > 0; i++) {
+		if (poll_fds[i].revents == 0)
+			continue;
+		n--;
+		so = poll_so[i];
+		if (so == NULL) {
+			woken = 1;
+			continue;
+		}
+		events = ((poll_fds[i].revents & POLLIN) ? SO_EV_IN : 0) |
+			 ((poll_fds[i].revents & POLLOUT) ? SO_EV_OUT : 0) |
+			 ((poll_fds[i].revents & POLLPRI) ? SO_EV_PRI : 0);
+		/* select() reports errors and hangups as readable/writable */
+		if (poll_fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+			events |= so->so_events & (SO_EV_IN | SO_EV_OUT);
+		ready_add(so, events & so->so_events);
+	}
+	return woken;
+}
+
+static int slirp_wait_init(void)
+{
+	if (poll_max == 0) {
+		poll_fds = (struct pollfd *)malloc(64 * sizeof(*poll_fds));
+		poll_so = (struct socket **)malloc(64 * sizeof(*poll_so));
+		if (poll_fds == NULL || poll_so == NULL)
+			return 0;
+		poll_max = 64;
+		poll_num = 1;	/* Slot 0 is the wakeup descriptor */
+	}
+	return 1;
+}
+
+#else
+
+/*
+ * select() backend: the descriptor sets of the waiting sockets are kept
+ * between waits and copied for select()
+ */
+static fd_set poll_readfds, poll_writefds, poll_xfds;
+static struct socket **poll_so;
+static int poll_num, poll_max;
+static int poll_nfds = -1;		/* Highest descriptor in the sets */
+
+static void poll_fd_clr(struct socket *so)
+{
+	int i;
+
+	if (so->so_evfd == -1)
+		return;
+	FD_CLR(so->so_evfd, &poll_readfds);
+	FD_CLR(so->so_evfd, &poll_writefds);
+	FD_CLR(so->so_evfd, &poll_xfds);
+	if (so->so_evfd == poll_nfds) {
+		poll_nfds = -1;
+		for (i = 0; i < poll_num; i++)
+			if (poll_so[i] != so && poll_nfds < poll_so[i]->so_evfd)
+				poll_nfds = poll_so[i]->so_evfd;
+	}
+	so->so_evfd = -1;
+}
+
+static void slirp_unwatch_backend(struct socket *so)
+{
+	int i = so->so_evslot;
+
+	poll_fd_clr(so);
+	if (i != -1) {
+		poll_num--;
+		if (i != poll_num) {
+			poll_so[i] = poll_so[poll_num];
+			poll_so[i]->so_evslot = i;
+		}
+		so->so_evslot = -1;
+	}
+	so->so_events = 0;
+}
+
+static void slirp_watch(struct socket *so, int events)
+{
+	struct socket **sop;
+
+	if (events == 0) {
+		slirp_unwatch_backend(so);
+		return;
+	}
+	if (so->so_evslot == -1) {
+		if (poll_num == poll_max) {
+			sop = (struct socket **)realloc(poll_so, (poll_max + 64) * sizeof(*sop));
+			if (sop == NULL)
+				return;
+			poll_so = sop;
+			poll_max += 64;
+		}
+		so->so_evslot = poll_num++;
+		poll_so[so->so_evslot] = so;
+	} else
+		poll_fd_clr(so);
+	if (events & SO_EV_IN)
+		FD_SET(so->s, &poll_readfds);
+	if (events & SO_EV_OUT)
+		FD_SET(so->s, &poll_writefds);
+	if (events & SO_EV_PRI)
+		FD_SET(so->s, &poll_xfds);
+	if (poll_nfds < so->s)
+		poll_nfds = so->s;
+	so->so_evfd = so->s;
+	so->so_events = events;
+}
+
+static int slirp_wait(int timeout, int wakeup_fd)
+{
+	fd_set readfds, writefds, xfds;
+	struct timeval tv;
+	struct socket *so;
+	int i, n, nfds, events, woken;
+
+	readfds = poll_readfds;
+	writefds = poll_writefds;
+	xfds = poll_xfds;
+	nfds = poll_nfds;
+	if (wakeup_fd != -1) {
+		FD_SET(wakeup_fd, &readfds);
+		if (nfds < wakeup_fd)
+			nfds = wakeup_fd;
+	}
+
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+	if (nfds < 0) {
+#ifdef _WIN32
+		Sleep(timeout);
+#else
+		usleep(timeout * 1000);
+#endif
+		return 0;
+	}
+	n = select(nfds + 1, &readfds, &writefds, &xfds, &tv);
+	if (n <= 0)
+		return 0;
+	woken = wakeup_fd != -1 && FD_ISSET(wakeup_fd, &readfds);
+	n -= woken;
+	if (!ready_grow(poll_num))
+		return woken;
+
+	/* n counts each descriptor once for every set it is in */
+	for (i = 0; i < poll_num && n > 0; i++) {
+		so = poll_so[i];
+		events = select_revents(so, &readfds, &writefds, &xfds);
+		if (events == 0)
+			continue;
+		n -= ((events & SO_EV_IN) != 0) + ((events & SO_EV_OUT) != 0) + ((events & SO_EV_PRI) != 0);
+		ready_add(so, events & so->so_events);
+	}
+	return woken;
+}
+
+static int slirp_wait_init(void)
+{
+	return 1;
+}
+
+#endif
+
+/*
+ * Called by sofree(), the socket must not be dispatched any more
+ */
+void slirp_unwatch(struct socket *so)
+{
+	int i;
+
+	for (i = 0; i < ready_num; i++)
+		if (ready_so[i] == so)
+			ready_so[i] = NULL;
+	if (so->so_rewatch) {
+		for (i = 0; i < rewatch_num; i++)
+			if (rewatch_so[i] == so)
+				rewatch_so[i] = NULL;
+	}
+	slirp_unwatch_backend(so);
+}
+
+int slirp_poll(int timeout_usec, int wakeup_fd)
+{
+	struct socket *so;
+	int timeout, max_timeout, woken, i;
+
+	updtime();
+	slirp_timers();
+
+	if (!slirp_wait_init())
+		return 0;
+	timeout = slirp_scan(slirp_watch, 0);
+
+	/* Retry output soon if the queue to the guest was full */
+	if (if_queued && link_up && (timeout < 0 || timeout > FAST_TIMO))
+		timeout = FAST_TIMO;
+	max_timeout = (timeout_usec + 999) / 1000;
+	if (timeout < 0 || timeout > max_timeout)
+		timeout = max_timeout;
+
+	ready_num = 0;
+	woken = slirp_wait(timeout, wakeup_fd);
+
+	updtime();
+	slirp_timers();
+
+	/*
+	 * Check the sockets which got events, sofree() removes
+	 * sockets closed meanwhile from the list
 	 */
-	 global_readfds = NULL;
-	 global_writefds = NULL;
-	 global_xfds = NULL;
+	for (i = 0; i < ready_num; i++) {
+		so = ready_so[i];
+		if (so == NULL)
+			continue;
+		so->so_revents = ready_events[i];
+		slirp_rewatch(so);
+		if (so->so_tcpcb)
+			tcp_events(so);
+		else
+			udp_events(so);
+	}
+	ready_num = 0;
+
+	/*
+	 * See if we can start outputting
+	 */
+	if (if_queued && link_up)
+	   if_start();
+
+	return woken;
 }
 
 #define ETH_ALEN 6
@@ -615,7 +1185,8 @@ void slirp_input(const uint8_t *pkt, int pkt_len)
         m = m_get();
         if (!m)
             return;
-        /* Note: we add to align the IP header */
+        /* Note: we add to align the IP header. The 2 + ETH_HLEN bytes
+           in front of it hold the reassembly queue links (struct qlink) */
         m->m_len = pkt_len + 2;
         memcpy(m->m_data + 2, pkt, pkt_len);
 
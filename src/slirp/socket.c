@@ -60,6 +60,8 @@ socreate()
     memset(so, 0, sizeof(struct socket));
     so->so_state = SS_NOFDREF;
     so->s = -1;
+    so->so_evfd = -1;
+    so->so_evslot = -1;
   }
   return(so);
 }
@@ -85,6 +87,8 @@ sofree(so)
   if(so->so_next && so->so_prev) 
     remque(so);  /* crashes if so is not in a queue */
 
+  slirp_unwatch(so);
+
   free(so);
 }
 
@@ -564,12 +568,13 @@ solisten(port, laddr, lport, flags)
 		return NULL;
 	}
 	insque(so,&tcb);
+	slirp_rewatch(so);
 	
 	/* 
 	 * SS_FACCEPTONCE sockets must time out.
 	 */
 	if (flags & SS_FACCEPTONCE)
-	   so->so_tcpcb->t_timer[TCPT_KEEP] = TCPTV_KEEP_INIT*2;
+	   TCPT_ARM(so->so_tcpcb, TCPT_KEEP, TCPTV_KEEP_INIT*2);
 	
 	so->so_state = (SS_FACCEPTCONN|flags);
 	so->so_lport = lport; /* Kept in network format */
@@ -662,9 +667,7 @@ sofcantrcvmore(so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
 		shutdown(so->s,0);
-		if(global_writefds) {
-		  FD_CLR(so->s,global_writefds);
-		}
+		so->so_revents &= ~SO_EV_OUT;
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTSENDMORE)
@@ -679,12 +682,7 @@ sofcantsendmore(so)
 {
 	if ((so->so_state & SS_NOFDREF) == 0) {
             shutdown(so->s,1);           /* send FIN to fhost */
-            if (global_readfds) {
-                FD_CLR(so->s,global_readfds);
-            }
-            if (global_xfds) {
-                FD_CLR(so->s,global_xfds);
-            }
+            so->so_revents &= ~(SO_EV_IN|SO_EV_PRI);
 	}
 	so->so_state &= ~(SS_ISFCONNECTING);
 	if (so->so_state & SS_FCANTRCVMORE)
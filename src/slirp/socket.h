@@ -51,8 +51,21 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  int	so_evfd;		/* Descriptor registered with the poll backend, or -1 */
+  int	so_evslot;		/* Slot in the poll backend's arrays, or -1 */
+  int	so_events;		/* Events registered, SO_EV_* below */
+  int	so_revents;		/* Events to handle in this poll round */
+  int	so_rewatch;		/* Queued by slirp_rewatch() */
 };
 
+/*
+ * Socket events for the poll loop in slirp.c
+ */
+#define SO_EV_IN		0x1	/* Readable or accepting */
+#define SO_EV_OUT		0x2	/* Writable or connected */
+#define SO_EV_PRI		0x4	/* Urgent data */
+
 
 /*
  * Socket state bits. (peer means the host on the Internet,
@@ -90,7 +90,7 @@ tcp_output(tp)
 	 * to send, then transmit; otherwise, investigate further.
 	 */
 	idle = (tp->snd_max == tp->snd_una);
-	if (idle && tp->t_idle >= tp->t_rxtcur)
+	if (idle && TCP_IDLE(tp) >= tp->t_rxtcur)
 		/*
 		 * We have been idle for "a while" and no acks are
 		 * expected to clock out any data we send --
@@ -134,7 +134,7 @@ again:
 				flags &= ~TH_FIN;
 			win = 1;
 		} else {
-			tp->t_timer[TCPT_PERSIST] = 0;
+			TCPT_STOP(tp, TCPT_PERSIST);
 			tp->t_rxtshift = 0;
 		}
 	}
@@ -154,7 +154,7 @@ again:
 		 */
 		len = 0;
 		if (win == 0) {
-			tp->t_timer[TCPT_REXMT] = 0;
+			TCPT_STOP(tp, TCPT_REXMT);
 			tp->snd_nxt = tp->snd_una;
 		}
 	}
@@ -254,8 +254,8 @@ again:
 	 * if window is nonzero, transmit what we can,
 	 * otherwise force out a byte.
 	 */
-	if (so->so_snd.sb_cc && tp->t_timer[TCPT_REXMT] == 0 &&
-	    tp->t_timer[TCPT_PERSIST] == 0) {
+	if (so->so_snd.sb_cc && !TCPT_ISSET(tp, TCPT_REXMT) &&
+	    !TCPT_ISSET(tp, TCPT_PERSIST)) {
 		tp->t_rxtshift = 0;
 		tcp_setpersist(tp);
 	}
@@ -425,7 +425,7 @@ send:
 	 * case, since we know we aren't doing a retransmission.
 	 * (retransmit and persist are mutually exclusive...)
 	 */
-	if (len || (flags & (TH_SYN|TH_FIN)) || tp->t_timer[TCPT_PERSIST])
+	if (len || (flags & (TH_SYN|TH_FIN)) || TCPT_ISSET(tp, TCPT_PERSIST))
 		ti->ti_seq = htonl(tp->snd_nxt);
 	else
 		ti->ti_seq = htonl(tp->snd_max);
@@ -476,7 +476,7 @@ send:
 	 * In transmit state, time the transmission and arrange for
 	 * the retransmit.  In persist state, just set snd_max.
 	 */
-	if (tp->t_force == 0 || tp->t_timer[TCPT_PERSIST] == 0) {
+	if (tp->t_force == 0 || !TCPT_ISSET(tp, TCPT_PERSIST)) {
 		tcp_seq startseq = tp->snd_nxt;
 
 		/*
@@ -497,8 +497,8 @@ send:
 			 * Time this transmission if not a retransmission and
 			 * not currently timing anything.
 			 */
-			if (tp->t_rtt == 0) {
-				tp->t_rtt = 1;
+			if (tp->t_rtttime == 0) {
+				tp->t_rtttime = tcp_now;
 				tp->t_rtseq = startseq;
 				tcpstat.tcps_segstimed++;
 			}
@@ -512,11 +512,11 @@ send:
 		 * Initialize shift counter which is used for backoff
 		 * of retransmit time.
 		 */
-		if (tp->t_timer[TCPT_REXMT] == 0 &&
+		if (!TCPT_ISSET(tp, TCPT_REXMT) &&
 		    tp->snd_nxt != tp->snd_una) {
-			tp->t_timer[TCPT_REXMT] = tp->t_rxtcur;
-			if (tp->t_timer[TCPT_PERSIST]) {
-				tp->t_timer[TCPT_PERSIST] = 0;
+			TCPT_ARM(tp, TCPT_REXMT, tp->t_rxtcur);
+			if (TCPT_ISSET(tp, TCPT_PERSIST)) {
+				TCPT_STOP(tp, TCPT_PERSIST);
 				tp->t_rxtshift = 0;
 			}
 		}
@@ -590,6 +590,7 @@ tcp_setpersist(tp)
 	register struct tcpcb *tp;
 {
     int t = ((tp->t_srtt >> 2) + tp->t_rttvar) >> 1;
+    int persist;
 
 /*	if (tp->t_timer[TCPT_REXMT])
  *		panic("tcp_output REXMT");
@@ -597,9 +598,10 @@ tcp_setpersist(tp)
 	/*
 	 * Start/restart persistence timer.
 	 */
-	TCPT_RANGESET(tp->t_timer[TCPT_PERSIST],
+	TCPT_RANGESET(persist,
 	    t * tcp_backoff[tp->t_rxtshift],
 	    TCPTV_PERSMIN, TCPTV_PERSMAX);
+	TCPT_ARM(tp, TCPT_PERSIST, persist);
 	if (tp->t_rxtshift < TCP_MAXRXTSHIFT)
 		tp->t_rxtshift++;
 }
@@ -85,7 +85,7 @@ tcp_template(tp)
 	struct socket *so = tp->t_socket;
 	register struct tcpiphdr *n = &tp->t_template;
 
-	n->ti_next = n->ti_prev = 0;
+	memset(&n->ti_i.ih_mbuf, 0, sizeof(struct mbuf_ptr));
 	n->ti_x1 = 0;
 	n->ti_pr = IPPROTO_TCP;
 	n->ti_len = htons(sizeof (struct tcpiphdr) - sizeof (struct ip));
@@ -168,7 +168,7 @@ tcp_respond(tp, ti, m, ack, seq, flags)
 	tlen += sizeof (struct tcpiphdr);
 	m->m_len = tlen;
 
-	ti->ti_next = ti->ti_prev = 0;
+	memset(&ti->ti_i.ih_mbuf, 0, sizeof(struct mbuf_ptr));
 	ti->ti_x1 = 0;
 	ti->ti_seq = htonl(seq);
 	ti->ti_ack = htonl(ack);
@@ -208,11 +208,12 @@ tcp_newtcpcb(so)
 		return ((struct tcpcb *)0);
 	
 	memset((char *) tp, 0, sizeof(struct tcpcb));
-	tp->seg_next = tp->seg_prev = (tcpiphdrp_32)tp;
+	tp->seg_link.next = tp->seg_link.prev = &tp->seg_link;
 	tp->t_maxseg = tcp_mssdflt;
 	
 	tp->t_flags = tcp_do_rfc1323 ? (TF_REQ_SCALE|TF_REQ_TSTMP) : 0;
 	tp->t_socket = so;
+	tp->t_rcvtime = tcp_now;
 	
 	/*
 	 * Init srtt to TCPTV_SRTTBASE (0), so we can tell that we have no
@@ -284,17 +285,18 @@ tcp_close(tp)
 	DEBUG_ARG("tp = %lx", (long )tp);
 	
 	/* free the reassembly queue, if any */
-	t = (struct tcpiphdr *) tp->seg_next;
-	while (t != (struct tcpiphdr *)tp) {
-		t = (struct tcpiphdr *)t->ti_next;
-		m = (struct mbuf *) REASS_MBUF((struct tcpiphdr *)t->ti_prev);
-		remque_32((struct tcpiphdr *) t->ti_prev);
+	t = tcpfrag_list_first(tp);
+	while (!tcpfrag_list_end(t, tp)) {
+		t = tcpiphdr_next(t);
+		m = REASS_MBUF(tcpiphdr_prev(t));
+		remque(tcpiphdr2qlink(tcpiphdr_prev(t)));
 		m_freem(m);
 	}
 	/* It's static */
 /*	if (tp->t_template)
  *		(void) m_free(dtom(tp->t_template));
  */
+	tcp_detachtimers(tp);
 /*	free(tp, M_PCB);  */
 	free(tp);
 	so->so_tcpcb = 0;
@@ -532,7 +534,7 @@ tcp_connect(inso)
 	tcpstat.tcps_connattempt++;
 	
 	tp->t_state = TCPS_SYN_SENT;
-	tp->t_timer[TCPT_KEEP] = TCPTV_KEEP_INIT;
+	TCPT_ARM(tp, TCPT_KEEP, TCPTV_KEEP_INIT);
 	tp->iss = tcp_iss; 
 	tcp_iss += TCP_ISSINCR/2;
 	tcp_sendseqinit(tp);
@@ -550,6 +552,7 @@ tcp_attach(so)
 	   return -1;
 	
 	insque(so, &tcb);
+	slirp_rewatch(so);
 
 	return 0;
 }
@@ -861,7 +864,7 @@ tcp_emu(so, m)
 				tcpstat.tcps_connattempt++;
 					
 				tp->t_state = TCPS_SYN_SENT;
-				tp->t_timer[TCPT_KEEP] = TCPTV_KEEP_INIT;
+				TCPT_ARM(tp, TCPT_KEEP, TCPTV_KEEP_INIT);
 				tp->iss = tcp_iss; 
 				tcp_iss += TCP_ISSINCR/2;
 				tcp_sendseqinit(tp);
@@ -42,7 +42,83 @@ int	tcp_maxidle;
 int	so_options = DO_KEEPALIVE;
 
 struct   tcpstat tcpstat;        /* tcp statistics */
-u_int32_t        tcp_now;                /* for RFC 1323 timestamps */
+u_int32_t        tcp_now = 1;            /* for RFC 1323 timestamps, 0 is never used */
+
+static struct tcpcb *tcp_wheel[TCP_WHEEL_SIZE];	/* tcpcb's by earliest timer deadline */
+static struct tcpcb *tcp_delacks;		/* tcpcb's waiting for a delayed ack */
+
+#define	TCP_TIME_LEQ(a, b)	((int)((a) - (b)) <= 0)
+
+/*
+ * Put tp into the timer wheel slot of its earliest timer,
+ * or take it out if no timer is set.
+ */
+static void
+tcp_wheel_update(tp)
+	register struct tcpcb *tp;
+{
+	register struct tcpcb **slot;
+	u_int32_t expire = 0;
+	register int i;
+
+	for (i = 0; i < TCPT_NTIMERS; i++)
+		if (tp->t_timer[i] && (expire == 0 || TCP_TIME_LEQ(tp->t_timer[i], expire)))
+			expire = tp->t_timer[i];
+	if (expire == tp->t_wexpire)
+		return;
+
+	if (tp->t_wprev) {
+		if (tp->t_wnext)
+			tp->t_wnext->t_wprev = tp->t_wprev;
+		*tp->t_wprev = tp->t_wnext;
+		tp->t_wprev = NULL;
+	}
+	tp->t_wexpire = expire;
+	if (expire) {
+		slot = &tcp_wheel[expire & (TCP_WHEEL_SIZE - 1)];
+		tp->t_wnext = *slot;
+		if (*slot)
+			(*slot)->t_wprev = &tp->t_wnext;
+		tp->t_wprev = slot;
+		*slot = tp;
+	}
+}
+
+/*
+ * Set timer to expire after ticks slow ticks, 0 stops it.
+ */
+void
+tcp_settimer(tp, timer, ticks)
+	register struct tcpcb *tp;
+	int timer, ticks;
+{
+	u_int32_t expire = 0;
+
+	if (ticks > 0) {
+		expire = tcp_now + ticks;
+		if (expire == 0)
+			expire = 1;
+	}
+	tp->t_timer[timer] = expire;
+	tcp_wheel_update(tp);
+}
+
+/*
+ * Ask for a delayed ack, sent by the next tcp_fasttimo()
+ */
+void
+tcp_delack(tp)
+	register struct tcpcb *tp;
+{
+	tp->t_flags |= TF_DELACK;
+	if ((tp->t_flags & TF_DELACKQ) == 0) {
+		tp->t_flags |= TF_DELACKQ;
+		tp->t_dnext = tcp_delacks;
+		tcp_delacks = tp;
+	}
+	if (time_fasttimo == 0)
+		time_fasttimo = curtime; /* Flag when we want a fasttimo */
+}
 
 /*
  * Fast timeout routine for processing delayed acks
@@ -50,68 +126,96 @@ u_int32_t        tcp_now;                /* for RFC 1323 timestamps */
 void
 tcp_fasttimo()
 {
-	register struct socket *so;
 	register struct tcpcb *tp;
 
 	DEBUG_CALL("tcp_fasttimo");
 	
-	so = tcb.so_next;
-	if (so)
-	for (; so != &tcb; so = so->so_next)
-		if ((tp = (struct tcpcb *)so->so_tcpcb) &&
-		    (tp->t_flags & TF_DELACK)) {
+	while ((tp = tcp_delacks) != NULL) {
+		tcp_delacks = tp->t_dnext;
+		tp->t_flags &= ~TF_DELACKQ;
+		if (tp->t_flags & TF_DELACK) {
 			tp->t_flags &= ~TF_DELACK;
 			tp->t_flags |= TF_ACKNOW;
 			tcpstat.tcps_delack++;
 			(void) tcp_output(tp);
 		}
+	}
 }
 
 /*
- * Tcp protocol timeout routine called every 500 ms.
- * Updates the timers in all active tcb's and
- * causes finite state machine actions if timers expire.
+ * Tcp protocol timeout routine called every slow tick.
+ * Runs the timers which expire in this tick, the
+ * connections are found in the current timer wheel slot.
  */
 void
 tcp_slowtimo()
 {
-	register struct socket *ip, *ipnxt;
 	register struct tcpcb *tp;
+	struct tcpcb **slot;
 	register int i;
 
 	DEBUG_CALL("tcp_slowtimo");
 	
 	tcp_maxidle = TCPTV_KEEPCNT * tcp_keepintvl;
+	tcp_iss += TCP_ISSINCR/PR_SLOWHZ;		/* increment iss */
+#ifdef TCP_COMPAT_42
+	if ((int)tcp_iss < 0)
+		tcp_iss = 0;				/* XXX */
+#endif
+	if (++tcp_now == 0)				/* for timestamps */
+		tcp_now = 1;
+
 	/*
-	 * Search through tcb's and update active timers.
+	 * The slot also holds tcpcb's due in later rounds of the wheel.
+	 * tcp_timers() may rearm timers or close the connection, so
+	 * start over after each tcpcb handled.
 	 */
-	ip = tcb.so_next;
-	if (ip == 0)
-	   return;
-	for (; ip != &tcb; ip = ipnxt) {
-		ipnxt = ip->so_next;
-		tp = sototcpcb(ip);
-		if (tp == 0)
+	slot = &tcp_wheel[tcp_now & (TCP_WHEEL_SIZE - 1)];
+again:
+	for (tp = *slot; tp; tp = tp->t_wnext) {
+		if (!TCP_TIME_LEQ(tp->t_wexpire, tcp_now))
 			continue;
 		for (i = 0; i < TCPT_NTIMERS; i++) {
-			if (tp->t_timer[i] && --tp->t_timer[i] == 0) {
-				tcp_timers(tp,i);
-				if (ipnxt->so_prev != ip)
-					goto tpgone;
+			if (tp->t_timer[i] && TCP_TIME_LEQ(tp->t_timer[i], tcp_now)) {
+				tp->t_timer[i] = 0;
+				slirp_rewatch(tp->t_socket);
+				if (tcp_timers(tp,i) == NULL)
+					goto again;
 			}
 		}
-		tp->t_idle++;
-		if (tp->t_rtt)
-		   tp->t_rtt++;
-tpgone:
-		;
+		tcp_wheel_update(tp);
+		goto again;
 	}
-	tcp_iss += TCP_ISSINCR/PR_SLOWHZ;		/* increment iss */
-#ifdef TCP_COMPAT_42
-	if ((int)tcp_iss < 0)
-		tcp_iss = 0;				/* XXX */
-#endif
-	tcp_now++;					/* for timestamps */
+}
+
+/*
+ * Advance the slow tick count by ticks without looking at the timer
+ * wheel, when the caller has been away for more than a wheel round.
+ * Timers due meanwhile go off in the next round.
+ */
+void
+tcp_skiptimo(ticks)
+	int ticks;
+{
+	tcp_iss += ticks * (TCP_ISSINCR/PR_SLOWHZ);
+	tcp_now += ticks;
+	if (tcp_now == 0)
+		tcp_now = 1;
+}
+
+/*
+ * Number of slow ticks until the next timer wheel slot with tcpcb's
+ * in it, or -1 if no timer is set
+ */
+int
+tcp_nexttimo()
+{
+	register int i;
+
+	for (i = 1; i <= TCP_WHEEL_SIZE; i++)
+		if (tcp_wheel[(tcp_now + i) & (TCP_WHEEL_SIZE - 1)])
+			return i;
+	return -1;
 }
 
 /*
@@ -125,6 +229,27 @@ tcp_canceltimers(tp)
 
 	for (i = 0; i < TCPT_NTIMERS; i++)
 		tp->t_timer[i] = 0;
+	tcp_wheel_update(tp);
+}
+
+/*
+ * Remove tp from the timer wheel and the delayed ack list before it is freed.
+ */
+void
+tcp_detachtimers(tp)
+	struct tcpcb *tp;
+{
+	register struct tcpcb **p;
+
+	tcp_canceltimers(tp);
+	if (tp->t_flags & TF_DELACKQ) {
+		for (p = &tcp_delacks; *p; p = &(*p)->t_dnext)
+			if (*p == tp) {
+				*p = tp->t_dnext;
+				break;
+			}
+		tp->t_flags &= ~TF_DELACKQ;
+	}
 }
 
 int	tcp_backoff[TCP_MAXRXTSHIFT + 1] =
@@ -152,8 +277,8 @@ tcp_timers(tp, timer)
 	 */
 	case TCPT_2MSL:
 		if (tp->t_state != TCPS_TIME_WAIT &&
-		    tp->t_idle <= tcp_maxidle)
-			tp->t_timer[TCPT_2MSL] = tcp_keepintvl;
+		    TCP_IDLE(tp) <= tcp_maxidle)
+			TCPT_ARM(tp, TCPT_2MSL, tcp_keepintvl);
 		else
 			tp = tcp_close(tp);
 		break;
@@ -208,7 +333,7 @@ tcp_timers(tp, timer)
 		rexmt = TCP_REXMTVAL(tp) * tcp_backoff[tp->t_rxtshift];
 		TCPT_RANGESET(tp->t_rxtcur, rexmt,
 		    (short)tp->t_rttmin, TCPTV_REXMTMAX); /* XXX */
-		tp->t_timer[TCPT_REXMT] = tp->t_rxtcur;
+		TCPT_ARM(tp, TCPT_REXMT, tp->t_rxtcur);
 		/*
 		 * If losing, let the lower level know and try for
 		 * a better route.  Also, if we backed off this far,
@@ -226,7 +351,7 @@ tcp_timers(tp, timer)
 		/*
 		 * If timing a segment in this window, stop the timer.
 		 */
-		tp->t_rtt = 0;
+		tp->t_rtttime = 0;
 		/*
 		 * Close the congestion window down to one segment
 		 * (we'll open it by one segment for each ack we get).
@@ -285,7 +410,7 @@ tcp_timers(tp, timer)
 
 /*		if (tp->t_socket->so_options & SO_KEEPALIVE && */
 		if ((so_options) && tp->t_state <= TCPS_CLOSE_WAIT) {
-		    	if (tp->t_idle >= tcp_keepidle + tcp_maxidle)
+		    	if (TCP_IDLE(tp) >= tcp_keepidle + tcp_maxidle)
 				goto dropit;
 			/*
 			 * Send a packet designed to force a response
@@ -311,9 +436,9 @@ tcp_timers(tp, timer)
 			tcp_respond(tp, &tp->t_template, (struct mbuf *)NULL,
 			    tp->rcv_nxt, tp->snd_una - 1, 0);
 #endif
-			tp->t_timer[TCPT_KEEP] = tcp_keepintvl;
+			TCPT_ARM(tp, TCPT_KEEP, tcp_keepintvl);
 		} else
-			tp->t_timer[TCPT_KEEP] = tcp_keepidle;
+			TCPT_ARM(tp, TCPT_KEEP, tcp_keepidle);
 		break;
 
 	dropit:
@@ -38,11 +38,16 @@
 #define _TCP_TIMER_H_
 
 /*
- * Definitions of the TCP timers.  These timers are counted
- * down PR_SLOWHZ times a second.
+ * Definitions of the TCP timers.  These timers expire after a number
+ * of slow ticks, which happen PR_SLOWHZ times a second.  They are kept
+ * as deadlines in tcp_now ticks, and every tcpcb with a timer set is
+ * hashed into a timer wheel slot by its earliest deadline, so a slow
+ * tick only visits the connections which have a timer due.
  */
 #define	TCPT_NTIMERS	4
 
+#define	TCP_WHEEL_SIZE	256		/* timer wheel slots (power of 2) */
+
 #define	TCPT_REXMT	0		/* retransmit */
 #define	TCPT_PERSIST	1		/* retransmit persistence */
 #define	TCPT_KEEP	2		/* keep alive */
@@ -118,6 +123,17 @@ char *tcptimers[] =
 /*
  * Force a time value to be in a certain range.
  */
+#define	TCPT_ISSET(tp, timer)		((tp)->t_timer[timer] != 0)
+#define	TCPT_ARM(tp, timer, ticks)	tcp_settimer((tp), (timer), (ticks))
+#define	TCPT_STOP(tp, timer)		tcp_settimer((tp), (timer), 0)
+
+/*
+ * Slow ticks since the last segment was received, and the round trip
+ * time in ticks (starting at 1) of the segment being timed.
+ */
+#define	TCP_IDLE(tp)	((int)(tcp_now - (tp)->t_rcvtime))
+#define	TCP_RTT(tp)	((short)(tcp_now - (tp)->t_rtttime + 1))
+
 #define	TCPT_RANGESET(tv, value, tvmin, tvmax) { \
 	(tv) = (value); \
 	if ((tv) < (tvmin)) \
@@ -136,7 +152,12 @@ struct tcpcb;
 
 void tcp_fasttimo _P((void));
 void tcp_slowtimo _P((void));
+void tcp_skiptimo _P((int));
+int tcp_nexttimo _P((void));
+void tcp_settimer _P((struct tcpcb *, int, int));
+void tcp_delack _P((struct tcpcb *));
 void tcp_canceltimers _P((struct tcpcb *));
+void tcp_detachtimers _P((struct tcpcb *));
 struct tcpcb * tcp_timers _P((register struct tcpcb *, int));
 
 #endif
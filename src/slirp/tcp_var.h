@@ -40,20 +40,17 @@
 #include "tcpip.h"
 #include "tcp_timer.h"
 
-#if SIZEOF_CHAR_P == 4
- typedef struct tcpiphdr *tcpiphdrp_32;
-#else
- typedef u_int32_t tcpiphdrp_32;
-#endif
-
 /*
  * Tcp control block, one per tcp; fields:
  */
 struct tcpcb {
-	tcpiphdrp_32 seg_next;	/* sequencing queue */
-	tcpiphdrp_32 seg_prev;
+	struct	qlink seg_link;		/* sequencing queue */
 	short	t_state;		/* state of this connection */
-	short	t_timer[TCPT_NTIMERS];	/* tcp timers */
+	u_int32_t t_timer[TCPT_NTIMERS];	/* tcp timer deadlines (tcp_now), 0 = off */
+	u_int32_t t_wexpire;		/* earliest deadline, 0 = not on timer wheel */
+	struct	tcpcb *t_wnext;		/* next tcpcb in timer wheel slot */
+	struct	tcpcb **t_wprev;	/* link pointing to this tcpcb */
+	struct	tcpcb *t_dnext;		/* next tcpcb waiting for a delayed ack */
 	short	t_rxtshift;		/* log(2) of rexmt exp. backoff */
 	short	t_rxtcur;		/* current retransmit value */
 	short	t_dupacks;		/* consecutive dup acks recd */
@@ -70,6 +67,7 @@ struct tcpcb {
 #define	TF_REQ_TSTMP	0x0080		/* have/will request timestamps */
 #define	TF_RCVD_TSTMP	0x0100		/* a timestamp was received in SYN */
 #define	TF_SACK_PERMIT	0x0200		/* other side said I could SACK */
+#define	TF_DELACKQ	0x0400		/* on delayed ack list */
 
 	/* Make it static  for now */
 /*	struct	tcpiphdr *t_template;	/ * skeletal packet for transmit */
@@ -112,8 +110,8 @@ struct tcpcb {
  * transmit timing stuff.  See below for scale of srtt and rttvar.
  * "Variance" is actually smoothed difference.
  */
-	short	t_idle;			/* inactivity time */
-	short	t_rtt;			/* round trip time */
+	u_int32_t t_rcvtime;		/* tcp_now of last segment received */
+	u_int32_t t_rtttime;		/* tcp_now when timing started, 0 = not timing */
 	tcp_seq	t_rtseq;		/* sequence number being timed */
 	short	t_srtt;			/* smoothed round-trip time */
 	short	t_rttvar;		/* variance in round-trip time */
@@ -174,16 +172,11 @@ struct tcpcb {
  * We want to avoid doing m_pullup on incoming packets but that
  * means avoiding dtom on the tcp reassembly code.  That in turn means
  * keeping an mbuf pointer in the reassembly queue (since we might
- * have a cluster).  As a quick hack, the source & destination
- * port numbers (which are no longer needed once we've located the
- * tcpcb) are overlayed with an mbuf pointer.
+ * have a cluster).  The mbuf pointer takes the place of the former
+ * queue links at the start of the overlaid ip header, which is no
+ * longer needed once the checksum is verified.
  */
-#if SIZEOF_CHAR_P == 4
-typedef struct mbuf *mbufp_32;
-#else
-typedef u_int32_t mbufp_32;
-#endif
-#define REASS_MBUF(ti) (*(mbufp_32 *)&((ti)->ti_t))
+#define REASS_MBUF(ti) ((ti)->ti_mbuf)
 
 /*
  * TCP statistics.
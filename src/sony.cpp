@@ -44,6 +44,8 @@ using std::vector;
 #include "sys.h"
 #include "prefs.h"
 #include "sony.h"
+#include "async_io.h"
+#include "disk_trace.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -266,6 +268,7 @@ int16 SonyOpen(uint32 pb, uint32 dce)
 	WriteMacInt32(dce + dCtlPosition, 0);
 	WriteMacInt16(dce + dCtlQHdr + qFlags, ReadMacInt16(dce + dCtlQHdr + qFlags) & 0xff00 | 3);	// Version number, must be >=3 or System 8 will replace us
 	acc_run_called = false;
+	AsyncIOInstall();
 
 	// Install driver again with refnum -2 (HD20)
 	uint32 utab = ReadMacInt32(0x11c);
@@ -329,6 +332,25 @@ int16 SonyOpen(uint32 pb, uint32 dce)
  *  Driver Prime() routine
  */
 
+// Check result of read/write and update ParamBlock and DCE
+static int16 sony_prime_done(uint32 pb, uint32 dce, void *buffer, size_t length, size_t actual, bool write)
+{
+	if (actual != length)
+		return set_dsk_err(write ? writErr : readErr);
+
+	if (!write) {
+
+		// Clear TagBuf
+		WriteMacInt32(0x2fc, 0);
+		WriteMacInt32(0x300, 0);
+		WriteMacInt32(0x304, 0);
+	}
+
+	WriteMacInt32(pb + ioActCount, actual);
+	WriteMacInt32(dce + dCtlPosition, ReadMacInt32(dce + dCtlPosition) + actual);
+	return set_dsk_err(noErr);
+}
+
 int16 SonyPrime(uint32 pb, uint32 dce)
 {
 	WriteMacInt32(pb + ioActCount, 0);
@@ -348,33 +370,31 @@ int16 SonyPrime(uint32 pb, uint32 dce)
 	if ((length & 0x1ff) || (position & 0x1ff))
 		return set_dsk_err(paramErr);
 
+	bool write = (ReadMacInt16(pb + ioTrap) & 0xff) != aRdCmd;
+	if (write && info->read_only)
+		return set_dsk_err(wPrErr);
+
+	// Asynchronous request? Then hand it to the I/O thread
+	if (AsyncIOPrime(pb, dce, info->fh, buffer, position, length, write, sony_prime_done))
+		return ioInProgress;
+
+	uint64 start = DiskTraceStart();
 	size_t actual = 0;
-	if ((ReadMacInt16(pb + ioTrap) & 0xff) == aRdCmd) {
+	if (!write) {
 
 		// Read
 		actual = Sys_read(info->fh, buffer, position, length);
-		if (actual != length)
-			return set_dsk_err(readErr);
-
-		// Clear TagBuf
-		WriteMacInt32(0x2fc, 0);
-		WriteMacInt32(0x300, 0);
-		WriteMacInt32(0x304, 0);
 
 	} else {
 
 		// Write
-		if (info->read_only)
-			return set_dsk_err(wPrErr);
 		actual = Sys_write(info->fh, buffer, position, length);
-		if (actual != length)
-			return set_dsk_err(writErr);
 	}
 
+	DiskTrace(pb, dce, position, length, actual, write, false, start);
+
 	// Update ParamBlock and DCE
-	WriteMacInt32(pb + ioActCount, actual);
-	WriteMacInt32(dce + dCtlPosition, ReadMacInt32(dce + dCtlPosition) + actual);
-	return set_dsk_err(noErr);
+	return sony_prime_done(pb, dce, buffer, length, actual, write);
 }
 
 
@@ -420,6 +440,7 @@ int16 SonyControl(uint32 pb, uint32 dce)
 			if (info->read_only)
 				err = wPrErr;
 			else if (ReadMacInt8(info->status + dsDiskInPlace) > 0) {
+				AsyncIODrain();
 				if (!SysFormat(info->fh))
 					err = writErr;
 			} else
@@ -428,6 +449,7 @@ int16 SonyControl(uint32 pb, uint32 dce)
 
 		case 7:		// Eject
 			if (ReadMacInt8(info->status + dsDiskInPlace) > 0) {
+				AsyncIODrain();
 				SysEject(info->fh);
 				WriteMacInt8(info->status + dsDiskInPlace, 0);
 			}
@@ -54,10 +54,49 @@ struct TMDesc {
 	uint32 task;		// Mac address of associated TMTask
 	tm_time_t wakeup;	// Time this task is scheduled for execution
 	bool in_use;		// Flag: descriptor in use
+	int heap_pos;		// Position in wakeup queue (-1 = not scheduled)
+	int next;			// Next descriptor in hash chain or free list (-1 = end)
 };
 
 const int NUM_DESCS = 64;		// Maximum number of descriptors
 static TMDesc desc[NUM_DESCS];
+static int free_descs;			// Head of free descriptor list
+
+// Hash table for finding the descriptor of a TMTask
+const int DESC_HASH_SIZE = 128;	// Must be a power of two
+static int desc_hash[DESC_HASH_SIZE];
+
+// Wakeup queue: binary min-heap of descriptor indices, ordered by wakeup time
+static int wakeup_queue[NUM_DESCS];
+static int num_queued;
+
+
+/*
+ *  Hash TMTask address
+ */
+
+static inline int hash_tm(uint32 tm)
+{
+	return ((tm >> 1) * 2654435761U) >> 25;
+}
+
+
+/*
+ *  Reset descriptor list, hash table and wakeup queue
+ */
+
+static void reset_descs(void)
+{
+	for (int i=0; i<NUM_DESCS; i++) {
+		desc[i].in_use = false;
+		desc[i].heap_pos = -1;
+		desc[i].next = i + 1 < NUM_DESCS ? i + 1 : -1;
+	}
+	free_descs = 0;
+	for (int i=0; i<DESC_HASH_SIZE; i++)
+		desc_hash[i] = -1;
+	num_queued = 0;
+}
 
 
 /*
@@ -66,14 +105,21 @@ static TMDesc desc[NUM_DESCS];
 
 static int alloc_desc(uint32 tm)
 {
-	// Search for first free descriptor
-	for (int i=0; i<NUM_DESCS; i++)
-		if (!desc[i].in_use) {
-			desc[i].task = tm;
-			desc[i].in_use = true;
-			return i;
-		}
-	return -1;
+	// Take first free descriptor
+	int i = free_descs;
+	if (i < 0)
+		return -1;
+	free_descs = desc[i].next;
+
+	desc[i].task = tm;
+	desc[i].in_use = true;
+	desc[i].heap_pos = -1;
+
+	// Link into hash chain
+	int h = hash_tm(tm);
+	desc[i].next = desc_hash[h];
+	desc_hash[h] = i;
+	return i;
 }
 
 
@@ -81,9 +127,18 @@ static int alloc_desc(uint32 tm)
  *  Free descriptor in list
  */
 
-inline static void free_desc(int i)
+static void free_desc(int i)
 {
+	// Unlink from hash chain
+	int *p = &desc_hash[hash_tm(desc[i].task)];
+	while (*p != i)
+		p = &desc[*p].next;
+	*p = desc[i].next;
+
+	// Put on free list
 	desc[i].in_use = false;
+	desc[i].next = free_descs;
+	free_descs = i;
 }
 
 
@@ -91,15 +146,101 @@ inline static void free_desc(int i)
  *  Find descriptor associated with given TMTask
  */
 
-inline static int find_desc(uint32 tm)
+static inline int find_desc(uint32 tm)
 {
-	for (int i=0; i<NUM_DESCS; i++)
-		if (desc[i].in_use && desc[i].task == tm)
+	for (int i=desc_hash[hash_tm(tm)]; i>=0; i=desc[i].next)
+		if (desc[i].task == tm)
 			return i;
 	return -1;
 }
 
 
+/*
+ *  Wakeup queue management
+ */
+
+static inline bool wakes_before(int i, int j)
+{
+	return timer_cmp_time(desc[i].wakeup, desc[j].wakeup) < 0;
+}
+
+static inline void queue_place(int pos, int i)
+{
+	wakeup_queue[pos] = i;
+	desc[i].heap_pos = pos;
+}
+
+static void queue_sift_up(int pos)
+{
+	int i = wakeup_queue[pos];
+	while (pos > 0) {
+		int parent = (pos - 1) / 2;
+		if (!wakes_before(i, wakeup_queue[parent]))
+			break;
+		queue_place(pos, wakeup_queue[parent]);
+		pos = parent;
+	}
+	queue_place(pos, i);
+}
+
+static void queue_sift_down(int pos)
+{
+	int i = wakeup_queue[pos];
+	for (;;) {
+		int child = 2 * pos + 1;
+		if (child >= num_queued)
+			break;
+		if (child + 1 < num_queued && wakes_before(wakeup_queue[child + 1], wakeup_queue[child]))
+			child++;
+		if (!wakes_before(wakeup_queue[child], i))
+			break;
+		queue_place(pos, wakeup_queue[child]);
+		pos = child;
+	}
+	queue_place(pos, i);
+}
+
+// Remove descriptor from wakeup queue (if queued)
+static void dequeue_desc(int i)
+{
+	int pos = desc[i].heap_pos;
+	if (pos < 0)
+		return;
+	desc[i].heap_pos = -1;
+	int last = wakeup_queue[--num_queued];
+	if (last != i) {
+		queue_place(pos, last);
+		if (pos > 0 && wakes_before(last, wakeup_queue[(pos - 1) / 2]))
+			queue_sift_up(pos);
+		else
+			queue_sift_down(pos);
+	}
+}
+
+// Insert descriptor into wakeup queue, or move it if already queued
+static void enqueue_desc(int i)
+{
+	dequeue_desc(i);
+	queue_place(num_queued, i);
+	queue_sift_up(num_queued++);
+}
+
+
+/*
+ *  Tell host timer about earliest pending wakeup time
+ */
+
+static void update_wakeup(void)
+{
+#if PRECISE_TIMING
+	if (num_queued)
+		timer_wakeup_at(desc[wakeup_queue[0]].wakeup);
+	else
+		timer_wakeup_cancel();
+#endif
+}
+
+
 /*
  *  Enqueue task in Time Manager queue
  */
@@ -140,8 +281,12 @@ static void dequeue_tm(uint32 tm)
 void TimerInit(void)
 {
 	// Mark all descriptors as inactive
-	for (int i=0; i<NUM_DESCS; i++)
-		free_desc(i);
+	reset_descs();
+
+#if PRECISE_TIMING
+	// Start host wakeup timer
+	timer_wakeup_init();
+#endif
 }
 
 
@@ -151,6 +296,10 @@ void TimerInit(void)
 
 void TimerExit(void)
 {
+#if PRECISE_TIMING
+	// Stop host wakeup timer
+	timer_wakeup_exit();
+#endif
 }
 
 
@@ -161,8 +310,8 @@ void TimerExit(void)
 void TimerReset(void)
 {
 	// Mark all descriptors as inactive
-	for (int i=0; i<NUM_DESCS; i++)
-		free_desc(i);
+	reset_descs();
+	update_wakeup();
 }
 
 
@@ -216,7 +365,8 @@ int16 RmvTime(uint32 tm)
 		WriteMacInt32(tm + tmCount, 0);
 	D(bug(" tmCount %d\n", ReadMacInt32(tm + tmCount)));
 
-	// Free descriptor
+	// Free descriptor (a stale host wakeup for it is harmless)
+	dequeue_desc(i);
 	free_desc(i);
 	return 0;
 }
@@ -280,37 +430,59 @@ int16 PrimeTime(uint32 tm, int32 time)
 	// Make task active and enqueue it in the Time Manager queue
 	WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) | 0x8000);
 	enqueue_tm(tm);
+
+	// Insert into wakeup queue, rearm host timer if it is the new earliest task
+	enqueue_desc(i);
+	if (desc[i].heap_pos == 0)
+		update_wakeup();
 	return 0;
 }
 
 
 /*
- *  Timer interrupt function (executed as part of 60Hz interrupt)
+ *  Timer interrupt function (executed as part of 60Hz interrupt, and as
+ *  INTFLAG_TIMER interrupt when PRECISE_TIMING is enabled)
  */
 
 void TimerInterrupt(void)
 {
-	// Look for active TMTasks that have expired
+	// Take all TMTasks that have expired off the wakeup queue
 	tm_time_t now;
 	timer_current_time(now);
-	for (int i=0; i<NUM_DESCS; i++)
-		if (desc[i].in_use) {
-			uint32 tm = desc[i].task;
-			if ((ReadMacInt16(tm + qType) & 0x8000) && timer_cmp_time(desc[i].wakeup, now) < 0) {
-
-				// Found one, mark as inactive and remove it from the Time Manager queue
-				WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
-				dequeue_tm(tm);
-
-				// Call timer function
-				uint32 addr = ReadMacInt32(tm + tmAddr);
-				if (addr) {
-					D(bug("Calling TimeTask %08lx, addr %08lx\n", tm, addr));
-					M68kRegisters r;
-					r.a[0] = addr;
-					r.a[1] = tm;
-					Execute68k(addr, &r);
-				}
+	int expired[NUM_DESCS];
+	int num_expired = 0;
+	while (num_queued && timer_cmp_time(desc[wakeup_queue[0]].wakeup, now) < 0) {
+		int i = wakeup_queue[0];
+		dequeue_desc(i);
+		expired[num_expired++] = i;
+	}
+
+	// Call them in order of their wakeup time
+	for (int j=0; j<num_expired; j++) {
+		int i = expired[j];
+
+		// Skip tasks that were removed or re-primed by a previous task
+		if (!desc[i].in_use || desc[i].heap_pos >= 0)
+			continue;
+		uint32 tm = desc[i].task;
+		if (ReadMacInt16(tm + qType) & 0x8000) {
+
+			// Found one, mark as inactive and remove it from the Time Manager queue
+			WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
+			dequeue_tm(tm);
+
+			// Call timer function
+			uint32 addr = ReadMacInt32(tm + tmAddr);
+			if (addr) {
+				D(bug("Calling TimeTask %08lx, addr %08lx\n", tm, addr));
+				M68kRegisters r;
+				r.a[0] = addr;
+				r.a[1] = tm;
+				Execute68k(addr, &r);
 			}
 		}
+	}
+
+	// Rearm host timer for the next pending task
+	update_wakeup();
 }
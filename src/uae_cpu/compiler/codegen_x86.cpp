@@ -3983,6 +3983,7 @@ raw_init_cpu(void)
 
   /* Have CMOV support? */
   have_cmov = c->x86_hwcap & (1 << 15);
+  have_sse2 = c->x86_hwcap & (1 << 26);
 #if defined(__x86_64__)
   if (!have_cmov) {
 	  write_log("x86-64 implementations are bound to have CMOV!\n");
@@ -4147,10 +4148,17 @@ static __inline__ void usereg(int r)
 	make_tos(r);
 }
 
+static __inline__ void sse2_fpu_pop(int r);
+
 /* This is called with one FP value in a reg *above* tos, which it will
-   pop off the stack if necessary */
+   pop off the stack if necessary. With SSE2 FPU code, the value is moved
+   into the SSE register and always popped */
 static __inline__ void tos_make(int r)
 {
+    if (use_sse2_fpu) {
+	sse2_fpu_pop(r);
+	return;
+    }
     if (live.spos[r]<0) {
 	live.tos++;
 	live.spos[r]=live.tos;
@@ -4174,6 +4182,7 @@ DEFINE_OP(fstpl, FSTPDm);
 DEFINE_OP(fldl,  FLDDm);
 DEFINE_OP(fildl, FILDLm);
 DEFINE_OP(fistl, FISTLm);
+DEFINE_OP(fistpl, FISTPLm);
 DEFINE_OP(flds,  FLDSm);
 DEFINE_OP(fsts,  FSTSm);
 DEFINE_OP(fstpt, FSTPTm);
@@ -4191,6 +4200,7 @@ DEFINE_OP(fstpl, 0xdd, 0x1d);
 DEFINE_OP(fldl,  0xdd, 0x05);
 DEFINE_OP(fildl, 0xdb, 0x05);
 DEFINE_OP(fistl, 0xdb, 0x15);
+DEFINE_OP(fistpl, 0xdb, 0x1d);
 DEFINE_OP(flds,  0xd9, 0x05);
 DEFINE_OP(fsts,  0xd9, 0x15);
 DEFINE_OP(fstpt, 0xdb, 0x3d);
@@ -4198,8 +4208,35 @@ DEFINE_OP(fldt,  0xdb, 0x2d);
 #endif
 #undef DEFINE_OP
 
+/* With SSE2 FPU code, FP native register i is %xmm<i> and holds a double,
+   %xmm7 is scratch. The x87 stack stays empty between instructions, it is
+   only used to convert from and to extended precision and for constants. */
+#define SSE2_FPU_SCRATCH X86_XMM7
+
+static double sse2_fpu_temp;
+static const uae_u64 sse2_fpu_abs_mask  = UVAL64(0x7fffffffffffffff);
+static const uae_u64 sse2_fpu_sign_mask = UVAL64(0x8000000000000000);
+
+/* Move the top of the x87 stack into SSE register r and pop it */
+static __inline__ void sse2_fpu_pop(int r)
+{
+    raw_fstpl((uintptr)&sse2_fpu_temp);
+    MOVSDmr((uintptr)&sse2_fpu_temp, X86_NOREG, X86_NOREG, 1, r);
+}
+
+/* Push SSE register r onto the x87 stack */
+static __inline__ void sse2_fpu_push(int r)
+{
+    MOVSDrm(r, (uintptr)&sse2_fpu_temp, X86_NOREG, X86_NOREG, 1);
+    raw_fldl((uintptr)&sse2_fpu_temp);
+}
+
 LOWFUNC(NONE,WRITE,2,raw_fmov_mr,(MEMW m, FR r))
 {
+    if (use_sse2_fpu) {
+	MOVSDrm(r, m, X86_NOREG, X86_NOREG, 1);
+	return;
+    }
     make_tos(r);
     raw_fstl(m);
 }
@@ -4207,6 +4244,10 @@ LENDFUNC(NONE,WRITE,2,raw_fmov_mr,(MEMW m, FR r))
 
 LOWFUNC(NONE,WRITE,2,raw_fmov_mr_drop,(MEMW m, FR r))
 {
+    if (use_sse2_fpu) {
+	MOVSDrm(r, m, X86_NOREG, X86_NOREG, 1);
+	return;
+    }
     make_tos(r);
     raw_fstpl(m);
     live.onstack[live.tos]=-1;
@@ -4217,6 +4258,10 @@ LENDFUNC(NONE,WRITE,2,raw_fmov_mr,(MEMW m, FR r))
 
 LOWFUNC(NONE,READ,2,raw_fmov_rm,(FW r, MEMR m))
 {
+    if (use_sse2_fpu) {
+	MOVSDmr(m, X86_NOREG, X86_NOREG, 1, r);
+	return;
+    }
     raw_fldl(m);
     tos_make(r);
 }
@@ -4224,6 +4269,10 @@ LENDFUNC(NONE,READ,2,raw_fmov_rm,(FW r, MEMR m))
 
 LOWFUNC(NONE,READ,2,raw_fmovi_rm,(FW r, MEMR m))
 {
+    if (use_sse2_fpu) {
+	CVTSI2SDLmr(m, X86_NOREG, X86_NOREG, 1, r);
+	return;
+    }
     raw_fildl(m);
     tos_make(r);
 }
@@ -4231,6 +4280,12 @@ LENDFUNC(NONE,READ,2,raw_fmovi_rm,(FW r, MEMR m))
 
 LOWFUNC(NONE,WRITE,2,raw_fmovi_mr,(MEMW m, FR r))
 {
+    if (use_sse2_fpu) {
+	/* fistp rounds like the x87 code, cvtsd2si would need a register */
+	sse2_fpu_push(r);
+	raw_fistpl(m);
+	return;
+    }
     make_tos(r);
     raw_fistl(m);
 }
@@ -4238,6 +4293,10 @@ LENDFUNC(NONE,WRITE,2,raw_fmovi_mr,(MEMW m, FR r))
 
 LOWFUNC(NONE,READ,2,raw_fmovs_rm,(FW r, MEMR m))
 {
+    if (use_sse2_fpu) {
+	CVTSS2SDmr(m, X86_NOREG, X86_NOREG, 1, r);
+	return;
+    }
     raw_flds(m);
     tos_make(r);
 }
@@ -4245,6 +4304,11 @@ LENDFUNC(NONE,READ,2,raw_fmovs_rm,(FW r, MEMR m))
 
 LOWFUNC(NONE,WRITE,2,raw_fmovs_mr,(MEMW m, FR r))
 {
+    if (use_sse2_fpu) {
+	CVTSD2SSrr(r, SSE2_FPU_SCRATCH);
+	MOVSSrm(SSE2_FPU_SCRATCH, m, X86_NOREG, X86_NOREG, 1);
+	return;
+    }
     make_tos(r);
     raw_fsts(m);
 }
@@ -4254,6 +4318,12 @@ LOWFUNC(NONE,WRITE,2,raw_fmov_ext_mr,(MEMW m, FR r))
 {
     int rs;
 
+    if (use_sse2_fpu) {
+	sse2_fpu_push(r);
+	raw_fstpt(m);
+	return;
+    }
+
     /* Stupid x87 can't write a long double to mem without popping the 
        stack! */
     usereg(r);
@@ -4269,6 +4339,11 @@ LOWFUNC(NONE,WRITE,2,raw_fmov_ext_mr_drop,(MEMW m, FR r))
 {
     int rs;
 
+    if (use_sse2_fpu) {
+	sse2_fpu_push(r);
+	raw_fstpt(m);
+	return;
+    }
     make_tos(r);
     raw_fstpt(m);	/* store and pop it */
     live.onstack[live.tos]=-1;
@@ -4326,6 +4401,10 @@ LENDFUNC(NONE,NONE,1,raw_fmov_1,(FW r))
 
 LOWFUNC(NONE,NONE,1,raw_fmov_0,(FW r))
 {
+    if (use_sse2_fpu) {
+	XORPDrr(r, r);
+	return;
+    }
     emit_byte(0xd9);
     emit_byte(0xee);
     tos_make(r);
@@ -4336,6 +4415,11 @@ LOWFUNC(NONE,NONE,2,raw_fmov_rr,(FW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	if (d!=s)
+	    MOVAPDrr(s, d);
+	return;
+    }
     usereg(s);
     ds=stackpos(s);
     if (ds==0 && live.spos[d]>=0) {
@@ -4365,6 +4449,10 @@ LOWFUNC(NONE,NONE,2,raw_fsqrt_rr,(FW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	SQRTSDrr(s, d);
+	return;
+    }
     if (d!=s) {
 	usereg(s);
 	ds=stackpos(s);
@@ -4386,6 +4474,13 @@ LOWFUNC(NONE,NONE,2,raw_fabs_rr,(FW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	if (d!=s)
+	    MOVAPDrr(s, d);
+	MOVSDmr((uintptr)&sse2_fpu_abs_mask, X86_NOREG, X86_NOREG, 1, SSE2_FPU_SCRATCH);
+	ANDPDrr(SSE2_FPU_SCRATCH, d);
+	return;
+    }
     if (d!=s) {
 	usereg(s);
 	ds=stackpos(s);
@@ -4550,6 +4645,13 @@ LOWFUNC(NONE,NONE,2,raw_fneg_rr,(FW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	if (d!=s)
+	    MOVAPDrr(s, d);
+	MOVSDmr((uintptr)&sse2_fpu_sign_mask, X86_NOREG, X86_NOREG, 1, SSE2_FPU_SCRATCH);
+	XORPDrr(SSE2_FPU_SCRATCH, d);
+	return;
+    }
     if (d!=s) {
 	usereg(s);
 	ds=stackpos(s);
@@ -4571,6 +4673,10 @@ LOWFUNC(NONE,NONE,2,raw_fadd_rr,(FRW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	ADDSDrr(s, d);
+	return;
+    }
     usereg(s);
     usereg(d);
     
@@ -4594,6 +4700,10 @@ LOWFUNC(NONE,NONE,2,raw_fsub_rr,(FRW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	SUBSDrr(s, d);
+	return;
+    }
     usereg(s);
     usereg(d);
     
@@ -4617,6 +4727,10 @@ LOWFUNC(NONE,NONE,2,raw_fcmp_rr,(FR d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	UCOMISDrr(s, d);
+	return;
+    }
     usereg(s);
     usereg(d);
     
@@ -4632,6 +4746,10 @@ LOWFUNC(NONE,NONE,2,raw_fmul_rr,(FRW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	MULSDrr(s, d);
+	return;
+    }
     usereg(s);
     usereg(d);
     
@@ -4655,6 +4773,10 @@ LOWFUNC(NONE,NONE,2,raw_fdiv_rr,(FRW d, FR s))
 {
     int ds;
 
+    if (use_sse2_fpu) {
+	DIVSDrr(s, d);
+	return;
+    }
     usereg(s);
     usereg(d);
     
@@ -4715,6 +4837,11 @@ LENDFUNC(NONE,NONE,2,raw_frem1_rr,(FRW d, FR s))
 
 LOWFUNC(NONE,NONE,1,raw_ftst_r,(FR r))
 {
+    if (use_sse2_fpu) {
+	XORPDrr(SSE2_FPU_SCRATCH, SSE2_FPU_SCRATCH);
+	UCOMISDrr(SSE2_FPU_SCRATCH, r);
+	return;
+    }
     make_tos(r);
     emit_byte(0xd9);  /* ftst */
     emit_byte(0xe4);
@@ -4729,6 +4856,12 @@ static __inline__ void raw_fflags_into_flags(int r)
 {
     int p;
 
+    if (use_sse2_fpu) {
+	/* ucomisd sets ZF, PF and CF like fucomi */
+	XORPDrr(SSE2_FPU_SCRATCH, SSE2_FPU_SCRATCH);
+	UCOMISDrr(SSE2_FPU_SCRATCH, r);
+	return;
+    }
     usereg(r);
     p=stackpos(r);
 
@@ -2234,6 +2234,14 @@ enum {
 #define MOVAPDmr(MD, MB, MI, MS, RD)	_SSEPDmr(0x28, MD, MB, MI, MS, RD)
 #define MOVAPDrm(RS, MD, MB, MI, MS)	_SSEPDrm(0x29, RS, MD, MB, MI, MS)
 
+#define MOVSSrr(RS, RD)			_SSESSrr(0x10, RS, RD)
+#define MOVSSmr(MD, MB, MI, MS, RD)	_SSESSmr(0x10, MD, MB, MI, MS, RD)
+#define MOVSSrm(RS, MD, MB, MI, MS)	_SSESSrm(0x11, RS, MD, MB, MI, MS)
+
+#define MOVSDrr(RS, RD)			_SSESDrr(0x10, RS, RD)
+#define MOVSDmr(MD, MB, MI, MS, RD)	_SSESDmr(0x10, MD, MB, MI, MS, RD)
+#define MOVSDrm(RS, MD, MB, MI, MS)	_SSESDrm(0x11, RS, MD, MB, MI, MS)
+
 #define CVTDQ2PDrr(RS, RD)		 _SSELrr(0xf3, X86_SSE_CVTDQ2PD, RS,_rX, RD,_rX)
 #define CVTDQ2PDmr(MD, MB, MI, MS, RD)	 _SSELmr(0xf3, X86_SSE_CVTDQ2PD, MD, MB, MI, MS, RD,_rX)
 #define CVTDQ2PSrr(RS, RD)		__SSELrr(      X86_SSE_CVTDQ2PS, RS,_rX, RD,_rX)
@@ -160,6 +160,7 @@ extern int check_for_cache_miss(void);
 extern void comp_fpp_opp (uae_u32 opcode, uae_u16 extra);
 extern void comp_fbcc_opp (uae_u32 opcode);
 extern void comp_fscc_opp (uae_u32 opcode, uae_u16 extra);
+extern bool use_sse2_fpu;
 
 extern uae_u32 needed_flags;
 extern cacheline cache_tags[];
@@ -576,6 +577,7 @@ typedef struct blockinfo_t {
     uae_u8 needed_flags;  
     uae_u8 status;  
     uae_u8 havestate;
+    uae_u8 sse2_fpu;  /* Compiled with SSE2 FPU code for double/nearest FPCR */
     
     dependency  dep[2];  /* Holds things we depend on */
     dependency* deplist; /* List of things that depend on this */
@@ -94,6 +94,23 @@ static void fpuop_illg(uae_u32 opcode, uae_u32 extra)
 
 static uae_s32 temp_fp[4];  /* To convert between FP/integer */
 
+/* SSE2 FPU code holds doubles. Extended precision operands and the
+   operations which need the x87 are left to the interpreter */
+STATIC_INLINE bool needs_x87 (uae_u16 extra)
+{
+    switch (extra & 0x7f) {
+     case 0x03:		/* FINTRZ */
+     case 0x0e:		/* FSIN */
+     case 0x10:		/* FETOX */
+     case 0x11:		/* FTWOTOX */
+     case 0x16:		/* FLOG2 */
+     case 0x1d:		/* FCOS */
+     case 0x21:		/* FMOD */
+	return true;
+    }
+    return false;
+}
+
 /* return register number, or -1 for failure */
 STATIC_INLINE int get_fp_value (uae_u32 opcode, uae_u16 extra)
 {
@@ -114,6 +131,8 @@ STATIC_INLINE int get_fp_value (uae_u32 opcode, uae_u16 extra)
     mode = (opcode >> 3) & 7;
     reg = opcode & 7;
     size = (extra >> 10) & 7;
+    if (size == 2 && use_sse2_fpu)
+	return -1;
     switch (mode) {
      case 0:
 	switch (size) {
@@ -324,6 +343,8 @@ STATIC_INLINE int put_fp_value (int val, uae_u32 opcode, uae_u16 extra)
     mode = (opcode >> 3) & 7;
     reg = opcode & 7;
     size = (extra >> 10) & 7;
+    if (size == 2 && use_sse2_fpu)
+	return -1;
     ad = (uae_u32)-1;
     switch (mode) {
      case 0:
@@ -968,6 +989,10 @@ void comp_fpp_opp (uae_u32 opcode, uae_u16 extra)
 	return;
      case 6:
      case 7: 
+	if (use_sse2_fpu) { /* FMOVEM must not round to double */
+	    FAIL(1);
+	    return;
+	}
 	{
 	    uae_u32 ad, list = 0;
 	    int incr = 0;
@@ -1294,6 +1319,10 @@ void comp_fpp_opp (uae_u32 opcode, uae_u16 extra)
 			}
 			return;
 		}
+		if (use_sse2_fpu && needs_x87(extra)) {
+			FAIL(1);
+			return;
+		}
 		
 		switch (extra & 0x7f) {
 		case 0x00:		/* FMOVE */
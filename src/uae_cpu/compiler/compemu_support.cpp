@@ -157,7 +157,12 @@ static uae_u32	cache_size			= 0;		// Size of total cache allocated for compiled
 static uae_u32	current_cache_size	= 0;		// Cache grows upwards: how much has been consumed already
 static bool		lazy_flush			= true;		// Flag: lazy translation cache invalidation
 static bool		avoid_fpu			= true;		// Flag: compile FPU instructions ?
+static bool		jit_fpu_sse2		= false;	// Flag: compile FPU instructions to SSE2 code when FPCR allows ?
+static bool		fpcr_allows_sse2	= false;	// Flag: FPCR selects double precision, round to nearest
+static bool		have_sse2_blocks	= false;	// Flag: blocks with SSE2 FPU code may be active ?
+bool			use_sse2_fpu		= false;	// Flag: block being compiled uses SSE2 FPU code
 static bool		have_cmov			= false;	// target has CMOV instructions ?
+static bool		have_sse2			= false;	// target has SSE2 instructions ?
 static bool		have_lahf_lm		= true;		// target has LAHF supported in long mode ?
 static bool		have_rat_stall		= true;		// target has partial register stalls ?
 const bool		tune_alignment		= true;		// Tune code alignments for running CPU ?
@@ -5019,9 +5024,11 @@ void compiler_init(void)
 #ifdef USE_JIT_FPU
 	// Use JIT compiler for FPU instructions ?
 	avoid_fpu = !PrefsFindBool("jitfpu");
+	jit_fpu_sse2 = !avoid_fpu && PrefsFindBool("jitfpusse2");
 #else
 	// JIT FPU is always disabled
 	avoid_fpu = true;
+	jit_fpu_sse2 = false;
 #endif
 	write_log("<JIT compiler> : compile FPU instructions : %s\n", !avoid_fpu ? "yes" : "no");
 	
@@ -5033,6 +5040,9 @@ void compiler_init(void)
 	raw_init_cpu();
 	setzflg_uses_bsf = target_check_bsf();
 	write_log("<JIT compiler> : target processor has CMOV instructions : %s\n", have_cmov ? "yes" : "no");
+	if (!have_sse2)
+		jit_fpu_sse2 = false;
+	write_log("<JIT compiler> : compile FPU instructions to SSE2 code : %s\n", str_on_off(jit_fpu_sse2));
 	write_log("<JIT compiler> : target processor can suffer from partial register stalls : %s\n", have_rat_stall ? "yes" : "no");
 	write_log("<JIT compiler> : alignment for loops, jumps are %d, %d\n", align_loops, align_jumps);
 	
@@ -6381,6 +6391,7 @@ static void flush_icache_hard(int n)
     }
 
     reset_lists();
+    have_sse2_blocks=false;
     if (!compiled_code)
 	return;
     current_compile_p=compiled_code;
@@ -6481,6 +6492,32 @@ void flush_icache_range(uae_u8 *start_p, uae_u32 length)
 	flush_icache(-1);
 }
 
+/* Recompile blocks with SSE2 FPU code, they are entered through their
+   direct_pen from now on. Other blocks are not affected */
+static void invalidate_sse2_blocks(blockinfo* bi)
+{
+	while (bi) {
+		if (bi->sse2_fpu && (bi->status == BI_ACTIVE || bi->status == BI_NEED_CHECK))
+			block_need_recompile(bi);
+		bi = bi->next;
+	}
+}
+
+/* Blocks with SSE2 FPU code compute in double precision and round to
+   nearest, so they are recompiled when the FPCR selects anything else.
+   x87 code follows the host control word and remains valid */
+void compiler_fpcr_changed(uae_u32 new_fpcr)
+{
+	const uae_u32 mask = FPCR_ROUNDING_PRECISION | FPCR_ROUNDING_MODE;
+	fpcr_allows_sse2 = (new_fpcr & mask) == (FPCR_PRECISION_DOUBLE | FPCR_ROUND_NEAR);
+	if (!fpcr_allows_sse2 && have_sse2_blocks) {
+		invalidate_sse2_blocks(active);
+		invalidate_sse2_blocks(dormant);
+		have_sse2_blocks = false;
+		SPCFLAGS_SET( SPCFLAG_JIT_EXEC_RETURN ); /* To get out of compiled code */
+	}
+}
+
 static void catastrophe(void)
 {
     abort();
@@ -6625,6 +6662,11 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	if (current_compile_p>=max_compile_start)
 	    flush_icache_hard(7);
 
+	/* FPU instructions are compiled to SSE2 code for the FPCR at this time */
+	use_sse2_fpu=jit_fpu_sse2 && fpcr_allows_sse2;
+	if (use_sse2_fpu)
+	    have_sse2_blocks=true;
+
 	alloc_blockinfos();
 
 	bi=get_blockinfo_addr_new(pc_hist[0].location,0);
@@ -6710,6 +6752,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	bi->direct_handler=(cpuop_func *)get_target();
 	set_dhtu(bi,bi->direct_handler);
 	bi->status=BI_COMPILING;
+	bi->sse2_fpu=use_sse2_fpu;
 	current_block_start_target=(uintptr)get_target();
 	
 	log_startblock();
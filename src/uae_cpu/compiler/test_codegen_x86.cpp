@@ -2029,6 +2029,7 @@ int main(void)
 	    GENIA("cmpnle", CMP, X86_SSE_CC_NLE);
 	    GENIA("cmpord", CMP, X86_SSE_CC_O);
 	    GEN1("movap", MOVAP);
+	    GEN1("movs", MOVS);
 	    GEN("movdqa", MOVDQA);
 	    GEN("movdqu", MOVDQU);
 	    GEN("movd", MOVDXD);
@@ -2120,9 +2121,15 @@ int main(void)
 			set_target(block);
 			uint8 *b = get_target();
 			int i = 0;
+#define _GENrm(INSN, GENOP) do {		\
+	insns[i] = INSN;			\
+	modes[i] = 0;				\
+	i++; GENOP##rm(r, D, B, I, S);		\
+} while (0)
 #define GEN(INSN, GENOP) do {			\
-	insns[i++] = INSN;			\
-	GENOP##mr(D, B, I, S, r);		\
+	insns[i] = INSN;			\
+	modes[i] = 1;				\
+	i++; GENOP##mr(D, B, I, S, r);		\
 } while (0)
 #define GEN64(INSN, GENOP) do {			\
 	if (X86_TARGET_64BIT)			\
@@ -2137,8 +2144,9 @@ int main(void)
 	GEN1(INSN "p", GENOP##P);		\
 } while (0)
 #define GENI(INSN, GENOP, IMM) do {		\
-	insns[i++] = INSN;			\
-	GENOP##mr(IMM, D, B, I, S, r);		\
+	insns[i] = INSN;			\
+	modes[i] = 1;				\
+	i++; GENOP##mr(IMM, D, B, I, S, r);	\
 } while (0)
 #define GENI1(INSN, GENOP, IMM) do {		\
 	GENI(INSN "s", GENOP##S, IMM);		\
@@ -2174,6 +2182,9 @@ int main(void)
 			GENIA("cmpnle", CMP, X86_SSE_CC_NLE);
 			GENIA("cmpord", CMP, X86_SSE_CC_O);
 			GEN1("movap", MOVAP);
+			GEN1("movs", MOVS);
+			_GENrm("movss", MOVSS);
+			_GENrm("movsd", MOVSD);
 			GEN("movdqa", MOVDQA);
 			GEN("movdqu", MOVDQU);
 #if 0
@@ -2217,6 +2228,7 @@ int main(void)
 #undef  GEN1
 #undef  GEN64
 #undef  GEN
+#undef _GENrm
 			int last_insn = i;
 			uint8 *e = get_target();
 
@@ -2227,7 +2239,7 @@ int main(void)
 			    insn_t ii;
 			    parse_insn(&ii, buffer);
 
-			    if (!check_mem_reg(&ii, insns[i], D, B, I, S, r)) {
+			    if (!check_mem_reg(&ii, insns[i], D, B, I, S, r, modes[i])) {
 				show_instruction(buffer, p);
 				n_failures++;
 			    }
@@ -230,6 +230,11 @@ extern void fpu_dump_flags(void);
 static inline uae_u32 get_fpcr(void);
 static inline void set_fpcr(uae_u32 new_fpcr);
 
+#if USE_JIT && defined(USE_JIT_FPU) && defined(FPU_IEEE)
+/* Translated FPU code may depend on rounding precision and mode */
+extern void compiler_fpcr_changed(uae_u32 new_fpcr);
+#endif
+
 /* Accessors to FPU Status Register */
 static inline uae_u32 get_fpsr(void);
 static inline void set_fpsr(uae_u32 new_fpsr);
@@ -68,12 +68,15 @@
 
 #include "sysdeps.h"
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <float.h>
 #include <errno.h>
 #include "memory.h"
 #include "readcpu.h"
 #include "newcpu.h"
 #include "main.h"
+#include "prefs.h"
 
 #define FPU_IMPLEMENTATION
 
@@ -112,6 +115,11 @@ PRIVATE int current_exception_flags;
 PRIVATE int accrued_exception_flags;
 #define FPS , &fp_status
 
+#ifdef FPU_HYBRID
+bool fpu_hybrid = true;				// Host double fast path enabled ("fpuhybrid" prefs item)
+PRIVATE int hybrid_precision;		// Rounding precision in bits if the fast path applies to the FPCR, 0 otherwise
+#endif
+
 #define CHKERR(d) ({	\
 	double ret = (d);	\
 	if (errno == EDOM)	\
@@ -228,6 +236,15 @@ PRIVATE inline void set_host_control_word(void)
 		set_floatx80_rounding_precision(80 FPS);
 		break;
 	}
+#ifdef FPU_HYBRID
+	hybrid_precision = 0;
+	if (fpu_hybrid && FPU fpcr.exception_enable == 0 && (FPU fpcr.rounding_mode & FPCR_ROUNDING_MODE) == FPCR_ROUND_NEAR) {
+		if ((FPU fpcr.rounding_precision & FPCR_ROUNDING_PRECISION) == FPCR_PRECISION_SINGLE)
+			hybrid_precision = 24;
+		else if ((FPU fpcr.rounding_precision & FPCR_ROUNDING_PRECISION) == FPCR_PRECISION_DOUBLE)
+			hybrid_precision = 53;
+	}
+#endif
 }
 
 /* Return the current rounding mode in m68k format */
@@ -582,6 +599,211 @@ PRIVATE inline void FFPU extract_packed(fpu_register const &src, uae_u32 *wrd1,
 	}
 }
 
+#ifdef FPU_HYBRID
+/* -------------------------------------------------------------------------- */
+/* --- Host double fast path                                              --- */
+/* -------------------------------------------------------------------------- */
+
+/*
+	When the FPCR selects single or double rounding precision, round to
+	nearest and no exception is enabled, FADD, FSUB, FMUL, FDIV, FSQRT,
+	FCMP and their FS/FD/FSGL variants are computed with host doubles.
+	Registers stay in extended format, so FMOVEM, FSAVE and all other
+	instructions see them unchanged; the operands are converted on the fly.
+
+	The results are bit for bit the same as with SoftFloat. Operands must
+	fit into the rounding precision (24 bits for single, so that rounding
+	the double result to single gives the correctly rounded result), and
+	their exponents must lie within +/-HYBRID_EXP_LIMIT, so that the result
+	can neither overflow nor underflow. Everything else (NaNs, infinities,
+	denormals, huge or tiny numbers, operands with extended precision,
+	division by zero, square roots of negative numbers) is left to
+	SoftFloat, as are all other instructions and extended precision FPCRs.
+
+	The inexact flag is computed from the operands instead of host exception
+	flags: with Knuth's TwoSum for additions, and from the lengths of the
+	mantissas for products (a quotient or square root is exact if the
+	product with the divisor or itself is). TwoSum needs strict IEEE double
+	arithmetic, i.e. no x87 excess precision.
+*/
+
+const int HYBRID_EXP_LIMIT = 400;
+
+enum {
+	HYBRID_ADD,
+	HYBRID_SUB,
+	HYBRID_MUL,
+	HYBRID_DIV,
+	HYBRID_SQRT
+};
+
+/* Convert register to double if the fast path can handle it */
+PRIVATE inline bool hybrid_get(fpu_register const &r, int prec, double &d)
+{
+	uae_u64 bits = (uae_u64)(r.high & 0x8000) << 48;
+	if ((r.high & 0x7fff) != 0 || r.low != 0) {
+		int exp = (int)(r.high & 0x7fff) - 0x3fff;
+		if (exp < -HYBRID_EXP_LIMIT || exp > HYBRID_EXP_LIMIT || !(r.low >> 63))
+			return false;
+		if (r.low & ((UINT64_C(1) << (64 - prec)) - 1))
+			return false;
+		bits |= ((uae_u64)(exp + 1023) << 52) | ((r.low << 1) >> 12);
+	}
+	memcpy(&d, &bits, sizeof(d));
+	return true;
+}
+
+/* Convert double (zero or normal) to register */
+PRIVATE inline fpu_register hybrid_put(double d)
+{
+	uae_u64 bits;
+	memcpy(&bits, &d, sizeof(bits));
+	fpu_register r;
+	r.high = (bits >> 48) & 0x8000;
+	r.low = 0;
+	int exp = (bits >> 52) & 0x7ff;
+	if (exp) {
+		r.high |= exp - 1023 + 0x3fff;
+		r.low = (UINT64_C(1) << 63) | ((bits << 12) >> 1);
+	}
+	return r;
+}
+
+/* Rounding error of s = a + b (Knuth's TwoSum) */
+PRIVATE inline double hybrid_sum_error(double a, double b, double s)
+{
+	double bv = s - a;
+	double av = s - bv;
+	return (a - av) + (b - bv);
+}
+
+/* Check whether the product of two mantissas (normalized to bit 63, or 0) fits into a double */
+PRIVATE inline bool hybrid_mul_exact(uae_u64 ma, uae_u64 mb)
+{
+	if (ma == 0 || mb == 0)
+		return true;
+	int za = __builtin_ctzll(ma), zb = __builtin_ctzll(mb);
+	int bits = 128 - za - zb;		// The product of the odd parts has bits - 1 or bits bits
+	if (bits <= 53)
+		return true;
+	if (bits > 54)
+		return false;
+	return ((ma >> za) * (mb >> zb)) >> 53 == 0;
+}
+
+/*
+	Compute dst op src (op src for FSQRT) rounded to the FPCR precision,
+	then to round_prec bits (24 for the single precision variants). Returns
+	false if SoftFloat has to do it.
+*/
+PRIVATE inline bool FFPU hybrid_op(int op, fpu_register const &dst, fpu_register const &src, int round_prec, fpu_register &result)
+{
+	double a = 0, b, r;
+	if (!hybrid_get(src, hybrid_precision, b))
+		return false;
+	if (op != HYBRID_SQRT && !hybrid_get(dst, hybrid_precision, a))
+		return false;
+
+	bool exact;
+	switch (op) {
+	case HYBRID_ADD:
+		r = a + b;
+		exact = hybrid_sum_error(a, b, r) == 0;
+		break;
+	case HYBRID_SUB:
+		r = a - b;
+		exact = hybrid_sum_error(a, -b, r) == 0;
+		break;
+	case HYBRID_MUL:
+		r = a * b;
+		exact = hybrid_mul_exact(dst.low, src.low);
+		break;
+	case HYBRID_DIV:
+		if (b == 0)
+			return false;
+		r = a / b;
+		exact = r * b == a && hybrid_mul_exact(hybrid_put(r).low, src.low);
+		break;
+	case HYBRID_SQRT:
+		if (b < 0)
+			return false;
+		r = sqrt(b);
+		exact = r * r == b && hybrid_mul_exact(hybrid_put(r).low, hybrid_put(r).low);
+		break;
+	default:
+		return false;
+	}
+
+	// Round to single precision, the result must stay a normal single
+	if (round_prec == 24 || hybrid_precision == 24) {
+		if (r != 0 && (fabs(r) < FLT_MIN || fabs(r) > FLT_MAX))
+			return false;
+		float f = (float)r;
+		if (isinf(f))
+			return false;
+		if (f != r)
+			exact = false;
+		r = f;
+	}
+
+	if (!exact)
+		set_float_exception_flags(get_float_exception_flags(&fp_status) | float_flag_inexact, &fp_status);
+	result = hybrid_put(r);
+	return true;
+}
+
+/* Execute arithmetic instruction on the fast path if possible */
+PRIVATE inline bool FFPU hybrid_arithmetic(uae_u32 op, int reg, fpu_register const &src)
+{
+	int kind, round_prec = 53;
+	if (op >= 0x40 && !FPU is_integral)
+		return false;
+	switch (op) {
+	case 0x04:	kind = HYBRID_SQRT;	break;						/* FSQRT */
+	case 0x20:	kind = HYBRID_DIV;	break;						/* FDIV */
+	case 0x22:	kind = HYBRID_ADD;	break;						/* FADD */
+	case 0x23:	kind = HYBRID_MUL;	break;						/* FMUL */
+	case 0x24:	kind = HYBRID_DIV;	round_prec = 24; break;		/* FSGLDIV */
+	case 0x27:	kind = HYBRID_MUL;	round_prec = 24; break;		/* FSGLMUL */
+	case 0x28:	kind = HYBRID_SUB;	break;						/* FSUB */
+	case 0x38:	kind = HYBRID_SUB;	break;						/* FCMP */
+	case 0x41:	kind = HYBRID_SQRT;	round_prec = 24; break;		/* FSSQRT */
+	case 0x45:	kind = HYBRID_SQRT;	break;						/* FDSQRT */
+	case 0x60:	kind = HYBRID_DIV;	round_prec = 24; break;		/* FSDIV */
+	case 0x62:	kind = HYBRID_ADD;	round_prec = 24; break;		/* FSADD */
+	case 0x63:	kind = HYBRID_MUL;	round_prec = 24; break;		/* FSMUL */
+	case 0x64:	kind = HYBRID_DIV;	break;						/* FDDIV */
+	case 0x66:	kind = HYBRID_ADD;	break;						/* FDADD */
+	case 0x67:	kind = HYBRID_MUL;	break;						/* FDMUL */
+	case 0x68:	kind = HYBRID_SUB;	round_prec = 24; break;		/* FSSUB */
+	case 0x6c:	kind = HYBRID_SUB;	break;						/* FDSUB */
+	default:
+		return false;
+	}
+
+	fpu_register result;
+	if (op == 0x38) {
+		// FCMP only sets the condition codes and exception status
+		set_exception_status(0);
+		if (!hybrid_op(kind, FPU registers[reg], src, round_prec, result))
+			return false;
+		make_fpsr(result);
+		return true;
+	}
+	if (!hybrid_op(kind, FPU registers[reg], src, round_prec, result))
+		return false;
+	FPU registers[reg] = result;
+	make_fpsr(result);
+	return true;
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- Transcendental functions                                           --- */
+/* -------------------------------------------------------------------------- */
+
+#include "fpu/mathlib.cpp"
+
 /* -------------------------------------------------------------------------- */
 /* --- FP OP functions                                                    --- */
 /* -------------------------------------------------------------------------- */
@@ -1246,7 +1468,7 @@ void FFPU fpuop_restore(uae_u32 opcode)
 void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 {
 	int reg;
-	fpu_register src;
+	fpu_register src, sin_x, cos_x;
 
 	switch ((extra >> 13) & 0x7) {
 	case 3:
@@ -1581,6 +1803,11 @@ void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 			return;
 		}
 
+#ifdef FPU_HYBRID
+		if (hybrid_precision && hybrid_arithmetic(extra & 0x7f, reg, src))
+			return;
+#endif
+
 		if (FPU is_integral) {
 			// 68040-specific operations
 			switch (extra & 0x7f) {
@@ -1686,7 +1913,7 @@ void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 			break;
 		case 0x02:		/* FSINH */
 			fpu_debug(("FSINH %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(sinh(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_sinh(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x03:		/* FINTRZ */
@@ -1703,72 +1930,72 @@ void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 			break;
 		case 0x06:		/* FLOGNP1 */
 			fpu_debug(("FLOGNP1 %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(log(floatx80_to_float64(src FPS) + 1.0)) FPS);
+			FPU registers[reg] = fp_do_log1p(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x08:		/* FETOXM1 */
 			fpu_debug(("FETOXM1 %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(exp(floatx80_to_float64(src FPS))) - 1.0 FPS);
+			FPU registers[reg] = fp_do_expm1(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x09:		/* FTANH */
 			fpu_debug(("FTANH %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(tanh(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_tanh(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x0a:		/* FATAN */
 			fpu_debug(("FATAN %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(atan(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_atan(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x0c:		/* FASIN */
 			fpu_debug(("FASIN %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(asin(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_asin(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x0d:		/* FATANH */
 			fpu_debug(("FATANH %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(atanh(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_atanh(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x0e:		/* FSIN */
 			fpu_debug(("FSIN %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(sin(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_sin(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x0f:		/* FTAN */
 			fpu_debug(("FTAN %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(tan(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_tan(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x10:		/* FETOX */
 			fpu_debug(("FETOX %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(exp(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_exp(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x11:		/* FTWOTOX */
 			fpu_debug(("FTWOTOX %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(pow(2.0, floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_exp2(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x12:		/* FTENTOX */
 			fpu_debug(("FTENTOX %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(pow(10.0, floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_exp10(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x14:		/* FLOGN */
 			fpu_debug(("FLOGN %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(log(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_log(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x15:		/* FLOG10 */
 			fpu_debug(("FLOG10 %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(log10(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_log10(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x16:		/* FLOG2 */
 			fpu_debug(("FLOG2 %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(log(floatx80_to_float64(src FPS)) / log(2.0)) FPS);
+			FPU registers[reg] = fp_do_log2(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x18:		/* FABS */
@@ -1778,7 +2005,7 @@ void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 			break;
 		case 0x19:		/* FCOSH */
 			fpu_debug(("FCOSH %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(cosh(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_cosh(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x1a:		/* FNEG */
@@ -1788,12 +2015,12 @@ void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 			break;
 		case 0x1c:		/* FACOS */
 			fpu_debug(("FACOS %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(acos(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_acos(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x1d:		/* FCOS */
 			fpu_debug(("FCOS %.04f\n",(double)src));
-			FPU registers[reg] = float64_to_floatx80(CHKERR(cos(floatx80_to_float64(src FPS))) FPS);
+			FPU registers[reg] = fp_do_cos(src);
 			make_fpsr(FPU registers[reg]);
 			break;
 		case 0x1e:		/* FGETEXP */
@@ -1916,9 +2143,10 @@ void FFPU fpuop_arithmetic(uae_u32 opcode, uae_u32 extra)
 		case 0x36:
 		case 0x37:
 			fpu_debug(("FSINCOS %.04f\n",(double)src));
-			// Cosine must be calculated first if same register
-			FPU registers[extra & 7] = float64_to_floatx80(CHKERR(cos(floatx80_to_float64(src FPS))) FPS);
-			FPU registers[reg] = float64_to_floatx80(CHKERR(sin(floatx80_to_float64(src FPS))) FPS);
+			// Cosine must be stored first if same register
+			fp_do_sincos(src, sin_x, cos_x);
+			FPU registers[extra & 7] = cos_x;
+			FPU registers[reg] = sin_x;
 			// Set FPU fpsr according to the sine result
 			make_fpsr(FPU registers[reg]);
 			break;
@@ -1957,6 +2185,10 @@ PUBLIC void FFPU fpu_init (bool integral_68040)
 	FPU is_integral = integral_68040;
 	FPU instruction_address = 0;
 	FPU fpsr.quotient = 0;
+#ifdef FPU_HYBRID
+	fpu_hybrid = PrefsFindBool("fpuhybrid");
+#endif
+	fpu_fast_math = PrefsFindBool("fpufastmath");
 	set_fpcr(0);
 	set_fpsr(0);
 
@@ -114,6 +114,9 @@ static inline void FFPU set_fpcr(uae_u32 new_fpcr)
 	set_rounding_mode			( new_fpcr & FPCR_ROUNDING_MODE		);
 	FPU fpcr.exception_enable	= new_fpcr & FPCR_EXCEPTION_ENABLE;
 	set_host_control_word();
+#if USE_JIT && defined(USE_JIT_FPU) && defined(FPU_IEEE)
+	compiler_fpcr_changed(new_fpcr);
+#endif
 }
 
 /* -------------------------------------------------------------------------- */
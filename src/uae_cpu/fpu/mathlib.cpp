@@ -98,3 +98,1353 @@ PRIVATE fpu_extended fp_do_log1p(fpu_extended x)
 }
 
 #endif
+
+#ifdef FPU_SOFT
+
+/*
+ *  Transcendental functions for the SoftFloat core
+ *
+ *  The argument is taken apart into sign, exponent and a 128 bit mantissa
+ *  and reduced with tables to an interval where a short polynomial
+ *  converges; polynomials are evaluated in fixed point. Intermediate
+ *  results keep 128 bits, so the result is within one ulp of the exact
+ *  extended precision value. The result is rounded once by SoftFloat,
+ *  in the FPCR rounding mode and precision. The fast mode ("fpufastmath"
+ *  prefs item) calls the host library in double precision instead, as
+ *  long as argument and result are normal doubles. Trigonometric
+ *  arguments are still reduced here, and logarithms near 1 go through
+ *  log1p(x - 1), so these keep double precision in the result.
+ *
+ *  Table entries were computed with 80 digit decimal arithmetic.
+ */
+
+bool fpu_fast_math = false;		// Transcendental functions in host double precision ("fpufastmath" prefs item)
+
+/* Unpacked number (-1)^sign * (hi:lo) * 2^(exp-127) with bit 63 of hi set, or zero with hi = lo = 0 */
+struct fp_xf {
+	uae_u64 hi, lo;
+	int exp;
+	int sign;
+};
+
+/* Polynomial coefficient in fixed point, (hi:lo) * 2^-127 */
+struct fp_coef {
+	uae_u64 hi, lo;
+};
+
+static const fp_xf xf_one = {UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000), 0, 0};
+static const fp_xf xf_two = {UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000), 1, 0};
+static const fp_xf xf_ln2 = {UINT64_C(0xb17217f7d1cf79ab), UINT64_C(0xc9e3b39803f2f6af), -1, 0};
+static const fp_xf xf_log2e = {UINT64_C(0xb8aa3b295c17f0bb), UINT64_C(0xbe87fed0691d3e89), 0, 0};
+static const fp_xf xf_log2_10 = {UINT64_C(0xd49a784bcd1b8afe), UINT64_C(0x492bf6ff4dafdb4d), 1, 0};
+static const fp_xf xf_log10e = {UINT64_C(0xde5bd8a937287195), UINT64_C(0x355baaafad33dc32), -2, 0};
+static const fp_xf xf_pio2 = {UINT64_C(0xc90fdaa22168c234), UINT64_C(0xc4c6628b80dc1cd1), 0, 0};
+static const fp_xf xf_pio4 = {UINT64_C(0xc90fdaa22168c234), UINT64_C(0xc4c6628b80dc1cd1), -1, 0};
+
+// 2/pi with 192 bits
+static const uae_u64 two_over_pi[3] = {UINT64_C(0xa2f9836e4e441529), UINT64_C(0xfc2757d1f534ddc0), UINT64_C(0xdb6295993c439041)};
+
+// 2^(j/64)
+static const fp_xf exp2_table[64] = {
+	{UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000), 0, 0},
+	{UINT64_C(0x8164d1f3bc030773), UINT64_C(0x7be56527bd14def5), 0, 0},
+	{UINT64_C(0x82cd8698ac2ba1d7), UINT64_C(0x3e2a475b46520bff), 0, 0},
+	{UINT64_C(0x843a28c3acde4046), UINT64_C(0x1af92eca13fd1582), 0, 0},
+	{UINT64_C(0x85aac367cc487b14), UINT64_C(0xc5c95b8c2154c1b2), 0, 0},
+	{UINT64_C(0x871f61969e8d1010), UINT64_C(0x3a1727c57b52a956), 0, 0},
+	{UINT64_C(0x88980e8092da8527), UINT64_C(0x5df8d76c98c67563), 0, 0},
+	{UINT64_C(0x8a14d575496efd9a), UINT64_C(0x080ca1d92c3680c2), 0, 0},
+	{UINT64_C(0x8b95c1e3ea8bd6e6), UINT64_C(0xfbe4628758a53c90), 0, 0},
+	{UINT64_C(0x8d1adf5b7e5ba9e5), UINT64_C(0xb4c7b4968e41ad36), 0, 0},
+	{UINT64_C(0x8ea4398b45cd53c0), UINT64_C(0x2dc0144c8783d4c6), 0, 0},
+	{UINT64_C(0x9031dc431466b1dc), UINT64_C(0x775814a8494e87e2), 0, 0},
+	{UINT64_C(0x91c3d373ab11c336), UINT64_C(0x0fd6d8e0ae5ac9d8), 0, 0},
+	{UINT64_C(0x935a2b2f13e6e92b), UINT64_C(0xd339940e9d924ee7), 0, 0},
+	{UINT64_C(0x94f4efa8fef70961), UINT64_C(0x2e8afad12551de54), 0, 0},
+	{UINT64_C(0x96942d3720185a00), UINT64_C(0x48ea9b683a9c22c5), 0, 0},
+	{UINT64_C(0x9837f0518db8a96f), UINT64_C(0x46ad23182e42f6f6), 0, 0},
+	{UINT64_C(0x99e0459320b7fa64), UINT64_C(0xe43086cb34b5fcaf), 0, 0},
+	{UINT64_C(0x9b8d39b9d54e5538), UINT64_C(0xa2a817a2a3cc3f1f), 0, 0},
+	{UINT64_C(0x9d3ed9a72cffb750), UINT64_C(0xde494cf050e99b0b), 0, 0},
+	{UINT64_C(0x9ef5326091a111ad), UINT64_C(0xa0911f09ebb9fdd1), 0, 0},
+	{UINT64_C(0xa0b0510fb9714fc2), UINT64_C(0x192dc79edb0fd9a9), 0, 0},
+	{UINT64_C(0xa27043030c496818), UINT64_C(0x9b7a04ef80cfdea8), 0, 0},
+	{UINT64_C(0xa43515ae09e6809e), UINT64_C(0x0d1db4831781e1ef), 0, 0},
+	{UINT64_C(0xa5fed6a9b15138ea), UINT64_C(0x1cbd7f621710701b), 0, 0},
+	{UINT64_C(0xa7cd93b4e9653569), UINT64_C(0x9ec5b4d5039f72af), 0, 0},
+	{UINT64_C(0xa9a15ab4ea7c0ef8), UINT64_C(0x541e24ec3531fa73), 0, 0},
+	{UINT64_C(0xab7a39b5a93ed337), UINT64_C(0x658023b2759e0079), 0, 0},
+	{UINT64_C(0xad583eea42a14ac6), UINT64_C(0x4980a8c8f59a2ec4), 0, 0},
+	{UINT64_C(0xaf3b78ad690a4374), UINT64_C(0xdf26101ccbb35033), 0, 0},
+	{UINT64_C(0xb123f581d2ac258f), UINT64_C(0x87d037e96d215d8e), 0, 0},
+	{UINT64_C(0xb311c412a9112489), UINT64_C(0x3ecf14dc798a519c), 0, 0},
+	{UINT64_C(0xb504f333f9de6484), UINT64_C(0x597d89b3754abe9f), 0, 0},
+	{UINT64_C(0xb6fd91e328d17791), UINT64_C(0x07165f0ddd541a5a), 0, 0},
+	{UINT64_C(0xb8fbaf4762fb9ee9), UINT64_C(0x1b879778566b65a2), 0, 0},
+	{UINT64_C(0xbaff5ab2133e45fb), UINT64_C(0x74d519d24593838c), 0, 0},
+	{UINT64_C(0xbd08a39f580c36be), UINT64_C(0xa8811fb66d0faf7a), 0, 0},
+	{UINT64_C(0xbf1799b67a731082), UINT64_C(0xe815d0abcbf0b851), 0, 0},
+	{UINT64_C(0xc12c4cca66709456), UINT64_C(0x7c457d59a50087b5), 0, 0},
+	{UINT64_C(0xc346ccda24976407), UINT64_C(0x20ec856128b83a42), 0, 0},
+	{UINT64_C(0xc5672a115506dadd), UINT64_C(0x3e2ad0c964dd9f37), 0, 0},
+	{UINT64_C(0xc78d74c8abb9b15c), UINT64_C(0xc13a2e3976c0277e), 0, 0},
+	{UINT64_C(0xc9b9bd866e2f27a2), UINT64_C(0x80e1f92a0511697e), 0, 0},
+	{UINT64_C(0xcbec14fef2727c5c), UINT64_C(0xf4907c8f45ebf6dd), 0, 0},
+	{UINT64_C(0xce248c151f8480e3), UINT64_C(0xe235838f95f2c6ed), 0, 0},
+	{UINT64_C(0xd06333daef2b2594), UINT64_C(0xd6d45c6559a4d502), 0, 0},
+	{UINT64_C(0xd2a81d91f12ae45a), UINT64_C(0x12248e57c3de4028), 0, 0},
+	{UINT64_C(0xd4f35aabcfedfa1f), UINT64_C(0x5921deffa6262c5b), 0, 0},
+	{UINT64_C(0xd744fccad69d6af4), UINT64_C(0x39a68bb9902d3fde), 0, 0},
+	{UINT64_C(0xd99d15c278afd7b5), UINT64_C(0xfe873deca3e12bac), 0, 0},
+	{UINT64_C(0xdbfbb797daf23755), UINT64_C(0x3d840d5a9e29aa64), 0, 0},
+	{UINT64_C(0xde60f4825e0e9123), UINT64_C(0xdd07a2d9e8466859), 0, 0},
+	{UINT64_C(0xe0ccdeec2a94e111), UINT64_C(0x065895048dd333ca), 0, 0},
+	{UINT64_C(0xe33f8972be8a5a51), UINT64_C(0x09bfe90795980eed), 0, 0},
+	{UINT64_C(0xe5b906e77c8348a8), UINT64_C(0x1e5e8f4a4edbb0ed), 0, 0},
+	{UINT64_C(0xe8396a503c4bdc68), UINT64_C(0x791790d0ac70c7de), 0, 0},
+	{UINT64_C(0xeac0c6e7dd24392e), UINT64_C(0xd02d75b3706e54fb), 0, 0},
+	{UINT64_C(0xed4f301ed9942b84), UINT64_C(0x600d2db6a64bfb12), 0, 0},
+	{UINT64_C(0xefe4b99bdcdaf5cb), UINT64_C(0x46561cf6948db913), 0, 0},
+	{UINT64_C(0xf281773c59ffb139), UINT64_C(0xe8980a9cc8f47a4b), 0, 0},
+	{UINT64_C(0xf5257d152486cc2c), UINT64_C(0x7b9d0c7aed980fc3), 0, 0},
+	{UINT64_C(0xf7d0df730ad13bb8), UINT64_C(0xfe90d496d60fb6eb), 0, 0},
+	{UINT64_C(0xfa83b2db722a033a), UINT64_C(0x7c25bb14315d7fcd), 0, 0},
+	{UINT64_C(0xfd3e0c0cf486c174), UINT64_C(0x853f3a5931e0ee03), 0, 0}
+};
+
+// 2^16 / (1 + (j + 1/2) / 128) rounded, and -ln of it times 2^-16
+struct fp_log_entry {
+	uae_u32 inv;
+	fp_xf log_inv;
+};
+
+static const fp_log_entry log_table[128] = {
+	{65281, {UINT64_C(0xff7f551588de024f), UINT64_C(0xee055fc515062c04), -9, 0}},
+	{64777, {UINT64_C(0xbedb7afc6373b080), UINT64_C(0xe91941c71b6eed58), -7, 0}},
+	{64281, {UINT64_C(0x9e65821e05ba6995), UINT64_C(0xe4404e5f64100f57), -6, 0}},
+	{63792, {UINT64_C(0xdcf4013f0c8c6c89), UINT64_C(0x6160608d1b20ffa8), -6, 0}},
+	{63310, {UINT64_C(0x8d8aec49a6ec157b), UINT64_C(0xd5fd85829528aa0a), -5, 0}},
+	{62836, {UINT64_C(0xac531d7e47a6a464), UINT64_C(0xa9cfef8fe71d5235), -5, 0}},
+	{62369, {UINT64_C(0xcae1487686675480), UINT64_C(0xd2ca52624c0ea761), -5, 0}},
+	{61909, {UINT64_C(0xe933ac58b121f91f), UINT64_C(0x44bb9f8a2da45bb6), -5, 0}},
+	{61455, {UINT64_C(0x83acc9acc7278980), UINT64_C(0xdcfdde710629f06e), -4, 0}},
+	{61008, {UINT64_C(0x92a0317854a0b7f2), UINT64_C(0x85f9e2b22a495c38), -4, 0}},
+	{60568, {UINT64_C(0xa17325f613373b8d), UINT64_C(0xedb14c546431e007), -4, 0}},
+	{60133, {UINT64_C(0xb0362d4a742a5240), UINT64_C(0xeacca644981eb12a), -4, 0}},
+	{59705, {UINT64_C(0xbed72b6c991a9bc8), UINT64_C(0x5e1f13a0db586251), -4, 0}},
+	{59283, {UINT64_C(0xcd5e0a31fda1ba38), UINT64_C(0xd7cbf1768fb04eba), -4, 0}},
+	{58867, {UINT64_C(0xdbca095e6c315057), UINT64_C(0xfa6c2be03ce308ff), -4, 0}},
+	{58457, {UINT64_C(0xea1a66b3985ef27b), UINT64_C(0x34f4c8ad810e832f), -4, 0}},
+	{58053, {UINT64_C(0xf84e5e012a79091f), UINT64_C(0xa55dde19b34b9c3a), -4, 0}},
+	{57654, {UINT64_C(0x833720969dd35e2a), UINT64_C(0xc11cab3c99861bda), -3, 0}},
+	{57260, {UINT64_C(0x8a3cbc2344356438), UINT64_C(0x10416852c3041999), -3, 0}},
+	{56872, {UINT64_C(0x913318c857565ba2), UINT64_C(0x8f8340136fdc4987), -3, 0}},
+	{56489, {UINT64_C(0x981e74c7264097db), UINT64_C(0x0c72aee5fb031ce3), -3, 0}},
+	{56111, {UINT64_C(0x9efe81876be34ebb), UINT64_C(0x49799e70adb194c3), -3, 0}},
+	{55738, {UINT64_C(0xa5d2ef9d02373478), UINT64_C(0xd26c670696b699e0), -3, 0}},
+	{55370, {UINT64_C(0xac9b6ecd18cc46d5), UINT64_C(0x6ab11235f6e454db), -3, 0}},
+	{55007, {UINT64_C(0xb357ae13c8ac91c6), UINT64_C(0xedabf5fcb84f14ea), -3, 0}},
+	{54649, {UINT64_C(0xba075baa076f25e7), UINT64_C(0x1801f16b83238a26), -3, 0}},
+	{54295, {UINT64_C(0xc0aef90a37d15b52), UINT64_C(0x4da8272e4525d2d0), -3, 0}},
+	{53946, {UINT64_C(0xc7496ef444320557), UINT64_C(0xfa4b47b8688f9630), -3, 0}},
+	{53601, {UINT64_C(0xcddb4d7442be30ea), UINT64_C(0x0c6e9b66e0862140), -3, 0}},
+	{53261, {UINT64_C(0xd45f6be4417ac617), UINT64_C(0x3ddc3c92b6a6aed2), -3, 0}},
+	{52925, {UINT64_C(0xdada68f47e4f2370), UINT64_C(0x83fb9cdd3351674a), -3, 0}},
+	{52593, {UINT64_C(0xe14c06ac7388077d), UINT64_C(0x03e637a46026c18b), -3, 0}},
+	{52265, {UINT64_C(0xe7b4067100512853), UINT64_C(0x5c61e1cc7c6c5220), -3, 0}},
+	{51942, {UINT64_C(0xee0d1d0572ebe87b), UINT64_C(0x8e57e66d4e28fc8d), -3, 0}},
+	{51622, {UINT64_C(0xf4611a9574db0522), UINT64_C(0x5f4fba4d727bdef6), -3, 0}},
+	{51306, {UINT64_C(0xfaaabab315220287), UINT64_C(0x15b7a88aaf69909c), -3, 0}},
+	{50995, {UINT64_C(0x80724c2db5f9cae2), UINT64_C(0xa90c60a8cc56a1a3), -2, 0}},
+	{50686, {UINT64_C(0x838eeefec2ac8b3d), UINT64_C(0xd7563479752cc9e9), -2, 0}},
+	{50382, {UINT64_C(0x86a36ebcd61e5906), UINT64_C(0x872c81fe846cb77f), -2, 0}},
+	{50081, {UINT64_C(0x89b4da14b6e6885e), UINT64_C(0xc39b89adeaf94170), -2, 0}},
+	{49784, {UINT64_C(0x8cc0796ea15b7b3b), UINT64_C(0xcf8b79ef7e5c12f0), -2, 0}},
+	{49490, {UINT64_C(0x8fc8d0f270fba089), UINT64_C(0xa27a9be85913d03b), -2, 0}},
+	{49200, {UINT64_C(0x92cb2086fcb1cf82), UINT64_C(0xef48726fbc229434), -2, 0}},
+	{48913, {UINT64_C(0x95c9f3d5d19a26cf), UINT64_C(0x6f90d8997dea56e8), -2, 0}},
+	{48630, {UINT64_C(0x98c2824ae8300f5b), UINT64_C(0xeeade919352a133f), -2, 0}},
+	{48349, {UINT64_C(0x9bba151630a3e640), UINT64_C(0x3789eaa723ae107d), -2, 0}},
+	{48072, {UINT64_C(0x9eab2d2e2df88328), UINT64_C(0x5fbb5eef4b667343), -2, 0}},
+	{47798, {UINT64_C(0xa19865505da4ae63), UINT64_C(0x9a43acfafcb924d8), -2, 0}},
+	{47528, {UINT64_C(0xa47ee4026e8e5624), UINT64_C(0x1b895c71d4deca4c), -2, 0}},
+	{47260, {UINT64_C(0xa76411931ba34773), UINT64_C(0x3080a920bea9c26a), -2, 0}},
+	{46995, {UINT64_C(0xaa45181d6e94167e), UINT64_C(0x63b2c7a24cf4a0c1), -2, 0}},
+	{46733, {UINT64_C(0xad21df87b918103a), UINT64_C(0x053d320a828ad86e), -2, 0}},
+	{46474, {UINT64_C(0xaffa4f856542a90f), UINT64_C(0x324a25c84533cbb4), -2, 0}},
+	{46218, {UINT64_C(0xb2ce4f98395399aa), UINT64_C(0xb45b6388d0cbaf9c), -2, 0}},
+	{45965, {UINT64_C(0xb59dc711acf2ec49), UINT64_C(0x0f26719f89447e25), -2, 0}},
+	{45714, {UINT64_C(0xb86b7b144055e80c), UINT64_C(0x2c1494de2b5ac8d5), -2, 0}},
+	{45467, {UINT64_C(0xbb319a91fb976992), UINT64_C(0xf6bc68d716afab69), -2, 0}},
+	{45222, {UINT64_C(0xbdf5cc5210c1dd48), UINT64_C(0x809e0981c151138e), -2, 0}},
+	{44979, {UINT64_C(0xc0b802ed1005aee0), UINT64_C(0x19429ca3e33f5730), -2, 0}},
+	{44739, {UINT64_C(0xc37542d1b8b607fa), UINT64_C(0x557b9a65ea1bbbdc), -2, 0}},
+	{44502, {UINT64_C(0xc62d7242cb4853af), UINT64_C(0xc41ad3f014729c06), -2, 0}},
+	{44267, {UINT64_C(0xc8e36d5a2f52ec5d), UINT64_C(0xedfb31503a87395c), -2, 0}},
+	{44035, {UINT64_C(0xcb942c08d1dbb227), UINT64_C(0x17dee5b0533827ef), -2, 0}},
+	{43805, {UINT64_C(0xce429217068c0afe), UINT64_C(0x33060bcb405bac6b), -2, 0}},
+	{43577, {UINT64_C(0xd0ee9126c17daec4), UINT64_C(0x35246724f08a4529), -2, 0}},
+	{43352, {UINT64_C(0xd39514b35f0f50b3), UINT64_C(0xe6038696e88d892b), -2, 0}},
+	{43129, {UINT64_C(0xd6390c12ca5020d0), UINT64_C(0x0056855af237e3d0), -2, 0}},
+	{42908, {UINT64_C(0xd8da687679f31ee0), UINT64_C(0x89bc1cfa2bb1ec47), -2, 0}},
+	{42690, {UINT64_C(0xdb7608e9efdeede7), UINT64_C(0xc3332d6a4c35a842), -2, 0}},
+	{42474, {UINT64_C(0xde0ee8586e2c520c), UINT64_C(0xab8bd65dda200932), -2, 0}},
+	{42260, {UINT64_C(0xe0a4f788af913566), UINT64_C(0x5be33dc8f4b4f070), -2, 0}},
+	{42048, {UINT64_C(0xe33827200b7fc1e9), UINT64_C(0x60f17e68ffef8a12), -2, 0}},
+	{41838, {UINT64_C(0xe5c867a2e79a894a), UINT64_C(0x701c10425e3cc5e2), -2, 0}},
+	{41631, {UINT64_C(0xe8528373a81c1c85), UINT64_C(0xea97ef76b0fab4df), -2, 0}},
+	{41425, {UINT64_C(0xeadcb2d7368d2602), UINT64_C(0xb036560bec1be04d), -2, 0}},
+	{41222, {UINT64_C(0xed6095f1ad2e865c), UINT64_C(0x8e1a78807ebc57a2), -2, 0}},
+	{41020, {UINT64_C(0xefe474c83bbdaa7d), UINT64_C(0x42800fade405f09b), -2, 0}},
+	{40820, {UINT64_C(0xf2651543d9c86dfe), UINT64_C(0xcfca0810c305f817), -2, 0}},
+	{40623, {UINT64_C(0xf4df2d2cddf8a552), UINT64_C(0x700db9d166d2205e), -2, 0}},
+	{40427, {UINT64_C(0xf7591c320768a1af), UINT64_C(0xae72ee7d5599480c), -2, 0}},
+	{40233, {UINT64_C(0xf9cf9be414c3e019), UINT64_C(0x4878ff558c2e6347), -2, 0}},
+	{40041, {UINT64_C(0xfc429bb7fa4f11e6), UINT64_C(0xfe82d73551e5a196), -2, 0}},
+	{39851, {UINT64_C(0xfeb20b07bc7c8ca1), UINT64_C(0x0aeef8af03dafc03), -2, 0}},
+	{39662, {UINT64_C(0x80909389767e73a3), UINT64_C(0x97aabf0408dd2213), -1, 0}},
+	{39476, {UINT64_C(0x81c4a37e80e1d6dd), UINT64_C(0x9683209199bcd6c9), -1, 0}},
+	{39291, {UINT64_C(0x82f87ce935755ffb), UINT64_C(0x1943d61aafbe09f9), -1, 0}},
+	{39108, {UINT64_C(0x842a704274706af0), UINT64_C(0x4855d1d95756aa0e), -1, 0}},
+	{38926, {UINT64_C(0x855c23f6884894c7), UINT64_C(0xa845d99ab16bb20f), -1, 0}},
+	{38746, {UINT64_C(0x868be4661b47e67f), UINT64_C(0x82123d11addf72ad), -1, 0}},
+	{38568, {UINT64_C(0x87b9a8e4fe6bf740), UINT64_C(0x62f5cf362b94d53e), -1, 0}},
+	{38392, {UINT64_C(0x88e568bc4d87be8d), UINT64_C(0x1c84d26553a87224), -1, 0}},
+	{38217, {UINT64_C(0x8a10d229263aa70d), UINT64_C(0x8cdec735b6f5164e), -1, 0}},
+	{38044, {UINT64_C(0x8b3a295da2384e51), UINT64_C(0x0e31462df3f80b68), -1, 0}},
+	{37872, {UINT64_C(0x8c63207fbaf82dc2), UINT64_C(0xea4245dfe1db5ad2), -1, 0}},
+	{37702, {UINT64_C(0x8d89f7ac2836dcb4), UINT64_C(0x164e6a3b5c40251d), -1, 0}},
+	{37533, {UINT64_C(0x8eb064f33de4980a), UINT64_C(0xa1be734258d46521), -1, 0}},
+	{37366, {UINT64_C(0x8fd4a45c537c5805), UINT64_C(0x04721de440fe3216), -1, 0}},
+	{37200, {UINT64_C(0x90f86fe32e775f14), UINT64_C(0x2dcf4c9173fb2d1d), -1, 0}},
+	{37036, {UINT64_C(0x9219ff7a52519b1a), UINT64_C(0xb8a024cb5b564a3e), -1, 0}},
+	{36873, {UINT64_C(0x933b1109a1877e69), UINT64_C(0x56fdd38f22e2f34c), -1, 0}},
+	{36712, {UINT64_C(0x9459d86fe75bfd5a), UINT64_C(0x1fd2b26f52ee0505), -1, 0}},
+	{36552, {UINT64_C(0x957817815f255708), UINT64_C(0xe06c27e492cd9549), -1, 0}},
+	{36393, {UINT64_C(0x9695cb097a816dc5), UINT64_C(0x5a092c9fc088b547), -1, 0}},
+	{36236, {UINT64_C(0x97b120ca89f230b5), UINT64_C(0x532dc8e5fbef308f), -1, 0}},
+	{36080, {UINT64_C(0x98cbe07d407350f0), UINT64_C(0x6f9d720ded00045f), -1, 0}},
+	{35926, {UINT64_C(0x99e433d1f80e6b8a), UINT64_C(0xd0d70ddb8bb62fc2), -1, 0}},
+	{35772, {UINT64_C(0x9afdbb6ec63d108f), UINT64_C(0x99c2157a162cc88a), -1, 0}},
+	{35620, {UINT64_C(0x9c14cbf30ed41c49), UINT64_C(0x73ac4dbfc1756766), -1, 0}},
+	{35470, {UINT64_C(0x9d295bf40731c82b), UINT64_C(0x64e5c838400646e6), -1, 0}},
+	{35320, {UINT64_C(0x9e3f180014b06183), UINT64_C(0x9f9469bf5b464904), -1, 0}},
+	{35172, {UINT64_C(0x9f52489b9342f600), UINT64_C(0x7032f4712140c8b6), -1, 0}},
+	{35026, {UINT64_C(0xa062e44475890483), UINT64_C(0x64a80d9c2cc2c3ed), -1, 0}},
+	{34880, {UINT64_C(0xa174a36f0405f810), UINT64_C(0x28b250ee3facb687), -1, 0}},
+	{34735, {UINT64_C(0xa285a589f4cd0249), UINT64_C(0xc82f3e02b620c58b), -1, 0}},
+	{34592, {UINT64_C(0xa39401f9af556e0d), UINT64_C(0x6e341303c7d253b4), -1, 0}},
+	{34450, {UINT64_C(0xa4a1961d20623d50), UINT64_C(0x70f0eeb8591cc97f), -1, 0}},
+	{34309, {UINT64_C(0xa5ae5e4ad0e8242b), UINT64_C(0x5ce309d46d1bcea6), -1, 0}},
+	{34169, {UINT64_C(0xa6ba56d23d9cc5ef), UINT64_C(0x3fab80d5ff308141), -1, 0}},
+	{34031, {UINT64_C(0xa7c38efa89fbc2a6), UINT64_C(0xcce151d17ed45694), -1, 0}},
+	{33893, {UINT64_C(0xa8cddb06119ed15f), UINT64_C(0x7878bb0259f58c70), -1, 0}},
+	{33757, {UINT64_C(0xa9d55b2dcd306551), UINT64_C(0x924a20ca426352a0), -1, 0}},
+	{33622, {UINT64_C(0xaadbf8a5d3a05444), UINT64_C(0x4bbd8d4e9be82a1d), -1, 0}},
+	{33487, {UINT64_C(0xabe3a49a1df94142), UINT64_C(0x36089d94d6483aa5), -1, 0}},
+	{33354, {UINT64_C(0xace873300596024d), UINT64_C(0xcb75d63acae86d27), -1, 0}},
+	{33222, {UINT64_C(0xadec53874ed59eee), UINT64_C(0x960a5c4e7fd6ca75), -1, 0}},
+	{33091, {UINT64_C(0xaeef41b8b0f99e3b), UINT64_C(0xef59996828d15d42), -1, 0}},
+	{32961, {UINT64_C(0xaff139d6950d45f2), UINT64_C(0x87e01807f5bc2256), -1, 0}},
+	{32832, {UINT64_C(0xb0f237ed2b233611), UINT64_C(0xe7457982c5b7dbfd), -1, 0}}
+};
+
+// sin(j/32), cos(j/32)
+struct fp_sincos_entry {
+	fp_xf sin, cos;
+};
+
+static const fp_sincos_entry sincos_table[26] = {
+	{{0, 0, 0, 0}, {UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000), 0, 0}},
+	{{UINT64_C(0xfff5557777437465), UINT64_C(0x7f209bb6a3c8cabd), -6, 0}, {UINT64_C(0xffe000aaa93e9589), UINT64_C(0x576da4ec94946fb9), -1, 0}},
+	{{UINT64_C(0xffd557776a76d5a5), UINT64_C(0xd259b2f692d4acb0), -5, 0}, {UINT64_C(0xff800aaa4fa69a65), UINT64_C(0x070f73284de215b9), -1, 0}},
+	{{UINT64_C(0xbfb808192a8720d7), UINT64_C(0xe168c00280d0803f), -4, 0}, {UINT64_C(0xfee035fbf35cda63), UINT64_C(0x2056a6bf1b6b28e0), -1, 0}},
+	{{UINT64_C(0xff5577743771ae50), UINT64_C(0x34d43390fc4fc2d3), -4, 0}, {UINT64_C(0xfe00aa93eade9b6d), UINT64_C(0x1e6a129df6f18ce5), -1, 0}},
+	{{UINT64_C(0x9f598962eb365a8f), UINT64_C(0xaccd6cd9721f5651), -3, 0}, {UINT64_C(0xfce1a053e621438b), UINT64_C(0x6d60c76e8c45bf0b), -1, 0}},
+	{{UINT64_C(0xbee0817dd795a8ad), UINT64_C(0x5a8711e4be158962), -3, 0}, {UINT64_C(0xfb835efcf670dd2c), UINT64_C(0xe6fe7924697eea14), -1, 0}},
+	{{UINT64_C(0xde37c276e30ccb38), UINT64_C(0x34ad4f619560b915), -3, 0}, {UINT64_C(0xf9e63e1d9e8b6f6f), UINT64_C(0x2e296bae5b5ed9c1), -1, 0}},
+	{{UINT64_C(0xfd5776a798abb5d4), UINT64_C(0x4ef5ee39a8f458d7), -3, 0}, {UINT64_C(0xf80aa4fbef750ba7), UINT64_C(0x83d33cb95f94f8a4), -1, 0}},
+	{{UINT64_C(0x8e1beb2635c3b28c), UINT64_C(0x0edfc1b9fe8ffc63), -2, 0}, {UINT64_C(0xf5f10a7bb77d3dfa), UINT64_C(0x0c1da8b578427833), -1, 0}},
+	{{UINT64_C(0x9d6894bb4e9ec004), UINT64_C(0x0f554121e0e69c51), -2, 0}, {UINT64_C(0xf399f500c9e9fd37), UINT64_C(0xae9957263dab8877), -1, 0}},
+	{{UINT64_C(0xac8de4fd17acb97c), UINT64_C(0x74bac3fe0cae4522), -2, 0}, {UINT64_C(0xf105fa4d66b607a6), UINT64_C(0x7d44e04272520443), -1, 0}},
+	{{UINT64_C(0xbb8812abb2109e91), UINT64_C(0x528ceb44931bcbb1), -2, 0}, {UINT64_C(0xee35bf5ccac89052), UINT64_C(0xcd91ddb734d3a47e), -1, 0}},
+	{{UINT64_C(0xca535f4faa36252c), UINT64_C(0x63d832f815081424), -2, 0}, {UINT64_C(0xeb29f839f201fd13), UINT64_C(0xb93796827916a78f), -1, 0}},
+	{{UINT64_C(0xd8ec182990b0b4a3), UINT64_C(0xb7a68cc15cd8a559), -2, 0}, {UINT64_C(0xe7e367d2956cfb16), UINT64_C(0xb6aa11e5419cd005), -1, 0}},
+	{{UINT64_C(0xe74e971ea528f6d0), UINT64_C(0x375ed251d67f6043), -2, 0}, {UINT64_C(0xe462dfc670d421ab), UINT64_C(0x3d1a15901228f147), -1, 0}},
+	{{UINT64_C(0xf57743a2582f7f43), UINT64_C(0xb25e1b27ec1bdb33), -2, 0}, {UINT64_C(0xe0a94032dbea7ced), UINT64_C(0xbddd9da2fafad985), -1, 0}},
+	{{UINT64_C(0x81b149ce34caa5a4), UINT64_C(0xe650f8d09fd4d6aa), -1, 0}, {UINT64_C(0xdcb7777ac4207051), UINT64_C(0x68f31e3eb780ce9d), -1, 0}},
+	{{UINT64_C(0x88868625b4e1dbb2), UINT64_C(0x3133101330225272), -1, 0}, {UINT64_C(0xd88e820b1526311d), UINT64_C(0xd561efbc0c1a9a53), -1, 0}},
+	{{UINT64_C(0x8f39a191b2ba6122), UINT64_C(0xa3fa4f41d5a3ffd4), -1, 0}, {UINT64_C(0xd42f6a1b9f0168cd), UINT64_C(0xf031c2f63c8d9305), -1, 0}},
+	{{UINT64_C(0x95c8ef544210ec0b), UINT64_C(0x91c49bd2aa09e851), -1, 0}, {UINT64_C(0xcf9b476c897c25c5), UINT64_C(0xbfe750dd3f308eaf), -1, 0}},
+	{{UINT64_C(0x9c32cba2b14156ef), UINT64_C(0x05256c4f857991ca), -1, 0}, {UINT64_C(0xcad33f00658fe5e8), UINT64_C(0x204bbc0f3a66a0e7), -1, 0}},
+	{{UINT64_C(0xa2759c0e79c35582), UINT64_C(0x527c32b55f5405c2), -1, 0}, {UINT64_C(0xc5d882d2ee48030c), UINT64_C(0x7c07d28e981e3480), -1, 0}},
+	{{UINT64_C(0xa88fcfebd9a8dd47), UINT64_C(0xe2f3c76ef9e24399), -1, 0}, {UINT64_C(0xc0ac518c8b6ae710), UINT64_C(0xba37a3eeb90cb15b), -1, 0}},
+	{{UINT64_C(0xae7fe0b5fc786b2d), UINT64_C(0x966e1d6af140a488), -1, 0}, {UINT64_C(0xbb4ff632a908f73e), UINT64_C(0xc151839cb9d993b5), -1, 0}},
+	{{UINT64_C(0xb44452709a597529), UINT64_C(0x05913765434a59d1), -1, 0}, {UINT64_C(0xb5c4c7d4f7dae915), UINT64_C(0xac786ccf4b1a498d), -1, 0}}
+};
+
+// atan(j/32)
+static const fp_xf atan_table[33] = {
+	{0, 0, 0, 0},
+	{UINT64_C(0xffeaaddd4bb12542), UINT64_C(0x779d776dda8c6214), -6, 0},
+	{UINT64_C(0xffaaddb967ef4e36), UINT64_C(0xcb2792dc0e2e0d51), -5, 0},
+	{UINT64_C(0xbf70c13017887460), UINT64_C(0x93567e784cf83676), -4, 0},
+	{UINT64_C(0xfeadd4d5617b6e32), UINT64_C(0xc897989f3e888ef8), -4, 0},
+	{UINT64_C(0x9eb77746331362c3), UINT64_C(0x47619d250360fe85), -3, 0},
+	{UINT64_C(0xbdcbda5e72d81134), UINT64_C(0x7b0b4f881c9c7488), -3, 0},
+	{UINT64_C(0xdc86ba9493051022), UINT64_C(0xf621a5c1cb552f03), -3, 0},
+	{UINT64_C(0xfadbafc96406eb15), UINT64_C(0x6dc79ef5f7a217e6), -3, 0},
+	{UINT64_C(0x8c5fad185f8bc130), UINT64_C(0xca4748b1bf88298d), -2, 0},
+	{UINT64_C(0x9b13b9b83f5e5e69), UINT64_C(0xc5abb498d27af328), -2, 0},
+	{UINT64_C(0xa9856cca8e6a4eda), UINT64_C(0x99b7f77bf7d9e8c1), -2, 0},
+	{UINT64_C(0xb7b0ca0f26f78473), UINT64_C(0x8aa32122dcfe4483), -2, 0},
+	{UINT64_C(0xc59269ca50d92b6d), UINT64_C(0xa1746e91f50a28de), -2, 0},
+	{UINT64_C(0xd327761e611fe5b6), UINT64_C(0x427c95e9001e7136), -2, 0},
+	{UINT64_C(0xe06da64a764f7c67), UINT64_C(0xc631ed96798cb804), -2, 0},
+	{UINT64_C(0xed63382b0dda7b45), UINT64_C(0x6fe445ecbc3a8d03), -2, 0},
+	{UINT64_C(0xfa06e85aa0a0be5c), UINT64_C(0x66d23c7d5dc8ecc2), -2, 0},
+	{UINT64_C(0x832bf4a6d9867e2a), UINT64_C(0x4b6a09cb61a515c1), -1, 0},
+	{UINT64_C(0x892aecdfde9547b5), UINT64_C(0x094478fc472b4afc), -1, 0},
+	{UINT64_C(0x8f005d5ef7f59f9b), UINT64_C(0x5c835e1665c43748), -1, 0},
+	{UINT64_C(0x94ac72c9847186f6), UINT64_C(0x18c4f393f78a32f9), -1, 0},
+	{UINT64_C(0x9a2f80e671bdda20), UINT64_C(0x4226f8e2204ff3bd), -1, 0},
+	{UINT64_C(0x9f89fdc4f4b7a1ec), UINT64_C(0xf8b492644f0701e0), -1, 0},
+	{UINT64_C(0xa4bc7d1934f70924), UINT64_C(0x19a87f2a457dac9f), -1, 0},
+	{UINT64_C(0xa9c7abdc4830f5c8), UINT64_C(0x916a84b5be7933f6), -1, 0},
+	{UINT64_C(0xaeac4c38b4d8c080), UINT64_C(0x14725e2f3e52070a), -1, 0},
+	{UINT64_C(0xb36b31c91f043691), UINT64_C(0x590141744462f93a), -1, 0},
+	{UINT64_C(0xb8053e2bc2319e73), UINT64_C(0xcb2da55210a4443d), -1, 0},
+	{UINT64_C(0xbc7b5deae98af280), UINT64_C(0xd4113006e80fb290), -1, 0},
+	{UINT64_C(0xc0ce85b8ac526640), UINT64_C(0x89dd62c46e92fa25), -1, 0},
+	{UINT64_C(0xc4ffaffabf8fbd54), UINT64_C(0x8cb43d10bc9e0221), -1, 0},
+	{UINT64_C(0xc90fdaa22168c234), UINT64_C(0xc4c6628b80dc1cd1), -1, 0}
+};
+
+// 1/k!
+static const fp_coef fact_inv[24] = {
+	{UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000)},	// 1/0!
+	{UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000)},	// 1/1!
+	{UINT64_C(0x4000000000000000), UINT64_C(0x0000000000000000)},	// 1/2!
+	{UINT64_C(0x1555555555555555), UINT64_C(0x5555555555555555)},	// 1/3!
+	{UINT64_C(0x0555555555555555), UINT64_C(0x5555555555555555)},	// 1/4!
+	{UINT64_C(0x0111111111111111), UINT64_C(0x1111111111111111)},	// 1/5!
+	{UINT64_C(0x002d82d82d82d82d), UINT64_C(0x82d82d82d82d82d8)},	// 1/6!
+	{UINT64_C(0x0006806806806806), UINT64_C(0x8068068068068068)},	// 1/7!
+	{UINT64_C(0x0000d00d00d00d00), UINT64_C(0xd00d00d00d00d00d)},	// 1/8!
+	{UINT64_C(0x0000171de3a556c7), UINT64_C(0x338faac1c88e5001)},	// 1/9!
+	{UINT64_C(0x0000024fc9f6ef13), UINT64_C(0xeb8e5de02da7d4cd)},	// 1/10!
+	{UINT64_C(0x00000035cc8acfea), UINT64_C(0x89c71fce8fc97070)},	// 1/11!
+	{UINT64_C(0x000000047bb63bfe), UINT64_C(0x3625ed5136a61eb4)},	// 1/12!
+	{UINT64_C(0x000000005849184e), UINT64_C(0xa1b425f28e0cc749)},	// 1/13!
+	{UINT64_C(0x00000000064e5d2a), UINT64_C(0x301f27482eb7c517)},	// 1/14!
+	{UINT64_C(0x00000000006b9fcf), UINT64_C(0x9ccee07c476195ac)},	// 1/15!
+	{UINT64_C(0x000000000006b9fc), UINT64_C(0xf9ccee07c476195b)},	// 1/16!
+	{UINT64_C(0x000000000000654b), UINT64_C(0x1dc0c2b529ac9814)},	// 1/17!
+	{UINT64_C(0x00000000000005a0), UINT64_C(0x9e18ee5f65deec01)},	// 1/18!
+	{UINT64_C(0x000000000000004b), UINT64_C(0xd26d1a05055c9328)},	// 1/19!
+	{UINT64_C(0x0000000000000003), UINT64_C(0xca8574804044a0f5)},	// 1/20!
+	{UINT64_C(0x0000000000000000), UINT64_C(0x2e371dedb9eae318)},	// 1/21!
+	{UINT64_C(0x0000000000000000), UINT64_C(0x0219c72db6ff0a53)},	// 1/22!
+	{UINT64_C(0x0000000000000000), UINT64_C(0x001761b41316381a)}	// 1/23!
+};
+
+// 1/(k+1)
+static const fp_coef inv_int[27] = {
+	{UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000)},	// 1/1
+	{UINT64_C(0x4000000000000000), UINT64_C(0x0000000000000000)},	// 1/2
+	{UINT64_C(0x2aaaaaaaaaaaaaaa), UINT64_C(0xaaaaaaaaaaaaaaab)},	// 1/3
+	{UINT64_C(0x2000000000000000), UINT64_C(0x0000000000000000)},	// 1/4
+	{UINT64_C(0x1999999999999999), UINT64_C(0x999999999999999a)},	// 1/5
+	{UINT64_C(0x1555555555555555), UINT64_C(0x5555555555555555)},	// 1/6
+	{UINT64_C(0x1249249249249249), UINT64_C(0x2492492492492492)},	// 1/7
+	{UINT64_C(0x1000000000000000), UINT64_C(0x0000000000000000)},	// 1/8
+	{UINT64_C(0x0e38e38e38e38e38), UINT64_C(0xe38e38e38e38e38e)},	// 1/9
+	{UINT64_C(0x0ccccccccccccccc), UINT64_C(0xcccccccccccccccd)},	// 1/10
+	{UINT64_C(0x0ba2e8ba2e8ba2e8), UINT64_C(0xba2e8ba2e8ba2e8c)},	// 1/11
+	{UINT64_C(0x0aaaaaaaaaaaaaaa), UINT64_C(0xaaaaaaaaaaaaaaab)},	// 1/12
+	{UINT64_C(0x09d89d89d89d89d8), UINT64_C(0x9d89d89d89d89d8a)},	// 1/13
+	{UINT64_C(0x0924924924924924), UINT64_C(0x9249249249249249)},	// 1/14
+	{UINT64_C(0x0888888888888888), UINT64_C(0x8888888888888889)},	// 1/15
+	{UINT64_C(0x0800000000000000), UINT64_C(0x0000000000000000)},	// 1/16
+	{UINT64_C(0x0787878787878787), UINT64_C(0x8787878787878788)},	// 1/17
+	{UINT64_C(0x071c71c71c71c71c), UINT64_C(0x71c71c71c71c71c7)},	// 1/18
+	{UINT64_C(0x06bca1af286bca1a), UINT64_C(0xf286bca1af286bca)},	// 1/19
+	{UINT64_C(0x0666666666666666), UINT64_C(0x6666666666666666)},	// 1/20
+	{UINT64_C(0x0618618618618618), UINT64_C(0x6186186186186186)},	// 1/21
+	{UINT64_C(0x05d1745d1745d174), UINT64_C(0x5d1745d1745d1746)},	// 1/22
+	{UINT64_C(0x0590b21642c8590b), UINT64_C(0x21642c8590b21643)},	// 1/23
+	{UINT64_C(0x0555555555555555), UINT64_C(0x5555555555555555)},	// 1/24
+	{UINT64_C(0x051eb851eb851eb8), UINT64_C(0x51eb851eb851eb85)},	// 1/25
+	{UINT64_C(0x04ec4ec4ec4ec4ec), UINT64_C(0x4ec4ec4ec4ec4ec5)},	// 1/26
+	{UINT64_C(0x04bda12f684bda12), UINT64_C(0xf684bda12f684bda)}	// 1/27
+};
+
+
+/*
+ *  Unpacked arithmetic
+ */
+
+PRIVATE inline fp_xf xf_make(uae_u64 hi, uae_u64 lo, int exp, int sign)
+{
+	fp_xf r;
+	r.hi = hi;
+	r.lo = lo;
+	r.exp = exp;
+	r.sign = sign;
+	return r;
+}
+
+/* Normalize mantissa */
+PRIVATE inline fp_xf xf_norm(uae_u64 hi, uae_u64 lo, int exp, int sign)
+{
+	if (hi == 0) {
+		if (lo == 0)
+			return xf_make(0, 0, 0, sign);
+		hi = lo;
+		lo = 0;
+		exp -= 64;
+	}
+	int s = countLeadingZeros64(hi);
+	if (s) {
+		hi = (hi << s) | (lo >> (64 - s));
+		lo <<= s;
+		exp -= s;
+	}
+	return xf_make(hi, lo, exp, sign);
+}
+
+PRIVATE inline fp_xf xf_neg(fp_xf a)
+{
+	a.sign ^= 1;
+	return a;
+}
+
+PRIVATE inline fp_xf xf_abs(fp_xf a)
+{
+	a.sign = 0;
+	return a;
+}
+
+/* Multiply by 2^n */
+PRIVATE inline fp_xf xf_scale(fp_xf a, int n)
+{
+	a.exp += n;
+	return a;
+}
+
+PRIVATE inline fp_xf xf_from_int(int n)
+{
+	return xf_norm(n < 0 ? -(uae_s64)n : n, 0, 63, n < 0);
+}
+
+PRIVATE inline fp_xf xf_from_floatx80(floatx80 const &a)
+{
+	int exp = a.high & 0x7fff;
+	return xf_norm(a.low, 0, (exp ? exp : 1) - 0x3fff, a.high >> 15);
+}
+
+/* Double in (0.5, 1] times 2^n, for initial approximations */
+PRIVATE inline fp_xf xf_from_double(double d, int n)
+{
+	if (d >= 1.0)
+		return xf_make(UINT64_C(1) << 63, 0, n, 0);
+	return xf_make((uae_u64)(d * 18446744073709551616.0), 0, n - 1, 0);
+}
+
+/* Mantissa as double in [1, 2) */
+PRIVATE inline double xf_mant_double(fp_xf const &a)
+{
+	return (double)(a.hi >> 11) * (1.0 / 4503599627370496.0);
+}
+
+/* 128 bit product */
+PRIVATE inline void xf_mul64(uae_u64 a, uae_u64 b, uae_u64 &h, uae_u64 &l)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)a * b;
+	h = p >> 64;
+	l = (uae_u64)p;
+#else
+	mul64To128(a, b, &h, &l);
+#endif
+}
+
+/* Right shift of 128 bit number by 0 to 128 bits (shift128Right() drops the result for 64 and more) */
+PRIVATE inline void xf_shift_right(uae_u64 hi, uae_u64 lo, int count, uae_u64 &h, uae_u64 &l)
+{
+	if (count == 0) {
+		h = hi;
+		l = lo;
+	} else if (count < 64) {
+		h = hi >> count;
+		l = (hi << (64 - count)) | (lo >> count);
+	} else {
+		h = 0;
+		l = count < 128 ? hi >> (count - 64) : 0;
+	}
+}
+
+/* Upper 128 bits of 256 bit product, the low product is below the rounding error */
+PRIVATE inline void xf_mul128(uae_u64 ah, uae_u64 al, uae_u64 bh, uae_u64 bl, uae_u64 &h, uae_u64 &l)
+{
+	uae_u64 ph, pl;
+	xf_mul64(ah, bh, h, l);
+	xf_mul64(ah, bl, ph, pl);
+	add128(h, l, 0, ph, &h, &l);
+	xf_mul64(al, bh, ph, pl);
+	add128(h, l, 0, ph, &h, &l);
+}
+
+PRIVATE inline fp_xf xf_mul(fp_xf const &a, fp_xf const &b)
+{
+	if (a.hi == 0 || b.hi == 0)
+		return xf_make(0, 0, 0, a.sign ^ b.sign);
+	uae_u64 h, l;
+	xf_mul128(a.hi, a.lo, b.hi, b.lo, h, l);
+	int exp = a.exp + b.exp;
+	if (h >> 63)
+		exp++;
+	else {
+		h = (h << 1) | (l >> 63);
+		l <<= 1;
+	}
+	return xf_make(h, l, exp, a.sign ^ b.sign);
+}
+
+PRIVATE fp_xf xf_add(fp_xf a, fp_xf b)
+{
+	if (b.hi == 0)
+		return a;
+	if (a.hi == 0)
+		return b;
+	if (a.exp < b.exp || (a.exp == b.exp && (a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo)))) {
+		fp_xf t = a;
+		a = b;
+		b = t;
+	}
+	int shift = a.exp - b.exp;
+	uae_u64 bh, bl, h, l;
+	xf_shift_right(b.hi, b.lo, shift > 128 ? 128 : shift, bh, bl);
+	if (a.sign == b.sign) {
+		add128(a.hi, a.lo, bh, bl, &h, &l);
+		if (h < a.hi || (h == a.hi && l < a.lo)) {
+			l = (l >> 1) | (h << 63);
+			h = (h >> 1) | (UINT64_C(1) << 63);
+			a.exp++;
+		}
+		return xf_make(h, l, a.exp, a.sign);
+	}
+	sub128(a.hi, a.lo, bh, bl, &h, &l);
+	return xf_norm(h, l, a.exp, (h | l) ? a.sign : 0);
+}
+
+PRIVATE inline fp_xf xf_sub(fp_xf const &a, fp_xf const &b)
+{
+	return xf_add(a, xf_neg(b));
+}
+
+/* Quotient, reciprocal of double precision estimate refined by one Newton-Raphson step */
+PRIVATE fp_xf xf_div(fp_xf const &a, fp_xf const &b)
+{
+	fp_xf y = xf_from_double(1.0 / xf_mant_double(b), -b.exp);
+	y = xf_add(y, xf_mul(y, xf_sub(xf_one, xf_mul(xf_abs(b), y))));
+	y.sign = b.sign;
+	return xf_mul(a, y);
+}
+
+/* Square root of positive number, through reciprocal square root like the quotient */
+PRIVATE fp_xf xf_sqrt(fp_xf const &a)
+{
+	if (a.hi == 0)
+		return a;
+	int odd = a.exp & 1;
+	fp_xf y = xf_from_double(1.0 / sqrt(xf_mant_double(a) * (odd ? 2.0 : 1.0)), -((a.exp - odd) >> 1));
+	y = xf_add(y, xf_scale(xf_mul(y, xf_sub(xf_one, xf_mul(a, xf_mul(y, y)))), -1));
+	return xf_mul(a, y);
+}
+
+/* Magnitude of number below 1 in fixed point, (hi:lo) * 2^-128 */
+PRIVATE inline void xf_to_fixed(fp_xf const &a, uae_u64 &hi, uae_u64 &lo)
+{
+	if (a.hi == 0) {
+		hi = lo = 0;
+		return;
+	}
+	int shift = -1 - a.exp;
+	xf_shift_right(a.hi, a.lo, shift > 128 ? 128 : shift, hi, lo);
+}
+
+/*
+ *  Evaluate c[0] + u*(c[step] + u*(c[2*step] + ...)) with n coefficients,
+ *  or c[0] - u*(c[step] - u*(...)) if alternate is set, with u in fixed
+ *  point as from xf_to_fixed(). The coefficients must fall fast enough
+ *  that every partial sum stays positive and below 2. As u is small, 64
+ *  bits of u and of the partial sums are enough for the products.
+ */
+PRIVATE fp_xf xf_poly(const fp_coef *c, int step, int n, uae_u64 uh, uae_u64 ul, bool alternate)
+{
+	if ((uh | ul) == 0)
+		return xf_norm(c->hi, c->lo, 0, 0);
+	int s = uh ? countLeadingZeros64(uh) : 64 + countLeadingZeros64(ul);
+	uae_u64 um = s >= 64 ? ul << (s - 64) : (uh << s) | (s ? ul >> (64 - s) : 0);
+	c += (n - 1) * step;
+	uae_u64 h = c->hi, l = c->lo;
+	while (--n) {
+		uae_u64 ph, pl;
+		xf_mul64(h, um, ph, pl);
+		xf_shift_right(ph, pl, s, ph, pl);
+		c -= step;
+		if (alternate)
+			sub128(c->hi, c->lo, ph, pl, &h, &l);
+		else
+			add128(c->hi, c->lo, ph, pl, &h, &l);
+	}
+	return xf_norm(h, l, 0, 0);
+}
+
+/* Round to extended precision in the FPCR rounding mode and precision */
+PRIVATE floatx80 xf_to_floatx80(fp_xf const &a)
+{
+	if (a.hi == 0)
+		return packFloatx80(a.sign, 0, 0);
+
+	// SoftFloat rounds the exact sum of the upper and the lower 64 bits
+	floatx80 lo = packFloatx80(a.sign, 0, 0);
+	int exp = a.exp + 0x3fff;
+	bool in_range = exp > 128 && exp < 0x7fff;
+	if (!in_range)
+		exp = 0x3fff;
+	if (a.lo) {
+		int s = countLeadingZeros64(a.lo);
+		lo = packFloatx80(a.sign, exp - 64 - s, a.lo << s);
+	}
+	floatx80 r = floatx80_add(packFloatx80(a.sign, exp, a.hi), lo FPS);
+	if (!in_range)
+		r = floatx80_scalbn(r, a.exp < -16400 ? -16400 : (a.exp > 16380 ? 16380 : a.exp) FPS);
+	return r;
+}
+
+
+/*
+ *  Kernels
+ */
+
+/* Split 2^y into 2^n * exp2_table[j] * (1 + tp) with |tp| < 2^-7, for |y| < 2^15 */
+PRIVATE void xf_exp2_reduce(fp_xf const &y, int &n, int &j, fp_xf &tp)
+{
+	// y = k/64 + r with |r| <= 1/128, exactly
+	int k = 0;
+	fp_xf r = y;
+	if (y.hi != 0 && y.exp >= -7) {
+		int frac_bits = 121 - y.exp;		// Bits of mantissa below the binary point of 64 * y
+		uae_u32 i = 0;
+		uae_u64 fh = y.hi, fl = y.lo;
+		if (frac_bits < 128) {
+			i = y.hi >> (frac_bits - 64);
+			fh &= (UINT64_C(1) << (frac_bits - 64)) - 1;
+		}
+		if (fh >> (frac_bits - 65)) {
+			i++;
+			sub128(frac_bits < 128 ? UINT64_C(1) << (frac_bits - 64) : 0, 0, fh, fl, &fh, &fl);
+			r.sign ^= 1;
+		}
+		r = xf_norm(fh, fl, y.exp, r.sign);
+		k = y.sign ? -(int)i : (int)i;
+	}
+	n = k >> 6;
+	j = k & 63;
+
+	// 2^r - 1 = t * P(t) with t = r * ln(2)
+	fp_xf t = xf_mul(r, xf_ln2);
+	uae_u64 uh, ul;
+	xf_to_fixed(t, uh, ul);
+	tp = xf_mul(t, xf_poly(fact_inv + 1, 1, 8, uh, ul, t.sign));
+}
+
+/* 2^y, out of extended range for |y| >= 2^15 */
+PRIVATE fp_xf xf_exp2(fp_xf const &y)
+{
+	if (y.hi != 0 && y.exp >= 15)
+		return xf_make(UINT64_C(1) << 63, 0, y.sign ? -32768 : 32768, 0);
+	int n, j;
+	fp_xf tp;
+	xf_exp2_reduce(y, n, j, tp);
+	const fp_xf &t = exp2_table[j];
+	return xf_scale(xf_add(t, xf_mul(t, tp)), n);
+}
+
+/* e^x - 1, computed as (2^n * exp2_table[j] - 1) + 2^n * exp2_table[j] * tp to keep small results accurate */
+PRIVATE fp_xf xf_expm1(fp_xf const &x)
+{
+	fp_xf y = xf_mul(x, xf_log2e);
+	if (y.hi != 0 && y.exp >= 15) {
+		if (!y.sign)
+			return xf_make(UINT64_C(1) << 63, 0, 32768, 0);
+		float_raise(float_flag_inexact FPS);
+		return xf_neg(xf_one);
+	}
+	int n, j;
+	fp_xf tp;
+	xf_exp2_reduce(y, n, j, tp);
+	fp_xf t = xf_scale(exp2_table[j], n);
+	return xf_add(xf_sub(t, xf_one), xf_mul(t, tp));
+}
+
+/* u * P(u^2) = atanh(u) for |u| < 2^-7 */
+PRIVATE fp_xf xf_atanh_series(fp_xf const &u)
+{
+	uae_u64 vh, vl;
+	xf_to_fixed(xf_mul(u, u), vh, vl);
+	return xf_mul(u, xf_poly(inv_int, 2, 5, vh, vl, false));
+}
+
+/* ln(x) for x > 0 */
+PRIVATE fp_xf xf_log(fp_xf const &x)
+{
+	// Near 1, ln(x) = 2 * atanh(f / (2 + f)) with f = x - 1 exact
+	if ((x.exp == 0 && x.hi < UINT64_C(0x8200000000000000)) || (x.exp == -1 && x.hi >= UINT64_C(0xfc00000000000000))) {
+		fp_xf f = xf_sub(x, xf_one);
+		return xf_scale(xf_atanh_series(xf_div(f, xf_add(f, xf_two))), 1);
+	}
+
+	// ln(x) = exp * ln(2) + ln(1/inv) + ln(1 + r) with r = mantissa * inv - 1, |r| < 2^-8
+	const fp_log_entry &t = log_table[(x.hi >> 56) & 0x7f];
+	uae_u64 p0, p1, p2, qh;
+	xf_mul64(x.hi, t.inv, p0, p1);
+	xf_mul64(x.lo, t.inv, qh, p2);
+	add128(p0, p1, 0, qh, &p0, &p1);
+	uae_u64 rh = (p0 << 48) | (p1 >> 16), rl = (p1 << 48) | (p2 >> 16);
+	int rsign = rh < (UINT64_C(1) << 63);
+	if (rsign)
+		sub128(UINT64_C(1) << 63, 0, rh, rl, &rh, &rl);
+	else
+		rh -= UINT64_C(1) << 63;
+	fp_xf r = xf_norm(rh, rl, 0, rsign);
+
+	// ln(1 + r) = r * P(r)
+	fp_xf res = xf_add(t.log_inv, xf_mul(r, xf_poly(inv_int, 1, 9, (rh << 1) | (rl >> 63), rl << 1, !rsign)));
+	if (x.exp)
+		res = xf_add(xf_mul(xf_from_int(x.exp), xf_ln2), res);
+	return res;
+}
+
+/* ln(1 + x) for x > -1 */
+PRIVATE fp_xf xf_log1p(fp_xf const &x)
+{
+	if (x.hi == 0 || x.exp < -6)
+		return xf_scale(xf_atanh_series(xf_div(x, xf_add(x, xf_two))), 1);
+	return xf_log(xf_add(x, xf_one));
+}
+
+/* |x| = q * pi/2 + r with |r| <= pi/4, for finite |x| < 2^63 */
+PRIVATE uae_u32 xf_reduce_pio2(floatx80 const &x, fp_xf &r)
+{
+	r = xf_abs(xf_from_floatx80(x));
+	uae_u32 q = 0;
+	if (r.exp > -1 || (r.exp == -1 && r.hi > xf_pio4.hi)) {
+		// Fixed point product with 2/pi, shifted to have the binary point at the top of f
+		uae_u64 w0, w1, w2, w3, ph;
+		mul128By64To192(two_over_pi[0], two_over_pi[1], r.hi, &w0, &w1, &w2);
+		xf_mul64(r.hi, two_over_pi[2], ph, w3);
+		add192(w0, w1, w2, 0, 0, ph, &w0, &w1, &w2);
+		int s = r.exp + 1;
+		uae_u64 f0 = w0, f1 = w1, f2 = w2;
+		if (s) {
+			q = w0 >> (64 - s);
+			f0 = (w0 << s) | (w1 >> (64 - s));
+			f1 = (w1 << s) | (w2 >> (64 - s));
+			f2 = (w2 << s) | (w3 >> (64 - s));
+		}
+
+		// Nearest multiple of pi/2, r = f * pi/2
+		int sign = 0;
+		if (f0 >> 63) {
+			q++;
+			sub192(0, 0, 0, f0, f1, f2, &f0, &f1, &f2);
+			sign = 1;
+		}
+		int exp = -1;
+		if (f0 == 0) {
+			f0 = f1;
+			f1 = f2;
+			f2 = 0;
+			exp -= 64;
+		}
+		s = f0 ? countLeadingZeros64(f0) : 0;
+		if (s) {
+			f0 = (f0 << s) | (f1 >> (64 - s));
+			f1 = (f1 << s) | (f2 >> (64 - s));
+		}
+		r = xf_mul(xf_make(f0, f1, exp - s, sign), xf_pio2);
+	}
+	return q;
+}
+
+/* sin(x) and cos(x) for finite |x| < 2^63 */
+PRIVATE void xf_sincos(floatx80 const &x, fp_xf &sin_x, fp_xf &cos_x)
+{
+	fp_xf r;
+	uae_u32 q = xf_reduce_pio2(x, r);
+
+	// r = j/32 + d with |d| <= 1/64
+	fp_xf d = xf_abs(r);
+	uae_u64 rh, rl;
+	xf_to_fixed(d, rh, rl);
+	int j = ((rh >> 58) + 1) >> 1;
+	if (j) {
+		int dsign = 0;
+		sub128(rh, rl, (uae_u64)j << 59, 0, &rh, &rl);
+		if (rh >> 63) {
+			sub128(0, 0, rh, rl, &rh, &rl);
+			dsign = 1;
+		}
+		d = xf_norm(rh, rl, -1, dsign);
+	}
+
+	// sin(d) = d * P(d^2), cos(d) - 1 = -d^2 * Q(d^2)
+	fp_xf v = xf_mul(d, d);
+	uae_u64 vh, vl;
+	xf_to_fixed(v, vh, vl);
+	fp_xf sd = xf_mul(d, xf_poly(fact_inv + 1, 2, 5, vh, vl, true));
+	fp_xf cm1 = xf_neg(xf_mul(v, xf_poly(fact_inv + 2, 2, 4, vh, vl, true)));
+	fp_xf s, c;
+	if (j == 0) {
+		s = sd;
+		c = xf_add(xf_one, cm1);
+	} else {
+		const fp_sincos_entry &t = sincos_table[j];
+		s = xf_add(t.sin, xf_add(xf_mul(t.sin, cm1), xf_mul(t.cos, sd)));
+		c = xf_add(t.cos, xf_sub(xf_mul(t.cos, cm1), xf_mul(t.sin, sd)));
+	}
+	s.sign ^= r.sign;
+
+	switch (q & 3) {
+		case 0: sin_x = s; cos_x = c; break;
+		case 1: sin_x = c; cos_x = xf_neg(s); break;
+		case 2: sin_x = xf_neg(s); cos_x = xf_neg(c); break;
+		case 3: sin_x = xf_neg(c); cos_x = s; break;
+	}
+	sin_x.sign ^= x.high >> 15;
+}
+
+/* atan(a) for 0 <= a <= 1, as atan(j/32) + atan(t) with t = (a - j/32) / (1 + a * j/32) */
+PRIVATE fp_xf xf_atan_reduced(fp_xf const &a)
+{
+	int j = 32;
+	if (a.exp < 0) {
+		uae_u64 ah, al;
+		xf_to_fixed(a, ah, al);
+		j = ((ah >> 58) + 1) >> 1;
+	}
+	fp_xf t = a;
+	if (j) {
+		fp_xf b = xf_scale(xf_from_int(j), -5);
+		t = xf_div(xf_sub(a, b), xf_add(xf_one, xf_mul(a, b)));
+	}
+
+	// atan(t) = t * P(t^2)
+	uae_u64 vh, vl;
+	xf_to_fixed(xf_mul(t, t), vh, vl);
+	fp_xf res = xf_mul(t, xf_poly(inv_int, 2, 6, vh, vl, true));
+	if (j)
+		res = xf_add(atan_table[j], res);
+	return res;
+}
+
+PRIVATE fp_xf xf_atan(fp_xf const &x)
+{
+	if (x.hi == 0)
+		return x;
+	fp_xf a = xf_abs(x), res;
+	if (a.exp > 0 || (a.exp == 0 && (a.hi << 1 | a.lo)))
+		res = xf_sub(xf_pio2, xf_atan_reduced(xf_div(xf_one, a)));
+	else
+		res = xf_atan_reduced(a);
+	res.sign = x.sign;
+	return res;
+}
+
+
+/*
+ *  Functions for the FPU instructions
+ */
+
+// Larger arguments of trigonometric functions are reduced by the host library in double precision
+const int TRIG_EXP_LIMIT = 0x3fff + 63;
+
+PRIVATE inline bool fx_is_nan(floatx80 const &a)
+{
+	return (a.high & 0x7fff) == 0x7fff && (a.low << 1) != 0;
+}
+
+PRIVATE inline bool fx_is_inf(floatx80 const &a)
+{
+	return (a.high & 0x7fff) == 0x7fff && (a.low << 1) == 0;
+}
+
+PRIVATE inline bool fx_is_zero(floatx80 const &a)
+{
+	return (a.high & 0x7fff) != 0x7fff && a.low == 0;
+}
+
+PRIVATE inline int fx_sign(floatx80 const &a)
+{
+	return a.high >> 15;
+}
+
+PRIVATE inline floatx80 fx_one(int sign)
+{
+	return packFloatx80(sign, 0x3fff, UINT64_C(0x8000000000000000));
+}
+
+/* Propagate NaN argument */
+PRIVATE inline floatx80 fx_nan(floatx80 const &a)
+{
+	return floatx80_add(a, a FPS);
+}
+
+PRIVATE inline floatx80 fx_invalid(void)
+{
+	floatx80 r;
+	float_raise(float_flag_invalid FPS);
+	r.high = floatx80_default_nan_high;
+	r.low = floatx80_default_nan_low;
+	return r;
+}
+
+PRIVATE inline floatx80 fx_divbyzero(int sign)
+{
+	float_raise(float_flag_divbyzero FPS);
+	return packFloatx80(sign, 0x7fff, UINT64_C(0x8000000000000000));
+}
+
+/* Conversions for the host library, SoftFloat's float64 is the bit pattern */
+PRIVATE inline double fx_to_double(floatx80 const &a)
+{
+	float64 f = floatx80_to_float64(a FPS);
+	double d;
+	memcpy(&d, &f, sizeof(d));
+	return d;
+}
+
+PRIVATE inline floatx80 fx_from_double(double d)
+{
+	float64 f;
+	memcpy(&f, &d, sizeof(f));
+	return float64_to_floatx80(f FPS);
+}
+
+/* Fast mode, the argument is within the double range with some margin */
+const int HOST_EXP_LIMIT = 1000;
+
+PRIVATE inline bool fx_host_range(floatx80 const &x)
+{
+	int exp = (x.high & 0x7fff) - 0x3fff;
+	return fpu_fast_math && exp >= -HOST_EXP_LIMIT && exp <= HOST_EXP_LIMIT;
+}
+
+PRIVATE inline double xf_to_double(fp_xf const &a)
+{
+	double d = ldexp((double)a.hi, a.exp - 63);
+	return a.sign ? -d : d;
+}
+
+/* Host result rounded to the FPCR precision */
+PRIVATE inline floatx80 fx_from_host(double d)
+{
+	return floatx80_add(fx_from_double(d), packFloatx80(d < 0, 0, 0) FPS);
+}
+
+PRIVATE inline bool fx_host(double (*func)(double), floatx80 const &x, floatx80 &r)
+{
+	if (!fx_host_range(x))
+		return false;
+	double d = func(fx_to_double(x));
+	if (!isnormal(d))	// Overflow, underflow or exact zero, leave flags to the accurate path
+		return false;
+	r = fx_from_host(d);
+	return true;
+}
+
+/* Fast mode argument reduction, in extended precision as the host would lose the low bits of q */
+PRIVATE inline bool fx_host_reduce(floatx80 const &x, uae_u32 &q, double &r)
+{
+	if (!fx_host_range(x) || (x.high & 0x7fff) >= TRIG_EXP_LIMIT)
+		return false;
+	fp_xf xr;
+	q = xf_reduce_pio2(x, xr);
+	r = xf_to_double(xr);
+	return true;
+}
+
+/* Compare magnitude with 1, returns -1, 0 or 1 */
+PRIVATE inline int xf_cmp_one(fp_xf const &a)
+{
+	if (a.hi == 0 || a.exp < 0)
+		return -1;
+	if (a.exp > 0 || (a.hi << 1) || a.lo)
+		return 1;
+	return 0;
+}
+
+PRIVATE floatx80 fp_do_sin(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return fx_invalid();
+	if (fx_is_zero(x))
+		return x;
+	uae_u32 q;
+	double r;
+	if (fx_host_reduce(x, q, r)) {
+		double d = (q & 1) ? cos(r) : sin(r);
+		return fx_from_host(((q & 2) != 0) ^ fx_sign(x) ? -d : d);
+	}
+	if ((x.high & 0x7fff) >= TRIG_EXP_LIMIT)
+		return fx_from_double(CHKERR(sin(fx_to_double(x))));
+	fp_xf s, c;
+	xf_sincos(x, s, c);
+	return xf_to_floatx80(s);
+}
+
+PRIVATE floatx80 fp_do_cos(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return fx_invalid();
+	if (fx_is_zero(x))
+		return fx_one(0);
+	uae_u32 q;
+	double r;
+	if (fx_host_reduce(x, q, r)) {
+		double d = (q & 1) ? sin(r) : cos(r);
+		return fx_from_host(((q + 1) & 2) ? -d : d);
+	}
+	if ((x.high & 0x7fff) >= TRIG_EXP_LIMIT)
+		return fx_from_double(CHKERR(cos(fx_to_double(x))));
+	fp_xf s, c;
+	xf_sincos(x, s, c);
+	return xf_to_floatx80(c);
+}
+
+PRIVATE void fp_do_sincos(floatx80 const &x, floatx80 &sin_x, floatx80 &cos_x)
+{
+	uae_u32 q;
+	double r;
+	if (fx_is_nan(x))
+		sin_x = cos_x = fx_nan(x);
+	else if (fx_is_inf(x))
+		sin_x = cos_x = fx_invalid();
+	else if (fx_is_zero(x)) {
+		sin_x = x;
+		cos_x = fx_one(0);
+	} else if (fx_host_reduce(x, q, r)) {
+		double s = sin(r), c = cos(r);
+		if (q & 1) {
+			double t = s;
+			s = c;
+			c = -t;
+		}
+		if (q & 2) {
+			s = -s;
+			c = -c;
+		}
+		sin_x = fx_from_host(fx_sign(x) ? -s : s);
+		cos_x = fx_from_host(c);
+	} else if ((x.high & 0x7fff) >= TRIG_EXP_LIMIT) {
+		sin_x = fx_from_double(CHKERR(sin(fx_to_double(x))));
+		cos_x = fx_from_double(CHKERR(cos(fx_to_double(x))));
+	} else {
+		fp_xf s, c;
+		xf_sincos(x, s, c);
+		sin_x = xf_to_floatx80(s);
+		cos_x = xf_to_floatx80(c);
+	}
+}
+
+PRIVATE floatx80 fp_do_tan(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return fx_invalid();
+	if (fx_is_zero(x))
+		return x;
+	uae_u32 q;
+	double r;
+	if (fx_host_reduce(x, q, r)) {
+		double d = (q & 1) ? -1.0 / tan(r) : tan(r);
+		return fx_from_host(fx_sign(x) ? -d : d);
+	}
+	if ((x.high & 0x7fff) >= TRIG_EXP_LIMIT)
+		return fx_from_double(CHKERR(tan(fx_to_double(x))));
+	fp_xf s, c;
+	xf_sincos(x, s, c);
+	return xf_to_floatx80(xf_div(s, c));
+}
+
+PRIVATE floatx80 fp_do_atan(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_zero(x))
+		return x;
+	if (fx_is_inf(x)) {
+		fp_xf r = xf_pio2;
+		r.sign = fx_sign(x);
+		return xf_to_floatx80(r);
+	}
+	floatx80 h;
+	if (fx_host(atan, x, h))
+		return h;
+	return xf_to_floatx80(xf_atan(xf_from_floatx80(x)));
+}
+
+PRIVATE floatx80 fp_do_asin(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_zero(x))
+		return x;
+	fp_xf a = xf_abs(xf_from_floatx80(x)), r;
+	floatx80 h;
+	int cmp = xf_cmp_one(a);
+	if (cmp > 0)
+		return fx_invalid();
+	if (cmp == 0)
+		r = xf_pio2;
+	else if (fx_host(asin, x, h))
+		return h;
+	else	// atan(a / sqrt(1 - a^2))
+		r = xf_atan(xf_div(a, xf_sqrt(xf_mul(xf_sub(xf_one, a), xf_add(xf_one, a)))));
+	r.sign = fx_sign(x);
+	return xf_to_floatx80(r);
+}
+
+PRIVATE floatx80 fp_do_acos(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	fp_xf a = xf_from_floatx80(x);
+	int cmp = xf_cmp_one(a);
+	if (cmp > 0)
+		return fx_invalid();
+	if (cmp == 0 && a.sign)
+		return xf_to_floatx80(xf_scale(xf_pio2, 1));
+	floatx80 h;
+	if (fx_host(acos, x, h))
+		return h;
+	// 2 * atan(sqrt((1 - a) / (1 + a))), accurate near 1
+	return xf_to_floatx80(xf_scale(xf_atan(xf_sqrt(xf_div(xf_sub(xf_one, a), xf_add(xf_one, a)))), 1));
+}
+
+PRIVATE floatx80 fp_do_atanh(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_zero(x))
+		return x;
+	fp_xf a = xf_abs(xf_from_floatx80(x)), r;
+	int cmp = xf_cmp_one(a);
+	if (cmp > 0)
+		return fx_invalid();
+	if (cmp == 0)
+		return fx_divbyzero(fx_sign(x));
+	floatx80 h;
+	if (fx_host(atanh, x, h))
+		return h;
+	if (a.exp < -7)
+		r = xf_atanh_series(a);
+	else	// ln(1 + 2a / (1 - a)) / 2, the quotient error stays relative to the result
+		r = xf_scale(xf_log1p(xf_div(xf_scale(a, 1), xf_sub(xf_one, a))), -1);
+	r.sign = fx_sign(x);
+	return xf_to_floatx80(r);
+}
+
+PRIVATE floatx80 fp_do_sinh(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x) || fx_is_zero(x))
+		return x;
+	floatx80 h;
+	if (fx_host(sinh, x, h))
+		return h;
+	fp_xf a = xf_abs(xf_from_floatx80(x)), r;
+	if (a.exp >= 5)		// e^-a is negligible
+		r = xf_scale(xf_exp2(xf_mul(a, xf_log2e)), -1);
+	else {				// (e + e / (e + 1)) / 2 with e = e^a - 1
+		fp_xf e = xf_expm1(a);
+		r = xf_scale(xf_add(e, xf_div(e, xf_add(e, xf_one))), -1);
+	}
+	r.sign = fx_sign(x);
+	return xf_to_floatx80(r);
+}
+
+PRIVATE floatx80 fp_do_cosh(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return floatx80_abs(x);
+	if (fx_is_zero(x))
+		return fx_one(0);
+	floatx80 h;
+	if (fx_host(cosh, x, h))
+		return h;
+	fp_xf a = xf_abs(xf_from_floatx80(x));
+	fp_xf e = xf_exp2(xf_mul(a, xf_log2e));
+	if (a.exp < 5)
+		e = xf_add(e, xf_div(xf_one, e));
+	return xf_to_floatx80(xf_scale(e, -1));
+}
+
+PRIVATE floatx80 fp_do_tanh(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return fx_one(fx_sign(x));
+	if (fx_is_zero(x))
+		return x;
+	floatx80 h;
+	if (fx_host(tanh, x, h))
+		return h;
+	fp_xf a = xf_abs(xf_from_floatx80(x));
+	if (a.exp >= 6) {
+		float_raise(float_flag_inexact FPS);
+		return fx_one(fx_sign(x));
+	}
+	// e / (e + 2) with e = e^2a - 1
+	fp_xf e = xf_expm1(xf_scale(a, 1));
+	fp_xf r = xf_div(e, xf_add(e, xf_two));
+	r.sign = fx_sign(x);
+	return xf_to_floatx80(r);
+}
+
+/* b^x = 2^(x * log2(b)), host is the double function for the fast mode */
+PRIVATE floatx80 fx_exp2_scaled(floatx80 const &x, fp_xf const *log2_b, double (*host)(double))
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return fx_sign(x) ? packFloatx80(0, 0, 0) : x;
+	if (fx_is_zero(x))
+		return fx_one(0);
+	floatx80 h;
+	if (fx_host(host, x, h))
+		return h;
+	fp_xf y = xf_from_floatx80(x);
+	if (log2_b)
+		y = xf_mul(y, *log2_b);
+	return xf_to_floatx80(xf_exp2(y));
+}
+
+PRIVATE double fx_host_exp10(double x)
+{
+	return pow(10.0, x);
+}
+
+PRIVATE floatx80 fp_do_exp(floatx80 const &x)
+{
+	return fx_exp2_scaled(x, &xf_log2e, exp);
+}
+
+PRIVATE floatx80 fp_do_exp2(floatx80 const &x)
+{
+	return fx_exp2_scaled(x, NULL, exp2);
+}
+
+PRIVATE floatx80 fp_do_exp10(floatx80 const &x)
+{
+	return fx_exp2_scaled(x, &xf_log2_10, fx_host_exp10);
+}
+
+PRIVATE floatx80 fp_do_expm1(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_inf(x))
+		return fx_sign(x) ? fx_one(1) : x;
+	if (fx_is_zero(x))
+		return x;
+	floatx80 h;
+	if (fx_host(expm1, x, h))
+		return h;
+	return xf_to_floatx80(xf_expm1(xf_from_floatx80(x)));
+}
+
+/* ln(x) times factor if given, host is the double function for the fast mode */
+PRIVATE floatx80 fx_log_scaled(floatx80 const &x, fp_xf const *factor, double (*host)(double))
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_zero(x))
+		return fx_divbyzero(1);
+	if (fx_sign(x))
+		return fx_invalid();
+	if (fx_is_inf(x))
+		return x;
+	fp_xf a = xf_from_floatx80(x);
+	if (fpu_fast_math && (a.exp == 0 || a.exp == -1)) {
+		// Near 1 with x - 1 exact, the rounded argument would lose the small result
+		double d = log1p(xf_to_double(xf_sub(a, xf_one)));
+		if (factor)
+			d *= xf_to_double(*factor);
+		if (isnormal(d))
+			return fx_from_host(d);
+	} else {
+		floatx80 h;
+		if (fx_host(host, x, h))
+			return h;
+	}
+	fp_xf r = xf_log(a);
+	if (factor)
+		r = xf_mul(r, *factor);
+	return xf_to_floatx80(r);
+}
+
+PRIVATE floatx80 fp_do_log(floatx80 const &x)
+{
+	return fx_log_scaled(x, NULL, log);
+}
+
+PRIVATE floatx80 fp_do_log10(floatx80 const &x)
+{
+	return fx_log_scaled(x, &xf_log10e, log10);
+}
+
+PRIVATE floatx80 fp_do_log2(floatx80 const &x)
+{
+	// Exact for powers of 2
+	int exp = x.high & 0x7fff;
+	if (x.low == (UINT64_C(1) << 63) && exp != 0 && exp != 0x7fff && !fx_sign(x))
+		return int32_to_floatx80(exp - 0x3fff FPS);
+	return fx_log_scaled(x, &xf_log2e, log2);
+}
+
+PRIVATE floatx80 fp_do_log1p(floatx80 const &x)
+{
+	if (fx_is_nan(x))
+		return fx_nan(x);
+	if (fx_is_zero(x))
+		return x;
+	if (fx_is_inf(x))
+		return fx_sign(x) ? fx_invalid() : x;
+	fp_xf a = xf_from_floatx80(x);
+	if (a.sign) {
+		int cmp = xf_cmp_one(a);
+		if (cmp > 0)
+			return fx_invalid();
+		if (cmp == 0)
+			return fx_divbyzero(1);
+	}
+	floatx80 h;
+	if (fx_host(log1p, x, h))
+		return h;
+	return xf_to_floatx80(xf_log1p(a));
+}
+
+#endif
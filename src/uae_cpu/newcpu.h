@@ -298,6 +298,16 @@ static inline void cpu_check_ticks(void)
 	if (--emulated_ticks <= 0)
 		cpu_do_check_ticks();
 }
+#elif USE_VIRTUAL_TIME
+extern int32 emulated_ticks;
+extern void clock_virtual_check(void);
+
+static inline void cpu_check_ticks(void)
+{
+	if (--emulated_ticks <= 0)
+		clock_virtual_check();
+}
+#define cpu_do_check_ticks()
 #else
 #define cpu_check_ticks()
 #define cpu_do_check_ticks()
@@ -0,0 +1,296 @@
+/*
+ *  zimage.cpp - Compressed, seekable disk images
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The disk is split into fixed-size chunks which are compressed
+ *  separately, so any part of it can be read without decompressing
+ *  everything before it. The file consists of
+ *
+ *    0      header (ZIMAGE_HEADER_SIZE bytes, see zimage.h)
+ *    64     chunk index, num_chunks + 1 big-endian 64-bit file offsets;
+ *           chunk i occupies the bytes from entry i to entry i + 1
+ *    ...    optional big-endian Adler-32 of every uncompressed chunk
+ *    ...    chunk data
+ *
+ *  The stored size of a chunk tells how it is encoded: 0 means the chunk
+ *  is all zeroes, the uncompressed size means it is stored as-is, anything
+ *  else is a zlib stream. Images are read-only; they are created with the
+ *  imgzip tool.
+ *
+ *  The last decompressed chunk is kept, so the block cache reading it in
+ *  smaller pieces only decompresses it once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "sysdeps.h"
+#include "zimage.h"
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+
+#define DEBUG 0
+#include "debug.h"
+
+
+static const char zimage_magic[8] = {'B', '2', 'Z', 'I', 'M', 'A', 'G', 'E'};
+
+// Open compressed image
+struct zimage {
+	int fd;
+	loff_t size;			// Size of uncompressed disk
+	uint32 chunk_size;
+	int chunk_shift;
+	uint32 num_chunks;
+	loff_t *index;			// Chunk index (num_chunks + 1 entries)
+	uint32 *checksums;		// Chunk checksums (NULL = none)
+	uint8 *data;			// Compressed data of current chunk
+	uint8 *buffer;			// Decompressed current chunk
+	uint32 buffer_chunk;	// Number of chunk in buffer (num_chunks = none)
+
+	// Statistics
+	uint32 stat_decompressed;	// Number of chunks decompressed
+	uint64 stat_read;			// Bytes read from file
+};
+
+
+/*
+ *  Big-endian header fields
+ */
+
+static uint32 get_be32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64 get_be64(const uint8 *p)
+{
+	return ((uint64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+
+/*
+ *  Positioned read, returns number of bytes read
+ */
+
+static size_t read_at(int fd, void *buffer, loff_t offset, size_t length)
+{
+	if (lseek(fd, offset, SEEK_SET) < 0)
+		return 0;
+	ssize_t actual = read(fd, buffer, length);
+	return actual < 0 ? 0 : actual;
+}
+
+
+/*
+ *  Check for image file header
+ */
+
+bool zimage_check(const uint8 *header)
+{
+	return memcmp(header + ZIMAGE_MAGIC, zimage_magic, sizeof(zimage_magic)) == 0 && get_be32(header + ZIMAGE_VERSION) == 1;
+}
+
+
+/*
+ *  Open image, read chunk index, returns NULL on error
+ */
+
+zimage *zimage_open(const char *name, int fd)
+{
+	D(bug("zimage_open(%s)\n", name));
+
+	uint8 header[ZIMAGE_HEADER_SIZE];
+	if (read_at(fd, header, 0, ZIMAGE_HEADER_SIZE) != ZIMAGE_HEADER_SIZE || !zimage_check(header)) {
+		printf("WARNING: %s is not a compressed disk image\n", name);
+		return NULL;
+	}
+
+	zimage *img = new zimage;
+	img->fd = fd;
+	img->size = get_be64(header + ZIMAGE_DISK_SIZE);
+	img->chunk_size = get_be32(header + ZIMAGE_CHUNK_SIZE);
+	img->num_chunks = get_be32(header + ZIMAGE_NUM_CHUNKS);
+	img->index = NULL;
+	img->checksums = NULL;
+	img->data = NULL;
+	img->buffer = NULL;
+	img->stat_decompressed = 0;
+	img->stat_read = 0;
+
+	uint32 flags = get_be32(header + ZIMAGE_FLAGS);
+	size_t index_size = (img->num_chunks + 1) * 8;
+	size_t checksum_size = (flags & ZIMAGE_CHECKSUMS) ? img->num_chunks * 4 : 0;
+	uint8 *raw = NULL;
+	loff_t file_size = lseek(fd, 0, SEEK_END);
+
+	img->chunk_shift = 0;
+	while (img->chunk_shift < 31 && (1U << img->chunk_shift) < img->chunk_size)
+		img->chunk_shift++;
+	if (img->chunk_size < 512 || (1U << img->chunk_shift) != img->chunk_size
+	 || img->num_chunks != uint32((img->size + img->chunk_size - 1) >> img->chunk_shift))
+		goto corrupt;
+
+	// Read chunk index and checksums
+	raw = (uint8 *)malloc(index_size + checksum_size);
+	img->index = new loff_t[img->num_chunks + 1];
+	if (raw == NULL || read_at(fd, raw, ZIMAGE_HEADER_SIZE, index_size + checksum_size) != index_size + checksum_size)
+		goto corrupt;
+	for (uint32 i=0; i<=img->num_chunks; i++) {
+		img->index[i] = get_be64(raw + i * 8);
+		if (img->index[i] > file_size || (i > 0 && img->index[i] < img->index[i-1]))
+			goto corrupt;
+	}
+	if (flags & ZIMAGE_CHECKSUMS) {
+		img->checksums = new uint32[img->num_chunks];
+		for (uint32 i=0; i<img->num_chunks; i++)
+			img->checksums[i] = get_be32(raw + index_size + i * 4);
+	}
+	free(raw);
+
+	img->data = new uint8[img->chunk_size];
+	img->buffer = new uint8[img->chunk_size];
+	img->buffer_chunk = img->num_chunks;
+	D(bug(" %u chunks of %u bytes, %s checksums\n", img->num_chunks, img->chunk_size, img->checksums ? "with" : "no"));
+	return img;
+
+corrupt:
+	printf("WARNING: Compressed disk image %s is damaged\n", name);
+	free(raw);
+	delete[] img->index;
+	delete img;
+	return NULL;
+}
+
+
+/*
+ *  Close image
+ */
+
+void zimage_close(zimage *img)
+{
+	if (img == NULL)
+		return;
+	D(bug("zimage_close, %u chunks decompressed, %llu bytes read\n", img->stat_decompressed, (unsigned long long)img->stat_read));
+	delete[] img->index;
+	delete[] img->checksums;
+	delete[] img->data;
+	delete[] img->buffer;
+	delete img;
+}
+
+
+/*
+ *  Use reopened file
+ */
+
+void zimage_reopen(zimage *img, int fd)
+{
+	img->fd = fd;
+}
+
+
+/*
+ *  Return size of uncompressed disk
+ */
+
+loff_t zimage_size(zimage *img)
+{
+	return img->size;
+}
+
+
+/*
+ *  Decompress chunk into buffer, returns false on error
+ */
+
+static bool load_chunk(zimage *img, uint32 chunk)
+{
+	if (img->buffer_chunk == chunk)
+		return true;
+	img->buffer_chunk = img->num_chunks;
+
+	uLongf length = img->chunk_size;
+	if ((loff_t)length > img->size - ((loff_t)chunk << img->chunk_shift))
+		length = img->size - ((loff_t)chunk << img->chunk_shift);
+	loff_t stored = img->index[chunk + 1] - img->index[chunk];
+
+	if (stored == 0) {
+		memset(img->buffer, 0, length);
+	} else if (stored == (loff_t)length) {
+		if (read_at(img->fd, img->buffer, img->index[chunk], length) != length)
+			return false;
+		img->stat_read += length;
+	} else {
+		if (stored > (loff_t)length || read_at(img->fd, img->data, img->index[chunk], stored) != (size_t)stored)
+			goto corrupt;
+		img->stat_read += stored;
+		uLongf actual = length;
+		if (uncompress(img->buffer, &actual, img->data, stored) != Z_OK || actual != length)
+			goto corrupt;
+		img->stat_decompressed++;
+	}
+
+	if (img->checksums && adler32(adler32(0, NULL, 0), img->buffer, length) != img->checksums[chunk])
+		goto corrupt;
+
+	img->buffer_chunk = chunk;
+	return true;
+
+corrupt:
+	printf("WARNING: Chunk %u of compressed disk image is damaged\n", chunk);
+	return false;
+}
+
+
+/*
+ *  Read from uncompressed disk, returns number of bytes read
+ */
+
+size_t zimage_read(zimage *img, void *buffer, loff_t offset, size_t length)
+{
+	if (img->fd < 0 || offset >= img->size)
+		return 0;
+	if ((loff_t)length > img->size - offset)
+		length = img->size - offset;
+
+	uint8 *p = (uint8 *)buffer;
+	size_t done = 0;
+	while (done < length) {
+		loff_t pos = offset + done;
+		uint32 chunk = pos >> img->chunk_shift;
+		uint32 skip = pos & (img->chunk_size - 1);
+		size_t n = img->chunk_size - skip;
+		if (n > length - done)
+			n = length - done;
+
+		if (!load_chunk(img, chunk))
+			break;
+		memcpy(p + done, img->buffer + skip, n);
+		done += n;
+	}
+	return done;
+}
+
+#endif